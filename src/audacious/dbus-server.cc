@@ -17,6 +17,12 @@
  * the use of this software.
  */
 
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gunixfdlist.h>
+
 #include <libaudcore/audstrings.h>
 #include <libaudcore/drct.h>
 #include <libaudcore/equalizer.h>
@@ -54,6 +60,37 @@ static Playlist current_playlist ()
 
 #define CURRENT current_playlist ()
 
+/* each tap opened through D-Bus is closed when its caller leaves the bus,
+ * and may be closed only by that caller */
+struct TapClient {
+    int id;
+    String sender; /* unique bus name */
+    unsigned watch;
+};
+
+static Index<TapClient> tap_clients;
+
+static void close_tap (int id)
+{
+    for (int i = 0; i < tap_clients.len (); i ++)
+    {
+        if (tap_clients[i].id == id)
+        {
+            g_bus_unwatch_name (tap_clients[i].watch);
+            tap_clients.remove (i, 1);
+            break;
+        }
+    }
+
+    aud_drct_close_tap (id);
+}
+
+static void tap_client_vanished (GDBusConnection *, const char * name, void * id)
+{
+    AUDINFO ("%s left without closing the tap.\n", name);
+    close_tap (GPOINTER_TO_INT (id));
+}
+
 static Index<PlaylistAddItem> strv_to_index (const char * const * strv)
 {
     Index<PlaylistAddItem> index;
@@ -110,6 +147,32 @@ static gboolean do_clear (Obj * obj, Invoc * invoc)
     return true;
 }
 
+static gboolean do_close_tap (Obj * obj, Invoc * invoc, int id)
+{
+    const char * sender = g_dbus_method_invocation_get_sender (invoc);
+
+    for (const TapClient & client : tap_clients)
+    {
+        if (client.id == id)
+        {
+            if (strcmp_safe (client.sender, sender))
+            {
+                g_dbus_method_invocation_return_error (invoc, G_IO_ERROR,
+                 G_IO_ERROR_PERMISSION_DENIED, "The tap was opened by another client.");
+                return true;
+            }
+
+            close_tap (id);
+            FINISH (close_tap);
+            return true;
+        }
+    }
+
+    g_dbus_method_invocation_return_error (invoc, G_IO_ERROR,
+     G_IO_ERROR_NOT_FOUND, "There is no such tap.");
+    return true;
+}
+
 static gboolean do_config_get (Obj * obj, Invoc * invoc, const char * section, const char * name)
 {
     String value = aud_get_str (section[0] ? section : nullptr, name);
@@ -246,6 +309,14 @@ static gboolean do_main_win_visible (Obj * obj, Invoc * invoc)
     return true;
 }
 
+static gboolean do_metadata_cache_stats (Obj * obj, Invoc * invoc)
+{
+    auto stats = Playlist::metadata_cache_stats ();
+    FINISH2 (metadata_cache_stats, stats.hits, stats.misses, stats.stale,
+     stats.stored, stats.entries);
+    return true;
+}
+
 static gboolean do_new_playlist (Obj * obj, Invoc * invoc)
 {
     Playlist::insert_playlist (CURRENT.index () + 1).activate ();
@@ -274,6 +345,58 @@ static gboolean do_open_list_to_temp (Obj * obj, Invoc * invoc, const char * con
     return true;
 }
 
+static gboolean do_open_tap (Obj * obj, Invoc * invoc, GUnixFDList *)
+{
+    int mem_fd, event_fd;
+    int id = aud_drct_open_tap (mem_fd, event_fd);
+
+    if (id < 0)
+    {
+        g_dbus_method_invocation_return_error (invoc, G_IO_ERROR,
+         G_IO_ERROR_NOT_SUPPORTED, "The tap is not available.");
+        return true;
+    }
+
+    /* the list holds copies of the file descriptors */
+    GUnixFDList * fds = g_unix_fd_list_new ();
+    int mem_index = g_unix_fd_list_append (fds, mem_fd, nullptr);
+    int event_index = g_unix_fd_list_append (fds, event_fd, nullptr);
+
+    close (mem_fd);
+    close (event_fd);
+
+    if (mem_index < 0 || event_index < 0)
+    {
+        aud_drct_close_tap (id);
+        g_object_unref (fds);
+        g_dbus_method_invocation_return_error (invoc, G_IO_ERROR,
+         G_IO_ERROR_FAILED, "The tap could not be opened.");
+        return true;
+    }
+
+    const char * sender = g_dbus_method_invocation_get_sender (invoc);
+
+    TapClient client = {id, String (sender), g_bus_watch_name_on_connection
+     (g_dbus_method_invocation_get_connection (invoc), sender,
+     G_BUS_NAME_WATCHER_FLAGS_NONE, nullptr, tap_client_vanished,
+     GINT_TO_POINTER (id), nullptr)};
+
+    tap_clients.append (std::move (client));
+
+    FINISH2 (open_tap, fds, mem_index, event_index, id);
+    g_object_unref (fds);
+    return true;
+}
+
+static gboolean do_output_stats (Obj * obj, Invoc * invoc)
+{
+    OutputStats stats;
+    aud_drct_get_output_stats (stats);
+    FINISH2 (output_stats, stats.underruns, stats.late_writes, stats.stalls,
+     stats.buffered, stats.max_buffered, stats.latency, stats.max_latency);
+    return true;
+}
+
 static gboolean do_pause (Obj * obj, Invoc * invoc)
 {
     aud_drct_pause ();
@@ -452,6 +575,34 @@ static gboolean do_reverse (Obj * obj, Invoc * invoc)
     return true;
 }
 
+static gboolean do_reset_output_stats (Obj * obj, Invoc * invoc)
+{
+    aud_drct_reset_output_stats ();
+    FINISH (reset_output_stats);
+    return true;
+}
+
+static gboolean do_scan_group_stats (Obj * obj, Invoc * invoc)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init (& builder, G_VARIANT_TYPE ("a(siiixxii)"));
+
+    for (auto & group : Playlist::scan_group_stats ())
+        g_variant_builder_add (& builder, "(siiixxii)", (const char *) group.name,
+         group.limit, group.running, group.waiting, (gint64) group.completed,
+         (gint64) group.total_us, group.avg_us, group.baseline_us);
+
+    FINISH2 (scan_group_stats, g_variant_builder_end (& builder));
+    return true;
+}
+
+static gboolean do_scan_hint (Obj * obj, Invoc * invoc, unsigned first, unsigned last)
+{
+    CURRENT.scan_hint (first, aud::min (last, (unsigned) INT_MAX));
+    FINISH (scan_hint);
+    return true;
+}
+
 static gboolean do_seek (Obj * obj, Invoc * invoc, unsigned pos)
 {
     aud_drct_seek (pos);
@@ -660,6 +811,31 @@ static gboolean do_song_tuple (Obj * obj, Invoc * invoc, unsigned pos, const cha
     return true;
 }
 
+static gboolean do_stage_stats (Obj * obj, Invoc * invoc, const char * name)
+{
+    static const char * const names[] = {
+        "decode", "convert", "effects", "post-process", "write", "period-wait"
+    };
+
+    static_assert (aud::n_elems (names) == (int) OutputStage::count,
+     "stage names do not match OutputStage");
+
+    OutputStats stats;
+    aud_drct_get_output_stats (stats);
+
+    OutputStageStats st = OutputStageStats ();
+    for (int i = 0; i < aud::n_elems (names); i ++)
+    {
+        if (! strcmp (name, names[i]))
+            st = stats.stages[i];
+    }
+
+    GVariant * var = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+     st.histogram, AUD_OUTPUT_STATS_BUCKETS, sizeof (int64_t));
+    FINISH2 (stage_stats, st.count, st.total_us, st.max_us, var);
+    return true;
+}
+
 static gboolean do_startup_notify (Obj * obj, Invoc * invoc, const char * id)
 {
     aud_ui_startup_notify (id);
@@ -702,6 +878,14 @@ static gboolean do_time (Obj * obj, Invoc * invoc)
     return true;
 }
 
+static gboolean do_timing (Obj * obj, Invoc * invoc)
+{
+    PlaybackTiming timing = PlaybackTiming ();
+    aud_drct_get_timing (timing);
+    FINISH2 (timing, timing.position, timing.buffered, timing.latency);
+    return true;
+}
+
 static gboolean do_toggle_auto_advance (Obj * obj, Invoc * invoc)
 {
     aud_toggle_bool (nullptr, "no_playlist_advance");
@@ -757,6 +941,7 @@ handlers[] =
     {"handle-auto-advance", (GCallback) do_auto_advance},
     {"handle-balance", (GCallback) do_balance},
     {"handle-clear", (GCallback) do_clear},
+    {"handle-close-tap", (GCallback) do_close_tap},
     {"handle-config-get", (GCallback) do_config_get},
     {"handle-config-set", (GCallback) do_config_set},
     {"handle-delete", (GCallback) do_delete},
@@ -775,10 +960,13 @@ handlers[] =
     {"handle-jump", (GCallback) do_jump},
     {"handle-length", (GCallback) do_length},
     {"handle-main-win-visible", (GCallback) do_main_win_visible},
+    {"handle-metadata-cache-stats", (GCallback) do_metadata_cache_stats},
     {"handle-new-playlist", (GCallback) do_new_playlist},
     {"handle-number-of-playlists", (GCallback) do_number_of_playlists},
     {"handle-open-list", (GCallback) do_open_list},
     {"handle-open-list-to-temp", (GCallback) do_open_list_to_temp},
+    {"handle-open-tap", (GCallback) do_open_tap},
+    {"handle-output-stats", (GCallback) do_output_stats},
     {"handle-pause", (GCallback) do_pause},
     {"handle-paused", (GCallback) do_paused},
     {"handle-play", (GCallback) do_play},
@@ -801,7 +989,10 @@ handlers[] =
     {"handle-recording", (GCallback) do_recording},
     {"handle-record", (GCallback) do_record},
     {"handle-repeat", (GCallback) do_repeat},
+    {"handle-reset-output-stats", (GCallback) do_reset_output_stats},
     {"handle-reverse", (GCallback) do_reverse},
+    {"handle-scan-group-stats", (GCallback) do_scan_group_stats},
+    {"handle-scan-hint", (GCallback) do_scan_hint},
     {"handle-seek", (GCallback) do_seek},
     {"handle-select-displayed-playlist", (GCallback) do_select_displayed_playlist},
     {"handle-select-playing-playlist", (GCallback) do_select_playing_playlist},
@@ -822,12 +1013,14 @@ handlers[] =
     {"handle-song-length", (GCallback) do_song_length},
     {"handle-song-title", (GCallback) do_song_title},
     {"handle-song-tuple", (GCallback) do_song_tuple},
+    {"handle-stage-stats", (GCallback) do_stage_stats},
     {"handle-startup-notify", (GCallback) do_startup_notify},
     {"handle-status", (GCallback) do_status},
     {"handle-stop", (GCallback) do_stop},
     {"handle-stop-after", (GCallback) do_stop_after},
     {"handle-stopped", (GCallback) do_stopped},
     {"handle-time", (GCallback) do_time},
+    {"handle-timing", (GCallback) do_timing},
     {"handle-toggle-auto-advance", (GCallback) do_toggle_auto_advance},
     {"handle-toggle-repeat", (GCallback) do_toggle_repeat},
     {"handle-toggle-shuffle", (GCallback) do_toggle_shuffle},
@@ -918,6 +1111,9 @@ ERROR:
 
 void dbus_server_cleanup ()
 {
+    while (tap_clients.len ())
+        close_tap (tap_clients[0].id);
+
     if (owner_id)
     {
         g_bus_unown_name (owner_id);
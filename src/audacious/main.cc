@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -49,18 +50,21 @@ static struct {
     int enqueue, enqueue_to_temp;
     int mainwin, show_jump_box;
     int headless, quit_after_play;
+    int render;
     int verbose;
     int qt;
 } options;
 
 static bool initted = false;
 static Index<PlaylistAddItem> filenames;
+static String render_file;
 
 static const struct {
     const char * long_arg;
     char short_arg;
     int * value;
     const char * desc;
+    String * file;  /* set by --option=FILE, if allowed */
 } arg_map[] = {
     {"help", 'h', & options.help, N_("Show command-line help")},
     {"version", 'v', & options.version, N_("Show version")},
@@ -76,12 +80,23 @@ static const struct {
     {"show-jump-box", 'j', & options.show_jump_box, N_("Display the jump-to-song window")},
     {"headless", 'H', & options.headless, N_("Start without a graphical interface")},
     {"quit-after-play", 'q', & options.quit_after_play, N_("Quit on playback stop")},
+    {"render", 'R', & options.render, N_("Play once, as fast as possible, into a WAV file (or nowhere)"), & render_file},
     {"verbose", 'V', & options.verbose, N_("Print debugging messages (may be used twice)")},
 #if defined(USE_QT) && defined(USE_GTK)
     {"qt", 'Q', & options.qt, N_("Run in Qt mode")},
 #endif
 };
 
+static String make_uri (const char * arg, const char * cur)
+{
+    if (strstr (arg, "://"))
+        return String (arg);
+    else if (g_path_is_absolute (arg))
+        return String (filename_to_uri (arg));
+    else
+        return String (filename_to_uri (filename_build ({cur, arg})));
+}
+
 static bool parse_options (int argc, char * * argv)
 {
     CharPtr cur (g_get_current_dir ());
@@ -100,16 +115,7 @@ static bool parse_options (int argc, char * * argv)
 
         if (arg[0] != '-')  /* filename */
         {
-            String uri;
-
-            if (strstr (arg, "://"))
-                uri = String (arg);
-            else if (g_path_is_absolute (arg))
-                uri = String (filename_to_uri (arg));
-            else
-                uri = String (filename_to_uri (filename_build ({cur, arg})));
-
-            filenames.append (uri);
+            filenames.append (make_uri (arg, cur));
         }
         else if (! arg[1])  /* "-" (standard input) */
         {
@@ -122,12 +128,18 @@ static bool parse_options (int argc, char * * argv)
         else if (arg[1] == '-')  /* long option */
         {
             bool found = false;
+            const char * file = strchr (arg + 2, '=');
+            int len = file ? file - (arg + 2) : strlen (arg + 2);
 
             for (auto & arg_info : arg_map)
             {
-                if (! strcmp (arg + 2, arg_info.long_arg))
+                if (! strncmp (arg + 2, arg_info.long_arg, len) &&
+                 ! arg_info.long_arg[len] && (! file || arg_info.file))
                 {
                     (* arg_info.value) ++;
+                    if (file)
+                        * arg_info.file = make_uri (file + 1, cur);
+
                     found = true;
                     break;
                 }
@@ -164,6 +176,13 @@ static bool parse_options (int argc, char * * argv)
         }
     }
 
+    /* rendering is done without an interface and ends when playback stops */
+    if (options.render)
+    {
+        options.headless = true;
+        options.quit_after_play = true;
+    }
+
     aud_set_headless_mode (options.headless);
 
     if (options.verbose >= 2)
@@ -185,9 +204,13 @@ static void print_help ()
     fprintf (stderr, "  -1, -2, -3, etc.          %s\n", _("Select instance to run/control"));
 
     for (auto & arg_info : arg_map)
-        fprintf (stderr, "  -%c, --%s%.*s%s\n", arg_info.short_arg,
-         arg_info.long_arg, (int) (20 - strlen (arg_info.long_arg)), pad,
-         _(arg_info.desc));
+    {
+        StringBuf name = arg_info.file ?
+         str_concat ({arg_info.long_arg, "[=FILE]"}) : str_copy (arg_info.long_arg);
+
+        fprintf (stderr, "  -%c, --%s%.*s%s\n", arg_info.short_arg, (const char *) name,
+         (int) (20 - name.len ()), pad, _(arg_info.desc));
+    }
 
     fprintf (stderr, "\n");
 }
@@ -207,6 +230,14 @@ static void do_remote ()
     if (dbus_server_init () != StartupType::Client)
         return;
 
+    /* the running instance would render in real time, if at all */
+    if (options.render)
+    {
+        fprintf (stderr, _("Cannot render while this instance is running; "
+         "select another instance (-2, -3, etc.).\n"));
+        exit (EXIT_FAILURE);
+    }
+
     if (! (bus = g_bus_get_sync (G_BUS_TYPE_SESSION, nullptr, & error)) ||
      ! (obj = obj_audacious_proxy_new_sync (bus, (GDBusProxyFlags) 0,
      dbus_server_name (), "/org/atheme/audacious", nullptr, & error)))
@@ -270,11 +301,12 @@ static void do_remote ()
 
 static void do_commands ()
 {
-    bool resume = aud_get_bool (nullptr, "resume_playback_on_startup");
+    bool resume = aud_get_bool (nullptr, "resume_playback_on_startup") && ! options.render;
+    bool have_files = filenames.len ();
 
-    if (filenames.len ())
+    if (have_files)
     {
-        if (options.enqueue_to_temp)
+        if (options.enqueue_to_temp || options.render)
         {
             aud_drct_pl_open_temp_list (std::move (filenames));
             resume = false;
@@ -291,7 +323,8 @@ static void do_commands ()
     if (resume)
         aud_resume ();
 
-    if (options.play || options.play_pause)
+    /* without files, render the current playlist */
+    if (options.play || options.play_pause || (options.render && ! have_files))
     {
         if (! aud_drct_get_playing ())
             aud_drct_play ();
@@ -300,6 +333,68 @@ static void do_commands ()
     }
 }
 
+/* Rendering plays each song once, regardless of the repeat settings, which
+ * are changed only for this run (they are restored before the config is
+ * saved).  Process time is measured with clock() and so includes all threads;
+ * the output statistics give the time spent in each stage of the audio path. */
+static bool render_repeat, render_no_advance;
+static clock_t render_clock;
+
+static bool start_render ()
+{
+    if (! aud_drct_start_render (render_file))
+    {
+        fprintf (stderr, _("Cannot create %s.\n"), (const char *) render_file);
+        return false;
+    }
+
+    render_repeat = aud_get_bool (nullptr, "repeat");
+    render_no_advance = aud_get_bool (nullptr, "no_playlist_advance");
+    aud_set_bool (nullptr, "repeat", false);
+    aud_set_bool (nullptr, "no_playlist_advance", false);
+
+    render_clock = clock ();
+    return true;
+}
+
+static bool finish_render ()
+{
+    static const char * const stage_names[] = {
+        N_("Decode"), N_("Convert"), N_("Effects"), N_("Post-process"),
+        N_("Write"), N_("Period wait")
+    };
+
+    static_assert (aud::n_elems (stage_names) == (int) OutputStage::count,
+     "stage names do not match OutputStage");
+
+    RenderStats render;
+    OutputStats stats;
+
+    double cpu = (double) (clock () - render_clock) / CLOCKS_PER_SEC;
+
+    aud_drct_stop_render (render);
+    aud_drct_get_output_stats (stats);
+
+    aud_set_bool (nullptr, "repeat", render_repeat);
+    aud_set_bool (nullptr, "no_playlist_advance", render_no_advance);
+
+    double audio_s = render.time / 1000.0;
+    double elapsed_s = aud::max (render.elapsed_us, (int64_t) 1) / 1000000.0;
+
+    printf (_("Rendered %.1f seconds of audio in %.2f seconds (%.1fx realtime).\n"),
+     audio_s, elapsed_s, audio_s / elapsed_s);
+    printf (_("Processor time: %.2f seconds.\n"), cpu);
+
+    for (int i = 0; i < aud::n_elems (stage_names); i ++)
+    {
+        double stage_s = stats.stages[i].total_us / 1000000.0;
+        printf ("  %-14s %9.3f s %6.1f%%\n", _(stage_names[i]), stage_s,
+         100 * stage_s / elapsed_s);
+    }
+
+    return ! render.error;
+}
+
 static void do_commands_at_idle (void *)
 {
     if (options.show_jump_box && ! options.headless)
@@ -381,9 +476,12 @@ int main (int argc, char * * argv)
     initted = true;
     aud_init ();
 
-    do_commands ();
+    bool success = ! options.render || start_render ();
 
-    if (! check_should_quit ())
+    if (success)
+        do_commands ();
+
+    if (success && ! check_should_quit ())
     {
         QueuedFunc at_idle_func;
         at_idle_func.queue (do_commands_at_idle, nullptr);
@@ -399,6 +497,9 @@ int main (int argc, char * * argv)
         hook_dissociate ("quit", (HookFunction) aud_quit);
     }
 
+    if (success && options.render)
+        success = finish_render ();
+
 #ifdef USE_DBUS
     dbus_server_cleanup ();
 #endif
@@ -406,5 +507,5 @@ int main (int argc, char * * argv)
     aud_cleanup ();
     initted = false;
 
-    return EXIT_SUCCESS;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -132,6 +132,8 @@ void plugin_enable (int argc, char * * argv);
 void config_get (int argc, char * * argv);
 void config_set (int argc, char * * argv);
 
+void tap_monitor (int argc, char * * argv);
+
 void equalizer_get_eq (int argc, char * * argv);
 void equalizer_get_eq_preamp (int argc, char * * argv);
 void equalizer_get_eq_band (int argc, char * * argv);
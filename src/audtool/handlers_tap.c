@@ -0,0 +1,227 @@
+/*
+ * handlers_tap.c
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gio/gunixfdlist.h>
+#include <libaudcore/tap.h>
+
+#include "audtool.h"
+
+/* tap-monitor is a small example of a tap reader: it follows the blocks and
+ * spectra as they are written and reports the peak level of each channel and
+ * the loudest frequency a few times a second. */
+
+#define REPORT_INTERVAL 200000  /* microseconds */
+#define MAX_CHANNELS 10
+
+typedef struct {
+    const AudTapHeader * header;
+    float * pcm;
+
+    uint64_t next_block, next_spectrum;
+    int64_t lost;  /* blocks overwritten before they could be read */
+
+    int channels, time;
+    int64_t clock_us;  /* when the last block was written */
+    float peaks[MAX_CHANNELS];
+    int loudest;  /* frequency, in Hz */
+} TapMonitor;
+
+static void read_blocks (TapMonitor * m)
+{
+    uint64_t blocks = aud_tap_blocks (m->header);
+
+    while (m->next_block < blocks)
+    {
+        AudTapBlock block;
+        int result = aud_tap_read_block (m->header, m->next_block, & block);
+
+        if (result == 0)
+            break;
+
+        if (result < 0 || ! aud_tap_read_pcm (m->header, block.start,
+         block.samples, m->pcm))
+        {
+            /* we fell behind; skip to the newest block */
+            blocks = aud_tap_blocks (m->header);
+            uint64_t skip_to = MAX (blocks - 1, m->next_block + 1);
+
+            m->lost += skip_to - m->next_block;
+            m->next_block = skip_to;
+            continue;
+        }
+
+        int channels = MIN (block.channels, MAX_CHANNELS);
+
+        if (channels != m->channels)
+        {
+            for (int c = 0; c < MAX_CHANNELS; c ++)
+                m->peaks[c] = 0;
+        }
+
+        for (uint32_t i = 0; i < block.samples; i ++)
+        {
+            int c = i % block.channels;
+            if (c < channels)
+                m->peaks[c] = MAX (m->peaks[c], fabsf (m->pcm[i]));
+        }
+
+        m->channels = channels;
+        m->time = block.time;
+        m->clock_us = block.clock_us;
+        m->next_block ++;
+    }
+}
+
+static void read_spectra (TapMonitor * m)
+{
+    uint64_t spectra = aud_tap_spectra (m->header);
+
+    /* only the latest spectrum is of interest */
+    if (spectra > m->next_spectrum)
+    {
+        AudTapSpectrum spectrum;
+
+        if (aud_tap_read_spectrum (m->header, spectra - 1, & spectrum) > 0)
+        {
+            uint32_t loudest = 0;
+
+            for (uint32_t i = 1; i < spectrum.bins; i ++)
+            {
+                if (spectrum.values[i] > spectrum.values[loudest])
+                    loudest = i;
+            }
+
+            /* value i is frequency (i + 1) / 512 of the sample rate */
+            m->loudest = (spectrum.bins && spectrum.values[loudest] > 0) ?
+             (int) ((loudest + 1) * (int64_t) spectrum.rate / 512) : 0;
+        }
+
+        m->next_spectrum = spectra;
+    }
+}
+
+static void report (TapMonitor * m)
+{
+    GString * line = g_string_new (NULL);
+
+    g_string_append_printf (line, "%4d:%06.3f", m->time / 60000, (m->time % 60000) / 1000.0);
+
+    for (int c = 0; c < m->channels; c ++)
+    {
+        if (m->peaks[c] > 0)
+            g_string_append_printf (line, " %6.1f dB", 20 * log10f (m->peaks[c]));
+        else
+            g_string_append (line, "   -inf dB");
+
+        m->peaks[c] = 0;
+    }
+
+    g_string_append_printf (line, "  %5d Hz  %4d ms old  %" G_GINT64_FORMAT " lost",
+     m->loudest, (int) ((g_get_monotonic_time () - m->clock_us) / 1000), m->lost);
+
+    audtool_report ("%s", line->str);
+    g_string_free (line, TRUE);
+}
+
+void tap_monitor (int argc, char * * argv)
+{
+    int seconds = (argc > 1) ? atoi (argv[1]) : 10;
+
+    if (seconds <= 0)
+    {
+        audtool_whine_args (argv[0], "[<seconds>]");
+        exit (1);
+    }
+
+    int mem_index = -1, event_index = -1, id = -1;
+    GUnixFDList * fds = NULL;
+    GError * error = NULL;
+
+    if (! obj_audacious_call_open_tap_sync (dbus_proxy, NULL, & mem_index,
+     & event_index, & id, & fds, NULL, & error))
+    {
+        audtool_whine ("Cannot open the tap: %s\n", error->message);
+        g_error_free (error);
+        exit (1);
+    }
+
+    int mem_fd = g_unix_fd_list_get (fds, mem_index, NULL);
+    int event_fd = g_unix_fd_list_get (fds, event_index, NULL);
+    g_object_unref (fds);
+
+    struct stat st;
+    void * mem = MAP_FAILED;
+
+    if (mem_fd >= 0 && fstat (mem_fd, & st) == 0)
+        mem = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, mem_fd, 0);
+
+    if (mem == MAP_FAILED || event_fd < 0 || ! aud_tap_check (mem, st.st_size))
+    {
+        audtool_whine ("The tap is not usable.\n");
+        exit (1);
+    }
+
+    TapMonitor m = {0};
+
+    m.header = mem;
+    m.pcm = g_new (float, m.header->pcm_samples);
+    m.next_block = aud_tap_blocks (m.header);
+    m.next_spectrum = aud_tap_spectra (m.header);
+
+    int64_t now = g_get_monotonic_time ();
+    int64_t end = now + (int64_t) seconds * 1000000;
+    int64_t next_report = now + REPORT_INTERVAL;
+
+    while (now < end)
+    {
+        struct pollfd pfd = {event_fd, POLLIN, 0};
+        uint64_t count;
+
+        if (poll (& pfd, 1, (MIN (next_report, end) - now + 999) / 1000) > 0 &&
+         read (event_fd, & count, sizeof count) == sizeof count)
+        {
+            read_blocks (& m);
+            read_spectra (& m);
+        }
+
+        now = g_get_monotonic_time ();
+
+        if (now >= next_report)
+        {
+            if (m.channels)
+                report (& m);
+
+            next_report += REPORT_INTERVAL * ((now - next_report) / REPORT_INTERVAL + 1);
+        }
+    }
+
+    g_free (m.pcm);
+    munmap (mem, st.st_size);
+    close (mem_fd);
+    close (event_fd);
+
+    obj_audacious_call_close_tap_sync (dbus_proxy, id, NULL, NULL);
+}
@@ -131,6 +131,7 @@ const struct commandhandler handlers[] =
     {"config-get", config_get, "DO NOT USE", 1},
     {"config-set", config_set, "DO NOT USE", 2},
     {"shutdown", shutdown_audacious_server, "shut down Audacious", 0},
+    {"tap-monitor", tap_monitor, "print audio levels for some seconds (default 10)", 1},
 
     {"help", get_handlers_list, "print this help", 0},
 
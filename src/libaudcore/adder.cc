@@ -29,6 +29,7 @@
 #include "i18n.h"
 #include "list.h"
 #include "mainloop.h"
+#include "meta-cache.h"
 #include "plugins-internal.h"
 #include "probe.h"
 #include "runtime.h"
@@ -64,6 +65,7 @@ struct AddResult : public ListNode
     String title;
     Index<PlaylistAddItem> items;
     bool saw_folder, filtered;
+    int * shared_count;  /* files found, if counted across threads */
 };
 
 static void * add_worker (void * unused);
@@ -83,6 +85,10 @@ static char status_path[512];
 static int status_count;
 static bool status_shown = false;
 
+/* read by the add thread for every file or folder */
+static ConfigHandle<bool> cfg_slow_probe ("slow_probe");
+static ConfigHandle<bool> cfg_recurse_folders ("recurse_folders");
+
 static void status_cb (void * unused)
 {
     pthread_mutex_lock (& mutex);
@@ -120,6 +126,15 @@ static void status_update (const char * filename, int found)
     pthread_mutex_unlock (& mutex);
 }
 
+/* the number of files found, as shown in the status */
+static int count_found (AddResult * result)
+{
+    if (result->shared_count)
+        return __atomic_load_n (result->shared_count, __ATOMIC_RELAXED);
+
+    return result->items.len ();
+}
+
 static void status_done_locked ()
 {
     status_timer.stop ();
@@ -139,7 +154,7 @@ static void add_file (PlaylistAddItem && item, Playlist::FilterFunc filter,
  void * user, AddResult * result, bool skip_invalid)
 {
     AUDINFO ("Adding file: %s\n", (const char *) item.filename);
-    status_update (item.filename, result->items.len ());
+    status_update (item.filename, count_found (result));
 
     /*
      * If possible, we'll wait until the file is added to the playlist to probe
@@ -158,14 +173,17 @@ static void add_file (PlaylistAddItem && item, Playlist::FilterFunc filter,
         /* If we open the file to identify the decoder, we can re-use the same
          * handle to read metadata. */
         VFSFile file;
+        MetaCacheKey cache_key;
 
         if (! item.decoder)
         {
-            if (aud_get_bool (nullptr, "slow_probe"))
+            if (cfg_slow_probe.get ())
             {
                 /* The slow path.  User settings dictate that we should try to
-                 * find a decoder even if we don't recognize the file extension. */
-                item.decoder = aud_file_find_decoder (item.filename, false, file);
+                 * find a decoder even if we don't recognize the file extension.
+                 * A file we have seen before need not be opened, though. */
+                if (! meta_cache_lookup (item.filename, cache_key, item.decoder, item.tuple))
+                    item.decoder = aud_file_find_decoder (item.filename, false, file);
                 if (skip_invalid && ! item.decoder)
                     return;
             }
@@ -183,7 +201,8 @@ static void add_file (PlaylistAddItem && item, Playlist::FilterFunc filter,
                     /* At least one plugin recognized the file extension and
                      * indicated that there might be subtunes.  Figure out for
                      * sure which decoder we need to use for this file. */
-                    item.decoder = aud_file_find_decoder (item.filename, true, file);
+                    if (! meta_cache_lookup (item.filename, cache_key, item.decoder, item.tuple))
+                        item.decoder = aud_file_find_decoder (item.filename, true, file);
                     if (skip_invalid && ! item.decoder)
                         return;
                 }
@@ -192,9 +211,12 @@ static void add_file (PlaylistAddItem && item, Playlist::FilterFunc filter,
 
         /* At this point we've either identified the decoder or determined that
          * the file doesn't have any subtunes.  If the former, read the tag so
-         * so we can expand any subtunes we find. */
-        if (item.decoder && input_plugin_has_subtunes (item.decoder))
-            aud_file_read_tag (item.filename, item.decoder, file, item.tuple);
+         * so we can expand any subtunes we find (unless it was cached). */
+        if (item.decoder && ! item.tuple.valid () && input_plugin_has_subtunes (item.decoder))
+        {
+            if (aud_file_read_tag (item.filename, item.decoder, file, item.tuple))
+                meta_cache_store (item.filename, cache_key, item.decoder, item.tuple);
+        }
     }
 
     int n_subtunes = item.tuple.get_n_subtunes ();
@@ -213,7 +235,12 @@ static void add_file (PlaylistAddItem && item, Playlist::FilterFunc filter,
         }
     }
     else
+    {
         result->items.append (std::move (item));
+
+        if (result->shared_count)
+            __atomic_add_fetch (result->shared_count, 1, __ATOMIC_RELAXED);
+    }
 }
 
 /* To prevent infinite recursion, we currently allow adding a folder from within
@@ -227,7 +254,7 @@ static void add_playlist (const char * filename, Playlist::FilterFunc filter,
  void * user, AddResult * result, bool save_title)
 {
     AUDINFO ("Adding playlist: %s\n", filename);
-    status_update (filename, result->items.len ());
+    status_update (filename, count_found (result));
 
     String title;
     Index<PlaylistAddItem> items;
@@ -267,7 +294,7 @@ static void add_cuesheets (Index<String> & files, Playlist::FilterFunc filter,
     for (String & cuesheet : cuesheets)
     {
         AUDINFO ("Adding cuesheet: %s\n", (const char *) cuesheet);
-        status_update (cuesheet, result->items.len ());
+        status_update (cuesheet, count_found (result));
 
         String title; // ignored
         Index<PlaylistAddItem> items;
@@ -300,11 +327,146 @@ static void add_cuesheets (Index<String> & files, Playlist::FilterFunc filter,
     }
 }
 
-static void add_folder (const char * filename, Playlist::FilterFunc filter,
- void * user, AddResult * result, bool save_title)
+/*
+ * Folders are searched by several threads at once, since reading a folder or
+ * probing a file mostly waits on the disk or the network.  Each folder is a
+ * task, which reads and sorts the folder and then splits its files into runs of
+ * WALK_RUN files, each a task of its own; a subfolder found in a run becomes a
+ * new task in turn.  Each thread takes the newest task from its own queue
+ * (staying deep in the tree, as a single thread would) or, if it has none,
+ * steals the oldest task from another thread (a folder or run near the top,
+ * likely to hold more work).
+ *
+ * Each task keeps what it found in a WalkNode, with its subtasks attached at
+ * the point in the list where they belong.  Once all the tasks are done, the
+ * tree is read back depth-first, which gives the same order as searching the
+ * folders one by one.
+ */
+
+#define WALK_THREADS 8
+#define WALK_RUN 32
+
+struct WalkNode;
+
+struct WalkChild
+{
+    int at;  /* the child's items go before parent->found.items[at] */
+    SmartPtr<WalkNode> node;
+};
+
+struct WalkNode
+{
+    String folder;        /* a folder to read, or */
+    Index<String> files;  /* a run of files from a folder (already sorted) */
+    bool save_title;
+
+    AddResult found;
+    Index<WalkChild> children;
+
+    WalkNode () :
+        save_title (false),
+        found () {}
+};
+
+struct Walk
+{
+    Playlist::FilterFunc filter;
+    void * user;
+    pthread_mutex_t filter_mutex;  /* the filter need not be thread-safe */
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    Index<WalkNode *> queues[WALK_THREADS];
+    int queued, pending;  /* tasks in the queues, and not yet finished */
+    int found;  /* files found, for the status */
+};
+
+static bool walk_filter (const char * filename, void * user)
+{
+    auto walk = (Walk *) user;
+
+    pthread_mutex_lock (& walk->filter_mutex);
+    bool add = walk->filter (filename, walk->user);
+    pthread_mutex_unlock (& walk->filter_mutex);
+
+    return add;
+}
+
+/* adds <child> to <parent> at the current end of its items */
+static void walk_push (Walk * walk, int self, WalkNode * parent, WalkNode * child)
+{
+    child->found.shared_count = & walk->found;
+
+    auto & link = parent->children.append ();
+    link.at = parent->found.items.len ();
+    link.node.capture (child);
+
+    pthread_mutex_lock (& walk->mutex);
+    walk->queues[self].append (child);
+    walk->queued ++;
+    walk->pending ++;
+    pthread_cond_signal (& walk->cond);
+    pthread_mutex_unlock (& walk->mutex);
+}
+
+/* returns nullptr once all tasks are finished */
+static WalkNode * walk_take (Walk * walk, int self)
+{
+    WalkNode * node = nullptr;
+
+    pthread_mutex_lock (& walk->mutex);
+
+    while (! walk->queued && walk->pending)
+        pthread_cond_wait (& walk->cond, & walk->mutex);
+
+    if (walk->queued)
+    {
+        auto & own = walk->queues[self];
+
+        if (own.len ())
+        {
+            node = own[own.len () - 1];
+            own.remove (own.len () - 1, 1);
+        }
+        else
+        {
+            for (int i = 1; i < WALK_THREADS; i ++)
+            {
+                auto & other = walk->queues[(self + i) % WALK_THREADS];
+
+                if (other.len ())
+                {
+                    node = other[0];
+                    other.remove (0, 1);
+                    break;
+                }
+            }
+        }
+
+        walk->queued --;
+    }
+
+    pthread_mutex_unlock (& walk->mutex);
+    return node;
+}
+
+static void walk_done (Walk * walk)
 {
+    pthread_mutex_lock (& walk->mutex);
+
+    if (! -- walk->pending)
+        pthread_cond_broadcast (& walk->cond);
+
+    pthread_mutex_unlock (& walk->mutex);
+}
+
+static void walk_folder (Walk * walk, int self, WalkNode * node)
+{
+    Playlist::FilterFunc filter = walk->filter ? walk_filter : nullptr;
+    const char * filename = node->folder;
+
     AUDINFO ("Adding folder: %s\n", filename);
-    status_update (filename, result->items.len ());
+    status_update (filename, count_found (& node->found));
 
     String error;
     Index<String> files = VFSFile::read_folder (filename, error);
@@ -315,23 +477,35 @@ static void add_folder (const char * filename, Playlist::FilterFunc filter,
     if (! files.len ())
         return;
 
-    if (save_title)
+    if (node->save_title)
     {
         const char * slash = strrchr (filename, '/');
         if (slash)
-            result->title = String (str_decode_percent (slash + 1));
+            node->found.title = String (str_decode_percent (slash + 1));
     }
 
-    add_cuesheets (files, filter, user, result);
+    add_cuesheets (files, filter, walk, & node->found);
 
     // sort file list in natural order (must come after add_cuesheets)
     files.sort (str_compare_encoded);
 
-    for (const char * file : files)
+    for (int at = 0; at < files.len (); at += WALK_RUN)
+    {
+        auto run = new WalkNode;
+        run->files.move_from (files, at, 0, aud::min (WALK_RUN, files.len () - at), true, false);
+        walk_push (walk, self, node, run);
+    }
+}
+
+static void walk_files (Walk * walk, int self, WalkNode * node)
+{
+    Playlist::FilterFunc filter = walk->filter ? walk_filter : nullptr;
+
+    for (const char * file : node->files)
     {
-        if (filter && ! filter (file, user))
+        if (filter && ! filter (file, walk))
         {
-            result->filtered = true;
+            node->found.filtered = true;
             continue;
         }
 
@@ -346,12 +520,124 @@ static void add_folder (const char * filename, Playlist::FilterFunc filter,
             continue;
 
         if (mode & VFS_IS_REGULAR)
-            add_file ({String (file)}, filter, user, result, true);
-        else if ((mode & VFS_IS_DIR) && aud_get_bool (nullptr, "recurse_folders"))
-            add_folder (file, filter, user, result, false);
+            add_file ({String (file)}, filter, walk, & node->found, true);
+        else if ((mode & VFS_IS_DIR) && cfg_recurse_folders.get ())
+        {
+            auto sub = new WalkNode;
+            sub->folder = String (file);
+            walk_push (walk, self, node, sub);
+        }
     }
 }
 
+static void walk_run (Walk * walk, int self)
+{
+    WalkNode * node;
+    while ((node = walk_take (walk, self)))
+    {
+        if (node->folder)
+            walk_folder (walk, self, node);
+        else
+            walk_files (walk, self, node);
+
+        walk_done (walk);
+    }
+}
+
+struct WalkThread
+{
+    Walk * walk;
+    int self;
+    pthread_t thread;
+};
+
+static void * walk_thread (void * data)
+{
+    auto thread = (WalkThread *) data;
+    walk_run (thread->walk, thread->self);
+    return nullptr;
+}
+
+/* appends the items found under <node> to <result>, in order */
+static void walk_collect (WalkNode * node, AddResult * result)
+{
+    auto & items = node->found.items;
+    int at = 0;
+
+    for (auto & child : node->children)
+    {
+        result->items.move_from (items, at, -1, child.at - at, true, false);
+        at = child.at;
+
+        walk_collect (child.node.get (), result);
+    }
+
+    result->items.move_from (items, at, -1, items.len () - at, true, false);
+
+    if (node->found.filtered)
+        result->filtered = true;
+}
+
+static void add_folder (const char * filename, Playlist::FilterFunc filter,
+ void * user, AddResult * result, bool save_title)
+{
+    Walk walk = Walk ();
+    walk.filter = filter;
+    walk.user = user;
+    walk.found = count_found (result);
+
+    pthread_mutex_init (& walk.filter_mutex, nullptr);
+    pthread_mutex_init (& walk.mutex, nullptr);
+    pthread_cond_init (& walk.cond, nullptr);
+
+    WalkNode root;
+    root.folder = String (filename);
+    root.save_title = save_title;
+    root.found.shared_count = & walk.found;
+
+    walk.queues[0].append (& root);
+    walk.queued = walk.pending = 1;
+
+    WalkThread threads[WALK_THREADS];
+    int n_threads = 1;
+
+    for (; n_threads < WALK_THREADS; n_threads ++)
+    {
+        auto & thread = threads[n_threads];
+        thread.walk = & walk;
+        thread.self = n_threads;
+
+        if (pthread_create (& thread.thread, nullptr, walk_thread, & thread))
+            break;
+    }
+
+    walk_run (& walk, 0);
+
+    for (int i = 1; i < n_threads; i ++)
+        pthread_join (threads[i].thread, nullptr);
+
+    pthread_cond_destroy (& walk.cond);
+    pthread_mutex_destroy (& walk.mutex);
+    pthread_mutex_destroy (& walk.filter_mutex);
+
+    if (root.found.title)
+        result->title = std::move (root.found.title);
+
+    walk_collect (& root, result);
+}
+
+/* searches <folder> as adding it to a playlist would, and returns what was
+ * found instead; for the unit tests */
+Index<PlaylistAddItem> adder_search_folder (const char * folder,
+ Playlist::FilterFunc filter, void * user, bool & filtered)
+{
+    AddResult result = AddResult ();
+    add_folder (folder, filter, user, & result, false);
+
+    filtered = result.filtered;
+    return std::move (result.items);
+}
+
 static void add_generic (PlaylistAddItem && item, Playlist::FilterFunc filter,
  void * user, AddResult * result, bool save_title, bool from_playlist)
 {
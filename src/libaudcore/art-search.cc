@@ -32,6 +32,11 @@ struct SearchParams {
     Index<String> include, exclude;
 };
 
+/* read by the scanner threads for every file */
+static ConfigHandle<bool> cfg_use_file_cover ("use_file_cover");
+static ConfigHandle<bool> cfg_recurse_for_cover ("recurse_for_cover");
+static ConfigHandle<int> cfg_recurse_for_cover_depth ("recurse_for_cover_depth");
+
 static bool has_front_cover_extension (const char * name)
 {
     const char * ext = strrchr (name, '.');
@@ -66,7 +71,7 @@ static String fileinfo_recursive_get_image (const char * path,
 
     const char * name;
 
-    if (aud_get_bool (nullptr, "use_file_cover") && ! depth)
+    if (cfg_use_file_cover.get () && ! depth)
     {
         /* Look for images matching file name */
         while ((name = g_dir_read_name (d)))
@@ -102,7 +107,7 @@ static String fileinfo_recursive_get_image (const char * path,
 
     g_dir_rewind (d);
 
-    if (aud_get_bool (nullptr, "recurse_for_cover") && depth < aud_get_int (nullptr, "recurse_for_cover_depth"))
+    if (cfg_recurse_for_cover.get () && depth < cfg_recurse_for_cover_depth.get ())
     {
         /* Descend into directories recursively. */
         while ((name = g_dir_read_name (d)))
@@ -0,0 +1,768 @@
+/*
+ * audio-simd.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/*
+ * Vectorized versions of the integer <-> float conversions in audio.cc.  The
+ * kernels here process as many whole blocks of samples as they can and return
+ * the number of samples handled; audio.cc finishes the remainder with the
+ * scalar loops.  The results must be bit-for-bit identical to the scalar code:
+ *  - Integer to float conversion and the power-of-two scaling are exact (or
+ *    rounded by the same hardware rounding mode) in both versions.
+ *  - Float to integer conversion uses the current rounding mode, which
+ *    audio_to_int() sets to FE_TONEAREST, exactly as lrintf() does.
+ *  - Clamping uses max/min instructions whose operand order matches that of
+ *    aud::clamp().
+ *
+ * On x86, the instruction set is chosen at runtime (SSE2 or AVX2).  On 64-bit
+ * ARM, NEON is always available and is used unconditionally.
+ */
+
+#include "internal.h"
+
+#include <stdint.h>
+
+#include "audio.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define USE_X86_SIMD
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define USE_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+#ifdef WORDS_BIGENDIAN
+static constexpr bool native_le = false;
+#else
+static constexpr bool native_le = true;
+#endif
+
+static constexpr bool is_le (int format)
+{
+    return format == FMT_S16_LE || format == FMT_U16_LE ||
+           format == FMT_S24_LE || format == FMT_U24_LE ||
+           format == FMT_S32_LE || format == FMT_U32_LE ||
+           format == FMT_S24_3LE || format == FMT_U24_3LE;
+}
+
+static constexpr bool is_signed (int format)
+{
+    return (format == FMT_S8 ||
+            format == FMT_S16_LE || format == FMT_S16_BE ||
+            format == FMT_S24_LE || format == FMT_S24_BE ||
+            format == FMT_S32_LE || format == FMT_S32_BE ||
+            format == FMT_S24_3LE || format == FMT_S24_3BE);
+}
+
+static constexpr bool needs_swap (int format)
+    { return format >= FMT_S16_LE && format < FMT_S24_3LE && (is_le (format) ^ native_le); }
+
+static constexpr bool is_padded24 (int format)
+    { return format >= FMT_S24_LE && format <= FMT_U24_BE; }
+
+static constexpr bool is_packed24 (int format)
+    { return format >= FMT_S24_3LE; }
+
+/* magnitude of the sign bit for each word size */
+static constexpr unsigned sign_bit (int format)
+{
+    return (format >= FMT_S32_LE && format < FMT_S24_3LE) ? 0x80000000 :
+           (format >= FMT_S24_LE) ? 0x800000 :
+           (format >= FMT_S16_LE) ? 0x8000 : 0x80;
+}
+
+/* see pos_range() in audio.cc */
+static constexpr unsigned pos_limit (int format)
+{
+    return (format >= FMT_S32_LE && format < FMT_S24_3LE) ? 0x7fffff80 :
+           (format >= FMT_S24_LE) ? 0x7fffff :
+           (format >= FMT_S16_LE) ? 0x7fff : 0x7f;
+}
+
+static SimdLevel detect_level ()
+{
+#ifdef USE_X86_SIMD
+    __builtin_cpu_init ();
+
+    if (__builtin_cpu_supports ("avx2"))
+        return SimdLevel::AVX2;
+    if (__builtin_cpu_supports ("sse2"))
+        return SimdLevel::SSE2;
+#endif
+#ifdef USE_NEON_SIMD
+    return SimdLevel::NEON;
+#endif
+
+    return SimdLevel::None;
+}
+
+static const SimdLevel s_detected = detect_level ();
+static SimdLevel s_level = s_detected;
+
+SimdLevel audio_simd_detect ()
+    { return s_detected; }
+
+SimdLevel audio_simd_get_level ()
+    { return s_level; }
+
+void audio_simd_set_level (SimdLevel level)
+{
+    /* never select an instruction set that the CPU does not support */
+    if (level == SimdLevel::None || level == s_detected ||
+     (level == SimdLevel::SSE2 && s_detected == SimdLevel::AVX2))
+        s_level = level;
+    else
+        s_level = s_detected;
+}
+
+const char * audio_simd_level_name (SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::SSE2: return "SSE2";
+        case SimdLevel::AVX2: return "AVX2";
+        case SimdLevel::NEON: return "NEON";
+        default: return "none";
+    }
+}
+
+#ifdef USE_X86_SIMD
+
+#define SSE2_FUNC __attribute__ ((target ("sse2")))
+#define AVX2_FUNC __attribute__ ((target ("avx2")))
+
+/* ---- SSE2 ---- */
+
+SSE2_FUNC static inline __m128i swap16_sse2 (__m128i v)
+    { return _mm_or_si128 (_mm_slli_epi16 (v, 8), _mm_srli_epi16 (v, 8)); }
+
+SSE2_FUNC static inline __m128i swap32_sse2 (__m128i v)
+{
+    v = swap16_sse2 (v);
+    v = _mm_shufflelo_epi16 (v, _MM_SHUFFLE (2, 3, 0, 1));
+    return _mm_shufflehi_epi16 (v, _MM_SHUFFLE (2, 3, 0, 1));
+}
+
+/* converts 32-bit words to signed integers */
+template<int format>
+SSE2_FUNC static inline __m128i word32_to_int_sse2 (__m128i v)
+{
+    if (needs_swap (format))
+        v = swap32_sse2 (v);
+    if (! is_signed (format))
+        v = _mm_xor_si128 (v, _mm_set1_epi32 (sign_bit (format)));
+    if (is_padded24 (format))
+        v = _mm_srai_epi32 (_mm_slli_epi32 (v, 8), 8); /* ignore high byte */
+
+    return v;
+}
+
+/* converts signed integers to 32-bit words */
+template<int format>
+SSE2_FUNC static inline __m128i int_to_word32_sse2 (__m128i v)
+{
+    if (! is_signed (format))
+        v = _mm_add_epi32 (v, _mm_set1_epi32 (sign_bit (format)));
+    if (is_padded24 (format))
+        v = _mm_and_si128 (v, _mm_set1_epi32 (0xffffff)); /* zero high byte */
+    if (needs_swap (format))
+        v = swap32_sse2 (v);
+
+    return v;
+}
+
+template<int format>
+SSE2_FUNC static inline __m128 to_float_sse2 (__m128i v)
+    { return _mm_mul_ps (_mm_cvtepi32_ps (v), _mm_set1_ps (1.0f / sign_bit (format))); }
+
+template<int format>
+SSE2_FUNC static inline __m128i from_float_sse2 (const float * in)
+{
+    __m128 f = _mm_mul_ps (_mm_loadu_ps (in), _mm_set1_ps ((float) sign_bit (format)));
+    f = _mm_max_ps (f, _mm_set1_ps (-(float) sign_bit (format)));
+    f = _mm_min_ps (f, _mm_set1_ps ((float) pos_limit (format)));
+    return _mm_cvtps_epi32 (f);
+}
+
+template<int format>
+SSE2_FUNC static int from_int_sse2 (const void * in_, float * out, int samples)
+{
+    auto in = (const char *) in_;
+    int done = 0;
+
+    if (format == FMT_S8 || format == FMT_U8)
+    {
+        for (; done + 16 <= samples; done += 16)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *) (in + done));
+            if (! is_signed (format))
+                v = _mm_xor_si128 (v, _mm_set1_epi8 ((char) 0x80));
+
+            __m128i lo = _mm_srai_epi16 (_mm_unpacklo_epi8 (v, v), 8);
+            __m128i hi = _mm_srai_epi16 (_mm_unpackhi_epi8 (v, v), 8);
+
+            _mm_storeu_ps (out + done, to_float_sse2<format> (_mm_srai_epi32 (_mm_unpacklo_epi16 (lo, lo), 16)));
+            _mm_storeu_ps (out + done + 4, to_float_sse2<format> (_mm_srai_epi32 (_mm_unpackhi_epi16 (lo, lo), 16)));
+            _mm_storeu_ps (out + done + 8, to_float_sse2<format> (_mm_srai_epi32 (_mm_unpacklo_epi16 (hi, hi), 16)));
+            _mm_storeu_ps (out + done + 12, to_float_sse2<format> (_mm_srai_epi32 (_mm_unpackhi_epi16 (hi, hi), 16)));
+        }
+    }
+    else if (format <= FMT_U16_BE)
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *) (in + 2 * done));
+            if (needs_swap (format))
+                v = swap16_sse2 (v);
+            if (! is_signed (format))
+                v = _mm_xor_si128 (v, _mm_set1_epi16 ((short) 0x8000));
+
+            _mm_storeu_ps (out + done, to_float_sse2<format> (_mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16)));
+            _mm_storeu_ps (out + done + 4, to_float_sse2<format> (_mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16)));
+        }
+    }
+    else if (! is_packed24 (format))
+    {
+        for (; done + 4 <= samples; done += 4)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *) (in + 4 * done));
+            _mm_storeu_ps (out + done, to_float_sse2<format> (word32_to_int_sse2<format> (v)));
+        }
+    }
+
+    /* packed 24-bit formats need SSSE3 shuffles; see the AVX2 version */
+    return done;
+}
+
+template<int format>
+SSE2_FUNC static int to_int_sse2 (const float * in, void * out_, int samples)
+{
+    auto out = (char *) out_;
+    int done = 0;
+
+    if (format == FMT_S8 || format == FMT_U8)
+    {
+        for (; done + 16 <= samples; done += 16)
+        {
+            __m128i lo = _mm_packs_epi32 (from_float_sse2<format> (in + done),
+             from_float_sse2<format> (in + done + 4));
+            __m128i hi = _mm_packs_epi32 (from_float_sse2<format> (in + done + 8),
+             from_float_sse2<format> (in + done + 12));
+
+            __m128i v = _mm_packs_epi16 (lo, hi);
+            if (! is_signed (format))
+                v = _mm_xor_si128 (v, _mm_set1_epi8 ((char) 0x80));
+
+            _mm_storeu_si128 ((__m128i *) (out + done), v);
+        }
+    }
+    else if (format <= FMT_U16_BE)
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            __m128i v = _mm_packs_epi32 (from_float_sse2<format> (in + done),
+             from_float_sse2<format> (in + done + 4));
+
+            if (! is_signed (format))
+                v = _mm_xor_si128 (v, _mm_set1_epi16 ((short) 0x8000));
+            if (needs_swap (format))
+                v = swap16_sse2 (v);
+
+            _mm_storeu_si128 ((__m128i *) (out + 2 * done), v);
+        }
+    }
+    else if (! is_packed24 (format))
+    {
+        for (; done + 4 <= samples; done += 4)
+        {
+            __m128i v = int_to_word32_sse2<format> (from_float_sse2<format> (in + done));
+            _mm_storeu_si128 ((__m128i *) (out + 4 * done), v);
+        }
+    }
+
+    return done;
+}
+
+/* ---- AVX2 ---- */
+
+template<int format>
+AVX2_FUNC static inline __m256i swap_mask_avx2 ()
+{
+    if (format <= FMT_U16_BE)
+        return _mm256_setr_epi8 (1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+         1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    else
+        return _mm256_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+         3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+}
+
+template<int format>
+AVX2_FUNC static inline __m256 to_float_avx2 (__m256i v)
+    { return _mm256_mul_ps (_mm256_cvtepi32_ps (v), _mm256_set1_ps (1.0f / sign_bit (format))); }
+
+template<int format>
+AVX2_FUNC static inline __m256i from_float_avx2 (const float * in)
+{
+    __m256 f = _mm256_mul_ps (_mm256_loadu_ps (in), _mm256_set1_ps ((float) sign_bit (format)));
+    f = _mm256_max_ps (f, _mm256_set1_ps (-(float) sign_bit (format)));
+    f = _mm256_min_ps (f, _mm256_set1_ps ((float) pos_limit (format)));
+    return _mm256_cvtps_epi32 (f);
+}
+
+/* byte shuffles between packed 24-bit samples (in the low 12 bytes) and
+ * 32-bit integers (with the sample in the high 3 bytes) */
+template<int format>
+AVX2_FUNC static inline __m128i unpack24_mask ()
+{
+    if (is_le (format))
+        return _mm_setr_epi8 (-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    else
+        return _mm_setr_epi8 (-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9);
+}
+
+template<int format>
+AVX2_FUNC static inline __m128i pack24_mask ()
+{
+    if (is_le (format))
+        return _mm_setr_epi8 (0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    else
+        return _mm_setr_epi8 (2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+}
+
+template<int format>
+AVX2_FUNC static inline __m256 unpack24_avx2 (__m128i a, __m128i b)
+{
+    const __m128i mask = unpack24_mask<format> ();
+    __m256i v = _mm256_inserti128_si256 (_mm256_castsi128_si256
+     (_mm_shuffle_epi8 (a, mask)), _mm_shuffle_epi8 (b, mask), 1);
+
+    if (! is_signed (format))
+        v = _mm256_xor_si256 (v, _mm256_set1_epi32 (0x80000000));
+
+    return to_float_avx2<format> (_mm256_srai_epi32 (v, 8));
+}
+
+template<int format>
+AVX2_FUNC static inline __m128i pack24_avx2 (__m128i v)
+{
+    if (! is_signed (format))
+        v = _mm_add_epi32 (v, _mm_set1_epi32 (0x800000));
+
+    return _mm_shuffle_epi8 (v, pack24_mask<format> ());
+}
+
+template<int format>
+AVX2_FUNC static int from_int_avx2 (const void * in_, float * out, int samples)
+{
+    auto in = (const char *) in_;
+    int done = 0;
+
+    if (format == FMT_S8 || format == FMT_U8)
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            __m128i v = _mm_loadl_epi64 ((const __m128i *) (in + done));
+            if (! is_signed (format))
+                v = _mm_xor_si128 (v, _mm_set1_epi8 ((char) 0x80));
+
+            _mm256_storeu_ps (out + done, to_float_avx2<format> (_mm256_cvtepi8_epi32 (v)));
+        }
+    }
+    else if (format <= FMT_U16_BE)
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *) (in + 2 * done));
+            if (needs_swap (format))
+                v = _mm_shuffle_epi8 (v, _mm256_castsi256_si128 (swap_mask_avx2<format> ()));
+            if (! is_signed (format))
+                v = _mm_xor_si128 (v, _mm_set1_epi16 ((short) 0x8000));
+
+            _mm256_storeu_ps (out + done, to_float_avx2<format> (_mm256_cvtepi16_epi32 (v)));
+        }
+    }
+    else if (! is_packed24 (format))
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            __m256i v = _mm256_loadu_si256 ((const __m256i *) (in + 4 * done));
+            if (needs_swap (format))
+                v = _mm256_shuffle_epi8 (v, swap_mask_avx2<format> ());
+            if (! is_signed (format))
+                v = _mm256_xor_si256 (v, _mm256_set1_epi32 (sign_bit (format)));
+            if (is_padded24 (format))
+                v = _mm256_srai_epi32 (_mm256_slli_epi32 (v, 8), 8); /* ignore high byte */
+
+            _mm256_storeu_ps (out + done, to_float_avx2<format> (v));
+        }
+    }
+    else
+    {
+        /* 16 samples = 48 bytes = three full vectors, split into four
+         * groups of 12 bytes without reading past the end of the input */
+        for (; done + 16 <= samples; done += 16)
+        {
+            auto get = (const __m128i *) (in + 3 * done);
+            __m128i v0 = _mm_loadu_si128 (get);
+            __m128i v1 = _mm_loadu_si128 (get + 1);
+            __m128i v2 = _mm_loadu_si128 (get + 2);
+
+            _mm256_storeu_ps (out + done, unpack24_avx2<format> (v0, _mm_alignr_epi8 (v1, v0, 12)));
+            _mm256_storeu_ps (out + done + 8, unpack24_avx2<format>
+             (_mm_alignr_epi8 (v2, v1, 8), _mm_srli_si128 (v2, 4)));
+        }
+    }
+
+    return done;
+}
+
+template<int format>
+AVX2_FUNC static int to_int_avx2 (const float * in, void * out_, int samples)
+{
+    auto out = (char *) out_;
+    int done = 0;
+
+    if (format == FMT_S8 || format == FMT_U8)
+    {
+        for (; done + 16 <= samples; done += 16)
+        {
+            __m256i a = from_float_avx2<format> (in + done);
+            __m256i b = from_float_avx2<format> (in + done + 8);
+
+            __m128i lo = _mm_packs_epi32 (_mm256_castsi256_si128 (a), _mm256_extracti128_si256 (a, 1));
+            __m128i hi = _mm_packs_epi32 (_mm256_castsi256_si128 (b), _mm256_extracti128_si256 (b, 1));
+
+            __m128i v = _mm_packs_epi16 (lo, hi);
+            if (! is_signed (format))
+                v = _mm_xor_si128 (v, _mm_set1_epi8 ((char) 0x80));
+
+            _mm_storeu_si128 ((__m128i *) (out + done), v);
+        }
+    }
+    else if (format <= FMT_U16_BE)
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            __m256i a = from_float_avx2<format> (in + done);
+            __m128i v = _mm_packs_epi32 (_mm256_castsi256_si128 (a), _mm256_extracti128_si256 (a, 1));
+
+            if (! is_signed (format))
+                v = _mm_xor_si128 (v, _mm_set1_epi16 ((short) 0x8000));
+            if (needs_swap (format))
+                v = _mm_shuffle_epi8 (v, _mm256_castsi256_si128 (swap_mask_avx2<format> ()));
+
+            _mm_storeu_si128 ((__m128i *) (out + 2 * done), v);
+        }
+    }
+    else if (! is_packed24 (format))
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            __m256i v = from_float_avx2<format> (in + done);
+
+            if (! is_signed (format))
+                v = _mm256_add_epi32 (v, _mm256_set1_epi32 (sign_bit (format)));
+            if (is_padded24 (format))
+                v = _mm256_and_si256 (v, _mm256_set1_epi32 (0xffffff)); /* zero high byte */
+            if (needs_swap (format))
+                v = _mm256_shuffle_epi8 (v, swap_mask_avx2<format> ());
+
+            _mm256_storeu_si256 ((__m256i *) (out + 4 * done), v);
+        }
+    }
+    else
+    {
+        /* four groups of 12 bytes are merged into three full vectors */
+        for (; done + 16 <= samples; done += 16)
+        {
+            __m256i a = from_float_avx2<format> (in + done);
+            __m256i b = from_float_avx2<format> (in + done + 8);
+
+            __m128i p0 = pack24_avx2<format> (_mm256_castsi256_si128 (a));
+            __m128i p1 = pack24_avx2<format> (_mm256_extracti128_si256 (a, 1));
+            __m128i p2 = pack24_avx2<format> (_mm256_castsi256_si128 (b));
+            __m128i p3 = pack24_avx2<format> (_mm256_extracti128_si256 (b, 1));
+
+            auto set = (__m128i *) (out + 3 * done);
+            _mm_storeu_si128 (set, _mm_or_si128 (p0, _mm_slli_si128 (p1, 12)));
+            _mm_storeu_si128 (set + 1, _mm_or_si128 (_mm_srli_si128 (p1, 4), _mm_slli_si128 (p2, 8)));
+            _mm_storeu_si128 (set + 2, _mm_or_si128 (_mm_srli_si128 (p2, 8), _mm_slli_si128 (p3, 4)));
+        }
+    }
+
+    return done;
+}
+
+#endif // USE_X86_SIMD
+
+#ifdef USE_NEON_SIMD
+
+template<int format>
+static inline float32x4_t to_float_neon (int32x4_t v)
+    { return vmulq_n_f32 (vcvtq_f32_s32 (v), 1.0f / sign_bit (format)); }
+
+template<int format>
+static inline int32x4_t from_float_neon (const float * in)
+{
+    float32x4_t f = vmulq_n_f32 (vld1q_f32 (in), (float) sign_bit (format));
+    f = vmaxq_f32 (f, vdupq_n_f32 (-(float) sign_bit (format)));
+    f = vminq_f32 (f, vdupq_n_f32 ((float) pos_limit (format)));
+    return vcvtnq_s32_f32 (f); /* round to nearest, ties to even */
+}
+
+template<int format>
+static int from_int_neon (const void * in_, float * out, int samples)
+{
+    auto in = (const uint8_t *) in_;
+    int done = 0;
+
+    if (format == FMT_S8 || format == FMT_U8)
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            uint8x8_t v = vld1_u8 (in + done);
+            if (! is_signed (format))
+                v = veor_u8 (v, vdup_n_u8 (0x80));
+
+            int16x8_t w = vmovl_s8 (vreinterpret_s8_u8 (v));
+            vst1q_f32 (out + done, to_float_neon<format> (vmovl_s16 (vget_low_s16 (w))));
+            vst1q_f32 (out + done + 4, to_float_neon<format> (vmovl_s16 (vget_high_s16 (w))));
+        }
+    }
+    else if (format <= FMT_U16_BE)
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            uint8x16_t v = vld1q_u8 (in + 2 * done);
+            if (needs_swap (format))
+                v = vrev16q_u8 (v);
+
+            uint16x8_t u = vreinterpretq_u16_u8 (v);
+            if (! is_signed (format))
+                u = veorq_u16 (u, vdupq_n_u16 (0x8000));
+
+            int16x8_t w = vreinterpretq_s16_u16 (u);
+            vst1q_f32 (out + done, to_float_neon<format> (vmovl_s16 (vget_low_s16 (w))));
+            vst1q_f32 (out + done + 4, to_float_neon<format> (vmovl_s16 (vget_high_s16 (w))));
+        }
+    }
+    else if (! is_packed24 (format))
+    {
+        for (; done + 4 <= samples; done += 4)
+        {
+            uint8x16_t v = vld1q_u8 (in + 4 * done);
+            if (needs_swap (format))
+                v = vrev32q_u8 (v);
+
+            uint32x4_t u = vreinterpretq_u32_u8 (v);
+            if (! is_signed (format))
+                u = veorq_u32 (u, vdupq_n_u32 (sign_bit (format)));
+
+            int32x4_t w = vreinterpretq_s32_u32 (u);
+            if (is_padded24 (format))
+                w = vshrq_n_s32 (vshlq_n_s32 (w, 8), 8); /* ignore high byte */
+
+            vst1q_f32 (out + done, to_float_neon<format> (w));
+        }
+    }
+    else
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            uint8x8x3_t v = vld3_u8 (in + 3 * done);
+            uint8x8_t lo = v.val[is_le (format) ? 0 : 2];
+            uint8x8_t mid = v.val[1];
+            uint8x8_t hi = v.val[is_le (format) ? 2 : 0];
+
+            if (! is_signed (format))
+                hi = veor_u8 (hi, vdup_n_u8 (0x80));
+
+            /* build (int8_t (hi) << 24 | mid << 16 | lo << 8) >> 8 */
+            int16x8_t top = vreinterpretq_s16_u16 (vorrq_u16
+             (vshll_n_u8 (hi, 8), vmovl_u8 (mid)));
+            uint16x8_t bottom = vshll_n_u8 (lo, 8);
+
+            int32x4_t w0 = vreinterpretq_s32_u16 (vzip1q_u16 (bottom, vreinterpretq_u16_s16 (top)));
+            int32x4_t w1 = vreinterpretq_s32_u16 (vzip2q_u16 (bottom, vreinterpretq_u16_s16 (top)));
+
+            vst1q_f32 (out + done, to_float_neon<format> (vshrq_n_s32 (w0, 8)));
+            vst1q_f32 (out + done + 4, to_float_neon<format> (vshrq_n_s32 (w1, 8)));
+        }
+    }
+
+    return done;
+}
+
+template<int format>
+static int to_int_neon (const float * in, void * out_, int samples)
+{
+    auto out = (uint8_t *) out_;
+    int done = 0;
+
+    if (format == FMT_S8 || format == FMT_U8)
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            int16x8_t w = vcombine_s16 (vqmovn_s32 (from_float_neon<format> (in + done)),
+             vqmovn_s32 (from_float_neon<format> (in + done + 4)));
+
+            uint8x8_t v = vreinterpret_u8_s8 (vqmovn_s16 (w));
+            if (! is_signed (format))
+                v = veor_u8 (v, vdup_n_u8 (0x80));
+
+            vst1_u8 (out + done, v);
+        }
+    }
+    else if (format <= FMT_U16_BE)
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            uint16x8_t u = vreinterpretq_u16_s16 (vcombine_s16
+             (vqmovn_s32 (from_float_neon<format> (in + done)),
+              vqmovn_s32 (from_float_neon<format> (in + done + 4))));
+
+            if (! is_signed (format))
+                u = veorq_u16 (u, vdupq_n_u16 (0x8000));
+
+            uint8x16_t v = vreinterpretq_u8_u16 (u);
+            if (needs_swap (format))
+                v = vrev16q_u8 (v);
+
+            vst1q_u8 (out + 2 * done, v);
+        }
+    }
+    else if (! is_packed24 (format))
+    {
+        for (; done + 4 <= samples; done += 4)
+        {
+            uint32x4_t u = vreinterpretq_u32_s32 (from_float_neon<format> (in + done));
+
+            if (! is_signed (format))
+                u = vaddq_u32 (u, vdupq_n_u32 (sign_bit (format)));
+            if (is_padded24 (format))
+                u = vandq_u32 (u, vdupq_n_u32 (0xffffff)); /* zero high byte */
+
+            uint8x16_t v = vreinterpretq_u8_u32 (u);
+            if (needs_swap (format))
+                v = vrev32q_u8 (v);
+
+            vst1q_u8 (out + 4 * done, v);
+        }
+    }
+    else
+    {
+        for (; done + 8 <= samples; done += 8)
+        {
+            uint32x4_t u0 = vreinterpretq_u32_s32 (from_float_neon<format> (in + done));
+            uint32x4_t u1 = vreinterpretq_u32_s32 (from_float_neon<format> (in + done + 4));
+
+            if (! is_signed (format))
+            {
+                u0 = vaddq_u32 (u0, vdupq_n_u32 (0x800000));
+                u1 = vaddq_u32 (u1, vdupq_n_u32 (0x800000));
+            }
+
+            uint8x8_t lo = vmovn_u16 (vcombine_u16 (vmovn_u32 (u0), vmovn_u32 (u1)));
+            uint8x8_t mid = vmovn_u16 (vcombine_u16 (vshrn_n_u32 (u0, 8), vshrn_n_u32 (u1, 8)));
+            uint8x8_t hi = vmovn_u16 (vcombine_u16 (vshrn_n_u32 (u0, 16), vshrn_n_u32 (u1, 16)));
+
+            uint8x8x3_t v;
+            v.val[is_le (format) ? 0 : 2] = lo;
+            v.val[1] = mid;
+            v.val[is_le (format) ? 2 : 0] = hi;
+
+            vst3_u8 (out + 3 * done, v);
+        }
+    }
+
+    return done;
+}
+
+#endif // USE_NEON_SIMD
+
+#define DISPATCH(kernel, ...) \
+    switch (format) \
+    { \
+        case FMT_S8: return kernel<FMT_S8> (__VA_ARGS__); \
+        case FMT_U8: return kernel<FMT_U8> (__VA_ARGS__); \
+        case FMT_S16_LE: return kernel<FMT_S16_LE> (__VA_ARGS__); \
+        case FMT_S16_BE: return kernel<FMT_S16_BE> (__VA_ARGS__); \
+        case FMT_U16_LE: return kernel<FMT_U16_LE> (__VA_ARGS__); \
+        case FMT_U16_BE: return kernel<FMT_U16_BE> (__VA_ARGS__); \
+        case FMT_S24_LE: return kernel<FMT_S24_LE> (__VA_ARGS__); \
+        case FMT_S24_BE: return kernel<FMT_S24_BE> (__VA_ARGS__); \
+        case FMT_U24_LE: return kernel<FMT_U24_LE> (__VA_ARGS__); \
+        case FMT_U24_BE: return kernel<FMT_U24_BE> (__VA_ARGS__); \
+        case FMT_S32_LE: return kernel<FMT_S32_LE> (__VA_ARGS__); \
+        case FMT_S32_BE: return kernel<FMT_S32_BE> (__VA_ARGS__); \
+        case FMT_U32_LE: return kernel<FMT_U32_LE> (__VA_ARGS__); \
+        case FMT_U32_BE: return kernel<FMT_U32_BE> (__VA_ARGS__); \
+        case FMT_S24_3LE: return kernel<FMT_S24_3LE> (__VA_ARGS__); \
+        case FMT_S24_3BE: return kernel<FMT_S24_3BE> (__VA_ARGS__); \
+        case FMT_U24_3LE: return kernel<FMT_U24_3LE> (__VA_ARGS__); \
+        case FMT_U24_3BE: return kernel<FMT_U24_3BE> (__VA_ARGS__); \
+    }
+
+int audio_simd_from_int (const void * in, int format, float * out, int samples)
+{
+    switch (s_level)
+    {
+#ifdef USE_X86_SIMD
+    case SimdLevel::AVX2:
+        DISPATCH (from_int_avx2, in, out, samples);
+        break;
+    case SimdLevel::SSE2:
+        DISPATCH (from_int_sse2, in, out, samples);
+        break;
+#endif
+#ifdef USE_NEON_SIMD
+    case SimdLevel::NEON:
+        DISPATCH (from_int_neon, in, out, samples);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+int audio_simd_to_int (const float * in, void * out, int format, int samples)
+{
+    switch (s_level)
+    {
+#ifdef USE_X86_SIMD
+    case SimdLevel::AVX2:
+        DISPATCH (to_int_avx2, in, out, samples);
+        break;
+    case SimdLevel::SSE2:
+        DISPATCH (to_int_sse2, in, out, samples);
+        break;
+#endif
+#ifdef USE_NEON_SIMD
+    case SimdLevel::NEON:
+        DISPATCH (to_int_neon, in, out, samples);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    return 0;
+}
@@ -20,9 +20,11 @@
 #include <fenv.h>
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 
 #define WANT_AUD_BSWAP
 #include "audio.h"
+#include "internal.h"
 #include "objects.h"
 
 #define SW_VOLUME_RANGE 40 /* decibels */
@@ -257,6 +259,13 @@ void to_int_loop (const float * in, void * out_, int samples)
 
 EXPORT void audio_from_int (const void * in, int format, float * out, int samples)
 {
+    /* vectorized conversion of whole blocks, see audio-simd.cc */
+    int done = audio_simd_from_int (in, format, out, samples);
+
+    in = (const char *) in + FMT_SIZEOF (format) * done;
+    out += done;
+    samples -= done;
+
     switch (format)
     {
         case FMT_S8: from_int_loop<FMT_S8, int8_t> (in, out, samples); break;
@@ -289,6 +298,13 @@ EXPORT void audio_to_int (const float * in, void * out, int format, int samples)
     int save = fegetround ();
     fesetround (FE_TONEAREST);
 
+    /* vectorized conversion of whole blocks, see audio-simd.cc */
+    int done = audio_simd_to_int (in, out, format, samples);
+
+    in += done;
+    out = (char *) out + FMT_SIZEOF (format) * done;
+    samples -= done;
+
     switch (format)
     {
         case FMT_S8: to_int_loop<FMT_S8, int8_t> (in, out, samples); break;
@@ -333,16 +349,13 @@ EXPORT void audio_amplify (float * data, int channels, int frames, const float *
     }
 }
 
-EXPORT void audio_amplify (float * data, int channels, int frames, StereoVolume volume)
+/* returns false if the volume is 100% (no change needed) */
+bool audio_volume_factors (int channels, StereoVolume volume, float * factors)
 {
-    if (channels < 1 || channels > AUD_MAX_CHANNELS)
-        return;
-
     if (volume.left == 100 && volume.right == 100)
-        return;
+        return false;
 
     float lfactor = 0, rfactor = 0;
-    float factors[AUD_MAX_CHANNELS];
 
     if (volume.left > 0)
         lfactor = powf (10, (float) SW_VOLUME_RANGE * (volume.left - 100) / 100 / 20);
@@ -360,9 +373,23 @@ EXPORT void audio_amplify (float * data, int channels, int frames, StereoVolume
             factors[c] = aud::max (lfactor, rfactor);
     }
 
-    audio_amplify (data, channels, frames, factors);
+    return true;
+}
+
+EXPORT void audio_amplify (float * data, int channels, int frames, StereoVolume volume)
+{
+    if (channels < 1 || channels > AUD_MAX_CHANNELS)
+        return;
+
+    float factors[AUD_MAX_CHANNELS];
+    if (audio_volume_factors (channels, volume, factors))
+        audio_amplify (data, channels, frames, factors);
 }
 
+typedef float PostVec __attribute__ ((vector_size (16)));
+
+#define POST_LANES (int) (sizeof (PostVec) / sizeof (float))
+
 /* linear approximation of y = sin(x) */
 /* contributed by Anders Johansson */
 EXPORT void audio_soft_clip (float * data, int samples)
@@ -390,3 +417,139 @@ EXPORT void audio_soft_clip (float * data, int samples)
         * data ++ = (x > 0) ? y : -y;
     }
 }
+
+/* The same curve for audio_post_process().  It is concave, so it is simply
+ * the minimum of its segments; this avoids branching and allows the same
+ * arithmetic to be done on vectors.  Since it is computed in single precision,
+ * results may differ from audio_soft_clip() by one ulp. */
+template<class T>
+static inline T soft_clip (T x, T zero, T one)
+{
+    T a = (x > zero) ? x : -x;
+    T y = a, z;
+
+    z = 0.8f * a + 0.08f;
+    y = (z < y) ? z : y;
+    z = 0.7f * a + 0.15f;
+    y = (z < y) ? z : y;
+    z = 0.4f * a + 0.45f;
+    y = (z < y) ? z : y;
+    z = 0.15f * a + 0.775f;
+    y = (z < y) ? z : y;
+    y = (one < y) ? one : y;
+
+    return (x > zero) ? y : -y;
+}
+
+static inline float soft_clip (float x)
+    { return soft_clip<float> (x, 0, 1); }
+
+/* Number of samples processed at a time by audio_post_process().  Each block
+ * (16 KiB of floats) stays in the L1 or L2 cache while it passes through all
+ * the stages, so the buffer is only streamed from memory once. */
+#define POST_BLOCK 4096
+
+template<bool EQ, bool VOL, bool CLIP, bool CONV>
+static void post_process_loop (const AudioPostProcess & pp, float * data,
+ int samples, void * out)
+{
+    /* volume factors, repeated to fill a whole number of vectors */
+    const int unit = POST_LANES * pp.channels;
+    union {
+        PostVec vec[AUD_MAX_CHANNELS];
+        float flt[POST_LANES * AUD_MAX_CHANNELS];
+    } factors;
+
+    if (VOL)
+    {
+        for (int i = 0; i < unit; i ++)
+            factors.flt[i] = pp.factors[i % pp.channels];
+    }
+
+    const PostVec zero = {0, 0, 0, 0};
+    const PostVec one = {1, 1, 1, 1};
+
+    const int block = aud::max (1, POST_BLOCK / unit) * unit;
+    const int out_size = FMT_SIZEOF (pp.format);
+
+    for (int at = 0; at < samples; at += block)
+    {
+        float * chunk = data + at;
+        int len = aud::min (block, samples - at);
+
+        if (pp.before_eq)
+            pp.before_eq (chunk, len, at, pp.user);
+
+        if (EQ)
+            eq_filter (chunk, len);
+        if (pp.convolver)
+            conv_process (chunk, len);
+
+        if (pp.after_eq)
+            pp.after_eq (chunk, len, at, pp.user);
+
+        if (VOL || CLIP)
+        {
+            int i = 0;
+
+            for (; i + unit <= len; i += unit)
+            {
+                for (int v = 0; v < pp.channels; v ++)
+                {
+                    PostVec x;
+                    memcpy (& x, chunk + i + POST_LANES * v, sizeof x);
+
+                    if (VOL)
+                        x *= factors.vec[v];
+                    if (CLIP)
+                        x = soft_clip (x, zero, one);
+
+                    memcpy (chunk + i + POST_LANES * v, & x, sizeof x);
+                }
+            }
+
+            /* last partial unit, only at the very end of the data */
+            for (int j = 0; i < len; i ++, j ++)
+            {
+                if (VOL)
+                    chunk[i] *= factors.flt[j];
+                if (CLIP)
+                    chunk[i] = soft_clip (chunk[i]);
+            }
+        }
+
+        if (CONV)
+            audio_to_int (chunk, (char *) out + out_size * at, pp.format, len);
+    }
+}
+
+typedef void (* PostProcessFunc) (const AudioPostProcess & pp, float * data,
+ int samples, void * out);
+
+/* indexed by (EQ << 3 | VOL << 2 | CLIP << 1 | CONV) */
+static const PostProcessFunc post_process_funcs[16] = {
+    post_process_loop<false, false, false, false>,
+    post_process_loop<false, false, false, true>,
+    post_process_loop<false, false, true, false>,
+    post_process_loop<false, false, true, true>,
+    post_process_loop<false, true, false, false>,
+    post_process_loop<false, true, false, true>,
+    post_process_loop<false, true, true, false>,
+    post_process_loop<false, true, true, true>,
+    post_process_loop<true, false, false, false>,
+    post_process_loop<true, false, false, true>,
+    post_process_loop<true, false, true, false>,
+    post_process_loop<true, false, true, true>,
+    post_process_loop<true, true, false, false>,
+    post_process_loop<true, true, false, true>,
+    post_process_loop<true, true, true, false>,
+    post_process_loop<true, true, true, true>
+};
+
+void audio_post_process (const AudioPostProcess & pp, float * data, int samples, void * out)
+{
+    int index = (pp.equalizer << 3) | (pp.volume << 2) | (pp.soft_clip << 1) |
+     (pp.format != FMT_FLOAT);
+
+    post_process_funcs[index] (pp, data, samples, out);
+}
@@ -0,0 +1,121 @@
+/*
+ * bitmap.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "bitmap.h"
+
+/* bits <bit> and above of a word */
+static inline uint64_t mask_from (int bit)
+    { return ~(uint64_t) 0 << bit; }
+
+static inline int n_words (int bits)
+    { return (bits + 63) >> 6; }
+
+void Bitmap::update_summary (int word)
+{
+    uint64_t bit = (uint64_t) 1 << (word & 63);
+
+    if (m_words[word])
+        m_summary[word >> 6] |= bit;
+    else
+        m_summary[word >> 6] &= ~bit;
+}
+
+void Bitmap::resize (int len)
+{
+    int words = n_words (len);
+    int old_words = m_words.len ();
+
+    if (words > old_words)
+    {
+        int summary = n_words (words);
+
+        m_words.insert (-1, words - old_words);
+        if (summary > m_summary.len ())
+            m_summary.insert (-1, summary - m_summary.len ());
+    }
+    else if (len < m_len)
+    {
+        m_words.remove (words, -1);
+        m_summary.remove (n_words (words), -1);
+
+        /* bits past the end must stay clear for find_next() */
+        if (len & 63)
+            m_words[words - 1] &= ~mask_from (len & 63);
+        if (words & 63)
+            m_summary[m_summary.len () - 1] &= ~mask_from (words & 63);
+        if (words)
+            update_summary (words - 1);
+    }
+
+    m_len = len;
+}
+
+void Bitmap::set (int i, bool on)
+{
+    uint64_t & word = m_words[i >> 6];
+    uint64_t bit = (uint64_t) 1 << (i & 63);
+
+    if (on == (bool) (word & bit))
+        return;
+
+    word ^= bit;
+    update_summary (i >> 6);
+}
+
+/* returns the first nonzero word from <word> on, or -1 */
+int Bitmap::next_word (int word) const
+{
+    int s = word >> 6;
+    if (s >= m_summary.len ())
+        return -1;
+
+    uint64_t bits = m_summary[s] & mask_from (word & 63);
+
+    while (! bits)
+    {
+        if (++ s >= m_summary.len ())
+            return -1;
+
+        bits = m_summary[s];
+    }
+
+    return (s << 6) + __builtin_ctzll (bits);
+}
+
+int Bitmap::find_next (int from, int to) const
+{
+    if (to < 0 || to > m_len)
+        to = m_len;
+    if (from < 0 || from >= to)
+        return -1;
+
+    int w = from >> 6;
+    uint64_t bits = m_words[w] & mask_from (from & 63);
+
+    if (! bits)
+    {
+        if ((w = next_word (w + 1)) < 0)
+            return -1;
+
+        bits = m_words[w];
+    }
+
+    int found = (w << 6) + __builtin_ctzll (bits);
+    return (found < to) ? found : -1;
+}
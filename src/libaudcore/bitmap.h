@@ -0,0 +1,59 @@
+/*
+ * bitmap.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_BITMAP_H
+#define LIBAUDCORE_BITMAP_H
+
+#include <stdint.h>
+
+#include "index.h"
+
+/* A resizable array of bits which can quickly find the next bit that is set.
+ * A second level of bits tells which words of the first level are nonzero, so
+ * skipping over a million clear bits reads only a few hundred words. */
+
+class Bitmap
+{
+public:
+    int len () const
+        { return m_len; }
+
+    void resize (int len);  /* bits added are clear */
+    void clear ()
+        { resize (0); }
+
+    bool get (int i) const
+        { return (m_words[i >> 6] >> (i & 63)) & 1; }
+
+    void set (int i, bool on);
+
+    /* returns the first set bit from <from> up to (but not including) <to>, or
+     * up to the end if <to> is -1; returns -1 if there is none */
+    int find_next (int from, int to = -1) const;
+
+private:
+    void update_summary (int word);
+    int next_word (int word) const;
+
+    int m_len = 0;
+    Index<uint64_t> m_words;    /* one bit per item */
+    Index<uint64_t> m_summary;  /* one bit per nonzero word */
+};
+
+#endif // LIBAUDCORE_BITMAP_H
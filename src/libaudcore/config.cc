@@ -21,6 +21,7 @@
 #include "internal.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <string.h>
 
 #include "audstrings.h"
@@ -43,6 +44,11 @@ static const char * const core_defaults[] = {
  "resume_playback_on_startup", "TRUE",
  "show_interface", "TRUE",
 
+ /* convolver */
+ "convolver_active", "FALSE",
+ "convolver_block", "1024",
+ "convolver_file", "",
+
  /* equalizer */
  "eqpreset_default_file", "",
  "eqpreset_extension", "",
@@ -68,11 +74,17 @@ static const char * const core_defaults[] = {
 
  /* output */
  "default_gain", "0",
+ "effect_pipeline", "FALSE",
  "enable_replay_gain", "TRUE",
  "enable_clipping_prevention", "TRUE",
  "output_bit_depth", "-1",
  "output_buffer_size", "500",
+ "output_realtime", "FALSE",
+ "output_writer_buffer", "200",
+ "output_writer_thread", "FALSE",
  "record", "FALSE",
+ "record_buffer", "2000",
+ "record_overflow", aud::numeric_string<(int) RecordOverflow::Drop>::str,
  "record_stream", aud::numeric_string<(int) OutputStream::AfterReplayGain>::str,
  "replay_gain_mode", aud::numeric_string<(int) ReplayGainMode::Track>::str,
  "replay_gain_preamp", "0",
@@ -84,6 +96,7 @@ static const char * const core_defaults[] = {
  /* playback */
  "album_shuffle", "FALSE",
  "no_playlist_advance", "FALSE",
+ "prepare_next_song", "TRUE",
  "repeat", "FALSE",
  "shuffle", "FALSE",
  "stop_after_current_song", "FALSE",
@@ -100,6 +113,8 @@ static const char * const core_defaults[] = {
  "generic_title_format", "${?artist:${artist} - }${?album:${album} - }${title}",
  "leading_zero", "FALSE",
  "show_hours", "TRUE",
+ "metadata_cache", "TRUE",
+ "metadata_cache_days", "365",
  "metadata_fallbacks", "TRUE",
  "metadata_on_play", "FALSE",
  "show_numbers_in_pl", "FALSE",
@@ -149,6 +164,12 @@ typedef MultiHash_T<ConfigNode, ConfigOp> ConfigTable;
 static ConfigTable s_defaults, s_config;
 static volatile bool s_modified;
 
+/* registered ConfigHandles; these are updated with the mutex held, so that
+ * concurrent changes to a setting always leave the latest value cached */
+static pthread_mutex_t handle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ConfigHandleBase * handle_list;
+static bool handles_valid;
+
 ConfigNode * ConfigOp::add (const ConfigOp *)
 {
     switch (type)
@@ -240,6 +261,52 @@ private:
     }
 };
 
+/* updates the handles for one setting, or all of them if name is null */
+void config_update_handles (const char * name)
+{
+    pthread_mutex_lock (& handle_mutex);
+
+    if (handles_valid)
+    {
+        for (ConfigHandleBase * handle = handle_list; handle; handle = handle->m_next)
+        {
+            if (! name || ! strcmp (handle->m_name, name))
+                handle->update ();
+        }
+    }
+
+    pthread_mutex_unlock (& handle_mutex);
+}
+
+void ConfigHandleBase::add ()
+{
+    pthread_mutex_lock (& handle_mutex);
+
+    m_next = handle_list;
+    handle_list = this;
+
+    if (handles_valid)
+        update ();
+
+    pthread_mutex_unlock (& handle_mutex);
+}
+
+void ConfigHandleBase::remove ()
+{
+    pthread_mutex_lock (& handle_mutex);
+
+    for (ConfigHandleBase * * ptr = & handle_list; * ptr; ptr = & (* ptr)->m_next)
+    {
+        if (* ptr == this)
+        {
+            * ptr = m_next;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock (& handle_mutex);
+}
+
 void config_load ()
 {
     StringBuf path = filename_build ({aud_get_path (AudPath::UserDir), "config"});
@@ -258,6 +325,12 @@ void config_load ()
         aud_set_str (0, "replay_gain_album", "");
         aud_set_int (0, "replay_gain_mode", (int) ReplayGainMode::Album);
     }
+
+    pthread_mutex_lock (& handle_mutex);
+    handles_valid = true;
+    pthread_mutex_unlock (& handle_mutex);
+
+    config_update_handles (nullptr);
 }
 
 void config_save ()
@@ -327,11 +400,18 @@ EXPORT void aud_config_set_defaults (const char * section, const char * const *
 
         ConfigOp op = {OP_SET_NO_FLAG, section, name, String (value)};
         config_op_run (op, s_defaults);
+
+        if (! strcmp (section, DEFAULT_SECTION))
+            config_update_handles (name);
     }
 }
 
 void config_cleanup ()
 {
+    pthread_mutex_lock (& handle_mutex);
+    handles_valid = false;
+    pthread_mutex_unlock (& handle_mutex);
+
     s_config.clear ();
     s_defaults.clear ();
 }
@@ -346,6 +426,8 @@ EXPORT void aud_set_str (const char * section, const char * name, const char * v
     op.type = is_default ? OP_CLEAR : OP_SET;
     bool changed = config_op_run (op, s_config);
 
+    if (changed && ! strcmp (op.section, DEFAULT_SECTION))
+        config_update_handles (name);
     if (changed && ! section)
         event_queue (str_concat ({"set ", name}), nullptr);
 }
@@ -0,0 +1,356 @@
+/*
+ * convolution.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define WANT_AUD_BSWAP
+#include "audio.h"
+#include "convolver.h"
+#include "internal.h"
+#include "hook.h"
+#include "runtime.h"
+#include "vfs.h"
+
+/* The convolution stage filters the output through an impulse response read
+ * from a WAV file ("convolver_file"), right after the equalizer.  The block
+ * size of the convolver ("convolver_block") is also the latency it adds.
+ *
+ * The file is read and the filter is built in the main thread, together with
+ * a Convolver (the state of the filter) for the channel count last seen by the
+ * audio thread.  Both are handed to the audio thread through a lock-free triple
+ * buffer, as for the equalizer (see equalizer.cc).  A slot holds a ConvStage,
+ * or nullptr to bypass the stage.  Only the "front" slot is ever used by the
+ * audio thread, so the main thread can delete whatever it gets back in
+ * exchange for a new stage; picking up a new filter thus never allocates or
+ * frees memory in the audio thread, as realtime mode requires.
+ *
+ * If the channel count changes, conv_set_format() rebuilds the Convolver; it
+ * is called when the output is opened, where allocating is allowed.  A stage
+ * picked up by conv_active() for the wrong channel count is bypassed, but the
+ * main thread checks for that after publishing and builds another one.  The
+ * impulse response is used only if its sample rate is that of the audio;
+ * otherwise the stage is bypassed. */
+
+#define MAX_FRAMES (1 << 20)  /* longest impulse response used */
+
+#define SLOT_DIRTY 4
+
+struct ConvStage
+{
+    SmartPtr<ConvFilter> filter;
+    SmartPtr<Convolver> convolver;  /* nullptr if built for no channels */
+};
+
+static ConvStage * slots[3];
+static int back_slot = 0; /* main thread only */
+static int shared_slot = 1;
+static int front_slot = 2; /* audio thread only */
+
+/* written by the audio thread, read by the main thread */
+static int stage_channels;
+
+/* The remaining state belongs to the audio thread.  All the functions below
+ * except conv_init() and conv_cleanup() are called from output.cc with its
+ * locks held, so they do not need any locking of their own. */
+static ConvStage * stage;
+static Convolver * convolver; /* nullptr if bypassed */
+static int channels, rate;
+static int delay; /* milliseconds */
+
+/* main thread */
+static void publish_stage (ConvStage * new_stage)
+{
+    slots[back_slot] = new_stage;
+
+    int prev = __atomic_exchange_n (& shared_slot, back_slot | SLOT_DIRTY, __ATOMIC_ACQ_REL);
+    back_slot = prev & ~SLOT_DIRTY;
+
+    /* either never picked up or no longer in use */
+    delete slots[back_slot];
+    slots[back_slot] = nullptr;
+}
+
+/* audio thread; returns false if nothing new was published */
+static bool fetch_stage ()
+{
+    if (! (__atomic_load_n (& shared_slot, __ATOMIC_ACQUIRE) & SLOT_DIRTY))
+        return false;
+
+    int prev = __atomic_exchange_n (& shared_slot, front_slot, __ATOMIC_ACQ_REL);
+    front_slot = prev & ~SLOT_DIRTY;
+    stage = slots[front_slot];
+    return true;
+}
+
+/* audio thread; does not allocate */
+static void select_convolver ()
+{
+    convolver = nullptr;
+    delay = 0;
+
+    if (! stage || ! stage->convolver || stage->convolver->channels () != channels)
+        return;
+
+    if (stage->filter->rate != rate)
+    {
+        AUDWARN ("Impulse response is for %d Hz, not %d Hz; convolution disabled.\n",
+         stage->filter->rate, rate);
+        return;
+    }
+
+    convolver = stage->convolver.get ();
+    delay = aud::rescale<int64_t> (convolver->latency (), rate, 1000);
+}
+
+void conv_set_format (int new_channels, int new_rate)
+{
+    channels = new_channels;
+    rate = new_rate;
+
+    /* before fetching, so that a stage published after this is built for the
+     * new channel count (see conv_update) */
+    __atomic_store_n (& stage_channels, channels, __ATOMIC_RELEASE);
+
+    fetch_stage ();
+
+    if (stage && channels)
+    {
+        if (stage->convolver && stage->convolver->channels () == channels)
+            stage->convolver->reset ();
+        else
+            stage->convolver.capture (new Convolver (* stage->filter, channels));
+    }
+
+    select_convolver ();
+}
+
+bool conv_active ()
+{
+    if (fetch_stage ())
+        select_convolver ();
+
+    return (bool) convolver;
+}
+
+void conv_process (float * data, int samples)
+{
+    if (convolver)
+        convolver->process (data, samples);
+}
+
+void conv_flush ()
+{
+    if (convolver)
+        convolver->reset ();
+}
+
+int conv_get_delay ()
+{
+    return delay;
+}
+
+int conv_get_tail ()
+{
+    return convolver ? convolver->tail () : 0;
+}
+
+static int read_le16 (const char * p)
+{
+    uint16_t x;
+    memcpy (& x, p, sizeof x);
+    return FROM_LE16 (x);
+}
+
+static int64_t read_le32 (const char * p)
+{
+    uint32_t x;
+    memcpy (& x, p, sizeof x);
+    return FROM_LE32 (x);
+}
+
+/* main thread; parses a RIFF WAV file holding integer PCM or IEEE float */
+static bool load_ir (const char * filename, Index<float> & ir, int & ir_channels,
+ int & ir_rate)
+{
+    Index<char> wav = VFSFile::read_file (filename, VFS_IGNORE_MISSING);
+
+    const char * p = wav.begin ();
+    const char * end = wav.end ();
+
+    if (wav.len () < 12 || memcmp (p, "RIFF", 4) || memcmp (p + 8, "WAVE", 4))
+    {
+        AUDERR ("%s is not a WAV file.\n", filename);
+        return false;
+    }
+
+    int tag = 0, file_channels = 0, file_rate = 0, bits = 0;
+    const char * data = nullptr;
+    int64_t data_size = 0;
+
+    for (p += 12; end - p >= 8; )
+    {
+        int64_t size = read_le32 (p + 4);
+        const char * body = p + 8;
+        int64_t avail = aud::min (size, (int64_t) (end - body));
+
+        if (! memcmp (p, "fmt ", 4) && avail >= 16)
+        {
+            tag = read_le16 (body);
+            file_channels = read_le16 (body + 2);
+            file_rate = aud::min (read_le32 (body + 4), (int64_t) INT32_MAX);
+            bits = read_le16 (body + 14);
+
+            /* WAVE_FORMAT_EXTENSIBLE; the subformat begins with the tag */
+            if (tag == 0xfffe && avail >= 26)
+                tag = read_le16 (body + 24);
+        }
+        else if (! memcmp (p, "data", 4))
+        {
+            data = body;
+            data_size = avail;
+            break;
+        }
+
+        /* chunks are padded to an even size */
+        p = body + aud::min (size + (size & 1), (int64_t) (end - body));
+    }
+
+    int format = -1;
+
+    if (tag == 1 && bits == 8)
+        format = FMT_U8;
+    else if (tag == 1 && bits == 16)
+        format = FMT_S16_LE;
+    else if (tag == 1 && bits == 24)
+        format = FMT_S24_3LE;
+    else if (tag == 1 && bits == 32)
+        format = FMT_S32_LE;
+    else if (tag == 3 && bits == 32 && FMT_S16_NE == FMT_S16_LE)
+        format = FMT_FLOAT;
+
+    if (! data || format < 0 || file_channels < 1 ||
+     file_channels > AUD_MAX_CHANNELS || file_rate < 1)
+    {
+        AUDERR ("Unsupported WAV file %s (format %d, %d bits, %d channels).\n",
+         filename, tag, bits, file_channels);
+        return false;
+    }
+
+    int frames = data_size / (FMT_SIZEOF (format) * file_channels);
+
+    if (frames < 1)
+    {
+        AUDERR ("%s is empty.\n", filename);
+        return false;
+    }
+
+    if (frames > MAX_FRAMES)
+    {
+        AUDWARN ("Impulse response %s is too long; using the first %d frames.\n",
+         filename, MAX_FRAMES);
+        frames = MAX_FRAMES;
+    }
+
+    ir.insert (0, frames * file_channels);
+
+    if (format == FMT_FLOAT)
+        memcpy (ir.begin (), data, sizeof (float) * ir.len ());
+    else
+        audio_from_int (data, format, ir.begin (), ir.len ());
+
+    AUDINFO ("Loaded impulse response %s: %d frames, %d channels, %d Hz.\n",
+     filename, frames, file_channels, file_rate);
+
+    ir_channels = file_channels;
+    ir_rate = file_rate;
+    return true;
+}
+
+/* main thread */
+static void conv_update (void *, void *)
+{
+    Index<float> ir;
+    int ir_channels = 0, ir_rate = 0, block = CONV_MIN_BLOCK;
+
+    if (aud_get_bool (nullptr, "convolver_active"))
+    {
+        String filename = aud_get_str (nullptr, "convolver_file");
+
+        /* a power of two, as offered by the preferences */
+        int want = aud_get_int (nullptr, "convolver_block");
+
+        while (block < want && block < CONV_MAX_BLOCK)
+            block *= 2;
+
+        if (filename[0] && ! load_ir (filename, ir, ir_channels, ir_rate))
+            ir.clear ();
+    }
+
+    if (! ir.len ())
+    {
+        publish_stage (nullptr);
+        return;
+    }
+
+    int frames = ir.len () / ir_channels;
+
+    /* if the audio thread changed the channel count meanwhile, the stage just
+     * published may already be out of date */
+    int stage_for;
+    do
+    {
+        stage_for = __atomic_load_n (& stage_channels, __ATOMIC_ACQUIRE);
+
+        auto new_stage = new ConvStage;
+        new_stage->filter.capture (new ConvFilter (ir.begin (), ir_channels,
+         frames, ir_rate, block));
+
+        if (stage_for)
+            new_stage->convolver.capture (new Convolver (* new_stage->filter, stage_for));
+
+        publish_stage (new_stage);
+    }
+    while (__atomic_load_n (& stage_channels, __ATOMIC_ACQUIRE) != stage_for);
+}
+
+void conv_init ()
+{
+    conv_update (nullptr, nullptr);
+    hook_associate ("set convolver_active", conv_update, nullptr);
+    hook_associate ("set convolver_file", conv_update, nullptr);
+    hook_associate ("set convolver_block", conv_update, nullptr);
+}
+
+void conv_cleanup ()
+{
+    hook_dissociate ("set convolver_active", conv_update);
+    hook_dissociate ("set convolver_file", conv_update);
+    hook_dissociate ("set convolver_block", conv_update);
+
+    /* playback has stopped by now */
+    stage = nullptr;
+    convolver = nullptr;
+
+    for (ConvStage * & slot : slots)
+    {
+        delete slot;
+        slot = nullptr;
+    }
+}
@@ -0,0 +1,208 @@
+/*
+ * convolver.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "convolver.h"
+
+#include <string.h>
+
+#include "objects.h"
+
+/*
+ * Overlap-save: each block of input is transformed together with the block
+ * before it (2 * <block> points), multiplied by the spectrum of the impulse
+ * response zero-padded to the same length, and transformed back; the second
+ * half of the result is then free of wrap-around and is the output for that
+ * block.  With a partitioned impulse response, partition p is multiplied by
+ * the spectrum of the input from p blocks before, and the products are summed
+ * before the inverse FFT.  The input spectra are kept in a ring (the
+ * "frequency-domain delay line"), so each block of input is transformed once.
+ *
+ * The spectra are stored with a few bins of padding, so that the multiply-add
+ * (which is where nearly all the time goes for a long impulse response) is
+ * done on whole vectors.  The padding bins are zero in the filter, so they
+ * stay zero in the sum and are never read by the inverse FFT.
+ */
+
+typedef float ConvVec __attribute__ ((vector_size (16)));
+
+#define CONV_LANES (int) (sizeof (ConvVec) / sizeof (float))
+
+ConvFilter::ConvFilter (const float * ir, int channels, int frames, int rate, int block) :
+    channels (channels),
+    frames (frames),
+    rate (rate),
+    block (block),
+    parts ((frames + block - 1) / block),
+    bins ((block + CONV_LANES) / CONV_LANES * CONV_LANES)
+{
+    RealFFT fft (2 * block);
+    Index<float> buf;
+
+    buf.insert (0, 2 * block);
+    re.insert (0, channels * parts * bins);
+    im.insert (0, channels * parts * bins);
+
+    float scale = 1.0f / (2 * block);
+
+    for (int c = 0; c < channels; c ++)
+    {
+        for (int p = 0; p < parts; p ++)
+        {
+            int start = p * block;
+            int count = aud::min (block, frames - start);
+
+            for (int i = 0; i < count; i ++)
+                buf[i] = ir[(start + i) * channels + c] * scale;
+            for (int i = count; i < 2 * block; i ++)
+                buf[i] = 0;
+
+            int at = (c * parts + p) * bins;
+            fft.forward (buf.begin (), & re[at], & im[at]);
+        }
+    }
+}
+
+Convolver::Convolver (const ConvFilter & filter, int channels) :
+    m_filter (filter),
+    m_channels (channels),
+    m_fft (2 * filter.block)
+{
+    int block = filter.block;
+
+    m_input.insert (0, channels * 2 * block);
+    m_fdl_re.insert (0, channels * filter.parts * filter.bins);
+    m_fdl_im.insert (0, channels * filter.parts * filter.bins);
+    m_output.insert (0, channels * block);
+
+    m_acc_re.insert (0, filter.bins);
+    m_acc_im.insert (0, filter.bins);
+    m_work.insert (0, 2 * block);
+}
+
+void Convolver::reset ()
+{
+    for (Index<float> * buf : {& m_input, & m_fdl_re, & m_fdl_im, & m_output})
+        memset (buf->begin (), 0, sizeof (float) * buf->len ());
+
+    m_pos = 0;
+    m_head = 0;
+}
+
+/* acc += x * h (complex) */
+static void multiply_add (float * acc_re, float * acc_im, const float * x_re,
+ const float * x_im, const float * h_re, const float * h_im, int bins)
+{
+    for (int i = 0; i < bins; i += CONV_LANES)
+    {
+        ConvVec ar, ai, xr, xi, hr, hi;
+
+        memcpy (& ar, acc_re + i, sizeof ar);
+        memcpy (& ai, acc_im + i, sizeof ai);
+        memcpy (& xr, x_re + i, sizeof xr);
+        memcpy (& xi, x_im + i, sizeof xi);
+        memcpy (& hr, h_re + i, sizeof hr);
+        memcpy (& hi, h_im + i, sizeof hi);
+
+        ar += xr * hr - xi * hi;
+        ai += xr * hi + xi * hr;
+
+        memcpy (acc_re + i, & ar, sizeof ar);
+        memcpy (acc_im + i, & ai, sizeof ai);
+    }
+}
+
+void Convolver::process_block ()
+{
+    const int block = m_filter.block;
+    const int parts = m_filter.parts;
+    const int bins = m_filter.bins;
+
+    /* the oldest input spectrum is no longer needed */
+    m_head = (m_head ? m_head : parts) - 1;
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        float * input = & m_input[c * 2 * block];
+        float * fdl_re = & m_fdl_re[c * parts * bins];
+        float * fdl_im = & m_fdl_im[c * parts * bins];
+
+        int ir_channel = c % m_filter.channels;
+        const float * h_re = & m_filter.re[ir_channel * parts * bins];
+        const float * h_im = & m_filter.im[ir_channel * parts * bins];
+
+        m_fft.forward (input, fdl_re + m_head * bins, fdl_im + m_head * bins);
+
+        memset (m_acc_re.begin (), 0, sizeof (float) * bins);
+        memset (m_acc_im.begin (), 0, sizeof (float) * bins);
+
+        /* partition p goes with the input from p blocks before; the ring is
+         * walked in two straight runs rather than wrapping for each one */
+        int wrap = parts - m_head;
+
+        for (int p = 0; p < parts; p ++)
+        {
+            int slot = (p < wrap) ? m_head + p : p - wrap;
+
+            multiply_add (m_acc_re.begin (), m_acc_im.begin (),
+             fdl_re + slot * bins, fdl_im + slot * bins, h_re + p * bins,
+             h_im + p * bins, bins);
+        }
+
+        m_fft.inverse (m_acc_re.begin (), m_acc_im.begin (), m_work.begin ());
+
+        memcpy (& m_output[c * block], & m_work[block], sizeof (float) * block);
+        memcpy (input, input + block, sizeof (float) * block);
+    }
+}
+
+void Convolver::process (float * data, int samples)
+{
+    const int block = m_filter.block;
+    int frames = samples / m_channels;
+
+    while (frames > 0)
+    {
+        int count = aud::min (block - m_pos, frames);
+
+        /* swap each input sample for the output sample of <block> frames
+         * before */
+        for (int c = 0; c < m_channels; c ++)
+        {
+            float * in = & m_input[c * 2 * block + block + m_pos];
+            const float * out = & m_output[c * block + m_pos];
+            float * f = data + c;
+
+            for (int i = 0; i < count; i ++, f += m_channels)
+            {
+                in[i] = * f;
+                * f = out[i];
+            }
+        }
+
+        m_pos += count;
+        data += count * m_channels;
+        frames -= count;
+
+        if (m_pos == block)
+        {
+            process_block ();
+            m_pos = 0;
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * convolver.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_CONVOLVER_H
+#define LIBAUDCORE_CONVOLVER_H
+
+#include "fft.h"
+#include "index.h"
+
+/*
+ * Convolution with a long impulse response (e.g. a room or a speaker
+ * correction filter) by uniformly partitioned overlap-save:
+ *  - ConvFilter splits the impulse response into partitions of <block>
+ *    frames and keeps the spectrum of each.  Building one takes an FFT per
+ *    partition and channel, so it is done outside the audio thread.
+ *  - Convolver filters interleaved audio through a ConvFilter, one block at a
+ *    time.  Its output is delayed by exactly <block> frames.  Channel c of the
+ *    audio uses channel c % filter.channels of the impulse response.  At the
+ *    end of the stream, tail() frames of silence push out the rest of the
+ *    output, including the decay of the impulse response.
+ * The block size trades latency against CPU time: the work per block is one
+ * forward and one inverse FFT of 2 * <block> points per channel, plus a
+ * multiply-add of <block> + 1 complex values per partition, so halving the
+ * block size roughly doubles the cost of a long impulse response.
+ */
+
+#define CONV_MIN_BLOCK (FFT_MIN_SIZE / 2)
+#define CONV_MAX_BLOCK (FFT_MAX_SIZE / 2)
+
+struct ConvFilter
+{
+    /* <ir> holds <frames> frames of <channels> interleaved channels; <block>
+     * must be a power of two from CONV_MIN_BLOCK to CONV_MAX_BLOCK */
+    ConvFilter (const float * ir, int channels, int frames, int rate, int block);
+
+    const int channels, frames, rate, block;
+    const int parts;  /* number of partitions */
+    const int bins;   /* block + 1, rounded up to a whole number of vectors */
+
+    /* spectra in the order [channel][partition][bin], scaled by 1 / (2 * block)
+     * so that the inverse FFT needs no scaling */
+    Index<float> re, im;
+};
+
+class Convolver
+{
+public:
+    Convolver (const ConvFilter & filter, int channels);
+
+    int channels () const
+        { return m_channels; }
+    int latency () const  /* in frames */
+        { return m_filter.block; }
+    int tail () const  /* in frames */
+        { return m_filter.block + m_filter.frames - 1; }
+
+    void process (float * data, int samples);
+    void reset ();
+
+private:
+    void process_block ();
+
+    const ConvFilter & m_filter;
+    const int m_channels;
+
+    RealFFT m_fft;
+    int m_pos = 0;   /* frames filled in the current block */
+    int m_head = 0;  /* partition slot of the newest input spectrum */
+
+    Index<float> m_input;           /* [channel][2 * block]: last two blocks */
+    Index<float> m_fdl_re, m_fdl_im;  /* [channel][partition][bin]: input spectra */
+    Index<float> m_output;          /* [channel][block]: output of last block */
+    Index<float> m_acc_re, m_acc_im, m_work;
+};
+
+#endif // LIBAUDCORE_CONVOLVER_H
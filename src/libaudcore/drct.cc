@@ -146,6 +146,23 @@ EXPORT bool aud_drct_enable_record (bool enable)
     return plugin_enable_secondary (record_plugin, enable);
 }
 
+EXPORT bool aud_drct_enable_secondary (PluginHandle * plugin, bool enable)
+{
+    if (aud_plugin_get_type (plugin) != PluginType::Output ||
+     plugin_get_enabled (plugin) == PluginEnabled::Primary)
+        return false;
+
+    return plugin_enable_secondary (plugin, enable);
+}
+
+EXPORT void aud_drct_set_secondary_stream (PluginHandle * plugin, OutputStream stream)
+{
+    aud_set_int (aud_plugin_get_basename (plugin), "record_stream", (int) stream);
+
+    /* not sent automatically for plugin config sections */
+    hook_call ("set record_stream", nullptr);
+}
+
 /* --- VOLUME CONTROL --- */
 
 EXPORT int aud_drct_get_volume_main ()
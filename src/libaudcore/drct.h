@@ -20,11 +20,14 @@
 #ifndef LIBAUDCORE_DRCT_H
 #define LIBAUDCORE_DRCT_H
 
+#include <stdint.h>
+
 #include <libaudcore/audio.h>
 #include <libaudcore/index.h>
 #include <libaudcore/tuple.h>
 
 class PluginHandle;
+enum class OutputStream;
 
 /* CAUTION: These functions are not thread safe. */
 
@@ -56,7 +59,27 @@ Tuple aud_drct_get_tuple ();
 // connect to the "info change" hook to be notified of changes
 void aud_drct_get_info (int & bitrate, int & samplerate, int & channels);
 
+// returns true if the decoded audio is currently sent to the output plugin
+// unmodified (no format conversion or other processing)
+bool aud_drct_get_passthrough ();
+
+// returns the delay (in milliseconds) between the end of decoding of one song
+// and the start of the next, for the most recent time that playback advanced
+// on its own, or -1 if it has not yet done so
+int aud_drct_get_track_change_time ();
+
 int aud_drct_get_time ();
+
+struct PlaybackTiming {
+    int position;  // same as aud_drct_get_time()
+    int buffered;  // milliseconds of audio held in Audacious's own buffers
+    int latency;   // milliseconds reported by the output plugin
+};
+
+// returns false if not playing; does not wait for the audio threads, so it
+// is suitable for polling at display rate
+bool aud_drct_get_timing (PlaybackTiming & timing);
+
 int aud_drct_get_length ();
 void aud_drct_seek (int time);
 
@@ -67,6 +90,86 @@ void aud_drct_seek (int time);
 void aud_drct_set_ab_repeat (int a, int b);
 void aud_drct_get_ab_repeat (int & a, int & b);
 
+/* --- OUTPUT STATISTICS --- */
+
+// stages of the audio path that are timed
+enum class OutputStage {
+    Decode,       // input plugin, between calls to write_audio()
+    Convert,      // conversion to floating point and replay gain
+    Effects,      // effect plugins
+    PostProcess,  // equalizer, volume, clipping and format conversion
+    Write,        // output plugin's write_audio()
+    PeriodWait,   // output plugin's period_wait()
+    count
+};
+
+// histogram bucket i counts durations from 2^i to 2^(i+1) microseconds (the
+// first bucket also counts shorter ones, the last one also longer ones)
+#define AUD_OUTPUT_STATS_BUCKETS 21
+
+struct OutputStageStats {
+    int64_t count;
+    int64_t total_us;
+    int max_us;
+    int64_t histogram[AUD_OUTPUT_STATS_BUCKETS];
+};
+
+struct OutputStats {
+    OutputStageStats stages[(int) OutputStage::count];
+
+    int buffered, max_buffered;  // milliseconds held in Audacious's buffers
+    int latency, max_latency;    // milliseconds reported by the output plugin
+
+    int64_t underruns;    // the output plugin ran out of audio while playing
+    int64_t late_writes;  // audio arrived with less than 10 ms left to play
+    int64_t stalls;       // writes that had to wait for buffer space
+};
+
+// statistics are collected from the start of the program, or from the last
+// call to aud_drct_reset_output_stats(); the values are read one at a time,
+// so they may not be consistent with each other while playing
+void aud_drct_get_output_stats (OutputStats & stats);
+void aud_drct_reset_output_stats ();
+
+/* --- OFFLINE RENDERING --- */
+
+// While rendering, the audio goes to a built-in output in place of the
+// selected output plugin (the setting itself is not changed).  The built-in
+// output never waits, so songs are processed as fast as they can be decoded;
+// the audio is written to a WAV file or, if no file is given, discarded.
+// The output statistics are reset when rendering starts.
+
+struct RenderStats {
+    int64_t time;        // milliseconds of audio rendered
+    int64_t elapsed_us;  // real time from the first song opened to the last closed
+    int64_t bytes;       // bytes of audio written (or discarded)
+    bool error;          // some of the audio could not be written to the file
+};
+
+// <uri> may be null to discard the audio; returns false if the file cannot be
+// created or rendering is already in progress
+bool aud_drct_start_render (const char * uri);
+
+// finishes the file and returns false if rendering was not in progress; must
+// be called before aud_cleanup()
+bool aud_drct_stop_render (RenderStats & stats);
+
+/* --- SHARED-MEMORY TAP --- */
+
+// The tap lets other processes on the same machine follow the audio as it is
+// played (after the equalizer) and its spectrum, through shared memory laid
+// out as described in tap.h.  Reading the tap never delays playback.
+
+// returns a memfd holding the shared memory (to be mapped read-only) and an
+// eventfd that is signaled whenever something is written to it, both owned by
+// the caller; the return value is the id to pass to aud_drct_close_tap(), or
+// -1 if the tap is not supported (it requires Linux) or could not be created
+int aud_drct_open_tap (int & mem_fd, int & event_fd);
+
+// stops signaling the reader's eventfd; the tap is written only while it has
+// readers (at most 16; opening another closes the oldest)
+void aud_drct_close_tap (int id);
+
 /* --- RECORDING CONTROL --- */
 
 /* Note that the behavior of these functions has changed in Audacious 3.9;
@@ -85,6 +188,17 @@ bool aud_drct_get_record_enabled ();
  * Returns true on success, otherwise false. */
 bool aud_drct_enable_record (bool enable);
 
+/* Output plugins other than the recording plugin may also be enabled as
+ * secondary outputs (for example, to feed a network stream).  These receive
+ * audio whenever they are enabled, regardless of the "record" option.  Returns
+ * true on success, otherwise false. */
+bool aud_drct_enable_secondary (PluginHandle * plugin, bool enable);
+
+/* Sets the point in the processing chain from which a secondary output plugin
+ * (including the recording plugin) takes its audio, overriding the
+ * "record_stream" option for that plugin. */
+void aud_drct_set_secondary_stream (PluginHandle * plugin, OutputStream stream);
+
 /* --- VOLUME CONTROL --- */
 
 StereoVolume aud_drct_get_volume ();
@@ -20,6 +20,7 @@
 #include "internal.h"
 
 #include <pthread.h>
+#include <string.h>
 
 #include "drct.h"
 #include "list.h"
@@ -39,6 +40,315 @@ struct Effect : public ListNode
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 static List<Effect> effects;
 static int input_channels, input_rate;
+static bool have_effects; /* effects.head () != nullptr; atomic */
+
+/* Optionally ("effect_pipeline"), each effect runs on a thread of its own.
+ * Blocks of audio are passed from one stage to the next through queues of at
+ * most PIPE_DEPTH blocks.  effect_process() queues a block for the first stage
+ * and returns whatever has come out of the last stage so far; effect_finish()
+ * waits until its block has come out, so everything queued before it is
+ * returned in order.  A block keeps its identity through the chain (each stage
+ * turns one block into one block, possibly empty), so the amount of input
+ * still inside the pipeline is known exactly and reported as extra delay.
+ *
+ * All queues are protected by pipe_mutex.  A stage's plugin is called only
+ * from its own thread, except for flush(), which is called while the whole
+ * pipeline is idle.  Each stage measures its delay (see measure_delay()) after
+ * every block, so that the delay can be read without waiting for the plugin.
+ * In this mode, an effect that is enabled or disabled during playback always
+ * causes an output reset, which rebuilds the pipeline.  The pipeline is not
+ * used in realtime mode ("output_realtime"), since blocks are allocated as
+ * they are passed from stage to stage. */
+
+#define PIPE_DEPTH 2
+
+/* The delay reported by an effect is taken to be linear in the delay after it:
+ * adjust_delay (delay) = offset + delay * scale / 1000.  The two values are
+ * packed into one word, which can be stored and loaded atomically. */
+static constexpr int64_t delay_model (int offset, int scale)
+    { return ((int64_t) scale << 32) | (uint32_t) offset; }
+
+static constexpr int64_t DELAY_NONE = delay_model (0, 1000);
+
+static int apply_delay (int64_t model, int delay)
+{
+    int offset = (int32_t) model, scale = (int32_t) (model >> 32);
+    return offset + aud::rescale<int64_t> (delay, 1000, scale);
+}
+
+/* the model of applying <first>, then <second> */
+static int64_t compose_delay (int64_t first, int64_t second)
+{
+    int scale = (int32_t) (first >> 32), second_scale = (int32_t) (second >> 32);
+    return delay_model (apply_delay (second, (int32_t) first),
+     aud::rescale<int64_t> (scale, 1000, second_scale));
+}
+
+static int64_t measure_delay (EffectPlugin * header)
+{
+    int offset = header->adjust_delay (0);
+    return delay_model (offset, header->adjust_delay (1000) - offset);
+}
+
+struct PipeBlock
+{
+    Index<float> data;
+    int64_t in_frames; /* frames of input this block was made from */
+    bool finish, end_of_playlist;
+};
+
+struct PipeStage
+{
+    Effect * effect;
+    pthread_t thread;
+    int64_t delay = DELAY_NONE; /* see measure_delay(); written by the thread */
+
+    PipeBlock queue[PIPE_DEPTH];
+    int queue_head = 0, queue_len = 0;
+    bool busy = false; /* holds a block taken from the queue */
+};
+
+static pthread_mutex_t pipe_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pipe_cond = PTHREAD_COND_INITIALIZER;
+
+static Index<SmartPtr<PipeStage>> pipe_stages;
+static bool pipe_quit;
+static int pipe_serial; /* incremented by a flush; stale blocks are dropped */
+static int pipe_finished; /* count of finish blocks that have come out */
+static int64_t pipe_in_frames; /* input frames inside the pipeline; atomic */
+static Index<float> pipe_output;
+
+/* The delay model of the whole chain is kept up to date by whoever calls the
+ * plugins (the stage threads, or effect_process() and friends), so that
+ * effect_adjust_delay() can be called from the audio thread while holding
+ * the output lock, without waiting for any plugin. */
+static int64_t chain_delay = DELAY_NONE; /* atomic */
+
+/* assumes mutex, or called by a stage thread (the stages do not change while
+ * their threads are running) */
+static void update_delay ()
+{
+    int64_t model = DELAY_NONE;
+
+    if (pipe_stages.len ())
+    {
+        for (int i = pipe_stages.len () - 1; i >= 0; i --)
+            model = compose_delay (model, __atomic_load_n (& pipe_stages[i]->delay, __ATOMIC_RELAXED));
+    }
+    else
+    {
+        for (Effect * e = effects.tail (); e; e = effects.prev (e))
+            model = compose_delay (model, measure_delay (e->header));
+    }
+
+    __atomic_store_n (& chain_delay, model, __ATOMIC_RELAXED);
+}
+
+static bool pipe_push (int stage, PipeBlock & block, int serial)
+{
+    if (stage == pipe_stages.len ())
+    {
+        pipe_output.insert (block.data.begin (), -1, block.data.len ());
+        __atomic_sub_fetch (& pipe_in_frames, block.in_frames, __ATOMIC_RELAXED);
+
+        if (block.finish)
+            pipe_finished ++;
+
+        pthread_cond_broadcast (& pipe_cond);
+        return true;
+    }
+
+    PipeStage * s = pipe_stages[stage].get ();
+
+    while (s->queue_len == PIPE_DEPTH && serial == pipe_serial && ! pipe_quit)
+        pthread_cond_wait (& pipe_cond, & pipe_mutex);
+
+    if (serial != pipe_serial || pipe_quit)
+        return false;
+
+    PipeBlock & slot = s->queue[(s->queue_head + s->queue_len) % PIPE_DEPTH];
+
+    slot.data = std::move (block.data);
+    slot.in_frames = block.in_frames;
+    slot.finish = block.finish;
+    slot.end_of_playlist = block.end_of_playlist;
+
+    s->queue_len ++;
+    pthread_cond_broadcast (& pipe_cond);
+    return true;
+}
+
+static void * pipe_worker (void * data)
+{
+    int stage = (int) (intptr_t) data;
+    PipeBlock block = PipeBlock ();
+
+    pthread_mutex_lock (& pipe_mutex);
+
+    PipeStage * s = pipe_stages[stage].get ();
+
+    while (1)
+    {
+        while (! s->queue_len && ! pipe_quit)
+            pthread_cond_wait (& pipe_cond, & pipe_mutex);
+
+        if (pipe_quit)
+            break;
+
+        PipeBlock & slot = s->queue[s->queue_head];
+
+        block.data = std::move (slot.data);
+        block.in_frames = slot.in_frames;
+        block.finish = slot.finish;
+        block.end_of_playlist = slot.end_of_playlist;
+
+        s->queue_head = (s->queue_head + 1) % PIPE_DEPTH;
+        s->queue_len --;
+        s->busy = true;
+
+        int serial = pipe_serial;
+        pthread_cond_broadcast (& pipe_cond);
+        pthread_mutex_unlock (& pipe_mutex);
+
+        EffectPlugin * header = s->effect->header;
+
+        Index<float> & out = block.finish ?
+         header->finish (block.data, block.end_of_playlist) :
+         header->process (block.data);
+
+        if (& out != & block.data)
+        {
+            block.data.resize (out.len ());
+            memcpy (block.data.begin (), out.begin (), sizeof (float) * out.len ());
+        }
+
+        __atomic_store_n (& s->delay, measure_delay (header), __ATOMIC_RELAXED);
+        update_delay ();
+
+        pthread_mutex_lock (& pipe_mutex);
+
+        pipe_push (stage + 1, block, serial);
+
+        s->busy = false;
+        pthread_cond_broadcast (& pipe_cond);
+    }
+
+    pthread_mutex_unlock (& pipe_mutex);
+    return nullptr;
+}
+
+static bool use_pipeline ()
+{
+    return aud_get_bool (nullptr, "effect_pipeline") &&
+     ! aud_get_bool (nullptr, "output_realtime");
+}
+
+/* assumes mutex; call after changing the list of effects */
+static void update_active ()
+{
+    __atomic_store_n (& have_effects, effects.head () != nullptr, __ATOMIC_RELAXED);
+}
+
+/* assumes mutex */
+static void pipe_stop ()
+{
+    pthread_mutex_lock (& pipe_mutex);
+    pipe_quit = true;
+    pthread_cond_broadcast (& pipe_cond);
+    pthread_mutex_unlock (& pipe_mutex);
+
+    for (auto & s : pipe_stages)
+        pthread_join (s->thread, nullptr);
+
+    pipe_stages.clear ();
+    pipe_output.clear ();
+    __atomic_store_n (& pipe_in_frames, 0, __ATOMIC_RELAXED);
+    pipe_quit = false;
+}
+
+/* assumes mutex */
+static void pipe_start ()
+{
+    pthread_mutex_lock (& pipe_mutex);
+
+    for (Effect * e = effects.head (); e; e = effects.next (e))
+    {
+        auto s = new PipeStage ();
+        s->effect = e;
+        s->delay = measure_delay (e->header);
+        pipe_stages.append (SmartPtr<PipeStage> (s));
+    }
+
+    for (int i = 0; i < pipe_stages.len (); i ++)
+        pthread_create (& pipe_stages[i]->thread, nullptr, pipe_worker, (void *) (intptr_t) i);
+
+    pthread_mutex_unlock (& pipe_mutex);
+}
+
+/* assumes mutex, pipe_stages.len () */
+static Index<float> & pipe_process (Index<float> & data, bool finish, bool end_of_playlist)
+{
+    PipeBlock block = PipeBlock ();
+
+    block.data = std::move (data);
+    block.in_frames = block.data.len () / input_channels;
+    block.finish = finish;
+    block.end_of_playlist = end_of_playlist;
+
+    rt_lock (& pipe_mutex);
+
+    int finished = pipe_finished;
+    int64_t in_frames = block.in_frames;
+    __atomic_add_fetch (& pipe_in_frames, in_frames, __ATOMIC_RELAXED);
+
+    if (! pipe_push (0, block, pipe_serial))
+        __atomic_sub_fetch (& pipe_in_frames, in_frames, __ATOMIC_RELAXED);
+
+    while (finish && pipe_finished == finished)
+        pthread_cond_wait (& pipe_cond, & pipe_mutex);
+
+    data = std::move (pipe_output);
+
+    pthread_mutex_unlock (& pipe_mutex);
+    return data;
+}
+
+/* assumes mutex, pipe_stages.len (); discards everything in the pipeline */
+static void pipe_discard ()
+{
+    pthread_mutex_lock (& pipe_mutex);
+
+    pipe_serial ++;
+
+    for (auto & s : pipe_stages)
+    {
+        for (int i = 0; i < s->queue_len; i ++)
+            s->queue[(s->queue_head + i) % PIPE_DEPTH].data.clear ();
+
+        s->queue_len = 0;
+    }
+
+    pthread_cond_broadcast (& pipe_cond);
+
+    /* blocks being processed are dropped when the stage tries to pass them on */
+    for (auto & s : pipe_stages)
+    {
+        while (s->busy)
+            pthread_cond_wait (& pipe_cond, & pipe_mutex);
+    }
+
+    pipe_output.clear ();
+    __atomic_store_n (& pipe_in_frames, 0, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock (& pipe_mutex);
+}
+
+int effect_pipeline_latency ()
+{
+    int64_t frames = __atomic_load_n (& pipe_in_frames, __ATOMIC_RELAXED);
+    int rate = __atomic_load_n (& input_rate, __ATOMIC_RELAXED);
+    return rate ? aud::rescale<int64_t> (frames, rate, 1000) : 0;
+}
 
 void effect_start (int & channels, int & rate)
 {
@@ -46,10 +356,13 @@ void effect_start (int & channels, int & rate)
 
     AUDDBG ("Starting effects.\n");
 
+    if (pipe_stages.len ())
+        pipe_stop ();
+
     effects.clear ();
 
     input_channels = channels;
-    input_rate = rate;
+    __atomic_store_n (& input_rate, rate, __ATOMIC_RELAXED);
 
     auto & list = aud_plugin_list (PluginType::Effect);
 
@@ -78,13 +391,42 @@ void effect_start (int & channels, int & rate)
         effects.append (effect);
     }
 
+    if (use_pipeline () && effects.head ())
+    {
+        AUDINFO ("Starting effect pipeline.\n");
+        pipe_start ();
+    }
+
+    update_active ();
+    update_delay ();
+    pthread_mutex_unlock (& mutex);
+}
+
+void effect_cleanup ()
+{
+    pthread_mutex_lock (& mutex);
+
+    if (pipe_stages.len ())
+        pipe_stop ();
+
+    effects.clear ();
+    update_active ();
+    update_delay ();
+
     pthread_mutex_unlock (& mutex);
 }
 
 Index<float> & effect_process (Index<float> & data)
 {
     Index<float> * cur = & data;
-    pthread_mutex_lock (& mutex);
+    rt_lock (& mutex);
+
+    if (pipe_stages.len ())
+    {
+        cur = & pipe_process (data, false, false);
+        pthread_mutex_unlock (& mutex);
+        return * cur;
+    }
 
     Effect * e = effects.head ();
     while (e)
@@ -113,6 +455,8 @@ Index<float> & effect_process (Index<float> & data)
         e = next;
     }
 
+    update_active ();
+    update_delay ();
     pthread_mutex_unlock (& mutex);
     return * cur;
 }
@@ -122,6 +466,10 @@ bool effect_flush (bool force)
     bool flushed = true;
     pthread_mutex_lock (& mutex);
 
+    /* audio still between stages predates the seek */
+    if (pipe_stages.len ())
+        pipe_discard ();
+
     for (Effect * e = effects.head (); e; e = effects.next (e))
     {
         if (! e->header->flush (force) && ! force)
@@ -131,6 +479,11 @@ bool effect_flush (bool force)
         }
     }
 
+    /* the stages are idle until the next block is queued */
+    for (auto & s : pipe_stages)
+        __atomic_store_n (& s->delay, measure_delay (s->effect->header), __ATOMIC_RELAXED);
+
+    update_delay ();
     pthread_mutex_unlock (& mutex);
     return flushed;
 }
@@ -138,24 +491,35 @@ bool effect_flush (bool force)
 Index<float> & effect_finish (Index<float> & data, bool end_of_playlist)
 {
     Index<float> * cur = & data;
-    pthread_mutex_lock (& mutex);
+    rt_lock (& mutex);
+
+    if (pipe_stages.len ())
+    {
+        cur = & pipe_process (data, true, end_of_playlist);
+        pthread_mutex_unlock (& mutex);
+        return * cur;
+    }
 
     for (Effect * e = effects.head (); e; e = effects.next (e))
         cur = & e->header->finish (* cur, end_of_playlist);
 
+    update_delay ();
     pthread_mutex_unlock (& mutex);
     return * cur;
 }
 
+/* takes no locks; see chain_delay */
 int effect_adjust_delay (int delay)
 {
-    pthread_mutex_lock (& mutex);
-
-    for (Effect * e = effects.tail (); e; e = effects.prev (e))
-        delay = e->header->adjust_delay (delay);
+    delay = apply_delay (__atomic_load_n (& chain_delay, __ATOMIC_RELAXED), delay);
+    return delay + effect_pipeline_latency ();
+}
 
-    pthread_mutex_unlock (& mutex);
-    return delay;
+/* includes effects that have been removed but not yet finished; takes no
+ * locks, so that the output can check it for every buffer */
+bool effect_active ()
+{
+    return __atomic_load_n (& have_effects, __ATOMIC_RELAXED);
 }
 
 static void effect_insert (PluginHandle * plugin, EffectPlugin * header)
@@ -223,19 +587,25 @@ static void effect_remove (PluginHandle * plugin)
 
 static void effect_enable (PluginHandle * plugin, EffectPlugin * ep, bool enable)
 {
-    if (ep->preserves_format)
-    {
-        pthread_mutex_lock (& mutex);
+    pthread_mutex_lock (& mutex);
 
+    /* the pipeline can only be built or rebuilt by a reset */
+    if (ep->preserves_format && ! pipe_stages.len () && ! use_pipeline ())
+    {
         if (enable)
             effect_insert (plugin, ep);
         else
             effect_remove (plugin);
 
+        update_active ();
+        update_delay ();
+
         pthread_mutex_unlock (& mutex);
     }
     else
     {
+        pthread_mutex_unlock (& mutex);
+
         AUDDBG ("Reset to add/remove %s.\n", aud_plugin_get_name (plugin));
         aud_output_reset (OutputReset::EffectsOnly);
     }
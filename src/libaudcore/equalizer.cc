@@ -28,7 +28,6 @@
 
 #include <assert.h>
 #include <math.h>
-#include <pthread.h>
 #include <string.h>
 
 #include "audio.h"
@@ -47,13 +46,48 @@
 static const float CF[AUD_EQ_NBANDS] = {31.25f, 62.5f, 125, 250, 500, 1000,
  2000, 4000, 8000, 16000};
 
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-static bool active;
+/* The filter state is kept in structure-of-arrays form: each vector holds the
+ * same quantity for EQ_LANES consecutive channels, so that all the channels of
+ * a frame are filtered at once.  The arithmetic in each lane is exactly that of
+ * the original one-channel-at-a-time filter. */
+typedef float EqVec __attribute__ ((vector_size (16)));
+
+#define EQ_LANES (int) (sizeof (EqVec) / sizeof (float))
+#define EQ_MAX_VECS ((AUD_MAX_CHANNELS + EQ_LANES - 1) / EQ_LANES)
+
+static_assert (EQ_MAX_VECS <= 3, "eq_filter() needs to be extended");
+
+/* Length of the gain ramp applied when the settings change (milliseconds) */
+#define RAMP_TIME 20
+
+/* The gains are computed in the main thread and handed to the audio thread
+ * through a lock-free triple buffer, so that neither side ever blocks.  The
+ * main thread fills the "back" slot and swaps it with the shared slot, setting
+ * SLOT_DIRTY; at the start of each buffer, the audio thread swaps its "front"
+ * slot with the shared slot if SLOT_DIRTY is set. */
+struct EqGains {
+    bool active;
+    float g[AUD_EQ_NBANDS]; /* Gain factor for each band */
+};
+
+#define SLOT_DIRTY 4
+
+static EqGains slots[3];
+static int back_slot = 0; /* main thread only */
+static int shared_slot = 1;
+static int front_slot = 2; /* audio thread only */
+
+/* The remaining state belongs to the audio thread.  eq_set_format() and
+ * eq_filter() are both called from output.cc with its locks held, so they do
+ * not need any locking of their own. */
+static bool active, want_active;
 static int channels, rate;
 static float a[AUD_EQ_NBANDS][2]; /* A weights */
 static float b[AUD_EQ_NBANDS][2]; /* B weights */
-static float wqv[AUD_MAX_CHANNELS][AUD_EQ_NBANDS][2]; /* Circular buffer for W data */
-static float gv[AUD_MAX_CHANNELS][AUD_EQ_NBANDS]; /* Gain factor for each channel and band */
+static EqVec wqv[AUD_EQ_NBANDS][2][EQ_MAX_VECS]; /* Circular buffer for W data */
+static float gv[AUD_EQ_NBANDS]; /* Gain factor currently applied */
+static float gv_target[AUD_EQ_NBANDS]; /* Gain factor at end of ramp */
+static int ramp_frames; /* Frames left in ramp */
 static int K; /* Number of used EQ bands */
 
 /* 2nd order band-pass filter design */
@@ -68,10 +102,52 @@ static void bp2 (float *a, float *b, float fc)
     b[1] = -1.005f;
 }
 
-void eq_set_format (int new_channels, int new_rate)
+/* main thread */
+static void publish_gains ()
+{
+    int prev = __atomic_exchange_n (& shared_slot, back_slot | SLOT_DIRTY, __ATOMIC_ACQ_REL);
+    back_slot = prev & ~SLOT_DIRTY;
+}
+
+/* audio thread; returns nullptr if nothing new was published */
+static const EqGains * fetch_gains ()
+{
+    if (! (__atomic_load_n (& shared_slot, __ATOMIC_ACQUIRE) & SLOT_DIRTY))
+        return nullptr;
+
+    int prev = __atomic_exchange_n (& shared_slot, front_slot, __ATOMIC_ACQ_REL);
+    front_slot = prev & ~SLOT_DIRTY;
+    return & slots[front_slot];
+}
+
+/* audio thread */
+static void apply_gains (const EqGains * gains, bool ramp)
 {
-    pthread_mutex_lock (& mutex);
+    want_active = gains->active;
+
+    for (int k = 0; k < AUD_EQ_NBANDS; k ++)
+        gv_target[k] = want_active ? gains->g[k] : 0;
+
+    /* start from zero gain (no effect) with a clean state */
+    if (want_active && ! active)
+    {
+        active = true;
+        memset (wqv, 0, sizeof wqv);
+        memset (gv, 0, sizeof gv);
+    }
+
+    if (ramp)
+        ramp_frames = aud::max (1, rate * RAMP_TIME / 1000);
+    else
+    {
+        memcpy (gv, gv_target, sizeof gv);
+        ramp_frames = 0;
+        active = want_active;
+    }
+}
 
+void eq_set_format (int new_channels, int new_rate)
+{
     channels = new_channels;
     rate = new_rate;
 
@@ -87,82 +163,205 @@ void eq_set_format (int new_channels, int new_rate)
         bp2 (a[k], b[k], CF[k] / (float) rate);
 
     /* Reset state */
-    memset (wqv[0][0], 0, sizeof wqv);
+    memset (wqv, 0, sizeof wqv);
 
-    pthread_mutex_unlock (& mutex);
+    /* Pick up the current settings without ramping */
+    const EqGains * gains = fetch_gains ();
+    apply_gains (gains ? gains : & slots[front_slot], false);
 }
 
 static void eq_set_bands_real (double preamp, double *values)
 {
+    EqGains & gains = slots[back_slot];
     float adj[AUD_EQ_NBANDS];
 
     for (int i = 0; i < AUD_EQ_NBANDS; i ++)
         adj[i] = preamp + values[i];
 
-    for (int c = 0; c < AUD_MAX_CHANNELS; c ++)
+    for (int i = 0; i < AUD_EQ_NBANDS; i ++)
+        gains.g[i] = powf (10, adj[i] / 20) - 1;
+}
+
+/* With only one or two channels, most of the vector lanes would be wasted, so
+ * it is faster to filter each channel separately.  If RAMP is set, the gains
+ * are moved by <step> per frame. */
+template<bool RAMP>
+static void eq_filter_channel (float *data, int frames, int channel, const float *step)
+{
+    int v = channel / EQ_LANES, l = channel % EQ_LANES;
+    float *end = data + frames * channels;
+    float g[AUD_EQ_NBANDS];
+
+    memcpy (g, gv, sizeof g);
+
+    for (float *f = data + channel; f < end; f += channels)
     {
-        for (int i = 0; i < AUD_EQ_NBANDS; i ++)
-            gv[c][i] = powf (10, adj[i] / 20) - 1;
+        float yt = *f; /* Current input sample */
+
+        for (int k = 0; k < K; k ++) /* Frequency band index */
+        {
+            float *wq0 = & wqv[k][0][v][l], *wq1 = & wqv[k][1][v][l];
+
+            if (RAMP)
+                g[k] += step[k];
+
+            /* Calculate output from AR part of current filter */
+            float w = yt * b[k][0] + *wq0 * a[k][0] + *wq1 * a[k][1];
+
+            /* Calculate output from MA part of current filter */
+            yt += (w + *wq1 * b[k][1]) * g[k];
+
+            /* Update circular buffer */
+            *wq1 = *wq0;
+            *wq0 = w;
+        }
+
+        /* Calculate output */
+        *f = yt;
     }
 }
 
-void eq_filter (float *data, int samples)
+/* NV is the number of vectors needed to hold one frame */
+template<int NV, bool RAMP>
+static void eq_filter_frames (float *data, int frames, const float *step)
 {
-    int channel;
+    EqVec w0[AUD_EQ_NBANDS][NV], w1[AUD_EQ_NBANDS][NV];
+    float g[AUD_EQ_NBANDS];
+    float *end = data + frames * channels;
 
-    pthread_mutex_lock (& mutex);
-
-    if (! active)
+    /* Work on local copies so that the compiler knows they are not aliased by
+     * the audio data */
+    for (int k = 0; k < K; k ++)
     {
-        pthread_mutex_unlock (& mutex);
-        return;
+        for (int v = 0; v < NV; v ++)
+        {
+            w0[k][v] = wqv[k][0][v];
+            w1[k][v] = wqv[k][1][v];
+        }
     }
 
-    for (channel = 0; channel < channels; channel ++)
+    memcpy (g, gv, sizeof g);
+
+    for (float *f = data; f < end; f += channels)
     {
-        float *g = gv[channel]; /* Gain factor */
-        float *end = data + samples;
-        float *f;
+        union {
+            EqVec vec[NV];
+            float flt[NV * EQ_LANES];
+        } yt = {}; /* Current input frame, unused lanes zeroed */
 
-        for (f = data + channel; f < end; f += channels)
+        memcpy (yt.flt, f, sizeof (float) * channels);
+
+        for (int k = 0; k < K; k ++) /* Frequency band index */
         {
-            int k; /* Frequency band index */
-            float yt = *f; /* Current input sample */
+            if (RAMP)
+                g[k] += step[k];
 
-            for (k = 0; k < K; k ++)
+            for (int v = 0; v < NV; v ++)
             {
-                /* Pointer to circular buffer wq */
-                float *wq = wqv[channel][k];
                 /* Calculate output from AR part of current filter */
-                float w = yt * b[k][0] + wq[0] * a[k][0] + wq[1] * a[k][1];
+                EqVec w = yt.vec[v] * b[k][0] + w0[k][v] * a[k][0] + w1[k][v] * a[k][1];
 
                 /* Calculate output from MA part of current filter */
-                yt += (w + wq[1] * b[k][1]) * g[k];
+                yt.vec[v] += (w + w1[k][v] * b[k][1]) * g[k];
 
                 /* Update circular buffer */
-                wq[1] = wq[0];
-                wq[0] = w;
+                w1[k][v] = w0[k][v];
+                w0[k][v] = w;
             }
+        }
 
-            /* Calculate output */
-            *f = yt;
+        /* Calculate output */
+        memcpy (f, yt.flt, sizeof (float) * channels);
+    }
+
+    for (int k = 0; k < K; k ++)
+    {
+        for (int v = 0; v < NV; v ++)
+        {
+            wqv[k][0][v] = w0[k][v];
+            wqv[k][1][v] = w1[k][v];
         }
     }
+}
 
-    pthread_mutex_unlock (& mutex);
+template<bool RAMP>
+static void eq_filter_block (float *data, int frames, const float *step)
+{
+    if (channels < 3)
+    {
+        for (int channel = 0; channel < channels; channel ++)
+            eq_filter_channel<RAMP> (data, frames, channel, step);
+    }
+    else
+    {
+        switch ((channels + EQ_LANES - 1) / EQ_LANES)
+        {
+            case 1: eq_filter_frames<1, RAMP> (data, frames, step); break;
+            case 2: eq_filter_frames<2, RAMP> (data, frames, step); break;
+            case 3: eq_filter_frames<3, RAMP> (data, frames, step); break;
+        }
+    }
 }
 
-static void eq_update (void *data, void *user)
+void eq_filter (float *data, int samples)
 {
-    pthread_mutex_lock (& mutex);
+    /* pick up new settings at buffer boundaries only */
+    const EqGains * gains = fetch_gains ();
+    if (gains)
+        apply_gains (gains, true);
+
+    if (! active)
+        return;
 
-    active = aud_get_bool (nullptr, "equalizer_active");
+    int frames = samples / channels;
 
+    if (ramp_frames > 0)
+    {
+        int ramp = aud::min (frames, ramp_frames);
+        float step[AUD_EQ_NBANDS];
+
+        for (int k = 0; k < AUD_EQ_NBANDS; k ++)
+            step[k] = (gv_target[k] - gv[k]) / ramp_frames;
+
+        eq_filter_block<true> (data, ramp, step);
+
+        ramp_frames -= ramp;
+
+        for (int k = 0; k < AUD_EQ_NBANDS; k ++)
+            gv[k] = ramp_frames ? gv[k] + step[k] * ramp : gv_target[k];
+
+        if (! ramp_frames && ! want_active)
+        {
+            active = false;
+            return;
+        }
+
+        data += ramp * channels;
+        frames -= ramp;
+    }
+
+    eq_filter_block<false> (data, frames, nullptr);
+}
+
+/* audio thread; lets the caller skip eq_filter() entirely while bypassed */
+bool eq_active ()
+{
+    const EqGains * gains = fetch_gains ();
+    if (gains)
+        apply_gains (gains, true);
+
+    return active;
+}
+
+/* main thread */
+static void eq_update (void *data, void *user)
+{
     double values[AUD_EQ_NBANDS];
     aud_eq_get_bands (values);
     eq_set_bands_real (aud_get_double (nullptr, "equalizer_preamp"), values);
 
-    pthread_mutex_unlock (& mutex);
+    slots[back_slot].active = aud_get_bool (nullptr, "equalizer_active");
+    publish_gains ();
 }
 
 void eq_init ()
@@ -17,106 +17,526 @@
  * the use of this software.
  */
 
+#include "fft.h"
 #include "internal.h"
 
-#include <complex>
 #include <math.h>
+#include <pthread.h>
+#include <string.h>
 
-#define TWO_PI 6.2831853f
+#include <utility>
 
-#define N 512                         /* size of the DFT */
-#define LOGN 9                        /* log N (base 2) */
+#include "runtime.h"
 
-typedef std::complex<float> Complex;
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define USE_X86_SIMD
+#include <immintrin.h>
+#endif
 
-static float hamming[N];              /* hamming window, scaled to sum to 1 */
-static int reversed[N];               /* bit-reversal table */
-static Complex roots[N / 2];          /* N-th roots of unity */
-static char generated = 0;            /* set if tables have been generated */
+/*
+ * A real signal of N samples is transformed by treating it as a complex
+ * signal of M = N/2 points (even samples as real parts, odd samples as
+ * imaginary parts), doing an M-point complex FFT, and separating the spectra
+ * of the even and odd samples afterward ("post-processing").  forward2()
+ * instead treats the two real signals as the real and imaginary parts of one
+ * N-point complex signal and separates their spectra in the same way.
+ *
+ * The complex FFT is a radix-2 Stockham FFT.  Each pass reads one pair of
+ * buffers (real and imaginary parts) and writes the other, so the output ends
+ * up in natural order without a bit-reversal step, and both reads and writes
+ * are sequential.  Pass s (s = 1, 2, 4, ... M/2) does M/2 butterflies on
+ * pairs of points M/2 apart, and interleaves the results in blocks of s:
+ *
+ *   y[q + 2sp]     = x[q + sp] + x[q + sp + M/2]
+ *   y[q + 2sp + s] = (x[q + sp] - x[q + sp + M/2]) * w[sp]
+ *
+ * where p < M/(2s), q < s, and w[j] = exp(-2 pi i j / M).  The SIMD versions
+ * vectorize the inner loop (over q) when s is large enough, and the outer loop
+ * (over p) with shuffles for s = 1 and s = 2.
+ *
+ * The inverse complex FFT is done by swapping the real and imaginary parts of
+ * the input and output.
+ */
 
-/* Reverse the order of the lowest LOGN bits in an integer. */
+#define MIN_ORDER 9
+#define MAX_ORDER 13
 
-static int bit_reverse (int x)
+static_assert (FFT_MIN_SIZE == 1 << MIN_ORDER && FFT_MAX_SIZE == 1 << MAX_ORDER,
+ "FFT size limits do not match");
+
+struct FFTPlan
 {
-    int y = 0;
+    int size;  /* N */
+
+    /* twiddle factors w[j], j < M/2, for M = N/2 (half) and M = N (full) */
+    const float * half_re, * half_im;
+    const float * full_re, * full_im;
+
+    /* exp(-2 pi i k / N), k <= N/4, for post-processing */
+    const float * post_re, * post_im;
+
+    /* Hamming window of N points, for intensity() */
+    const float * window;
+
+    Index<float> tables;
+};
 
-    for (int n = LOGN; n --; )
+static FFTPlan * plans[MAX_ORDER - MIN_ORDER + 1];
+static pthread_mutex_t plans_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* fills re[j] + i im[j] = exp(-2 pi i j / n), j < count */
+static void fill_roots (float * re, float * im, int n, int count)
+{
+    for (int j = 0; j < count; j ++)
     {
-        y = (y << 1) | (x & 1);
-        x >>= 1;
+        double angle = 2 * M_PI * j / n;
+        re[j] = cos (angle);
+        im[j] = -sin (angle);
     }
+}
+
+static FFTPlan * create_plan (int order)
+{
+    int n = 1 << order;
+    auto plan = new FFTPlan ();
+
+    plan->size = n;
+    plan->tables.resize (n / 2 + n + 2 * (n / 4 + 1) + n);
+
+    float * p = plan->tables.begin ();
+    fill_roots (p, p + n / 4, n / 2, n / 4);
+    fill_roots (p + n / 2, p + n, n, n / 2);
+    fill_roots (p + 3 * n / 2, p + 3 * n / 2 + n / 4 + 1, n, n / 4 + 1);
+
+    plan->half_re = p;
+    plan->half_im = p + n / 4;
+    plan->full_re = p + n / 2;
+    plan->full_im = p + n;
+    plan->post_re = p + 3 * n / 2;
+    plan->post_im = p + 3 * n / 2 + n / 4 + 1;
+
+    float * window = p + 3 * n / 2 + 2 * (n / 4 + 1);
+    for (int j = 0; j < n; j ++)
+        window[j] = 1 - 0.85f * cosf (j * (2 * (float) M_PI / n));
+
+    plan->window = window;
 
-    return y;
+    return plan;
 }
 
-/* Generate lookup tables. */
+static const FFTPlan * get_plan (int size)
+{
+    int order = MIN_ORDER;
+    while (order < MAX_ORDER && size > 1 << order)
+        order ++;
+
+    if (size != 1 << order)
+    {
+        AUDERR ("Unsupported FFT size: %d\n", size);
+        return nullptr;
+    }
+
+    FFTPlan * & slot = plans[order - MIN_ORDER];
+    FFTPlan * plan = __atomic_load_n (& slot, __ATOMIC_ACQUIRE);
+
+    if (! plan)
+    {
+        pthread_mutex_lock (& plans_mutex);
+
+        if (! (plan = slot))
+        {
+            plan = create_plan (order);
+            __atomic_store_n (& slot, plan, __ATOMIC_RELEASE);
+        }
 
-static void generate_tables ()
+        pthread_mutex_unlock (& plans_mutex);
+    }
+
+    return plan;
+}
+
+void fft_cleanup ()
 {
-    if (generated)
-        return;
+    for (FFTPlan * & plan : plans)
+    {
+        delete plan;
+        plan = nullptr;
+    }
+}
 
-    for (int n = 0; n < N; n ++)
-        hamming[n] = 1 - 0.85f * cosf (n * (TWO_PI / N));
-    for (int n = 0; n < N; n ++)
-        reversed[n] = bit_reverse (n);
-    for (int n = 0; n < N / 2; n ++)
-        roots[n] = exp (Complex (0, n * (TWO_PI / N)));
+/* ---- complex FFT passes ---- */
 
-    generated = 1;
+typedef void (* PassFunc) (int m, int s, const float * xr, const float * xi,
+ float * yr, float * yi, const float * wr, const float * wi);
+
+/* m = M/(2s) is the number of blocks in the pass */
+static void pass_scalar (int m, int s, const float * xr, const float * xi,
+ float * yr, float * yi, const float * wr, const float * wi)
+{
+    int half = m * s;
+
+    for (int p = 0; p < m; p ++)
+    {
+        float c = wr[s * p], d = wi[s * p];
+
+        for (int q = 0; q < s; q ++)
+        {
+            int i = q + s * p, o = q + 2 * s * p;
+
+            float ar = xr[i], ai = xi[i];
+            float br = xr[i + half], bi = xi[i + half];
+            float tr = ar - br, ti = ai - bi;
+
+            yr[o] = ar + br;
+            yi[o] = ai + bi;
+            yr[o + s] = tr * c - ti * d;
+            yi[o + s] = tr * d + ti * c;
+        }
+    }
 }
 
-/* Perform the DFT using the Cooley-Tukey algorithm.  At each step s, where
- * s=1..log N (base 2), there are N/(2^s) groups of intertwined butterfly
- * operations.  Each group contains (2^s)/2 butterflies, and each butterfly has
- * a span of (2^s)/2.  The twiddle factors are nth roots of unity where n = 2^s. */
+#ifdef USE_X86_SIMD
+
+#define SSE2_FUNC __attribute__ ((target ("sse2")))
+#define AVX2_FUNC __attribute__ ((target ("avx2")))
+
+/* returns the sums and the rotated differences of a and b */
+SSE2_FUNC static inline void butterfly_sse2 (__m128 ar, __m128 ai, __m128 br,
+ __m128 bi, __m128 c, __m128 d, __m128 & sr, __m128 & si, __m128 & dr, __m128 & di)
+{
+    __m128 tr = _mm_sub_ps (ar, br), ti = _mm_sub_ps (ai, bi);
+
+    sr = _mm_add_ps (ar, br);
+    si = _mm_add_ps (ai, bi);
+    dr = _mm_sub_ps (_mm_mul_ps (tr, c), _mm_mul_ps (ti, d));
+    di = _mm_add_ps (_mm_mul_ps (tr, d), _mm_mul_ps (ti, c));
+}
 
-static void do_fft (Complex a[N])
+SSE2_FUNC static void pass_sse2 (int m, int s, const float * xr, const float * xi,
+ float * yr, float * yi, const float * wr, const float * wi)
 {
-    int half = 1;       /* (2^s)/2 */
-    int inv = N / 2;    /* N/(2^s) */
+    int half = m * s;
+    __m128 sr, si, dr, di;
+
+    if (s == 1)
+    {
+        /* four blocks at a time; the results are interleaved */
+        for (int p = 0; p < m; p += 4)
+        {
+            butterfly_sse2 (_mm_loadu_ps (xr + p), _mm_loadu_ps (xi + p),
+             _mm_loadu_ps (xr + p + half), _mm_loadu_ps (xi + p + half),
+             _mm_loadu_ps (wr + p), _mm_loadu_ps (wi + p), sr, si, dr, di);
+
+            _mm_storeu_ps (yr + 2 * p, _mm_unpacklo_ps (sr, dr));
+            _mm_storeu_ps (yr + 2 * p + 4, _mm_unpackhi_ps (sr, dr));
+            _mm_storeu_ps (yi + 2 * p, _mm_unpacklo_ps (si, di));
+            _mm_storeu_ps (yi + 2 * p + 4, _mm_unpackhi_ps (si, di));
+        }
+    }
+    else if (s == 2)
+    {
+        /* two blocks at a time; w[2p] and w[2p + 2] are each used twice */
+        for (int p = 0; p < m; p += 2)
+        {
+            __m128 c = _mm_loadu_ps (wr + 2 * p), d = _mm_loadu_ps (wi + 2 * p);
+            c = _mm_shuffle_ps (c, c, _MM_SHUFFLE (2, 2, 0, 0));
+            d = _mm_shuffle_ps (d, d, _MM_SHUFFLE (2, 2, 0, 0));
+
+            butterfly_sse2 (_mm_loadu_ps (xr + 2 * p), _mm_loadu_ps (xi + 2 * p),
+             _mm_loadu_ps (xr + 2 * p + half), _mm_loadu_ps (xi + 2 * p + half),
+             c, d, sr, si, dr, di);
 
-    /* loop through steps */
-    while (inv)
+            _mm_storeu_ps (yr + 4 * p, _mm_movelh_ps (sr, dr));
+            _mm_storeu_ps (yr + 4 * p + 4, _mm_movehl_ps (dr, sr));
+            _mm_storeu_ps (yi + 4 * p, _mm_movelh_ps (si, di));
+            _mm_storeu_ps (yi + 4 * p + 4, _mm_movehl_ps (di, si));
+        }
+    }
+    else
     {
-        /* loop through groups */
-        for (int g = 0; g < N; g += half << 1)
+        for (int p = 0; p < m; p ++)
         {
-            /* loop through butterflies */
-            for (int b = 0, r = 0; b < half; b ++, r += inv)
+            __m128 c = _mm_set1_ps (wr[s * p]), d = _mm_set1_ps (wi[s * p]);
+
+            for (int q = 0; q < s; q += 4)
             {
-                Complex even = a[g + b];
-                Complex odd = roots[r] * a[g + half + b];
-                a[g + b] = even + odd;
-                a[g + half + b] = even - odd;
+                int i = q + s * p, o = q + 2 * s * p;
+
+                butterfly_sse2 (_mm_loadu_ps (xr + i), _mm_loadu_ps (xi + i),
+                 _mm_loadu_ps (xr + i + half), _mm_loadu_ps (xi + i + half),
+                 c, d, sr, si, dr, di);
+
+                _mm_storeu_ps (yr + o, sr);
+                _mm_storeu_ps (yi + o, si);
+                _mm_storeu_ps (yr + o + s, dr);
+                _mm_storeu_ps (yi + o + s, di);
             }
         }
+    }
+}
+
+AVX2_FUNC static void pass_avx2 (int m, int s, const float * xr, const float * xi,
+ float * yr, float * yi, const float * wr, const float * wi)
+{
+    if (s < 8)
+    {
+        pass_sse2 (m, s, xr, xi, yr, yi, wr, wi);
+        return;
+    }
+
+    int half = m * s;
+
+    for (int p = 0; p < m; p ++)
+    {
+        __m256 c = _mm256_set1_ps (wr[s * p]), d = _mm256_set1_ps (wi[s * p]);
+
+        for (int q = 0; q < s; q += 8)
+        {
+            int i = q + s * p, o = q + 2 * s * p;
+
+            __m256 ar = _mm256_loadu_ps (xr + i), ai = _mm256_loadu_ps (xi + i);
+            __m256 br = _mm256_loadu_ps (xr + i + half), bi = _mm256_loadu_ps (xi + i + half);
+            __m256 tr = _mm256_sub_ps (ar, br), ti = _mm256_sub_ps (ai, bi);
+
+            _mm256_storeu_ps (yr + o, _mm256_add_ps (ar, br));
+            _mm256_storeu_ps (yi + o, _mm256_add_ps (ai, bi));
+            _mm256_storeu_ps (yr + o + s, _mm256_sub_ps (_mm256_mul_ps (tr, c), _mm256_mul_ps (ti, d)));
+            _mm256_storeu_ps (yi + o + s, _mm256_add_ps (_mm256_mul_ps (tr, d), _mm256_mul_ps (ti, c)));
+        }
+    }
+}
+
+#endif // USE_X86_SIMD
 
-        half <<= 1;
-        inv >>= 1;
+static PassFunc get_pass_func ()
+{
+#ifdef USE_X86_SIMD
+    switch (audio_simd_get_level ())
+    {
+        case SimdLevel::AVX2: return pass_avx2;
+        case SimdLevel::SSE2: return pass_sse2;
+        default: break;
     }
+#endif
+
+    return pass_scalar;
 }
 
-/* Input is N=512 PCM samples.
- * Output is intensity of frequencies from 1 to N/2=256. */
+/* number of passes for an n-point FFT */
+static int count_passes (int n)
+{
+    int passes = 0;
+    while (n > 1 << passes)
+        passes ++;
+
+    return passes;
+}
 
-void calc_freq (const float data[N], float freq[N / 2])
+/* Does an n-point complex FFT of (ar, ai), using (br, bi) as the other
+ * buffer.  The result ends up in (ar, ai) if the number of passes is even and
+ * in (br, bi) if it is odd; callers arrange their input accordingly. */
+static void complex_fft (int n, const float * wr, const float * wi,
+ float * ar, float * ai, float * br, float * bi)
 {
-    generate_tables ();
+    PassFunc pass = get_pass_func ();
+
+    for (int s = 1; s < n; s <<= 1)
+    {
+        pass (n / (2 * s), s, ar, ai, br, bi, wr, wi);
+
+        std::swap (ar, br);
+        std::swap (ai, bi);
+    }
+}
+
+/* ---- real transforms ---- */
+
+/* work must hold N floats */
+static void real_forward (const FFTPlan * plan, const float * in,
+ float * re, float * im, float * work)
+{
+    int m = plan->size / 2;
+
+    /* pack so that the result of the FFT ends up in (re, im) */
+    bool odd = count_passes (m) & 1;
+    float * zr = odd ? work : re;
+    float * zi = odd ? work + m : im;
+
+    for (int k = 0; k < m; k ++)
+    {
+        zr[k] = in[2 * k];
+        zi[k] = in[2 * k + 1];
+    }
+
+    if (odd)
+        complex_fft (m, plan->half_re, plan->half_im, work, work + m, re, im);
+    else
+        complex_fft (m, plan->half_re, plan->half_im, re, im, work, work + m);
+
+    /* separate the spectra of the even (e) and odd (o) samples; the pairs k
+     * and m - k are done together, so that this can be done in place */
+    float z0 = re[0];
+    re[0] = z0 + im[0];
+    re[m] = z0 - im[0];
+    im[0] = im[m] = 0;
+
+    for (int k = 1; k <= m / 2; k ++)
+    {
+        float ar = re[k], ai = im[k];
+        float br = re[m - k], bi = im[m - k];
+        float c = plan->post_re[k], d = plan->post_im[k];
+
+        float er = 0.5f * (ar + br), ei = 0.5f * (ai - bi);
+        float or_ = 0.5f * (ai + bi), oi = -0.5f * (ar - br);
+        float tr = or_ * c - oi * d, ti = or_ * d + oi * c;
+
+        re[k] = er + tr;
+        im[k] = ei + ti;
+        re[m - k] = er - tr;
+        im[m - k] = ti - ei;
+    }
+}
+
+RealFFT::RealFFT (int size) :
+    m_size (size),
+    m_plan (get_plan (size))
+{
+    m_work.resize (size);
+}
+
+void RealFFT::forward (const float * in, float * re, float * im)
+{
+    real_forward (m_plan, in, re, im, m_work.begin ());
+}
+
+void RealFFT::forward2 (const float * in1, const float * in2, float * re1,
+ float * im1, float * re2, float * im2)
+{
+    int n = m_size;
+
+    if (m_work.len () < 4 * n)
+        m_work.resize (4 * n);
+
+    float * ar = m_work.begin (), * ai = ar + n;
+    float * br = ai + n, * bi = br + n;
 
-    /* input is filtered by a Hamming window */
-    /* input values are in bit-reversed order */
-    Complex a[N];
-    for (int n = 0; n < N; n ++)
-        a[reversed[n]] = data[n] * hamming[n];
+    memcpy (ar, in1, sizeof (float) * n);
+    memcpy (ai, in2, sizeof (float) * n);
 
-    do_fft (a);
+    complex_fft (n, m_plan->full_re, m_plan->full_im, ar, ai, br, bi);
 
-    /* output values are divided by N */
-    /* frequencies from 1 to N/2-1 are doubled */
-    for (int n = 0; n < N / 2 - 1; n ++)
-        freq[n] = 2 * abs (a[1 + n]) / N;
+    if (count_passes (n) & 1)
+    {
+        std::swap (ar, br);
+        std::swap (ai, bi);
+    }
+
+    /* Z[k] = X1[k] + i X2[k], and since X1 and X2 are spectra of real
+     * signals, conj (Z[n - k]) = X1[k] - i X2[k] */
+    for (int k = 0; k <= n / 2; k ++)
+    {
+        int j = (n - k) & (n - 1);
+        float zr = ar[k], zi = ai[k], yr = ar[j], yi = ai[j];
+
+        re1[k] = 0.5f * (zr + yr);
+        im1[k] = 0.5f * (zi - yi);
+        re2[k] = 0.5f * (zi + yi);
+        im2[k] = -0.5f * (zr - yr);
+    }
+}
+
+void RealFFT::inverse (const float * re, const float * im, float * out)
+{
+    int m = m_size / 2;
+    float * ar = m_work.begin (), * ai = ar + m;
+    float * br = out, * bi = out + m;
+
+    /* pack the spectrum so that the result of the FFT ends up in the work
+     * buffer; the real and imaginary parts are swapped (see above) */
+    bool odd = count_passes (m) & 1;
+    float * zr = odd ? br : ar;
+    float * zi = odd ? bi : ai;
+
+    zr[0] = re[0] + re[m];
+    zi[0] = re[0] - re[m];
+
+    for (int k = 1; k <= m / 2; k ++)
+    {
+        float xr = re[k], xi = im[k];
+        float yr = re[m - k], yi = im[m - k];
+        float c = m_plan->post_re[k], d = m_plan->post_im[k];
+
+        float er = xr + yr, ei = xi - yi;
+        float dr = xr - yr, di = xi + yi;
+        float or_ = dr * c + di * d, oi = di * c - dr * d;
+
+        zr[k] = er - oi;
+        zi[k] = ei + or_;
+        zr[m - k] = er + oi;
+        zi[m - k] = or_ - ei;
+    }
+
+    if (odd)
+        complex_fft (m, m_plan->half_re, m_plan->half_im, bi, br, ai, ar);
+    else
+        complex_fft (m, m_plan->half_re, m_plan->half_im, ai, ar, bi, br);
+
+    for (int k = 0; k < m; k ++)
+    {
+        out[2 * k] = ar[k];
+        out[2 * k + 1] = ai[k];
+    }
+}
+
+/* ---- intensity ---- */
+
+/* output values are divided by N; frequencies from 1 to N/2-1 are doubled,
+ * while frequency N/2 is not */
+static void calc_intensity (int n, const float * re, const float * im,
+ float * out)
+{
+    for (int k = 0; k < n / 2 - 1; k ++)
+        out[k] = 2 * sqrtf (re[1 + k] * re[1 + k] + im[1 + k] * im[1 + k]) / n;
+
+    out[n / 2 - 1] = fabsf (re[n / 2]) / n;
+}
+
+void RealFFT::intensity (const float * in, float * out)
+{
+    int n = m_size;
+
+    if (m_scratch.len () < 2 * n + 2)
+        m_scratch.resize (2 * n + 2);
+
+    float * windowed = m_scratch.begin ();
+    float * re = windowed + n, * im = re + n / 2 + 1;
+
+    for (int j = 0; j < n; j ++)
+        windowed[j] = in[j] * m_plan->window[j];
+
+    forward (windowed, re, im);
+    calc_intensity (n, re, im, out);
+}
+
+void RealFFT::intensity2 (const float * in1, const float * in2, float * out1,
+ float * out2)
+{
+    int n = m_size;
+
+    if (m_scratch.len () < 4 * n + 4)
+        m_scratch.resize (4 * n + 4);
+
+    float * windowed1 = m_scratch.begin (), * windowed2 = windowed1 + n;
+    float * re1 = windowed2 + n, * im1 = re1 + n / 2 + 1;
+    float * re2 = im1 + n / 2 + 1, * im2 = re2 + n / 2 + 1;
+
+    for (int j = 0; j < n; j ++)
+    {
+        windowed1[j] = in1[j] * m_plan->window[j];
+        windowed2[j] = in2[j] * m_plan->window[j];
+    }
 
-    /* frequency N/2 is not doubled */
-    freq[N / 2 - 1] = abs (a[N / 2]) / N;
+    forward2 (windowed1, windowed2, re1, im1, re2, im2);
+    calc_intensity (n, re1, im1, out1);
+    calc_intensity (n, re2, im2, out2);
 }
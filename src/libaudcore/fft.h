@@ -0,0 +1,72 @@
+/*
+ * fft.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_FFT_H
+#define LIBAUDCORE_FFT_H
+
+#include "index.h"
+
+/*
+ * RealFFT computes the discrete Fourier transform of real signals whose length
+ * is a power of two from FFT_MIN_SIZE to FFT_MAX_SIZE:
+ *  - forward() transforms <size> samples into the <size>/2 + 1 non-negative
+ *    frequencies, given as separate arrays of real and imaginary parts.
+ *  - forward2() transforms two signals (e.g. the channels of a stereo pair)
+ *    at the cost of one complex FFT of <size> points.
+ *  - inverse() undoes forward(), except that the result is multiplied by
+ *    <size> (no scaling is done in either direction).
+ *  - intensity() gives the magnitudes of frequencies 1/<size>, 2/<size>, ...,
+ *    1/2 of the sample rate (<size>/2 values), computed under a Hamming window
+ *    and scaled so that a full-scale sine wave has an intensity of about 1.
+ *    intensity2() does the same for two signals, using forward2().
+ * The input and output arrays must not overlap.  The twiddle factors for each
+ * size are computed once, on first use, and are then shared (read-only) by
+ * all RealFFT objects of that size in any thread.  Each RealFFT object has
+ * its own work buffers, so it must be used by only one thread at a time.
+ */
+
+#define FFT_MIN_SIZE 512
+#define FFT_MAX_SIZE 8192
+
+struct FFTPlan;
+
+class RealFFT
+{
+public:
+    explicit RealFFT (int size);
+
+    int size () const
+        { return m_size; }
+
+    void forward (const float * in, float * re, float * im);
+    void forward2 (const float * in1, const float * in2, float * re1,
+     float * im1, float * re2, float * im2);
+    void inverse (const float * re, const float * im, float * out);
+
+    void intensity (const float * in, float * out);
+    void intensity2 (const float * in1, const float * in2, float * out1,
+     float * out2);
+
+private:
+    int m_size;
+    const FFTPlan * m_plan;
+    Index<float> m_work, m_scratch;
+};
+
+#endif // LIBAUDCORE_FFT_H
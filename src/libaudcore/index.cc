@@ -84,6 +84,7 @@ EXPORT void * IndexBase::insert (int pos, int len)
             throw std::bad_alloc ();  /* nothing changed yet */
 
         __sync_add_and_fetch (& misc_bytes_allocated, new_size - m_size);
+        rt_audit_alloc ();
 
         m_data = new_data;
         m_size = new_size;
@@ -20,17 +20,21 @@
 #ifndef LIBAUDCORE_INTERNAL_H
 #define LIBAUDCORE_INTERNAL_H
 
+#include <pthread.h>
 #include <stdint.h>
 #include <sys/types.h>
 
+#include "audio.h"
 #include "index.h"
 #include "objects.h"
+#include "runtime.h"
 
 class InputPlugin;
 class Plugin;
 class PluginHandle;
 class VFSFile;
 class Tuple;
+class Visualizer;
 
 typedef bool (* DirForeachFunc) (const char * path, const char * basename, void * user);
 
@@ -45,6 +49,50 @@ void art_cleanup ();
 /* art-search.cc */
 String art_search (const char * filename);
 
+/* audio.cc */
+/* Describes the processing done in write_output(), after the effect plugins.
+ * The callbacks are optional; each is called once per block of data, with
+ * <offset> giving the position of the block (in samples) in the buffer. */
+struct AudioPostProcess
+{
+    typedef void (* TapFunc) (const float * data, int samples, int offset, void * user);
+
+    int channels;
+    bool equalizer;  /* apply eq_filter() */
+    bool convolver;  /* apply conv_process() */
+    bool volume;  /* multiply by factors[] */
+    bool soft_clip;  /* apply audio_soft_clip() (to within one ulp) */
+    int format;  /* convert to this format (no conversion for FMT_FLOAT) */
+    float factors[AUD_MAX_CHANNELS];
+
+    TapFunc before_eq, after_eq;
+    void * user;
+};
+
+bool audio_volume_factors (int channels, StereoVolume volume, float * factors);
+
+/* Runs all the stages over one cache-sized block at a time.  <out> is used
+ * only if conversion is needed and must hold FMT_SIZEOF (format) * samples
+ * bytes.  Specialized versions are compiled for every combination of stages. */
+void audio_post_process (const AudioPostProcess & pp, float * data, int samples, void * out);
+
+/* audio-simd.cc */
+enum class SimdLevel {
+    None,
+    SSE2,
+    AVX2,
+    NEON
+};
+
+SimdLevel audio_simd_detect ();
+SimdLevel audio_simd_get_level ();
+void audio_simd_set_level (SimdLevel level);  /* for testing */
+const char * audio_simd_level_name (SimdLevel level);
+
+/* these return the number of samples converted (always a prefix) */
+int audio_simd_from_int (const void * in, int format, float * out, int samples);
+int audio_simd_to_int (const float * in, void * out, int format, int samples);
+
 /* charset.cc */
 void chardet_init ();
 void chardet_cleanup ();
@@ -53,6 +101,82 @@ void chardet_cleanup ();
 void config_load ();
 void config_save ();
 void config_cleanup ();
+void config_update_handles (const char * name);
+
+/* Typed handle to a setting in the default section, for code that reads the
+ * setting often (e.g. once per audio buffer).  The value is cached and brought
+ * up to date by config_update_handles() whenever the setting is changed, so
+ * that get() is a single atomic load rather than a string lookup.  Handles are
+ * meant to be declared statically; get() returns zero/false until aud_init()
+ * has loaded the config. */
+class ConfigHandleBase
+{
+protected:
+    ConfigHandleBase (const char * name) :
+        m_name (name) {}
+
+    /* add() must be called by the constructor of the derived class and
+     * remove() by its destructor, since update() may be called in between */
+    void add ();
+    void remove ();
+
+    const char * name () const
+        { return m_name; }
+
+private:
+    const char * const m_name;
+    ConfigHandleBase * m_next = nullptr;
+
+    virtual void update () = 0;
+
+    friend void config_update_handles (const char * name);
+};
+
+template<class T>
+class ConfigHandle : public ConfigHandleBase
+{
+public:
+    ConfigHandle (const char * name) :
+        ConfigHandleBase (name)
+        { add (); }
+
+    ~ConfigHandle ()
+        { remove (); }
+
+    T get () const
+    {
+        T value;
+        __atomic_load (& m_value, & value, __ATOMIC_RELAXED);
+        return value;
+    }
+
+private:
+    T m_value = T ();
+
+    static void read (const char * name, bool & value)
+        { value = aud_get_bool (nullptr, name); }
+    static void read (const char * name, int & value)
+        { value = aud_get_int (nullptr, name); }
+    static void read (const char * name, double & value)
+        { value = aud_get_double (nullptr, name); }
+
+    void update ()
+    {
+        T value;
+        read (name (), value);
+        __atomic_store (& m_value, & value, __ATOMIC_RELAXED);
+    }
+};
+
+/* convolution.cc */
+void conv_init ();
+void conv_cleanup ();
+void conv_set_format (int new_channels, int new_rate);
+void conv_process (float * data, int samples);
+bool conv_active ();
+void conv_flush ();
+int conv_get_delay ();
+int conv_get_tail ();
 
 /* drct.cc */
 void record_init ();
@@ -64,6 +188,9 @@ Index<float> & effect_process (Index<float> & data);
 bool effect_flush (bool force);
 Index<float> & effect_finish (Index<float> & data, bool end_of_playlist);
 int effect_adjust_delay (int delay);
+bool effect_active ();
+int effect_pipeline_latency ();
+void effect_cleanup ();
 
 bool effect_plugin_start (PluginHandle * plugin);
 void effect_plugin_stop (PluginHandle * plugin);
@@ -73,12 +200,13 @@ void eq_init ();
 void eq_cleanup ();
 void eq_set_format (int new_channels, int new_rate);
 void eq_filter (float * data, int samples);
+bool eq_active ();
 
 /* eventqueue.cc */
 void event_queue_cancel_all ();
 
 /* fft.cc */
-void calc_freq (const float data[512], float freq[256]);
+void fft_cleanup ();
 
 /* hook.cc */
 void hook_cleanup ();
@@ -107,12 +235,41 @@ InputPlugin * load_input_plugin (PluginHandle * decoder, String * error = nullpt
 #define PROBE_FLAG_MIGHT_HAVE_SUBTUNES (1 << 1)
 int probe_by_filename (const char * filename);
 
+/* rtaudit.cc */
+/* In builds configured with --enable-rt-audit, heap allocations by Index (and
+ * by other code on the audio path that calls rt_audit_alloc()) and mutexes
+ * locked through rt_lock() are counted while a thread is between
+ * rt_audit_begin() and rt_audit_end(), and the counts are logged by
+ * rt_audit_report().  Otherwise these do nothing beyond locking the mutex. */
+#ifdef RT_AUDIT
+void rt_audit_begin ();
+void rt_audit_end ();
+void rt_audit_alloc ();
+void rt_audit_report ();
+void rt_lock (pthread_mutex_t * mutex);
+#else
+static inline void rt_audit_begin () {}
+static inline void rt_audit_end () {}
+static inline void rt_audit_alloc () {}
+static inline void rt_audit_report () {}
+static inline void rt_lock (pthread_mutex_t * mutex)
+    { pthread_mutex_lock (mutex); }
+#endif
+
 /* runtime.cc */
 extern size_t misc_bytes_allocated;
 
 /* strpool.cc */
 void string_leak_check ();
 
+/* tap.cc */
+bool tap_active ();
+/* called by the output; the samples are published by tap_commit() */
+void tap_write_pcm (const float * data, int samples);
+void tap_commit (int time, int channels, int rate);
+void tap_flush ();
+void tap_cleanup ();
+
 /* timer.cc */
 void timer_cleanup ();
 
@@ -144,16 +301,47 @@ struct IntHashKey
         { return int32_hash (val); }
 };
 
+struct PtrHashKey
+{
+    const void * ptr;
+
+    constexpr PtrHashKey (const void * ptr) :
+        ptr (ptr) {}
+    operator const void * () const
+        { return ptr; }
+    unsigned hash () const
+        { return ptr_hash (ptr); }
+};
+
 /* vis-runner.cc */
 void vis_runner_start_stop (bool playing, bool paused);
-void vis_runner_pass_audio (int time, const Index<float> & data, int channels, int rate);
+/* lock-free; calls must not overlap (the output serializes them) */
+void vis_runner_pass_audio (int time, const float * data, int samples,
+ int channels, int rate);
 void vis_runner_flush ();
 void vis_runner_enable (bool enable);
+/* frames of audio (at least 512) given to vis_analyze() */
+void vis_runner_set_frames (int frames);
+bool vis_runner_active ();
+void vis_runner_cleanup ();
+
+/* vis-spectrum.cc */
+void vis_spectrum_add (Visualizer * vis);
+void vis_spectrum_remove (Visualizer * vis);
+int vis_spectrum_frames ();
+bool vis_spectrum_need_mono ();
+void vis_spectrum_analyze (const float * data, const float * mono,
+ int channels, int frames, int rate, int time);
+void vis_spectrum_render (Visualizer * vis);
+void vis_spectrum_clear ();
 
 /* visualization.cc */
 void vis_activate (bool activate);
 void vis_send_clear ();
-void vis_send_audio (const float * data, int channels);
+/* called in the vis thread; the last 512 of <frames> are the new audio */
+void vis_analyze (const float * data, int channels, int frames, int rate, int time);
+/* called in the main thread, with the results of the last vis_analyze() */
+void vis_send_audio ();
 
 bool vis_plugin_start (PluginHandle * plugin);
 void vis_plugin_stop (PluginHandle * plugin);
@@ -0,0 +1,782 @@
+/*
+ * meta-cache.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "meta-cache.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "audstrings.h"
+#include "internal.h"
+#include "multihash.h"
+#include "playlist.h"
+#include "plugins.h"
+#include "runtime.h"
+
+/*
+ * The cache is a single file in the user's config folder, mapped into memory
+ * and never modified in place:
+ *
+ *   FileHeader
+ *   FileSlot[slots]   open-addressed hash table of URIs (at most half full)
+ *   FileRecord ...    each followed by its URI and data, padded to 8 bytes
+ *
+ * The file is native-endian; a file that does not match is simply ignored.
+ * New records are kept in memory ("pending") and written out together with
+ * the records from the mapped file, to a new file which then replaces the old
+ * one.  This is done when enough new records have piled up (at least half as
+ * many as in the file, so that the rewriting costs a fixed amount per record
+ * in the long run) and at shutdown.
+ *
+ * While rewriting, records that were found to be out of date are dropped, as
+ * are those not used in the last "metadata_cache_days" days.  The day a record
+ * was last used is kept in its slot, and updated only when the file is
+ * rewritten; in between, the slots used are marked in memory.  A record counts
+ * as used when it is looked up, or when its file is added to a playlist with a
+ * tuple already (as when saved playlists are loaded), since such entries are
+ * never scanned.  At shutdown, the file is rewritten if any record used has an
+ * older day, so the days are brought up to date at most once a day even if
+ * nothing else has changed.
+ *
+ * Lookups from several threads hold the read side of map_lock, which is taken
+ * for writing only to swap in a new file.  Pending records are guarded by
+ * pending_mutex.  Only one thread at a time rewrites the file (save_mutex); a
+ * scanner thread which finds it busy leaves the job to the other thread.
+ *
+ * If two instances of Audacious share the cache, the one that saves last
+ * wins; nothing is lost except the records that the other one added.
+ */
+
+#define FILENAME "metadata-cache"
+#define MAGIC "AudMeta"
+#define VERSION 1
+
+#define MIN_SAVE 4096     /* pending records before the file is rewritten */
+#define MIN_SLOTS 1024
+
+enum {
+    MARK_NONE,
+    MARK_USED,   /* day to be updated */
+    MARK_STALE   /* to be dropped */
+};
+
+enum {
+    TYPE_STRING,
+    TYPE_INT
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version, slots;
+    uint64_t records, size;
+};
+
+struct FileSlot {
+    uint32_t hash, day;
+    uint64_t offset;  /* of the FileRecord; 0 if the slot is empty */
+};
+
+struct FileRecord {
+    int64_t size, mtime;
+    uint32_t uri_len, data_len;
+};
+
+struct Pending {
+    Index<char> record;  /* FileRecord, URI, data, padding */
+    int64_t serial;
+};
+
+static ConfigHandle<bool> cfg_metadata_cache ("metadata_cache");
+static ConfigHandle<int> cfg_metadata_cache_days ("metadata_cache_days");
+
+static pthread_rwlock_t map_lock = PTHREAD_RWLOCK_INITIALIZER;
+static GMappedFile * mapping;
+static const char * map_data;
+static int64_t map_size;
+static FileHeader map_header;
+static Index<char> marks;  /* one per slot */
+static int map_records;
+
+static pthread_mutex_t pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SimpleHash<String, Pending> pending;
+static int64_t pending_serial;
+static int save_after = MIN_SAVE;
+
+static pthread_mutex_t save_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t stat_hits, stat_misses, stat_stale, stat_stored;
+
+static int64_t padded (int64_t len)
+    { return (len + 7) & ~(int64_t) 7; }
+
+static unsigned today ()
+    { return time (nullptr) / 86400; }
+
+static StringBuf cache_path ()
+    { return filename_build ({aud_get_path (AudPath::UserDir), FILENAME}); }
+
+static void count (int64_t & counter)
+    { __atomic_fetch_add (& counter, 1, __ATOMIC_RELAXED); }
+
+/* ---- records ---- */
+
+static void put (Index<char> & buf, const void * data, int len)
+    { buf.insert ((const char *) data, -1, len); }
+
+template<class T>
+static void put_value (Index<char> & buf, T value)
+    { put (buf, & value, sizeof value); }
+
+static void put_name (Index<char> & buf, const char * name)
+{
+    int len = aud::min ((int) strlen (name), 255);
+    put_value (buf, (uint8_t) len);
+    put (buf, name, len);
+}
+
+static Index<char> encode_record (const char * filename, const MetaCacheKey & key,
+ PluginHandle * decoder, const Tuple & tuple)
+{
+    Index<char> data;
+
+    put_name (data, aud_plugin_get_basename (decoder));
+
+    short n_subtunes = tuple.get_n_subtunes ();
+    put_value (data, (uint16_t) n_subtunes);
+
+    for (short i = 0; i < n_subtunes; i ++)
+        put_value (data, (int16_t) tuple.get_nth_subtune (i));
+
+    for (auto field : Tuple::all_fields ())
+    {
+        if (field == Tuple::FormattedTitle)
+            continue;
+
+        switch (tuple.get_value_type (field))
+        {
+        case Tuple::String:
+        {
+            String str = tuple.get_str (field);
+            put_name (data, Tuple::field_get_name (field));
+            put_value (data, (uint8_t) TYPE_STRING);
+            put_value (data, (uint32_t) strlen (str));
+            put (data, str, strlen (str));
+            break;
+        }
+
+        case Tuple::Int:
+            put_name (data, Tuple::field_get_name (field));
+            put_value (data, (uint8_t) TYPE_INT);
+            put_value (data, (int32_t) tuple.get_int (field));
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    put_value (data, (uint8_t) 0);
+
+    FileRecord header = {key.size, key.mtime, (uint32_t) strlen (filename),
+     (uint32_t) data.len ()};
+
+    Index<char> record;
+    put (record, & header, sizeof header);
+    put (record, filename, header.uri_len);
+    put (record, data.begin (), data.len ());
+    record.resize (padded (record.len ()));
+
+    return record;
+}
+
+/* bounds-checked reading of the data part of a record */
+struct Reader
+{
+    const char * p, * end;
+
+    bool get (void * dest, int64_t len)
+    {
+        if (end - p < len)
+            return false;
+
+        memcpy (dest, p, len);
+        p += len;
+        return true;
+    }
+
+    template<class T>
+    bool get_value (T & value)
+        { return get (& value, sizeof value); }
+
+    /* <buf> must hold 256 bytes */
+    bool get_name (char * buf)
+    {
+        uint8_t len;
+        if (! get_value (len) || ! get (buf, len))
+            return false;
+
+        buf[len] = 0;
+        return true;
+    }
+};
+
+enum class Restore {
+    Hit,
+    Stale,     /* the file has changed */
+    Unusable,  /* wrong decoder, corrupt record, etc. */
+};
+
+static Restore restore_record (const FileRecord & header, const char * data,
+ const MetaCacheKey & key, PluginHandle * & decoder, Tuple & tuple)
+{
+    if (header.size != key.size || header.mtime != key.mtime)
+        return Restore::Stale;
+
+    Reader reader = {data, data + header.data_len};
+    char name[256];
+
+    if (! reader.get_name (name))
+        return Restore::Unusable;
+
+    PluginHandle * plugin = aud_plugin_lookup_basename (name);
+    if (! plugin || aud_plugin_get_type (plugin) != PluginType::Input ||
+     ! aud_plugin_get_enabled (plugin) || (decoder && decoder != plugin))
+        return Restore::Unusable;
+
+    uint16_t n_subtunes;
+    if (! reader.get_value (n_subtunes))
+        return Restore::Unusable;
+
+    Index<short> subtunes;
+    subtunes.insert (0, n_subtunes);
+    bool numbered = true;  /* 1, 2, 3, ... as when no array is given */
+
+    for (int i = 0; i < n_subtunes; i ++)
+    {
+        int16_t value;
+        if (! reader.get_value (value))
+            return Restore::Unusable;
+
+        subtunes[i] = value;
+        numbered = numbered && (value == i + 1);
+    }
+
+    Tuple new_tuple;
+
+    /* before the fields, so as not to override NumSubtunes */
+    if (n_subtunes)
+        new_tuple.set_subtunes (n_subtunes, numbered ? nullptr : subtunes.begin ());
+
+    while (1)
+    {
+        uint8_t type;
+        if (! reader.get_name (name))
+            return Restore::Unusable;
+        if (! name[0])
+            break;
+        if (! reader.get_value (type))
+            return Restore::Unusable;
+
+        Tuple::Field field = Tuple::field_by_name (name);
+
+        if (type == TYPE_INT)
+        {
+            int32_t value;
+            if (! reader.get_value (value))
+                return Restore::Unusable;
+
+            if (field != Tuple::Invalid && Tuple::field_get_type (field) == Tuple::Int)
+                new_tuple.set_int (field, value);
+        }
+        else if (type == TYPE_STRING)
+        {
+            uint32_t len;
+            if (! reader.get_value (len) || reader.end - reader.p < len)
+                return Restore::Unusable;
+
+            if (field != Tuple::Invalid && Tuple::field_get_type (field) == Tuple::String)
+                new_tuple.set_str (field, str_copy (reader.p, len));
+
+            reader.p += len;
+        }
+        else
+            return Restore::Unusable;
+    }
+
+    new_tuple.set_state (Tuple::Valid);
+
+    decoder = plugin;
+    tuple = std::move (new_tuple);
+    return Restore::Hit;
+}
+
+/* ---- mapped file (map_lock held) ---- */
+
+static const FileSlot * get_slots ()
+    { return (const FileSlot *) (map_data + sizeof (FileHeader)); }
+
+/* returns null if the record does not fit in the file */
+static const FileRecord * get_record (uint64_t offset)
+{
+    if (offset % 8 || offset > (uint64_t) map_size ||
+     map_size - offset < sizeof (FileRecord))
+        return nullptr;
+
+    auto record = (const FileRecord *) (map_data + offset);
+    if ((uint64_t) (map_size - offset - sizeof (FileRecord)) <
+     (uint64_t) record->uri_len + record->data_len)
+        return nullptr;
+
+    return record;
+}
+
+static int find_slot (const char * uri, int uri_len, unsigned hash)
+{
+    if (! mapping)
+        return -1;
+
+    const FileSlot * slots = get_slots ();
+    unsigned mask = map_header.slots - 1;
+
+    for (unsigned i = hash & mask, tries = 0; tries < map_header.slots;
+     i = (i + 1) & mask, tries ++)
+    {
+        if (! slots[i].offset)
+            break;
+        if (slots[i].hash != hash)
+            continue;
+
+        const FileRecord * record = get_record (slots[i].offset);
+        if (record && record->uri_len == (unsigned) uri_len &&
+         ! memcmp (record + 1, uri, uri_len))
+            return i;
+    }
+
+    return -1;
+}
+
+static void unmap_file ()
+{
+    if (mapping)
+        g_mapped_file_unref (mapping);
+
+    mapping = nullptr;
+    map_data = nullptr;
+    map_size = 0;
+    map_header = FileHeader ();
+    marks.clear ();
+    __atomic_store_n (& map_records, 0, __ATOMIC_RELAXED);
+}
+
+static void map_file ()
+{
+    StringBuf path = cache_path ();
+    GError * error = nullptr;
+
+    unmap_file ();
+
+    GMappedFile * file = g_mapped_file_new (path, false, & error);
+
+    if (! file)
+    {
+        if (! g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            AUDWARN ("%s\n", error->message);
+
+        g_error_free (error);
+        return;
+    }
+
+    const char * data = g_mapped_file_get_contents (file);
+    int64_t size = g_mapped_file_get_length (file);
+    FileHeader header = FileHeader ();
+
+    if (size >= (int64_t) sizeof header)
+        memcpy (& header, data, sizeof header);
+
+    if (memcmp (header.magic, MAGIC, sizeof header.magic) || header.version != VERSION)
+    {
+        AUDWARN ("%s is not a metadata cache of this version.\n", (const char *) path);
+        g_mapped_file_unref (file);
+        return;
+    }
+
+    if (header.size != (uint64_t) size || ! header.slots ||
+     (header.slots & (header.slots - 1)) || header.records > header.slots ||
+     (uint64_t) (size - sizeof header) / sizeof (FileSlot) < header.slots)
+    {
+        AUDWARN ("Ignoring damaged metadata cache %s.\n", (const char *) path);
+        g_mapped_file_unref (file);
+        return;
+    }
+
+    mapping = file;
+    map_data = data;
+    map_size = size;
+    map_header = header;
+    marks.insert (0, header.slots);
+    __atomic_store_n (& map_records, (int) header.records, __ATOMIC_RELAXED);
+
+    AUDINFO ("Loaded metadata cache: %d records.\n", (int) header.records);
+}
+
+/* ---- saving ---- */
+
+struct OutRecord {
+    unsigned hash, day;
+    const char * data;
+    int64_t len;
+};
+
+static bool write_file (const char * path, const Index<OutRecord> & out)
+{
+    unsigned slots = MIN_SLOTS;
+    while (slots < 2 * (unsigned) out.len ())
+        slots *= 2;
+
+    Index<FileSlot> table;
+    table.insert (0, slots);
+
+    uint64_t offset = sizeof (FileHeader) + sizeof (FileSlot) * slots;
+
+    for (const OutRecord & rec : out)
+    {
+        unsigned i = rec.hash & (slots - 1);
+        while (table[i].offset)
+            i = (i + 1) & (slots - 1);
+
+        table[i] = {rec.hash, rec.day, offset};
+        offset += rec.len;
+    }
+
+    FileHeader header = FileHeader ();
+    memcpy (header.magic, MAGIC, sizeof header.magic);
+    header.version = VERSION;
+    header.slots = slots;
+    header.records = out.len ();
+    header.size = offset;
+
+    FILE * handle = g_fopen (path, "wb");
+    if (! handle)
+        return false;
+
+    bool success = (fwrite (& header, sizeof header, 1, handle) == 1 &&
+     fwrite (table.begin (), sizeof (FileSlot), slots, handle) == slots);
+
+    for (const OutRecord & rec : out)
+    {
+        if (! success)
+            break;
+
+        success = (fwrite (rec.data, 1, rec.len, handle) == (size_t) rec.len);
+    }
+
+    if (fclose (handle) != 0)
+        success = false;
+
+    return success;
+}
+
+/* save_mutex held */
+static void save ()
+{
+    SimpleHash<String, Index<char>> snapshot;
+    int64_t serial;
+
+    pthread_mutex_lock (& pending_mutex);
+
+    serial = pending_serial;
+    pending.iterate ([&] (const String & uri, Pending & p) {
+        Index<char> copy;
+        copy.insert (p.record.begin (), 0, p.record.len ());
+        snapshot.add (uri, std::move (copy));
+    });
+
+    pthread_mutex_unlock (& pending_mutex);
+
+    StringBuf path = cache_path ();
+    StringBuf temp = str_concat ({path, ".tmp"});
+    unsigned day = today ();
+    int max_days = cfg_metadata_cache_days.get ();
+    Index<OutRecord> out;
+    int dropped = 0;
+
+    pthread_rwlock_rdlock (& map_lock);
+
+    snapshot.iterate ([&] (const String & uri, Index<char> & record) {
+        out.append (OutRecord {str_calc_hash (uri), day, record.begin (), record.len ()});
+    });
+
+    const FileSlot * slots = mapping ? get_slots () : nullptr;
+
+    for (unsigned i = 0; i < map_header.slots; i ++)
+    {
+        if (! slots[i].offset)
+            continue;
+
+        int mark = __atomic_load_n (& marks[i], __ATOMIC_RELAXED);
+        unsigned last_used = (mark == MARK_USED) ? day : slots[i].day;
+        const FileRecord * record = get_record (slots[i].offset);
+
+        if (mark == MARK_STALE || ! record || (max_days > 0 &&
+         (int64_t) day - last_used > max_days))
+        {
+            dropped ++;
+            continue;
+        }
+
+        String uri (str_copy ((const char *) (record + 1), record->uri_len));
+        if (snapshot.lookup (uri))
+            continue;
+
+        out.append (OutRecord {slots[i].hash, last_used, (const char *) record,
+         (int64_t) sizeof (FileRecord) + padded ((int64_t) record->uri_len + record->data_len)});
+    }
+
+    bool success = write_file (temp, out);
+
+    pthread_rwlock_unlock (& map_lock);
+
+    if (success)
+    {
+        pthread_rwlock_wrlock (& map_lock);
+
+        /* on Windows, the old file cannot be replaced while mapped */
+        unmap_file ();
+
+        if (g_rename (temp, path) < 0)
+        {
+            AUDERR ("%s: %s\n", (const char *) path, strerror (errno));
+            success = false;
+        }
+
+        map_file ();
+        pthread_rwlock_unlock (& map_lock);
+    }
+    else
+        AUDERR ("Error writing %s: %s\n", (const char *) temp, strerror (errno));
+
+    if (! success)
+        g_unlink (temp);
+
+    pthread_mutex_lock (& pending_mutex);
+
+    int next = aud::max (MIN_SAVE, __atomic_load_n (& map_records, __ATOMIC_RELAXED) / 2);
+
+    if (success)
+    {
+        Index<String> saved;
+
+        pending.iterate ([&] (const String & uri, Pending & p) {
+            if (p.serial <= serial)
+                saved.append (uri);
+        });
+
+        for (const String & uri : saved)
+            pending.remove (uri);
+
+        save_after = next;
+        AUDINFO ("Saved metadata cache: %d records, %d dropped.\n", out.len (), dropped);
+    }
+    else
+        save_after = pending.n_items () + next;  /* try again later */
+
+    pthread_mutex_unlock (& pending_mutex);
+}
+
+/* ---- public ---- */
+
+bool meta_cache_lookup (const char * filename, MetaCacheKey & key,
+ PluginHandle * & decoder, Tuple & tuple)
+{
+    if (! cfg_metadata_cache.get () || strncmp (filename, "file://", 7) ||
+     is_cuesheet_entry (filename))
+        return false;
+
+    StringBuf path = uri_to_filename (strip_subtune (filename));
+    GStatBuf st;
+
+    if (! path || g_stat (path, & st) < 0 || ! S_ISREG (st.st_mode))
+        return false;
+
+    key.size = st.st_size;
+    key.mtime = (int64_t) st.st_mtime * 1000000000;
+#ifdef __linux__
+    key.mtime += st.st_mtim.tv_nsec;
+#endif
+
+    bool found = false;
+    Restore result = Restore::Unusable;
+
+    pthread_mutex_lock (& pending_mutex);
+
+    Pending * p = pending.lookup (String (filename));
+
+    if (p)
+    {
+        auto header = (const FileRecord *) p->record.begin ();
+        result = restore_record (* header, (const char *) (header + 1) +
+         header->uri_len, key, decoder, tuple);
+        found = true;
+    }
+
+    pthread_mutex_unlock (& pending_mutex);
+
+    if (! found)
+    {
+        pthread_rwlock_rdlock (& map_lock);
+
+        int uri_len = strlen (filename);
+        int i = find_slot (filename, uri_len, str_calc_hash (filename));
+
+        if (i >= 0)
+        {
+            auto header = get_record (get_slots ()[i].offset);
+            result = restore_record (* header, (const char *) (header + 1) +
+             uri_len, key, decoder, tuple);
+
+            if (result != Restore::Unusable)
+                __atomic_store_n (& marks[i], (result == Restore::Hit) ?
+                 (char) MARK_USED : (char) MARK_STALE, __ATOMIC_RELAXED);
+        }
+
+        pthread_rwlock_unlock (& map_lock);
+    }
+
+    if (result == Restore::Hit)
+    {
+        count (stat_hits);
+        return true;
+    }
+
+    if (result == Restore::Stale)
+        count (stat_stale);
+
+    count (stat_misses);
+    return false;
+}
+
+void meta_cache_touch (const char * filename)
+{
+    if (! __atomic_load_n (& map_records, __ATOMIC_RELAXED) ||
+     ! cfg_metadata_cache.get () || strncmp (filename, "file://", 7))
+        return;
+
+    pthread_rwlock_rdlock (& map_lock);
+
+    int i = find_slot (filename, strlen (filename), str_calc_hash (filename));
+
+    /* a record found to be out of date stays so */
+    char none = MARK_NONE;
+    if (i >= 0)
+        __atomic_compare_exchange_n (& marks[i], & none, (char) MARK_USED,
+         false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+    pthread_rwlock_unlock (& map_lock);
+}
+
+void meta_cache_store (const char * filename, const MetaCacheKey & key,
+ PluginHandle * decoder, const Tuple & tuple)
+{
+    if (! key.valid () || ! decoder || ! tuple.valid ())
+        return;
+
+    Index<char> record = encode_record (filename, key, decoder, tuple);
+
+    pthread_mutex_lock (& pending_mutex);
+    pending.add (String (filename), {std::move (record), ++ pending_serial});
+    bool want_save = (pending.n_items () >= save_after);
+    pthread_mutex_unlock (& pending_mutex);
+
+    count (stat_stored);
+
+    /* if another thread is saving already, leave it to that one */
+    if (want_save && ! pthread_mutex_trylock (& save_mutex))
+    {
+        save ();
+        pthread_mutex_unlock (& save_mutex);
+    }
+}
+
+EXPORT Playlist::MetadataCacheStats Playlist::metadata_cache_stats ()
+{
+    MetadataCacheStats stats;
+
+    stats.hits = __atomic_load_n (& stat_hits, __ATOMIC_RELAXED);
+    stats.misses = __atomic_load_n (& stat_misses, __ATOMIC_RELAXED);
+    stats.stale = __atomic_load_n (& stat_stale, __ATOMIC_RELAXED);
+    stats.stored = __atomic_load_n (& stat_stored, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock (& pending_mutex);
+    stats.entries = __atomic_load_n (& map_records, __ATOMIC_RELAXED) + pending.n_items ();
+    pthread_mutex_unlock (& pending_mutex);
+
+    return stats;
+}
+
+void meta_cache_init ()
+{
+    pthread_rwlock_wrlock (& map_lock);
+    map_file ();
+    pthread_rwlock_unlock (& map_lock);
+
+    pthread_mutex_lock (& pending_mutex);
+    save_after = aud::max (MIN_SAVE, map_records / 2);
+    pthread_mutex_unlock (& pending_mutex);
+}
+
+/* called after the scanner and the adder have stopped */
+void meta_cache_cleanup ()
+{
+    pthread_mutex_lock (& pending_mutex);
+    bool changed = pending.n_items ();
+    pthread_mutex_unlock (& pending_mutex);
+
+    /* records used today need not be written again */
+    unsigned day = today ();
+    const FileSlot * slots = mapping ? get_slots () : nullptr;
+
+    for (int i = 0; i < marks.len (); i ++)
+    {
+        if (marks[i] == MARK_STALE || (marks[i] == MARK_USED && slots[i].day != day))
+            changed = true;
+    }
+
+    pthread_mutex_lock (& save_mutex);
+
+    if (changed)
+        save ();
+
+    pthread_mutex_unlock (& save_mutex);
+
+    pthread_rwlock_wrlock (& map_lock);
+    unmap_file ();
+    pthread_rwlock_unlock (& map_lock);
+
+    pthread_mutex_lock (& pending_mutex);
+    pending.clear ();
+    save_after = MIN_SAVE;
+    pthread_mutex_unlock (& pending_mutex);
+}
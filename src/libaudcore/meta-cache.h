@@ -0,0 +1,63 @@
+/*
+ * meta-cache.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_META_CACHE_H
+#define LIBAUDCORE_META_CACHE_H
+
+#include <stdint.h>
+
+#include "tuple.h"
+
+class PluginHandle;
+
+/* The metadata cache remembers, across sessions, the decoder and the tuple
+ * found for local files, so that a file whose size and modification time have
+ * not changed need not be opened again to scan it.  Only "file://" URIs are
+ * cached (not cuesheet entries, whose tuples come from the cuesheet). */
+
+/* the version of a file, as seen by meta_cache_lookup() */
+struct MetaCacheKey
+{
+    int64_t size = -1;
+    int64_t mtime = 0;  /* nanoseconds, where the system gives them */
+
+    bool valid () const
+        { return size >= 0; }
+};
+
+/* Looks up <filename>.  On a hit, sets <decoder> (if it was set already, it
+ * must be the cached one for a hit) and <tuple>, and returns true.  On a miss,
+ * fills in <key>, to be passed to meta_cache_store() once the file has been
+ * read; <key> is left invalid if the file cannot be cached. */
+bool meta_cache_lookup (const char * filename, MetaCacheKey & key,
+ PluginHandle * & decoder, Tuple & tuple);
+
+/* Adds what was read from <filename> to the cache, if <tuple> is valid.  May
+ * be called from any thread. */
+void meta_cache_store (const char * filename, const MetaCacheKey & key,
+ PluginHandle * decoder, const Tuple & tuple);
+
+/* Marks the record for <filename> as still in use, without looking at the
+ * file; for entries whose tuples were not looked up in the cache. */
+void meta_cache_touch (const char * filename);
+
+void meta_cache_init ();
+void meta_cache_cleanup ();  /* saves the cache */
+
+#endif // LIBAUDCORE_META_CACHE_H
@@ -19,11 +19,16 @@
 
 #include "output.h"
 
+#include <inttypes.h>
 #include <math.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <glib.h>  /* for g_get_monotonic_time */
+
+#include "audstrings.h"
+#include "drct.h"
 #include "equalizer.h"
 #include "hook.h"
 #include "i18n.h"
@@ -32,47 +37,74 @@
 #include "plugin.h"
 #include "plugins.h"
 #include "runtime.h"
+#include "seqlock.h"
+#include "spscring.h"
 
 /* With Audacious 3.7, there is some support for secondary output plugins.
  * Notes and limitations:
- *  - Only one secondary output can be in use at a time.
- *  - A reduced API is used, consisting of only open_audio(), close_audio(), and
- *    write_audio().
- *  - The primary and secondary outputs are run from the same thread, with
- *    timing controlled by the primary's period_wait().  To avoid dropouts in
- *    the primary output, the secondary's write_audio() must be able to process
- *    audio faster than realtime.
- *  - The secondary's write_audio() is called in a tight loop until it has
- *    caught up to the primary, and should never return a zero byte count. */
+ *  - Any number of secondary outputs can be in use at a time.  Each takes
+ *    the audio from its own point in the chain (see setup_secondary()); where
+ *    several use the same point, they are passed the same buffer.
+ *  - A reduced API is used, consisting of only open_audio(), close_audio(),
+ *    write_audio(), and period_wait().
+ *  - Each secondary's write_audio() is called from a separate thread, which
+ *    is fed through a ring buffer (see SecondarySink below).  It may block or
+ *    return a zero byte count without affecting the primary output. */
+
+/* Optionally ("output_writer_thread"), the primary's write_audio() and
+ * period_wait() are called from a dedicated writer thread instead of the
+ * input thread.  The input thread then only fills a lock-free ring buffer
+ * (out_ring) with fully processed audio and waits only if the ring is full.
+ * The writer thread takes LOCK_MINOR only to check the state, to account for
+ * the audio it has written, and to wait or signal; it never takes LOCK_MAJOR.
+ * It calls write_audio() and period_wait() without LOCK_MINOR, so device
+ * writes go on while the input thread processes the next buffer.  Since the
+ * output plugin must not be called from two threads at once (except during
+ * period_wait()), write_audio(), get_delay(), pause() and flush() are called
+ * with LOCK_PLUGIN held.  A flush discards the ring while the writer may be
+ * writing from it; the writer then finds out_serial changed and does not
+ * account for that write.  The writer thread is started whenever the output
+ * plugin is opened and stopped before it is closed. */
 
 static pthread_mutex_t mutex_major = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t mutex_minor = PTHREAD_MUTEX_INITIALIZER;
 
-#define LOCK_MAJOR pthread_mutex_lock (& mutex_major)
+#define LOCK_MAJOR rt_lock (& mutex_major)
 #define UNLOCK_MAJOR pthread_mutex_unlock (& mutex_major)
-#define LOCK_MINOR pthread_mutex_lock (& mutex_minor)
+#define LOCK_MINOR rt_lock (& mutex_minor)
 #define UNLOCK_MINOR pthread_mutex_unlock (& mutex_minor)
 #define LOCK_ALL do { LOCK_MAJOR; LOCK_MINOR; } while (0)
 #define UNLOCK_ALL do { UNLOCK_MINOR; UNLOCK_MAJOR; } while (0)
 
+/* taken after LOCK_MINOR, if both are needed */
+static pthread_mutex_t mutex_plugin = PTHREAD_MUTEX_INITIALIZER;
+
+#define LOCK_PLUGIN rt_lock (& mutex_plugin)
+#define UNLOCK_PLUGIN pthread_mutex_unlock (& mutex_plugin)
+
 /* State variables.  State changes that are allowed between LOCK_MINOR and
  * UNLOCK_MINOR (all others must take place between LOCK_ALL and UNLOCK_ALL):
- * s_paused -> true or false, s_flushed -> true, s_resetting -> true,
- * s_secondary -> true or false */
+ * s_paused -> true or false, s_flushed -> true, s_resetting -> true */
 
 static bool s_input; /* input plugin connected */
 static bool s_output; /* primary output plugin connected */
-static bool s_secondary; /* secondary output plugin connected */
 static bool s_gain; /* replay gain info set */
 static bool s_paused; /* paused */
 static bool s_flushed; /* flushed, writes ignored until resume */
 static bool s_resetting; /* resetting output system */
+static bool s_writer; /* writer thread running */
+static bool s_writer_quit; /* writer thread asked to exit */
+static bool s_passthrough; /* last buffer was written without processing;
+                            * written with LOCK_MINOR, read atomically */
 
 /* Condition variable linked to LOCK_MINOR.
  * The input thread will wait if the following is true:
  *   ((! s_output || s_paused || s_resetting) && ! s_flushed)
  * Hence you must signal if you cause the inverse to be true:
- *   ((s_output && ! s_paused && ! s_resetting) || s_flushed) */
+ *   ((s_output && ! s_paused && ! s_resetting) || s_flushed)
+ * The writer thread waits on the same condition variable, and is also
+ * signaled when data is added to out_ring and when it is asked to exit; the
+ * input thread is signaled when the writer frees space in out_ring. */
 
 static pthread_cond_t cond_minor = PTHREAD_COND_INITIALIZER;
 
@@ -80,16 +112,19 @@ static pthread_cond_t cond_minor = PTHREAD_COND_INITIALIZER;
 #define WAIT_MINOR pthread_cond_wait (& cond_minor, & mutex_minor)
 
 static OutputPlugin * cop; /* current (primary) output plugin */
-static OutputPlugin * sop; /* secondary output plugin */
 
-static OutputStream record_stream;
+/* While the output is overridden (for rendering, see render.cc), cop is the
+ * overriding plugin, and the one selected by the user is only remembered in
+ * sel_op; it is not initialized until the override is removed.  These are
+ * used only from the main thread. */
+static bool s_override;
+static OutputPlugin * sel_op;
 
 static int seek_time;
 static String in_filename;
 static Tuple in_tuple;
 static int in_format, in_channels, in_rate;
 static int effect_channels, effect_rate;
-static int sec_channels, sec_rate;
 static int out_format, out_channels, out_rate;
 static int out_bytes_per_sec, out_bytes_held;
 static int64_t in_frames, out_bytes_written;
@@ -98,6 +133,130 @@ static ReplayGainInfo gain_info;
 static Index<float> buffer1;
 static Index<char> buffer2;
 
+static SpscRing out_ring; /* processed audio waiting for the writer thread */
+static pthread_t writer_thread;
+static int out_serial; /* incremented when out_ring is discarded */
+
+/* In realtime mode ("output_realtime"), buffer1 and buffer2 are allocated when
+ * the output is opened, with room for RT_CHUNK_MS of audio, and the input is
+ * split into pieces no larger than that.  Index keeps its memory when shrunk,
+ * so no further allocation is done unless an effect plugin returns more audio
+ * than expected.  Visualization data is passed through lock-free rings in any
+ * mode, and nodes are recycled (see vis-runner.cc).  In this mode, the "grow"
+ * overflow policy of secondary outputs acts as "drop", and the effect pipeline
+ * is not used (see effect.cc).
+ *
+ * This mode does not make the audio path lock-free.  LOCK_ALL, and the effect
+ * mutex around the effect plugins, are still taken once per buffer.  Nothing
+ * else takes them in steady state: they are contended only by control
+ * operations (seek, pause, output or effect changes, changing the hardware
+ * volume, or querying it or the recording statistics).  The time, the
+ * passthrough flag and the software volume are read without them.  All are
+ * taken through rt_lock(), so the audit reports any contention. */
+#define RT_CHUNK_MS 50
+
+static int rt_chunk_bytes; /* zero if not in realtime mode */
+
+/* The playback position is published through a seqlock, so that the time can
+ * be polled (by vis-runner, the interface, DBus clients, etc.) without taking
+ * LOCK_MINOR and waiting on the input or writer thread.  publish_timing() is
+ * called with LOCK_MINOR held each time audio is written and whenever the
+ * state changes.  In between, the position is assumed to advance in real time
+ * while playing, but by no more than the audio that was buffered.  The delay
+ * of the effects is read from the value they publish (see
+ * effect_adjust_delay()), so publishing never waits for an effect plugin. */
+struct TimingSnapshot {
+    int64_t stamp;  /* g_get_monotonic_time() at publication */
+    bool input, output, advancing;
+    int time, delay;  /* output_get_time() and the total delay it includes */
+    int raw_time, raw_delay;  /* output_get_raw_time() and the delay after it */
+    int buffered, latency;  /* in our buffers, and reported by the plugin */
+};
+
+static SeqLock<TimingSnapshot> timing_lock;
+static TimingSnapshot last_timing; /* last published, for LOCK_MINOR holders */
+
+/* Statistics for aud_drct_get_output_stats().  They are only ever added to
+ * (or reset), each field with a relaxed atomic operation, so collecting them
+ * costs a few clock reads per buffer and no locking.  A write is counted as
+ * late if the output had less than LATE_WRITE_MS of audio left to play. */
+#define LATE_WRITE_MS 10
+
+static OutputStats stats;
+
+/* Audio for the secondary output plugin is queued in a ring buffer of
+ * "record_buffer" milliseconds and written by a separate thread.  If the ring
+ * fills up, "record_overflow" decides whether the input thread waits for it
+ * (Block), the new audio is discarded and counted (Drop), or it is queued in
+ * memory without limit (Grow).  write() is called with LOCK_ALL held; while
+ * it waits (Block), it releases LOCK_MINOR, so that the primary output goes
+ * on.  The sink thread never takes LOCK_MINOR.  stop() writes out what is in
+ * the ring but discards audio queued beyond it (Grow); it is called with
+ * LOCK_MINOR released (see cleanup_secondary()). */
+class SecondarySink
+{
+public:
+    void start (OutputPlugin * plugin, int channels, int rate);
+    void stop ();  /* writes out the ring first */
+
+    void write (const float * data, int samples);
+    RecordStats stats ();
+
+private:
+    static void * run (void * me);
+    void run_locked ();
+
+    OutputPlugin * m_plugin = nullptr;
+    RecordOverflow m_policy = RecordOverflow::Grow;
+    int m_bytes_per_sec = 0;
+
+    SpscRing m_ring;
+    Index<float> m_pending; /* used by Grow once the ring is full */
+
+    pthread_t m_thread;
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_cond = PTHREAD_COND_INITIALIZER;
+    bool m_quit = false;
+
+    /* statistics, protected by m_mutex */
+    RecordStats m_stats = RecordStats ();
+};
+
+/* A secondary output plugin and the sink feeding it */
+struct Secondary
+{
+    Secondary (PluginHandle * handle, OutputPlugin * plugin) :
+        handle (handle), plugin (plugin) {}
+
+    PluginHandle * const handle;
+    OutputPlugin * const plugin;
+
+    bool open = false; /* open_audio() succeeded */
+    OutputStream stream = OutputStream::AsDecoded;
+    int channels = 0, rate = 0;
+
+    SecondarySink sink;
+};
+
+static Index<SmartPtr<Secondary>> secondaries; /* changed only with LOCK_ALL */
+static int sec_taps; /* (1 << stream) is set if an open secondary uses it */
+
+static constexpr int tap_bit (OutputStream stream)
+    { return 1 << (int) stream; }
+
+/* settings read for every buffer */
+static ConfigHandle<bool> cfg_enable_replay_gain ("enable_replay_gain");
+static ConfigHandle<double> cfg_replay_gain_preamp ("replay_gain_preamp");
+static ConfigHandle<int> cfg_replay_gain_mode ("replay_gain_mode");
+static ConfigHandle<bool> cfg_enable_clipping_prevention ("enable_clipping_prevention");
+static ConfigHandle<double> cfg_default_gain ("default_gain");
+static ConfigHandle<bool> cfg_shuffle ("shuffle");
+static ConfigHandle<bool> cfg_album_shuffle ("album_shuffle");
+static ConfigHandle<bool> cfg_soft_clipping ("soft_clipping");
+static ConfigHandle<bool> cfg_software_volume_control ("software_volume_control");
+static ConfigHandle<int> cfg_sw_volume_left ("sw_volume_left");
+static ConfigHandle<int> cfg_sw_volume_right ("sw_volume_right");
+
 static inline int get_format (bool & automatic)
 {
     automatic = false;
@@ -122,6 +281,88 @@ static void setup_effects ()
 
     effect_start (effect_channels, effect_rate);
     eq_set_format (effect_channels, effect_rate);
+    conv_set_format (effect_channels, effect_rate);
+}
+
+/* The read position of out_ring is changed only with LOCK_MINOR held, either
+ * by the writer thread itself or by flush_output().  The audio itself is read
+ * by the writer thread without the lock (see above). */
+static void * writer_worker (void *)
+{
+    LOCK_MINOR;
+
+    while (! s_writer_quit)
+    {
+        int len;
+        const void * data = out_ring.peek (len);
+
+        if (s_paused || s_flushed || s_resetting || ! len)
+        {
+            WAIT_MINOR;
+            continue;
+        }
+
+        int serial = out_serial;
+
+        /* taken before LOCK_MINOR is released, so that pause() cannot come
+         * between the check above and write_audio() */
+        LOCK_PLUGIN;
+        UNLOCK_MINOR;
+
+        int64_t start = g_get_monotonic_time ();
+        int written = cop->write_audio (data, len);
+        output_stats_add (OutputStage::Write, g_get_monotonic_time () - start);
+
+        UNLOCK_PLUGIN;
+        LOCK_MINOR;
+
+        if (serial != out_serial)
+            continue;
+
+        out_ring.consume (written);
+        out_bytes_written += written;
+
+        if (written)
+            SIGNAL_MINOR;
+
+        if (written < len)
+        {
+            UNLOCK_MINOR;
+            start = g_get_monotonic_time ();
+            cop->period_wait ();
+            output_stats_add (OutputStage::PeriodWait, g_get_monotonic_time () - start);
+            LOCK_MINOR;
+        }
+    }
+
+    UNLOCK_MINOR;
+    return nullptr;
+}
+
+/* assumes LOCK_ALL, s_output */
+static void start_writer ()
+{
+    int ms = aud::clamp (aud_get_int (0, "output_writer_buffer"), 10, 10000);
+    int frames = aud::rescale (ms, 1000, out_rate);
+
+    out_ring.alloc (FMT_SIZEOF (out_format) * out_channels * frames);
+
+    s_writer = true;
+    s_writer_quit = false;
+    pthread_create (& writer_thread, nullptr, writer_worker, nullptr);
+}
+
+/* assumes LOCK_MINOR, s_writer */
+static void stop_writer ()
+{
+    s_writer_quit = true;
+    SIGNAL_MINOR;
+
+    UNLOCK_MINOR;
+    pthread_join (writer_thread, nullptr);
+    LOCK_MINOR;
+
+    s_writer = false;
 }
 
 /* assumes LOCK_ALL */
@@ -130,6 +371,15 @@ static void cleanup_output ()
     if (! s_output)
         return;
 
+    if (s_writer)
+    {
+        /* let the writer thread play out the rest of the ring */
+        while (out_ring.len () && ! s_paused && ! s_flushed && ! s_resetting)
+            WAIT_MINOR;
+
+        stop_writer ();
+    }
+
     if (! s_paused && ! s_flushed && ! s_resetting)
     {
         UNLOCK_MINOR;
@@ -138,28 +388,247 @@ static void cleanup_output ()
     }
 
     s_output = false;
+    __atomic_store_n (& s_passthrough, false, __ATOMIC_RELAXED);
+    rt_chunk_bytes = 0;
 
     buffer1.clear ();
     buffer2.clear ();
 
     cop->close_audio ();
     vis_runner_start_stop (false, false);
+
+    rt_audit_report ();
 }
 
-/* assumes LOCK_MINOR */
-static void cleanup_secondary ()
+/* assumes LOCK_ALL, s_input; called whenever the input or output format may
+ * have changed, since the output is not reopened for every new input */
+static void setup_realtime ()
 {
-    if (! s_secondary)
+    if (! s_output || ! aud_get_bool (0, "output_realtime"))
+    {
+        rt_chunk_bytes = 0;
         return;
+    }
+
+    int in_frames = aud::rescale (RT_CHUNK_MS, 1000, in_rate);
+    /* allow for effects that raise the sample rate, plus some slack */
+    int out_frames = 2 * aud::rescale<int64_t> (in_frames, in_rate, out_rate) + 1024;
+
+    buffer1.resize (aud::max (in_frames * in_channels, out_frames * out_channels));
+    buffer1.resize (0);
+    buffer2.resize (FMT_SIZEOF (out_format) * out_frames * out_channels);
+    buffer2.resize (0);
+
+    rt_chunk_bytes = FMT_SIZEOF (in_format) * in_channels * in_frames;
+}
+
+void SecondarySink::start (OutputPlugin * plugin, int channels, int rate)
+{
+    int ms = aud::clamp (aud_get_int (0, "record_buffer"), 10, 60000);
+    int frames = aud::rescale<int64_t> (ms, 1000, rate);
+
+    m_plugin = plugin;
+    m_policy = (RecordOverflow) aud_get_int (0, "record_overflow");
+
+    /* growing the queue would mean allocating on the audio thread */
+    if (m_policy == RecordOverflow::Grow && aud_get_bool (0, "output_realtime"))
+        m_policy = RecordOverflow::Drop;
+    m_bytes_per_sec = sizeof (float) * channels * rate;
+
+    m_ring.alloc (sizeof (float) * channels * frames);
+    m_stats = RecordStats ();
+    m_quit = false;
+
+    pthread_create (& m_thread, nullptr, run, this);
+}
+
+void SecondarySink::stop ()
+{
+    pthread_mutex_lock (& m_mutex);
+    __atomic_store_n (& m_quit, true, __ATOMIC_RELAXED);
+
+    m_stats.dropped += m_pending.len ();
+    m_pending.clear ();
+
+    pthread_cond_broadcast (& m_cond);
+    pthread_mutex_unlock (& m_mutex);
+
+    pthread_join (m_thread, nullptr);
+
+    AUDINFO ("Recording stopped; peak queue %d ms, %" PRId64 " samples dropped.\n",
+     m_stats.max_queued_ms, m_stats.dropped);
+}
+
+void SecondarySink::write (const float * data, int samples)
+{
+    auto begin = (const char *) data;
+    auto end = (const char *) (data + samples);
+
+    rt_lock (& m_mutex);
+
+    /* once anything is pending, new audio must queue up behind it */
+    if (! m_pending.len ())
+        begin += m_ring.write (begin, end - begin);
+
+    if (begin < end)
+    {
+        switch (m_policy)
+        {
+        case RecordOverflow::Block:
+            /* the caller still holds LOCK_MAJOR, so the secondaries cannot
+             * be changed meanwhile */
+            UNLOCK_MINOR;
+
+            while (begin < end && ! m_quit)
+            {
+                pthread_cond_wait (& m_cond, & m_mutex);
+                begin += m_ring.write (begin, end - begin);
+            }
+
+            pthread_mutex_unlock (& m_mutex);
+            LOCK_MINOR;
+            rt_lock (& m_mutex);
+            break;
+
+        case RecordOverflow::Drop:
+            m_stats.dropped += (end - begin) / sizeof (float);
+            break;
+
+        default:
+            m_pending.insert ((const float *) begin, -1, (end - begin) / sizeof (float));
+            break;
+        }
+    }
+
+    int64_t queued = m_ring.len () + sizeof (float) * (int64_t) m_pending.len ();
+    m_stats.queued_ms = aud::rescale<int64_t> (queued, m_bytes_per_sec, 1000);
+    m_stats.max_queued_ms = aud::max (m_stats.max_queued_ms, m_stats.queued_ms);
 
-    s_secondary = false;
-    sop->close_audio ();
+    pthread_cond_broadcast (& m_cond);
+    pthread_mutex_unlock (& m_mutex);
+}
+
+RecordStats SecondarySink::stats ()
+{
+    pthread_mutex_lock (& m_mutex);
+    RecordStats stats = m_stats;
+    pthread_mutex_unlock (& m_mutex);
+    return stats;
+}
+
+void * SecondarySink::run (void * me)
+{
+    auto sink = (SecondarySink *) me;
+
+    pthread_mutex_lock (& sink->m_mutex);
+    sink->run_locked ();
+    pthread_mutex_unlock (& sink->m_mutex);
+
+    return nullptr;
+}
+
+/* exits only when asked to and the ring has been written out */
+void SecondarySink::run_locked ()
+{
+    while (1)
+    {
+        int len;
+        auto data = (const char *) m_ring.peek (len);
+
+        if (! len)
+        {
+            /* audio is added to m_pending only while the ring is not empty,
+             * so m_pending follows everything that was in the ring */
+            if (m_pending.len ())
+            {
+                Index<float> pending = std::move (m_pending);
+
+                pthread_mutex_unlock (& m_mutex);
+
+                auto begin = (const char *) pending.begin ();
+                auto end = (const char *) pending.end ();
+
+                /* m_quit is written only with m_mutex held */
+                while (begin < end && ! __atomic_load_n (& m_quit, __ATOMIC_RELAXED))
+                {
+                    int written = m_plugin->write_audio (begin, end - begin);
+                    if (! written)
+                        m_plugin->period_wait ();
+
+                    begin += written;
+                }
+
+                pthread_mutex_lock (& m_mutex);
+                m_stats.dropped += (end - begin) / sizeof (float);
+            }
+            else if (m_quit)
+                break;
+            else
+                pthread_cond_wait (& m_cond, & m_mutex);
+
+            continue;
+        }
+
+        pthread_mutex_unlock (& m_mutex);
+
+        int written = m_plugin->write_audio (data, len);
+        m_ring.consume (written);
+
+        if (! written)
+            m_plugin->period_wait ();
+
+        pthread_mutex_lock (& m_mutex);
+
+        /* wake the input thread if blocked */
+        pthread_cond_broadcast (& m_cond);
+    }
+}
+
+/* assumes LOCK_ALL */
+static void update_taps ()
+{
+    sec_taps = 0;
+
+    for (auto & sec : secondaries)
+    {
+        if (sec->open)
+            sec_taps |= tap_bit (sec->stream);
+    }
+}
+
+/* assumes LOCK_ALL; call update_taps() afterward */
+static void cleanup_secondary (Secondary & sec)
+{
+    if (! sec.open)
+        return;
+
+    sec.open = false;
+
+    /* the sink may take a while to write out its ring; the primary output
+     * goes on meanwhile */
+    UNLOCK_MINOR;
+    sec.sink.stop ();
+    LOCK_MINOR;
+
+    sec.plugin->close_audio ();
+}
+
+/* assumes LOCK_ALL */
+static void cleanup_secondaries ()
+{
+    for (auto & sec : secondaries)
+        cleanup_secondary (* sec);
+
+    sec_taps = 0;
 }
 
 /* assumes LOCK_MINOR, s_output */
 static void apply_pause ()
 {
+    LOCK_PLUGIN;
     cop->pause (s_paused);
+    UNLOCK_PLUGIN;
+
     vis_runner_start_stop (true, s_paused);
 }
 
@@ -209,22 +678,33 @@ static void setup_output (bool new_input)
     out_bytes_held = 0;
     out_bytes_written = 0;
 
+    if (aud_get_bool (0, "output_writer_thread"))
+        start_writer ();
+
     apply_pause ();
 
     if (! s_paused && ! s_flushed && ! s_resetting)
         SIGNAL_MINOR;
 }
 
-/* assumes LOCK_MINOR, s_input */
-static void setup_secondary (bool new_input)
+/* assumes LOCK_ALL, s_input; call update_taps() afterward */
+static void setup_secondary (Secondary & sec, bool new_input)
 {
-    if (! sop)
+    /* the recording plugin is started and stopped by the "record" setting;
+     * other secondary plugins run whenever they are enabled */
+    if (sec.handle == aud_drct_get_record_plugin () && ! aud_get_bool (0, "record"))
+    {
+        cleanup_secondary (sec);
         return;
+    }
+
+    /* "record_stream" may be overridden in the plugin's own config section */
+    String stream = aud_get_str (aud_plugin_get_basename (sec.handle), "record_stream");
+    sec.stream = (OutputStream) (stream[0] ? str_to_int (stream) : aud_get_int (0, "record_stream"));
 
     int rate, channels;
-    record_stream = (OutputStream) aud_get_int (0, "record_stream");
 
-    if (record_stream < OutputStream::AfterEffects)
+    if (sec.stream < OutputStream::AfterEffects)
     {
         rate = in_rate;
         channels = in_channels;
@@ -235,24 +715,34 @@ static void setup_secondary (bool new_input)
         channels = effect_channels;
     }
 
-    if (s_secondary && channels == sec_channels && rate == sec_rate &&
-     ! (new_input && sop->force_reopen))
+    if (sec.open && channels == sec.channels && rate == sec.rate &&
+     ! (new_input && sec.plugin->force_reopen))
         return;
 
-    cleanup_secondary ();
-    sop->set_info (in_filename, in_tuple);
+    cleanup_secondary (sec);
+    sec.plugin->set_info (in_filename, in_tuple);
 
     String error;
-    if (! sop->open_audio (FMT_FLOAT, rate, channels, error))
+    if (! sec.plugin->open_audio (FMT_FLOAT, rate, channels, error))
     {
         aud_ui_show_error (error ? (const char *) error : _("Error recording output stream"));
         return;
     }
 
-    s_secondary = true;
+    sec.open = true;
+    sec.channels = channels;
+    sec.rate = rate;
 
-    sec_channels = channels;
-    sec_rate = rate;
+    sec.sink.start (sec.plugin, channels, rate);
+}
+
+/* assumes LOCK_ALL, s_input */
+static void setup_secondaries (bool new_input)
+{
+    for (auto & sec : secondaries)
+        setup_secondary (* sec, new_input);
+
+    update_taps ();
 }
 
 /* assumes LOCK_MINOR, s_output */
@@ -261,25 +751,40 @@ static void flush_output ()
     out_bytes_held = 0;
     out_bytes_written = 0;
 
+    if (s_writer)
+    {
+        out_ring.discard ();
+        out_serial ++;
+        SIGNAL_MINOR; /* wake the input thread if waiting for space */
+    }
+
+    /* audio the writer thread is writing from the discarded ring is
+     * flushed along with the rest */
+    LOCK_PLUGIN;
     cop->flush ();
+    UNLOCK_PLUGIN;
+
+    conv_flush ();
     vis_runner_flush ();
+    tap_flush ();
 }
 
-static void apply_replay_gain (Index<float> & data)
+/* returns 1 if replay gain is disabled or the change would be inaudible */
+static float replay_gain_factor ()
 {
-    if (! aud_get_bool (0, "enable_replay_gain"))
-        return;
+    if (! cfg_enable_replay_gain.get ())
+        return 1;
 
-    float factor = powf (10, aud_get_double (0, "replay_gain_preamp") / 20);
+    float factor = powf (10, cfg_replay_gain_preamp.get () / 20);
 
     if (s_gain)
     {
         float peak;
 
-        auto mode = (ReplayGainMode) aud_get_int (0, "replay_gain_mode");
+        auto mode = (ReplayGainMode) cfg_replay_gain_mode.get ();
         if ((mode == ReplayGainMode::Album) ||
             (mode == ReplayGainMode::Automatic &&
-             (! aud_get_bool (0, "shuffle") || aud_get_bool (0, "album_shuffle"))))
+             (! cfg_shuffle.get () || cfg_album_shuffle.get ())))
         {
             factor *= powf (10, gain_info.album_gain / 20);
             peak = gain_info.album_peak;
@@ -290,24 +795,210 @@ static void apply_replay_gain (Index<float> & data)
             peak = gain_info.track_peak;
         }
 
-        if (aud_get_bool (0, "enable_clipping_prevention") && peak * factor > 1)
+        if (cfg_enable_clipping_prevention.get () && peak * factor > 1)
             factor = 1 / peak;
     }
     else
-        factor *= powf (10, aud_get_double (0, "default_gain") / 20);
+        factor *= powf (10, cfg_default_gain.get () / 20);
+
+    return (factor < 0.99 || factor > 1.01) ? factor : 1;
+}
+
+static void apply_replay_gain (Index<float> & data)
+{
+    float factor = replay_gain_factor ();
 
-    if (factor < 0.99 || factor > 1.01)
+    if (factor != 1)
         audio_amplify (data.begin (), 1, data.len (), & factor);
 }
 
-/* assumes LOCK_MINOR, s_secondary */
-static void write_secondary (const Index<float> & data)
+/* assumes LOCK_ALL; <taps> is a set of tap_bit() values, and every
+ * secondary using one of them is passed the same data */
+static void write_secondary (int taps, const float * data, int samples)
 {
-    auto begin = (const char *) data.begin ();
-    auto end = (const char *) data.end ();
+    for (auto & sec : secondaries)
+    {
+        if (sec->open && (taps & tap_bit (sec->stream)))
+            sec->sink.write (data, samples);
+    }
+}
 
-    while (begin < end)
-        begin += sop->write_audio (begin, end - begin);
+/* called by audio_post_process() for each block */
+static void pass_vis (const float * data, int samples, int offset, void * user)
+{
+    int out_time = * (int *) user;
+    int frames = offset / out_channels;
+
+    /* this audio is heard after the delay of the convolver */
+    vis_runner_pass_audio (out_time + aud::rescale<int64_t> (frames, out_rate, 1000) +
+     conv_get_delay (),
+     data, samples, out_channels, out_rate);
+}
+
+static void pass_after_eq (const float * data, int samples, int offset, void *)
+{
+    if (sec_taps & tap_bit (OutputStream::AfterEqualizer))
+        write_secondary (tap_bit (OutputStream::AfterEqualizer), data, samples);
+    if (tap_active ())
+        tap_write_pcm (data, samples);
+}
+
+static void atomic_max (int & var, int value)
+{
+    int old = __atomic_load_n (& var, __ATOMIC_RELAXED);
+    while (value > old && ! __atomic_compare_exchange_n (& var, & old, value,
+     true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void atomic_add (int64_t & var, int64_t value)
+    { __atomic_fetch_add (& var, value, __ATOMIC_RELAXED); }
+
+void output_stats_add (OutputStage stage, int64_t us)
+{
+    OutputStageStats & st = stats.stages[(int) stage];
+    int bucket = (us > 1) ? 63 - __builtin_clzll (us) : 0;
+
+    atomic_add (st.count, 1);
+    atomic_add (st.total_us, us);
+    atomic_add (st.histogram[aud::min (bucket, AUD_OUTPUT_STATS_BUCKETS - 1)], 1);
+    atomic_max (st.max_us, aud::min (us, (int64_t) INT32_MAX));
+}
+
+/* assumes LOCK_MINOR */
+static void publish_timing ()
+{
+    TimingSnapshot t = TimingSnapshot ();
+
+    t.stamp = g_get_monotonic_time ();
+    t.input = s_input;
+    t.output = s_output;
+
+    if (s_output)
+    {
+        int ring = s_writer ? out_ring.len () : 0;
+
+        t.advancing = ! (s_paused || s_flushed || s_resetting);
+        LOCK_PLUGIN;
+        t.latency = cop->get_delay ();
+        UNLOCK_PLUGIN;
+        t.buffered = aud::rescale<int64_t> (out_bytes_held + ring, out_bytes_per_sec, 1000);
+
+        int written = aud::rescale<int64_t> (out_bytes_written, out_bytes_per_sec, 1000);
+        t.raw_time = aud::max (written - t.latency, 0);
+        t.raw_delay = aud::rescale<int64_t> (ring, out_bytes_per_sec, 1000) + t.latency;
+    }
+
+    if (s_input)
+    {
+        int delay = effect_adjust_delay (t.latency + t.buffered + conv_get_delay ());
+        int time = aud::rescale<int64_t> (in_frames, in_rate, 1000);
+
+        t.time = seek_time + aud::max (time - delay, 0);
+        t.delay = aud::clamp (delay, 0, time);
+    }
+
+    timing_lock.write (t);
+    last_timing = t;
+
+    __atomic_store_n (& stats.buffered, t.buffered, __ATOMIC_RELAXED);
+    __atomic_store_n (& stats.latency, t.latency, __ATOMIC_RELAXED);
+    atomic_max (stats.max_buffered, t.buffered);
+    atomic_max (stats.max_latency, t.latency);
+}
+
+/* how far the output has played since <t> was published, up to <limit> */
+static int timing_advance (const TimingSnapshot & t, int limit)
+{
+    if (! t.advancing)
+        return 0;
+
+    int64_t elapsed = (g_get_monotonic_time () - t.stamp) / 1000;
+    return aud::clamp<int64_t> (elapsed, 0, limit);
+}
+
+/* assumes LOCK_MINOR; called before more audio is written, to find out
+ * whether the output ran out of audio (or nearly so) in the meantime */
+static void check_underrun ()
+{
+    const TimingSnapshot & t = last_timing;
+    if (! t.advancing || t.raw_delay <= 0)
+        return;
+
+    int64_t left = t.raw_delay - (g_get_monotonic_time () - t.stamp) / 1000;
+
+    if (left <= 0)
+        atomic_add (stats.underruns, 1);
+    else if (left < LATE_WRITE_MS)
+        atomic_add (stats.late_writes, 1);
+}
+
+/* assumes LOCK_MINOR, s_output */
+static int get_written_time ()
+{
+    int64_t out_bytes = out_bytes_written + (s_writer ? out_ring.len () : 0);
+    return aud::rescale<int64_t> (out_bytes, out_bytes_per_sec, 1000);
+}
+
+/* assumes LOCK_ALL, s_output */
+static void write_bytes (const void * out_data, int len)
+{
+    out_bytes_held = len;
+    check_underrun ();
+
+    bool stalled = false;
+
+    if (s_writer)
+    {
+        while (! s_paused && ! s_flushed && ! s_resetting)
+        {
+            int written = out_ring.write (out_data, out_bytes_held);
+
+            out_data = (const char *) out_data + written;
+            out_bytes_held -= written;
+
+            if (written)
+            {
+                publish_timing ();
+                SIGNAL_MINOR;
+            }
+
+            if (! out_bytes_held)
+                break;
+
+            stalled = true;
+            WAIT_MINOR;
+        }
+    }
+    else
+    {
+        while (! s_paused && ! s_flushed && ! s_resetting)
+        {
+            int64_t start = g_get_monotonic_time ();
+            int written = cop->write_audio (out_data, out_bytes_held);
+            output_stats_add (OutputStage::Write, g_get_monotonic_time () - start);
+
+            out_data = (const char *) out_data + written;
+            out_bytes_held -= written;
+            out_bytes_written += written;
+
+            publish_timing ();
+
+            if (! out_bytes_held)
+                break;
+
+            stalled = true;
+
+            UNLOCK_MINOR;
+            start = g_get_monotonic_time ();
+            cop->period_wait ();
+            output_stats_add (OutputStage::PeriodWait, g_get_monotonic_time () - start);
+            LOCK_MINOR;
+        }
+    }
+
+    if (stalled)
+        atomic_add (stats.stalls, 1);
 }
 
 /* assumes LOCK_ALL, s_output */
@@ -316,52 +1007,108 @@ static void write_output (Index<float> & data)
     if (! data.len ())
         return;
 
-    if (s_secondary && record_stream == OutputStream::AfterEffects)
-        write_secondary (data);
+    if (sec_taps & tap_bit (OutputStream::AfterEffects))
+        write_secondary (tap_bit (OutputStream::AfterEffects), data.begin (), data.len ());
 
-    int out_time = aud::rescale<int64_t> (out_bytes_written, out_bytes_per_sec, 1000);
-    vis_runner_pass_audio (out_time, data, out_channels, out_rate);
+    int out_time = get_written_time ();
 
-    eq_filter (data.begin (), data.len ());
+    /* The equalizer, convolver, software volume, soft clipping and conversion
+     * to the output format (plus the visualization, secondary output and
+     * shared-memory taps) are done in a single pass, one cache-sized block at a
+     * time. */
+    AudioPostProcess pp = AudioPostProcess ();
 
-    if (s_secondary && record_stream == OutputStream::AfterEqualizer)
-        write_secondary (data);
+    pp.channels = out_channels;
+    pp.equalizer = eq_active ();
+    pp.convolver = conv_active ();
+    pp.soft_clip = cfg_soft_clipping.get ();
+    pp.format = out_format;
 
-    if (aud_get_bool (0, "software_volume_control"))
+    if (cfg_software_volume_control.get ())
     {
-        StereoVolume v = {aud_get_int (0, "sw_volume_left"), aud_get_int (0, "sw_volume_right")};
-        audio_amplify (data.begin (), out_channels, data.len () / out_channels, v);
+        StereoVolume v = {cfg_sw_volume_left.get (), cfg_sw_volume_right.get ()};
+        pp.volume = audio_volume_factors (out_channels, v, pp.factors);
     }
 
-    if (aud_get_bool (0, "soft_clipping"))
-        audio_soft_clip (data.begin (), data.len ());
+    pp.before_eq = pass_vis;
+    if ((sec_taps & tap_bit (OutputStream::AfterEqualizer)) || tap_active ())
+        pp.after_eq = pass_after_eq;
+    pp.user = & out_time;
 
     const void * out_data = data.begin ();
 
     if (out_format != FMT_FLOAT)
     {
         buffer2.resize (FMT_SIZEOF (out_format) * data.len ());
-        audio_to_int (data.begin (), buffer2.begin (), out_format, data.len ());
         out_data = buffer2.begin ();
     }
 
-    out_bytes_held = FMT_SIZEOF (out_format) * data.len ();
+    int64_t start = g_get_monotonic_time ();
+    audio_post_process (pp, data.begin (), data.len (), buffer2.begin ());
+    output_stats_add (OutputStage::PostProcess, g_get_monotonic_time () - start);
+
+    tap_commit (out_time, out_channels, out_rate);
+
+    write_bytes (out_data, FMT_SIZEOF (out_format) * data.len ());
+}
+
+/* Passthrough: when the decoder's format is also the output format and no
+ * processing stage would change the audio, the decoder's buffer is written to
+ * the output plugin as is.  The check is made for every buffer, so enabling
+ * any stage mid-track switches back to the normal path at once.  Conversion
+ * to floating point is still done if visualization, a secondary output or
+ * the shared-memory tap needs it, since all of their taps see the same audio
+ * in this case. */
+
+/* assumes LOCK_ALL, s_input, s_output */
+static bool can_passthrough ()
+{
+    if (in_format != out_format || in_channels != out_channels || in_rate != out_rate)
+        return false;
+
+    if (replay_gain_factor () != 1 || effect_active () || eq_active () ||
+     conv_active () || cfg_soft_clipping.get ())
+        return false;
+
+    if (cfg_software_volume_control.get ())
+    {
+        float factors[AUD_MAX_CHANNELS];
+        StereoVolume v = {cfg_sw_volume_left.get (), cfg_sw_volume_right.get ()};
+
+        if (audio_volume_factors (out_channels, v, factors))
+            return false;
+    }
+
+    return true;
+}
+
+/* assumes LOCK_ALL, s_input, s_output */
+static void write_passthrough (const void * data, int samples)
+{
+    bool vis = vis_runner_active ();
+    bool tap = tap_active ();
+    int out_time = get_written_time ();
 
-    while (! s_paused && ! s_flushed && ! s_resetting)
+    if (vis || sec_taps || tap)
     {
-        int written = cop->write_audio (out_data, out_bytes_held);
+        buffer1.resize (samples);
 
-        out_data = (const char *) out_data + written;
-        out_bytes_held -= written;
-        out_bytes_written += written;
+        if (in_format == FMT_FLOAT)
+            memcpy (buffer1.begin (), data, sizeof (float) * samples);
+        else
+            audio_from_int (data, in_format, buffer1.begin (), samples);
 
-        if (! out_bytes_held)
-            break;
+        if (sec_taps)
+            write_secondary (sec_taps, buffer1.begin (), samples);
 
-        UNLOCK_MINOR;
-        cop->period_wait ();
-        LOCK_MINOR;
+        if (vis)
+            pass_vis (buffer1.begin (), samples, 0, & out_time);
+        if (tap)
+            tap_write_pcm (buffer1.begin (), samples);
     }
+
+    tap_commit (out_time, out_channels, out_rate);
+    write_bytes (data, FMT_SIZEOF (in_format) * samples);
 }
 
 /* assumes LOCK_ALL, s_input, s_output */
@@ -384,6 +1131,22 @@ static bool process_audio (const void * data, int size, int stop_time)
 
     in_frames += samples / in_channels;
 
+    bool passthrough = can_passthrough ();
+
+    if (passthrough != s_passthrough)
+    {
+        AUDINFO ("Passthrough %s.\n", passthrough ? "engaged" : "disengaged");
+        __atomic_store_n (& s_passthrough, passthrough, __ATOMIC_RELAXED);
+    }
+
+    if (passthrough)
+    {
+        write_passthrough (data, samples);
+        return ! stopped;
+    }
+
+    int64_t start = g_get_monotonic_time ();
+
     buffer1.resize (samples);
 
     if (in_format == FMT_FLOAT)
@@ -391,24 +1154,59 @@ static bool process_audio (const void * data, int size, int stop_time)
     else
         audio_from_int (data, in_format, buffer1.begin (), samples);
 
-    if (s_secondary && record_stream == OutputStream::AsDecoded)
-        write_secondary (buffer1);
+    if (sec_taps & tap_bit (OutputStream::AsDecoded))
+        write_secondary (tap_bit (OutputStream::AsDecoded), buffer1.begin (), buffer1.len ());
 
     apply_replay_gain (buffer1);
 
-    if (s_secondary && record_stream == OutputStream::AfterReplayGain)
-        write_secondary (buffer1);
+    if (sec_taps & tap_bit (OutputStream::AfterReplayGain))
+        write_secondary (tap_bit (OutputStream::AfterReplayGain), buffer1.begin (), buffer1.len ());
 
-    write_output (effect_process (buffer1));
+    int64_t now = g_get_monotonic_time ();
+    output_stats_add (OutputStage::Convert, now - start);
+
+    start = now;
+    Index<float> & out = effect_process (buffer1);
+    output_stats_add (OutputStage::Effects, g_get_monotonic_time () - start);
+
+    write_output (out);
 
     return ! stopped;
 }
 
+/* assumes LOCK_ALL, s_output */
+static void write_conv_tail ()
+{
+    int frames = conv_active () ? conv_get_tail () : 0;
+    int chunk = aud::rescale (RT_CHUNK_MS, 1000, out_rate);
+
+    while (frames > 0 && ! s_paused && ! s_flushed && ! s_resetting)
+    {
+        int count = aud::min (frames, chunk);
+
+        buffer1.resize (out_channels * count);
+        memset (buffer1.begin (), 0, sizeof (float) * buffer1.len ());
+        write_output (buffer1);
+
+        frames -= count;
+    }
+}
+
 /* assumes LOCK_ALL, s_output */
 static void finish_effects (bool end_of_playlist)
 {
     buffer1.resize (0);
-    write_output (effect_finish (buffer1, end_of_playlist));
+
+    int64_t start = g_get_monotonic_time ();
+    Index<float> & out = effect_finish (buffer1, end_of_playlist);
+    output_stats_add (OutputStage::Effects, g_get_monotonic_time () - start);
+
+    write_output (out);
+
+    /* the convolver holds back a block of audio, plus the decay of the
+     * impulse response; between songs, the next one pushes it out */
+    if (end_of_playlist)
+        write_conv_tail ();
 }
 
 bool output_open_audio (const String & filename, const Tuple & tuple,
@@ -439,10 +1237,10 @@ bool output_open_audio (const String & filename, const Tuple & tuple,
 
     setup_effects ();
     setup_output (true);
+    setup_secondaries (true);
+    setup_realtime ();
 
-    if (aud_get_bool (0, "record"))
-        setup_secondary (true);
-
+    publish_timing ();
     UNLOCK_ALL;
     return true;
 }
@@ -479,6 +1277,8 @@ void output_set_replay_gain (const ReplayGainInfo & info)
 /* returns false if stop_time is reached */
 bool output_write_audio (const void * data, int size, int stop_time)
 {
+    rt_audit_begin ();
+
 RETRY:
     LOCK_ALL;
     bool good = false;
@@ -493,10 +1293,24 @@ RETRY:
             goto RETRY;
         }
 
-        good = process_audio (data, size, stop_time);
+        int chunk = rt_chunk_bytes ? aud::min (size, rt_chunk_bytes) : size;
+        good = process_audio (data, chunk, stop_time);
+
+        /* realtime mode: process the rest in another pass */
+        if (good && chunk < size)
+        {
+            data = (const char *) data + chunk;
+            size -= chunk;
+
+            UNLOCK_ALL;
+            goto RETRY;
+        }
     }
 
+    publish_timing ();
     UNLOCK_ALL;
+
+    rt_audit_end ();
     return good;
 }
 
@@ -531,6 +1345,7 @@ void output_flush (int time, bool force)
         in_frames = 0;
     }
 
+    publish_timing ();
     UNLOCK_MINOR;
 }
 
@@ -541,6 +1356,7 @@ void output_resume ()
     if (s_input)
         s_flushed = false;
 
+    publish_timing ();
     UNLOCK_ALL;
 }
 
@@ -555,49 +1371,43 @@ void output_pause (bool pause)
         if (s_output)
         {
             apply_pause ();
-            if (! s_paused && ! s_flushed && ! s_resetting)
-                SIGNAL_MINOR;
+            /* also wakes any thread waiting on out_ring */
+            SIGNAL_MINOR;
         }
     }
 
+    publish_timing ();
     UNLOCK_MINOR;
 }
 
 int output_get_time ()
 {
-    LOCK_MINOR;
-    int time = 0, delay = 0;
-
-    if (s_input)
-    {
-        if (s_output)
-        {
-            delay = cop->get_delay ();
-            delay += aud::rescale<int64_t> (out_bytes_held, out_bytes_per_sec, 1000);
-        }
-
-        delay = effect_adjust_delay (delay);
-        time = aud::rescale<int64_t> (in_frames, in_rate, 1000);
-        time = seek_time + aud::max (time - delay, 0);
-    }
+    TimingSnapshot t = timing_lock.read ();
+    return t.input ? t.time + timing_advance (t, t.delay) : 0;
+}
 
-    UNLOCK_MINOR;
-    return time;
+/* does not wait for the audio thread, so that it can be polled */
+bool output_get_passthrough ()
+{
+    return __atomic_load_n (& s_passthrough, __ATOMIC_RELAXED);
 }
 
 int output_get_raw_time ()
 {
-    LOCK_MINOR;
-    int time = 0;
+    TimingSnapshot t = timing_lock.read ();
+    return t.output ? t.raw_time + timing_advance (t, t.raw_delay) : 0;
+}
 
-    if (s_output)
-    {
-        time = aud::rescale<int64_t> (out_bytes_written, out_bytes_per_sec, 1000);
-        time = aud::max (time - cop->get_delay (), 0);
-    }
+bool output_get_timing (PlaybackTiming & timing)
+{
+    TimingSnapshot t = timing_lock.read ();
+    if (! t.input)
+        return false;
 
-    UNLOCK_MINOR;
-    return time;
+    timing.position = t.time + timing_advance (t, t.delay);
+    timing.buffered = t.buffered;
+    timing.latency = t.latency;
+    return true;
 }
 
 void output_close_audio ()
@@ -614,6 +1424,7 @@ void output_close_audio ()
             finish_effects (false); /* first time for end of song */
     }
 
+    publish_timing ();
     UNLOCK_ALL;
 }
 
@@ -627,9 +1438,10 @@ void output_drain ()
             finish_effects (true); /* second time for end of playlist */
 
         cleanup_output ();
-        cleanup_secondary ();
+        cleanup_secondaries ();
     }
 
+    publish_timing ();
     UNLOCK_ALL;
 }
 
@@ -648,7 +1460,7 @@ static void output_reset (OutputReset type, OutputPlugin * op)
     if (type != OutputReset::EffectsOnly)
         cleanup_output ();
 
-    /* this does not reset the secondary plugin */
+    /* this does not reset the secondary plugins */
     if (type == OutputReset::ResetPlugin)
     {
         if (cop)
@@ -656,13 +1468,22 @@ static void output_reset (OutputReset type, OutputPlugin * op)
 
         if (op)
         {
-            /* secondary plugin may become primary */
-            if (op == sop)
+            /* a secondary plugin may become primary */
+            bool was_secondary = false;
+
+            for (int i = 0; i < secondaries.len (); i ++)
             {
-                cleanup_secondary ();
-                sop = nullptr;
+                if (secondaries[i]->plugin == op)
+                {
+                    cleanup_secondary (* secondaries[i]);
+                    secondaries.remove (i, 1);
+                    update_taps ();
+                    was_secondary = true;
+                    break;
+                }
             }
-            else if (! op->init ())
+
+            if (! was_secondary && ! op->init ())
                 op = nullptr;
         }
 
@@ -675,9 +1496,8 @@ static void output_reset (OutputReset type, OutputPlugin * op)
             setup_effects ();
 
         setup_output (false);
-
-        if (aud_get_bool (0, "record"))
-            setup_secondary (false);
+        setup_secondaries (false);
+        setup_realtime ();
     }
 
     s_resetting = false;
@@ -685,6 +1505,7 @@ static void output_reset (OutputReset type, OutputPlugin * op)
     if (s_output && ! s_paused && ! s_flushed)
         SIGNAL_MINOR;
 
+    publish_timing ();
     UNLOCK_ALL;
 }
 
@@ -693,14 +1514,71 @@ EXPORT void aud_output_reset (OutputReset type)
     output_reset (type, cop);
 }
 
+EXPORT void aud_drct_get_output_stats (OutputStats & out)
+{
+    auto load = [] (const int64_t & var)
+        { return __atomic_load_n (& var, __ATOMIC_RELAXED); };
+    auto load_int = [] (const int & var)
+        { return __atomic_load_n (& var, __ATOMIC_RELAXED); };
+
+    for (int i = 0; i < (int) OutputStage::count; i ++)
+    {
+        const OutputStageStats & st = stats.stages[i];
+
+        out.stages[i].count = load (st.count);
+        out.stages[i].total_us = load (st.total_us);
+        out.stages[i].max_us = load_int (st.max_us);
+
+        for (int b = 0; b < AUD_OUTPUT_STATS_BUCKETS; b ++)
+            out.stages[i].histogram[b] = load (st.histogram[b]);
+    }
+
+    out.buffered = load_int (stats.buffered);
+    out.max_buffered = load_int (stats.max_buffered);
+    out.latency = load_int (stats.latency);
+    out.max_latency = load_int (stats.max_latency);
+
+    out.underruns = load (stats.underruns);
+    out.late_writes = load (stats.late_writes);
+    out.stalls = load (stats.stalls);
+}
+
+EXPORT void aud_drct_reset_output_stats ()
+{
+    auto clear = [] (int64_t & var)
+        { __atomic_store_n (& var, 0, __ATOMIC_RELAXED); };
+    auto clear_int = [] (int & var)
+        { __atomic_store_n (& var, 0, __ATOMIC_RELAXED); };
+
+    for (OutputStageStats & st : stats.stages)
+    {
+        clear (st.count);
+        clear (st.total_us);
+        clear_int (st.max_us);
+
+        for (int64_t & bucket : st.histogram)
+            clear (bucket);
+    }
+
+    /* the current values remain valid */
+    clear_int (stats.max_buffered);
+    clear_int (stats.max_latency);
+
+    clear (stats.underruns);
+    clear (stats.late_writes);
+    clear (stats.stalls);
+}
+
 EXPORT StereoVolume aud_drct_get_volume ()
 {
+    /* the software volume is read without waiting for the audio thread */
+    if (cfg_software_volume_control.get ())
+        return {cfg_sw_volume_left.get (), cfg_sw_volume_right.get ()};
+
     StereoVolume volume = {0, 0};
     LOCK_MINOR;
 
-    if (aud_get_bool (0, "software_volume_control"))
-        volume = {aud_get_int (0, "sw_volume_left"), aud_get_int (0, "sw_volume_right")};
-    else if (cop)
+    if (cop)
         volume = cop->get_volume ();
 
     UNLOCK_MINOR;
@@ -714,7 +1592,7 @@ EXPORT void aud_drct_set_volume (StereoVolume volume)
     volume.left = aud::clamp (volume.left, 0, 100);
     volume.right = aud::clamp (volume.right, 0, 100);
 
-    if (aud_get_bool (0, "software_volume_control"))
+    if (cfg_software_volume_control.get ())
     {
         aud_set_int (0, "sw_volume_left", volume.left);
         aud_set_int (0, "sw_volume_right", volume.right);
@@ -725,52 +1603,123 @@ EXPORT void aud_drct_set_volume (StereoVolume volume)
     UNLOCK_MINOR;
 }
 
-PluginHandle * output_plugin_get_current ()
+bool output_get_record_stats (PluginHandle * plugin, RecordStats & stats)
+{
+    bool recording = false;
+
+    LOCK_MINOR;
+
+    for (auto & sec : secondaries)
+    {
+        if (sec->handle == plugin && sec->open)
+        {
+            stats = sec->sink.stats ();
+            recording = true;
+        }
+    }
+
+    UNLOCK_MINOR;
+    return recording;
+}
+
+void output_set_override (OutputPlugin * op)
 {
-    return cop ? aud_plugin_by_header (cop) : nullptr;
+    if (op)
+    {
+        if (! s_override)
+        {
+            s_override = true;
+            sel_op = cop;
+        }
+
+        output_reset (OutputReset::ResetPlugin, op);
+    }
+    else if (s_override)
+    {
+        s_override = false;
+        output_reset (OutputReset::ResetPlugin, sel_op);
+        sel_op = nullptr;
+    }
 }
 
-PluginHandle * output_plugin_get_secondary ()
+PluginHandle * output_plugin_get_current ()
 {
-    return sop ? aud_plugin_by_header (sop) : nullptr;
+    OutputPlugin * op = s_override ? sel_op : cop;
+    return op ? aud_plugin_by_header (op) : nullptr;
 }
 
 bool output_plugin_set_current (PluginHandle * plugin)
 {
-    output_reset (OutputReset::ResetPlugin, plugin ?
-     (OutputPlugin *) aud_plugin_get_header (plugin) : nullptr);
+    auto op = plugin ? (OutputPlugin *) aud_plugin_get_header (plugin) : nullptr;
+
+    /* while overridden, just remember the new selection (but a null plugin
+     * means that we are shutting down, so clean up the override as well) */
+    if (s_override && plugin)
+    {
+        sel_op = op;
+        return (bool) op;
+    }
+
+    s_override = false;
+    sel_op = nullptr;
+
+    output_reset (OutputReset::ResetPlugin, op);
     return (! plugin || cop);
 }
 
-bool output_plugin_set_secondary (PluginHandle * plugin)
+bool output_plugin_add_secondary (PluginHandle * plugin)
 {
-    LOCK_MINOR;
+    LOCK_ALL;
 
-    cleanup_secondary ();
-    if (sop)
-        sop->cleanup ();
+    auto op = (OutputPlugin *) aud_plugin_get_header (plugin);
+    if (! op || ! op->init ())
+    {
+        UNLOCK_ALL;
+        return false;
+    }
 
-    sop = plugin ? (OutputPlugin *) aud_plugin_get_header (plugin) : nullptr;
-    if (sop && ! sop->init ())
-        sop = nullptr;
+    auto sec = new Secondary (plugin, op);
+    secondaries.append (SmartPtr<Secondary> (sec));
 
-    if (s_input && aud_get_bool (0, "record"))
-        setup_secondary (false);
+    if (s_input)
+    {
+        setup_secondary (* sec, false);
+        update_taps ();
+    }
 
-    UNLOCK_MINOR;
-    return (! plugin || sop);
+    UNLOCK_ALL;
+    return true;
+}
+
+void output_plugin_remove_secondary (PluginHandle * plugin)
+{
+    LOCK_ALL;
+
+    for (int i = 0; i < secondaries.len (); i ++)
+    {
+        if (secondaries[i]->handle == plugin)
+        {
+            cleanup_secondary (* secondaries[i]);
+            secondaries[i]->plugin->cleanup ();
+            secondaries.remove (i, 1);
+            update_taps ();
+            break;
+        }
+    }
+
+    UNLOCK_ALL;
 }
 
 static void record_settings_changed (void *, void *)
 {
-    LOCK_MINOR;
+    LOCK_ALL;
 
-    if (s_input && aud_get_bool (0, "record"))
-        setup_secondary (false);
+    if (s_input)
+        setup_secondaries (false);
     else
-        cleanup_secondary ();
+        cleanup_secondaries ();
 
-    UNLOCK_MINOR;
+    UNLOCK_ALL;
 }
 
 void output_init ()
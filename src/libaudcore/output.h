@@ -20,11 +20,16 @@
 #ifndef LIBAUDCORE_OUTPUT_H
 #define LIBAUDCORE_OUTPUT_H
 
+#include <stdint.h>
+
 #include <libaudcore/audio.h>
 #include <libaudcore/objects.h>
 
+class OutputPlugin;
 class PluginHandle;
 class Tuple;
+struct PlaybackTiming;
+enum class OutputStage;
 
 void output_init ();
 void output_cleanup ();
@@ -38,14 +43,36 @@ void output_flush (int time, bool force = false);
 void output_resume ();
 void output_pause (bool pause);
 
+/* these do not lock; see publish_timing() */
 int output_get_time ();
 int output_get_raw_time ();
+bool output_get_timing (PlaybackTiming & timing);
+
+/* adds a duration (in microseconds) to the statistics of <stage> */
+void output_stats_add (OutputStage stage, int64_t us);
+
+/* true if the last buffer was passed to the output plugin unmodified */
+bool output_get_passthrough ();
+
+struct RecordStats {
+    int queued_ms;      /* audio currently queued for the secondary plugin */
+    int max_queued_ms;  /* peak value of queued_ms since recording started */
+    int64_t dropped;    /* samples discarded because the queue was full */
+};
+
+/* returns false if <plugin> is not a secondary plugin or is not running */
+bool output_get_record_stats (PluginHandle * plugin, RecordStats & stats);
+
 void output_close_audio ();
 void output_drain ();
 
+/* temporarily replaces the primary output plugin with <op>, or restores the
+ * selected plugin if <op> is null */
+void output_set_override (OutputPlugin * op);
+
 PluginHandle * output_plugin_get_current ();
-PluginHandle * output_plugin_get_secondary ();
 bool output_plugin_set_current (PluginHandle * plugin);
-bool output_plugin_set_secondary (PluginHandle * plugin);
+bool output_plugin_add_secondary (PluginHandle * plugin);
+void output_plugin_remove_secondary (PluginHandle * plugin);
 
 #endif
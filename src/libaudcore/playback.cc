@@ -40,6 +40,8 @@
 #include <assert.h>
 #include <pthread.h>
 
+#include <glib.h>  /* for g_get_monotonic_time */
+
 #include "audstrings.h"
 #include "hook.h"
 #include "i18n.h"
@@ -102,6 +104,21 @@ static QueuedFunc end_queue;
 static bool song_finished = false;
 static int failed_entries = 0;
 
+// when the last song ended on its own, the time (in microseconds) at which
+// decoding finished; the delay until the next song opens audio is kept in
+// change_time (in milliseconds)
+static int64_t change_start = 0;
+static int change_time = -1;
+
+// when the input plugin last returned from write_audio(), for the "decode"
+// statistics (see output_stats_add); used only by the playback thread
+static int64_t decode_start = 0;
+
+static ConfigHandle<bool> cfg_repeat ("repeat");
+static ConfigHandle<bool> cfg_no_playlist_advance ("no_playlist_advance");
+static ConfigHandle<bool> cfg_stop_after_current_song ("stop_after_current_song");
+static ConfigHandle<bool> cfg_show_numbers_in_pl ("show_numbers_in_pl");
+
 static void lock ()
     { pthread_mutex_lock (& mutex); }
 static void unlock ()
@@ -207,6 +224,8 @@ void playback_stop (bool exiting)
     if (pb_state.playing)
         playback_cleanup_locked ();
 
+    change_start = 0;
+
     if (pb_state.thread_running)
     {
         // discard audio buffer if exiting
@@ -244,20 +263,20 @@ static void end_cb (void *)
 
     auto do_next = [playlist] ()
     {
-        if (! playlist.next_song (aud_get_bool (nullptr, "repeat")))
+        if (! playlist.next_song (cfg_repeat.get ()))
         {
             playlist.set_position (-1);
             hook_call ("playlist end reached", nullptr);
         }
     };
 
-    if (aud_get_bool (nullptr, "no_playlist_advance"))
+    if (cfg_no_playlist_advance.get ())
     {
         // we assume here that repeat is not enabled;
         // single-song repeats are handled in run_playback()
         do_stop ();
     }
-    else if (aud_get_bool (nullptr, "stop_after_current_song"))
+    else if (cfg_stop_after_current_song.get ())
     {
         do_stop ();
         do_next ();
@@ -341,8 +360,8 @@ static void run_playback ()
             break;
 
         // check whether we need to repeat
-        pb_info.ended = (pb_control.repeat_a < 0 && ! (aud_get_bool (nullptr,
-         "repeat") && aud_get_bool (nullptr, "no_playlist_advance")));
+        pb_info.ended = (pb_control.repeat_a < 0 && ! (cfg_repeat.get () &&
+         cfg_no_playlist_advance.get ()));
 
         if (! pb_info.ended)
             request_seek_locked (pb_control.repeat_a);
@@ -376,7 +395,10 @@ static void finish_playback_locked ()
             AUDERR ("Playback finished with error.\n");
     }
     else
+    {
         failed_entries = 0;
+        change_start = g_get_monotonic_time ();
+    }
 
     // queue up function to start next song (or perform cleanup)
     end_queue.queue (end_cb, nullptr);
@@ -436,6 +458,10 @@ void playback_play (int seek_time, bool pause)
 {
     lock ();
 
+    // only automatic track changes are timed
+    if (! song_finished)
+        change_start = 0;
+
     if (pb_state.playing)
         playback_cleanup_locked ();
 
@@ -515,11 +541,20 @@ EXPORT void InputPlugin::open_audio (int format, int rate, int channels)
     pb_info.samplerate = rate;
     pb_info.channels = channels;
 
+    decode_start = 0;
+
     if (pb_info.ready)
         event_queue ("info change", nullptr);
     else
         event_queue ("playback ready", nullptr);
 
+    if (change_start)
+    {
+        change_time = (g_get_monotonic_time () - change_start) / 1000;
+        change_start = 0;
+        AUDINFO ("Track change took %d ms.\n", change_time);
+    }
+
     pb_info.ready = true;
 
     unlock ();
@@ -539,6 +574,9 @@ EXPORT void InputPlugin::set_replay_gain (const ReplayGainInfo & gain)
 
 EXPORT void InputPlugin::write_audio (const void * data, int length)
 {
+    if (decode_start)
+        output_stats_add (OutputStage::Decode, g_get_monotonic_time () - decode_start);
+
     if (! lock_if (in_sync))
         return;
 
@@ -551,7 +589,11 @@ EXPORT void InputPlugin::write_audio (const void * data, int length)
     // it's okay to call output_write_audio() even if we are no longer in sync,
     // since it will return immediately if output_flush() has been called
     int stop_time = (b >= 0) ? b : pb_info.stop_time;
-    if (output_write_audio (data, length, stop_time))
+    bool more = output_write_audio (data, length, stop_time);
+
+    decode_start = g_get_monotonic_time ();
+
+    if (more)
         return;
 
     if (! lock_if (in_sync))
@@ -666,7 +708,7 @@ EXPORT String aud_drct_get_title ()
 
     unlock ();
 
-    StringBuf prefix = aud_get_bool (nullptr, "show_numbers_in_pl") ?
+    StringBuf prefix = cfg_show_numbers_in_pl.get () ?
      str_printf ("%d. ", 1 + entry) : StringBuf (0);
 
     StringBuf time = (length > 0) ? str_format_time (length) : StringBuf ();
@@ -706,6 +748,33 @@ EXPORT int aud_drct_get_time ()
     return time;
 }
 
+// thread-safe
+EXPORT bool aud_drct_get_timing (PlaybackTiming & timing)
+{
+    lock ();
+    bool valid = is_ready () && output_get_timing (timing);
+    unlock ();
+    return valid;
+}
+
+// thread-safe
+EXPORT bool aud_drct_get_passthrough ()
+{
+    lock ();
+    bool passthrough = is_ready () && output_get_passthrough ();
+    unlock ();
+    return passthrough;
+}
+
+// thread-safe
+EXPORT int aud_drct_get_track_change_time ()
+{
+    lock ();
+    int time = change_time;
+    unlock ();
+    return time;
+}
+
 // thread-safe
 EXPORT int aud_drct_get_length ()
 {
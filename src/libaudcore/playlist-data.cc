@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "internal.h"
+#include "meta-cache.h"
 #include "runtime.h"
 #include "scanner.h"
 #include "tuple-compiler.h"
@@ -29,6 +31,12 @@
 static TupleCompiler s_tuple_formatter;
 static bool s_use_tuple_fallbacks = false;
 
+/* read with the playlist lock held */
+static ConfigHandle<bool> cfg_advance_on_delete ("advance_on_delete");
+static ConfigHandle<bool> cfg_album_shuffle ("album_shuffle");
+static ConfigHandle<bool> cfg_repeat ("repeat");
+static ConfigHandle<bool> cfg_shuffle ("shuffle");
+
 struct PlaylistEntry
 {
     PlaylistEntry (PlaylistAddItem && item);
@@ -112,6 +120,7 @@ void PlaylistData::delete_entry (PlaylistEntry * entry) // static
 PlaylistData::PlaylistData (Playlist::ID * id, const char * title) :
     modified (true),
     scan_status (NotScanning),
+    scans_queued (0),
     title (title),
     resume_time (0),
     m_id (id),
@@ -130,10 +139,27 @@ PlaylistData::~PlaylistData ()
     pl_signal_playlist_deleted (m_id);
 }
 
+static bool entry_is_unscanned (const PlaylistEntry & entry)
+{
+    return entry.tuple.state () == Tuple::Initial &&
+           strncmp (entry.filename, "stdin://", 8); // blacklist stdin
+}
+
+/* also brings m_unscanned up to date for the rows that moved */
 void PlaylistData::number_entries (int at, int length)
 {
+    m_unscanned.resize (m_entries.len ());
+
     for (int i = at; i < at + length; i ++)
+    {
         m_entries[i]->number = i;
+        m_unscanned.set (i, entry_is_unscanned (* m_entries[i]));
+    }
+}
+
+void PlaylistData::update_unscanned (const PlaylistEntry * entry)
+{
+    m_unscanned.set (entry->number, entry_is_unscanned (* entry));
 }
 
 PlaylistEntry * PlaylistData::entry_at (int i)
@@ -173,6 +199,7 @@ void PlaylistData::set_entry_tuple (PlaylistEntry * entry, Tuple && tuple)
         m_selected_length -= entry->length;
 
     entry->set_tuple (std::move (tuple));
+    update_unscanned (entry);
 
     m_total_length += entry->length;
     if (entry->selected)
@@ -234,6 +261,10 @@ void PlaylistData::insert_items (int at, Index<PlaylistAddItem> && items)
     int i = at;
     for (auto & item : items)
     {
+        /* never scanned, so the cache would not know it is still used */
+        if (item.tuple.valid ())
+            meta_cache_touch (item.filename);
+
         auto entry = new PlaylistEntry (std::move (item));
         m_entries[i ++].capture (entry);
         m_total_length += entry->length;
@@ -298,8 +329,8 @@ void PlaylistData::remove_entries (int at, int number)
 
     if (position_changed)
     {
-        if (aud_get_bool (nullptr, "advance_on_delete"))
-            next_song_with_hint (aud_get_bool (nullptr, "repeat"), at);
+        if (cfg_advance_on_delete.get ())
+            next_song_with_hint (cfg_repeat.get (), at);
 
         queue_position_change ();
     }
@@ -551,8 +582,8 @@ void PlaylistData::remove_selected ()
 
     if (position_changed)
     {
-        if (aud_get_bool (nullptr, "advance_on_delete"))
-            next_song_with_hint (aud_get_bool (nullptr, "repeat"), n_entries - after);
+        if (cfg_advance_on_delete.get ())
+            next_song_with_hint (cfg_repeat.get (), n_entries - after);
 
         queue_position_change ();
     }
@@ -817,7 +848,7 @@ bool PlaylistData::shuffle_prev ()
 
 bool PlaylistData::shuffle_next ()
 {
-    bool by_album = aud_get_bool (nullptr, "album_shuffle");
+    bool by_album = cfg_album_shuffle.get ();
 
     // helper #1: determine whether two entries are in the same album
     auto same_album = [] (const Tuple & a, const Tuple & b)
@@ -944,7 +975,7 @@ void PlaylistData::shuffle_replay (const Index<int> & history)
 
 bool PlaylistData::prev_song ()
 {
-    if (aud_get_bool (nullptr, "shuffle"))
+    if (cfg_shuffle.get ())
     {
         if (! shuffle_prev ())
             return false;
@@ -975,7 +1006,7 @@ bool PlaylistData::next_song_with_hint (bool repeat, int hint)
         return true;
     }
 
-    if (aud_get_bool (nullptr, "shuffle"))
+    if (cfg_shuffle.get ())
     {
         if (shuffle_next ())
             return true;
@@ -1009,23 +1040,73 @@ bool PlaylistData::next_song (bool repeat)
     return true;
 }
 
-int PlaylistData::next_unscanned_entry (int entry_num) const
+/* Returns the entry that next_song() would move to, so that it can be opened
+ * in advance.  Returns nullptr if the next entry depends on a random shuffle
+ * choice, or if it is stdin (which cannot be opened twice). */
+PlaylistEntry * PlaylistData::predict_next_song (bool repeat)
+{
+    PlaylistEntry * next = predict_next_song_unchecked (repeat);
+    if (next && ! strncmp (next->filename, "stdin://", 8))
+        return nullptr;
+
+    return next;
+}
+
+PlaylistEntry * PlaylistData::predict_next_song_unchecked (bool repeat)
 {
-    if (entry_num < 0)
-        return -1;
+    int n_entries = m_entries.len ();
+    if (! n_entries)
+        return nullptr;
+
+    if (m_queued.len ())
+        return m_queued[0];
 
-    for (; entry_num < m_entries.len (); entry_num ++)
+    if (cfg_shuffle.get ())
     {
-        auto & entry = *m_entries[entry_num];
+        if (! m_position)
+            return nullptr;
+
+        // same as steps #1 and #2 in shuffle_next()
+        PlaylistEntry * next = nullptr;
 
-        if (entry.tuple.state () == Tuple::Initial &&
-            strncmp (entry.filename, "stdin://", 8)) // blacklist stdin
+        for (auto & entry : m_entries)
         {
-            return entry_num;
+            if (entry->shuffle_num > m_position->shuffle_num &&
+             (! next || entry->shuffle_num < next->shuffle_num))
+                next = entry.get ();
+        }
+
+        if (next)
+            return next;
+
+        if (cfg_album_shuffle.get () && m_position->number + 1 < n_entries)
+        {
+            next = m_entries[m_position->number + 1].get ();
+
+            String album = m_position->tuple.get_str (Tuple::Album);
+            if (! next->shuffle_num && album && album == next->tuple.get_str (Tuple::Album))
+                return next;
         }
+
+        return nullptr;
     }
 
-    return -1;
+    int hint = position () + 1; // -1 becomes 0
+    if (hint >= n_entries)
+    {
+        if (! repeat)
+            return nullptr;
+
+        hint = 0;
+    }
+
+    return m_entries[hint].get ();
+}
+
+/* searches up to (but not including) <end_num>, or to the end if -1 */
+int PlaylistData::next_unscanned_entry (int entry_num, int end_num) const
+{
+    return m_unscanned.find_next (entry_num, end_num);
 }
 
 ScanRequest * PlaylistData::create_scan_request (PlaylistEntry * entry,
@@ -1057,6 +1138,7 @@ void PlaylistData::update_entry_from_scan (PlaylistEntry * entry, ScanRequest *
     if (entry->tuple.state () == Tuple::Initial)
     {
         entry->tuple.set_state (Tuple::Failed);
+        update_unscanned (entry);
         queue_update (Playlist::Metadata, entry->number, 1, update_flags);
     }
 }
@@ -1080,6 +1162,11 @@ bool PlaylistData::entry_needs_rescan (PlaylistEntry * entry, bool need_decoder,
     return (need_decoder && ! entry->decoder) || (need_tuple && ! entry->tuple.valid ());
 }
 
+bool PlaylistData::entry_is_local (const PlaylistEntry * entry)
+{
+    return ! strncmp (entry->filename, "file://", 7);
+}
+
 void PlaylistData::reformat_titles ()
 {
     for (auto & entry : m_entries)
@@ -20,6 +20,7 @@
 #ifndef PLAYLIST_DATA_H
 #define PLAYLIST_DATA_H
 
+#include "bitmap.h"
 #include "playlist.h"
 #include "scanner.h"
 
@@ -99,9 +100,11 @@ public:
 
     bool prev_song ();
     bool next_song (bool repeat);
+    PlaylistEntry * predict_next_song (bool repeat);
 
-    int next_unscanned_entry (int entry_num) const;
+    int next_unscanned_entry (int entry_num, int end_num = -1) const;
     bool entry_needs_rescan (PlaylistEntry * entry, bool need_decoder, bool need_tuple);
+    static bool entry_is_local (const PlaylistEntry * entry);
     ScanRequest * create_scan_request (PlaylistEntry * entry,
      ScanRequest::Callback callback, int extra_flags);
     void update_entry_from_scan (PlaylistEntry * entry, ScanRequest * request, int update_flags);
@@ -130,6 +133,7 @@ private:
     typedef SmartPtr<PlaylistEntry, delete_entry> EntryPtr;
 
     void number_entries (int at, int length);
+    void update_unscanned (const PlaylistEntry * entry);
     void set_entry_tuple (PlaylistEntry * entry, Tuple && tuple);
     void queue_update (Playlist::UpdateLevel level, int at, int count, int flags = 0);
     void queue_position_change ();
@@ -143,6 +147,7 @@ private:
     void shuffle_reset ();
 
     bool next_song_with_hint (bool repeat, int hint);
+    PlaylistEntry * predict_next_song_unchecked (bool repeat);
 
     PlaylistEntry * find_unselected_focus ();
     PlaylistEntry * queue_pop ();
@@ -150,12 +155,14 @@ private:
 public:
     bool modified;
     ScanStatus scan_status;
+    int scans_queued;  /* entries being scanned, counted by playlist.cc */
     String filename, title;
     int resume_time;
 
 private:
     Playlist::ID * m_id;
     Index<EntryPtr> m_entries;
+    Bitmap m_unscanned;  /* rows found by next_unscanned_entry() */
     PlaylistEntry * m_position, * m_focus;
     int m_selected_count;
     int m_last_shuffle_num;
@@ -53,6 +53,10 @@ public:
     void insert_flat_items (int at, Index<PlaylistAddItem> && items) const;
 };
 
+/* adder.cc */
+Index<PlaylistAddItem> adder_search_folder (const char * folder,
+ Playlist::FilterFunc filter, void * user, bool & filtered);
+
 /* playlist.cc */
 void playlist_init ();
 void playlist_enable_scan (bool enable);
@@ -133,20 +133,66 @@ struct ScanItem : public ListNode
         entry (entry),
         request (request),
         for_playback (for_playback),
-        handled_by_playback (false) {}
+        handled_by_playback (false),
+        prefetch (false),
+        deferred (false),
+        hinted (false) {}
 
     PlaylistData * playlist;
     PlaylistEntry * entry;
     ScanRequest * request;
+    String group; /* see scanner_group() */
     bool for_playback;
     bool handled_by_playback;
+    bool prefetch;
+    bool deferred; /* request not yet made, see scan_start_deferred() */
+    bool hinted; /* queued by scan_queue_hinted_entry() */
 };
 
 static bool scan_enabled_nominal, scan_enabled;
 static int scan_playlist, scan_row;
 static List<ScanItem> scan_list;
 
+/* indexes into scan_list, so that looking up an item does not depend on the
+ * number of entries being scanned */
+static SimpleHash<PtrHashKey, ScanItem *> scan_items_by_entry;
+static SimpleHash<PtrHashKey, ScanItem *> scan_items_by_request;
+
+/* Each scanner group is given at most scanner_capacity() requests at a time,
+ * counted here.  An entry found by the sweep or a hint whose group is full is
+ * added to scan_list as a deferred item, without making its request, and the
+ * sweep goes on to entries that may be in other groups.  Deferred items are
+ * started (hinted ones first) as their groups make room.  The sweep stops at
+ * SCAN_MAX_DEFERRED of them, which bounds both how far it looks ahead past a
+ * slow group and the work done each time a request finishes. */
+#define SCAN_MAX_DEFERRED 256
+
+static SimpleHash<String, int> scan_group_items; /* items not deferred */
+static int scan_deferred;
+
+/* Rows hinted by Playlist::scan_hint() (usually those visible in a playlist
+ * view) are queued ahead of the background sweep above, which picks up again
+ * at scan_playlist/scan_row once they are done.  Only the latest hint is kept;
+ * hint_row advances through it as its rows are queued. */
+static Playlist::ID * hint_id;
+static int hint_row, hint_last;
+
+/* The song predicted to play next is scanned (with the file opened) while the
+ * current one plays.  If the prediction turns out right, playback_entry_read()
+ * takes over the results instead of scanning the entry again. */
+static bool prefetch_armed;
+static PlaylistEntry * prefetch_entry;
+static SmartPtr<ScanRequest> prefetch_result;
+static int prefetch_hits, prefetch_misses;
+
+static ConfigHandle<bool> cfg_metadata_on_play ("metadata_on_play");
+static ConfigHandle<bool> cfg_no_playlist_advance ("no_playlist_advance");
+static ConfigHandle<bool> cfg_prepare_next_song ("prepare_next_song");
+static ConfigHandle<bool> cfg_repeat ("repeat");
+static ConfigHandle<bool> cfg_stop_after_current_song ("stop_after_current_song");
+
 static void scan_finish (ScanRequest * request);
+static void scan_finish_locked (ScanRequest * request);
 static void scan_cancel (PlaylistEntry * entry);
 static void scan_restart ();
 
@@ -290,24 +336,103 @@ EXPORT bool Playlist::scan_in_progress_any ()
     RETURN (scanning);
 }
 
+static void scan_count_group (const String & group, int diff)
+{
+    int * items = scan_group_items.lookup (group);
+    if (! items)
+        items = scan_group_items.add (group, 0);
+
+    * items += diff;
+
+    if (! * items)
+        scan_group_items.remove (group);
+}
+
+static bool scan_group_full (const String & group)
+{
+    int * items = scan_group_items.lookup (group);
+    return items && * items >= scanner_capacity (group);
+}
+
+/* item->group and item->deferred must be set */
+static void scan_list_add (ScanItem * item)
+{
+    scan_list.append (item);
+    scan_items_by_entry.add (item->entry, (ScanItem *) item);
+    scan_items_by_request.add (item->request, (ScanItem *) item);
+    item->playlist->scans_queued ++;
+
+    if (item->deferred)
+        scan_deferred ++;
+    else
+        scan_count_group (item->group, 1);
+}
+
+/* the caller deletes the item (and the request, if deferred) */
+static void scan_list_remove (ScanItem * item)
+{
+    scan_list.remove (item);
+    scan_items_by_entry.remove (item->entry);
+    scan_items_by_request.remove (item->request);
+    item->playlist->scans_queued --;
+
+    if (item->deferred)
+        scan_deferred --;
+    else
+        scan_count_group (item->group, -1);
+}
+
 static ScanItem * scan_list_find_entry (PlaylistEntry * entry)
 {
-    auto match = [entry] (const ScanItem & item)
-        { return item.entry == entry; };
+    ScanItem * * item = scan_items_by_entry.lookup (entry);
+    return item ? * item : nullptr;
+}
 
-    return scan_list.find (match);
+static ScanItem * scan_list_find_request (ScanRequest * request)
+{
+    ScanItem * * item = scan_items_by_request.lookup (request);
+    return item ? * item : nullptr;
 }
 
-static void scan_queue_entry (PlaylistData * playlist, PlaylistEntry * entry, bool for_playback = false)
+/* if <may_defer> is set, the request is deferred if its group is full */
+static ScanItem * scan_queue_entry (PlaylistData * playlist,
+ PlaylistEntry * entry, bool for_playback = false, bool may_defer = false)
 {
     int extra_flags = for_playback ? (SCAN_IMAGE | SCAN_FILE) : 0;
     auto request = playlist->create_scan_request (entry, scan_finish, extra_flags);
+    auto item = new ScanItem (playlist, entry, request, for_playback);
+
+    item->group = scanner_group (request->filename);
+    item->deferred = may_defer && scan_group_full (item->group);
 
-    scan_list.append (new ScanItem (playlist, entry, request, for_playback));
+    scan_list_add (item);
 
     /* playback entry will be scanned by the playback thread */
-    if (! for_playback)
+    if (! for_playback && ! item->deferred)
         scanner_request (request);
+
+    return item;
+}
+
+static void scan_start_item (ScanItem * item)
+{
+    item->deferred = false;
+    scan_deferred --;
+    scan_count_group (item->group, 1);
+
+    scanner_request (item->request);
+}
+
+static void scan_start_deferred ()
+{
+    for (int hinted = 1; hinted >= 0 && scan_deferred; hinted --)
+    {
+        for (ScanItem * item = scan_list.head (); item; item = scan_list.next (item))
+        {
+            if (item->deferred && item->hinted == hinted && ! scan_group_full (item->group))
+                scan_start_item (item);
+        }
+    }
 }
 
 static void scan_reset_playback ()
@@ -328,10 +453,7 @@ static void scan_reset_playback ()
 
 static void scan_check_complete (PlaylistData * playlist)
 {
-    auto match = [playlist] (const ScanItem & item)
-        { return item.playlist == playlist; };
-
-    if (playlist->scan_status != PlaylistData::ScanEnding || scan_list.find (match))
+    if (playlist->scan_status != PlaylistData::ScanEnding || playlist->scans_queued)
         return;
 
     playlist->scan_status = PlaylistData::NotScanning;
@@ -346,6 +468,31 @@ static void scan_check_complete (PlaylistData * playlist)
     event_queue ("playlist scan complete", nullptr);
 }
 
+static bool scan_queue_hinted_entry ()
+{
+    /* the hinted playlist may have been deleted */
+    PlaylistData * playlist = hint_id ? hint_id->data : nullptr;
+
+    while (playlist)
+    {
+        hint_row = playlist->next_unscanned_entry (hint_row, hint_last + 1);
+        if (hint_row < 0)
+            break;
+
+        auto entry = playlist->entry_at (hint_row);
+        hint_row ++;
+
+        if (! scan_list_find_entry (entry))
+        {
+            scan_queue_entry (playlist, entry, false, true)->hinted = true;
+            return true;
+        }
+    }
+
+    hint_id = nullptr;
+    return false;
+}
+
 static bool scan_queue_next_entry ()
 {
     if (! scan_enabled)
@@ -366,7 +513,7 @@ static bool scan_queue_next_entry ()
                 auto entry = playlist->entry_at (scan_row);
                 if (! scan_list_find_entry (entry))
                 {
-                    scan_queue_entry (playlist, entry);
+                    scan_queue_entry (playlist, entry, false, true);
                     return true;
                 }
 
@@ -386,36 +533,50 @@ static bool scan_queue_next_entry ()
 
 static void scan_schedule ()
 {
-    int scheduled = 0;
+    if (scan_deferred)
+        scan_start_deferred ();
 
-    for (ScanItem * item = scan_list.head (); item; item = scan_list.next (item))
-    {
-        if (++ scheduled >= SCAN_THREADS)
-            return;
-    }
+    /* hinted rows are not held back by SCAN_MAX_DEFERRED, since there are
+     * only as many as a playlist view shows */
+    while (scan_enabled && scan_queue_hinted_entry ())
+        ;
 
-    while (scan_queue_next_entry ())
-    {
-        if (++ scheduled >= SCAN_THREADS)
-            return;
-    }
+    while (scan_deferred < SCAN_MAX_DEFERRED && scan_queue_next_entry ())
+        ;
 }
 
 static void scan_finish (ScanRequest * request)
 {
     ENTER;
+    scan_finish_locked (request);
+    LEAVE;
+}
 
-    auto match = [request] (const ScanItem & item)
-        { return item.request == request; };
-
-    ScanItem * item = scan_list.find (match);
+static void scan_finish_locked (ScanRequest * request)
+{
+    ScanItem * item = scan_list_find_request (request);
     if (! item)
-        RETURN ();
+        return;
 
     PlaylistData * playlist = item->playlist;
     PlaylistEntry * entry = item->entry;
 
-    scan_list.remove (item);
+    scan_list_remove (item);
+
+    /* keep the open file etc. for playback_entry_read(); a remote entry is
+     * only looked up in advance (see prefetch_next_locked()) */
+    if (item->prefetch)
+    {
+        if (request->flags & SCAN_FILE)
+        {
+            prefetch_entry = entry;
+            prefetch_result.capture (new ScanRequest (request->filename,
+             request->flags, nullptr, request->decoder, request->tuple.ref ()));
+            prefetch_result->take_results (* request);
+        }
+        else
+            prefetch_entry = nullptr;
+    }
 
     // only use delayed update if a scan is still in progress
     int update_flags = 0;
@@ -430,8 +591,6 @@ static void scan_finish (ScanRequest * request)
     scan_schedule ();
 
     pthread_cond_broadcast (& cond);
-
-    LEAVE;
 }
 
 static void scan_cancel (PlaylistEntry * entry)
@@ -440,10 +599,74 @@ static void scan_cancel (PlaylistEntry * entry)
     if (! item)
         return;
 
-    scan_list.remove (item);
+    scan_list_remove (item);
+
+    if (item->deferred)
+        delete item->request;
+
     delete (item);
 }
 
+static void prefetch_clear ()
+{
+    auto match = [] (const ScanItem & item)
+        { return item.prefetch; };
+
+    ScanItem * item = scan_list.find (match);
+    if (item)
+    {
+        scan_list_remove (item);
+        delete item;
+    }
+
+    prefetch_entry = nullptr;
+    prefetch_result.clear ();
+}
+
+/* called once the current song has been opened, and again whenever the
+ * playing playlist or its queue changes */
+static void prefetch_next_locked ()
+{
+    if (! prefetch_armed || ! playing_id || ! cfg_prepare_next_song.get () ||
+     cfg_no_playlist_advance.get () || cfg_stop_after_current_song.get ())
+    {
+        prefetch_clear ();
+        return;
+    }
+
+    auto playlist = playing_id->data;
+    auto entry = playlist->predict_next_song (cfg_repeat.get ());
+
+    if (entry == prefetch_entry)
+        return;
+
+    prefetch_clear ();
+
+    /* leave entries that are already being scanned alone */
+    if (! entry || scan_list_find_entry (entry))
+        return;
+
+    /* Only local files are opened in advance.  A server may drop a connection
+     * left idle until the track change, and a live stream would buffer audio
+     * that is stale by then, so for other entries only the decoder and tuple
+     * are looked up (if not yet known), and nothing is kept open. */
+    bool local = PlaylistData::entry_is_local (entry);
+
+    if (! local && ! playlist->entry_needs_rescan (entry, true, true))
+        return;
+
+    auto request = playlist->create_scan_request (entry, scan_finish,
+     local ? SCAN_IMAGE | SCAN_FILE | SCAN_WARM : 0);
+    auto item = new ScanItem (playlist, entry, request, false);
+    item->group = scanner_group (request->filename);
+    item->prefetch = true;
+
+    scan_list_add (item);
+    scanner_request (request);
+
+    prefetch_entry = entry;
+}
+
 static void scan_restart ()
 {
     scan_playlist = 0;
@@ -451,6 +674,24 @@ static void scan_restart ()
     scan_schedule ();
 }
 
+EXPORT void Playlist::scan_hint (int first, int last) const
+{
+    ENTER_GET_PLAYLIST ();
+
+    first = aud::max (first, 0);
+    last = aud::min (last, playlist->n_entries () - 1);
+
+    if (first <= last)
+    {
+        hint_id = m_id;
+        hint_row = first;
+        hint_last = last;
+        scan_schedule ();
+    }
+
+    LEAVE;
+}
+
 /* mutex may be unlocked during the call */
 static void wait_for_entry (PlaylistData * playlist, int entry_num, bool need_decoder, bool need_tuple)
 {
@@ -465,7 +706,8 @@ static void wait_for_entry (PlaylistData * playlist, int entry_num, bool need_de
             return;
 
         // start scan if not already running ...
-        if (! scan_list_find_entry (entry))
+        ScanItem * item = scan_list_find_entry (entry);
+        if (! item)
         {
             // ... but only once
             if (scan_started)
@@ -473,6 +715,8 @@ static void wait_for_entry (PlaylistData * playlist, int entry_num, bool need_de
 
             scan_queue_entry (playlist, entry);
         }
+        else if (item->deferred)
+            scan_start_item (item);
 
         // wait for scan to finish
         scan_started = true;
@@ -484,6 +728,7 @@ static void start_playback_locked (int seek_time, bool pause)
 {
     art_clear_current ();
     scan_reset_playback ();
+    prefetch_armed = false;
 
     playback_play (seek_time, pause);
 
@@ -491,7 +736,16 @@ static void start_playback_locked (int seek_time, bool pause)
     auto entry = playlist->entry_at (playlist->position ());
 
     // playback always begins with a rescan of the current entry in order to
-    // open the file, ensure a valid tuple, and read album art
+    // open the file, ensure a valid tuple, and read album art; a prefetched
+    // scan of the entry is kept, but one still in progress is abandoned
+    if (entry != prefetch_entry || ! prefetch_result)
+    {
+        if (prefetch_entry)
+            prefetch_misses ++;
+
+        prefetch_clear ();
+    }
+
     scan_cancel (entry);
     scan_queue_entry (playlist, entry, true);
 }
@@ -500,12 +754,17 @@ static void stop_playback_locked ()
 {
     art_clear_current ();
     scan_reset_playback ();
+    prefetch_armed = false;
+    prefetch_clear ();
 
     playback_stop ();
 }
 
 void pl_signal_entry_deleted (PlaylistEntry * entry)
 {
+    if (entry == prefetch_entry)
+        prefetch_clear ();
+
     scan_cancel (entry);
 }
 
@@ -549,6 +808,9 @@ void pl_signal_update_queued (Playlist::ID * id, Playlist::UpdateLevel level, in
         playlist->modified = true;
     }
 
+    if (id == playing_id && (level == Playlist::Structure || (flags & PlaylistData::QueueChanged)))
+        prefetch_next_locked ();
+
     queue_global_update (level, flags);
 }
 
@@ -580,7 +842,7 @@ static void pl_hook_reformat_titles (void *, void *)
 static void pl_hook_trigger_scan (void *, void *)
 {
     ENTER;
-    scan_enabled = scan_enabled_nominal && ! aud_get_bool (nullptr, "metadata_on_play");
+    scan_enabled = scan_enabled_nominal && ! cfg_metadata_on_play.get ();
     scan_restart ();
     LEAVE;
 }
@@ -614,7 +876,7 @@ void playlist_enable_scan (bool enable)
     ENTER;
 
     scan_enabled_nominal = enable;
-    scan_enabled = scan_enabled_nominal && ! aud_get_bool (nullptr, "metadata_on_play");
+    scan_enabled = scan_enabled_nominal && ! cfg_metadata_on_play.get ();
     scan_restart ();
 
     LEAVE;
@@ -1093,9 +1355,25 @@ DecodeInfo playback_entry_read (int serial)
         ScanRequest * request = item->request;
         item->handled_by_playback = true;
 
-        LEAVE;
-        request->run ();
-        ENTER;
+        if (entry == prefetch_entry && prefetch_result &&
+         prefetch_result->filename == request->filename && ! prefetch_result->error)
+        {
+            request->take_results (* prefetch_result);
+            prefetch_entry = nullptr;
+            prefetch_result.clear ();
+            prefetch_hits ++;
+
+            AUDDBG ("Using prefetched scan of %s (%d hits, %d misses).\n",
+             (const char *) request->filename, prefetch_hits, prefetch_misses);
+
+            scan_finish_locked (request);
+        }
+        else
+        {
+            LEAVE;
+            request->run ();
+            ENTER;
+        }
 
         if (playback_check_serial (serial))
         {
@@ -1111,6 +1389,9 @@ DecodeInfo playback_entry_read (int serial)
             dec.ip = request->ip;
             dec.file = std::move (request->file);
             dec.error = std::move (request->error);
+
+            prefetch_armed = true;
+            prefetch_next_locked ();
         }
 
         delete request;
@@ -87,6 +87,29 @@ public:
         Index<String> exts;  // supported filename extensions
     };
 
+    /* Counters of the on-disk metadata cache, returned by metadata_cache_stats() */
+    struct MetadataCacheStats {
+        int64_t hits;    // files whose metadata was found in the cache
+        int64_t misses;  // files that had to be read (including stale ones)
+        int64_t stale;   // files found in the cache but changed since
+        int64_t stored;  // records added to the cache
+        int entries;     // records in the cache, saved or not
+    };
+
+    /* Activity of one group of metadata scanning threads, returned by
+     * scan_group_stats().  Local files are grouped by filesystem, others by
+     * URI scheme. */
+    struct ScanGroupStats {
+        String name;        // mount point (e.g. "/mnt/music") or URI scheme
+        int limit;          // requests allowed to run at once
+        int running;        // requests running
+        int waiting;        // requests waiting for a thread
+        int64_t completed;  // requests completed
+        int64_t total_us;   // time taken by the completed requests
+        int avg_us;         // recent average time per request
+        int baseline_us;    // shortest recent average seen
+    };
+
     typedef bool (* FilterFunc) (const char * filename, void * user);
     typedef int (* StringCompareFunc) (const char * a, const char * b);
     typedef int (* TupleCompareFunc) (const Tuple & a, const Tuple & b);
@@ -191,7 +214,8 @@ public:
     /* Similar to insert_items() but allows the caller to prevent some items
      * from being added by returning false from the <filter> callback.  Useful
      * for searching a folder and adding only new files to the playlist.  <user>
-     * is an opaque pointer passed to the callback. */
+     * is an opaque pointer passed to the callback.  The callback is called from
+     * background threads, though never from two at once. */
     void insert_filtered (int at, Index<PlaylistAddItem> && items,
      FilterFunc filter, void * user, bool play) const;
 
@@ -344,6 +368,12 @@ public:
     bool scan_in_progress () const;
     static bool scan_in_progress_any ();
 
+    /* Asks for the given range of entries (inclusive) to be scanned ahead of
+     * the others, for example because they are visible in a playlist view.
+     * Only the latest hint is kept; calling this again (for any playlist)
+     * replaces it.  Entries already scanned are skipped. */
+    void scan_hint (int first, int last) const;
+
     /* --- UTILITY API --- */
 
     /* Sorts entries according to a preset scheme. */
@@ -366,6 +396,15 @@ public:
      * This will speed up adding those entries to another playlist. */
     void cache_selected () const;
 
+    /* Returns the counters of the on-disk metadata cache, which remembers the
+     * metadata of local files between sessions.  The counters start from zero
+     * at each startup. */
+    static MetadataCacheStats metadata_cache_stats ();
+
+    /* Returns the state of each group of scanning threads, sorted by name.
+     * The counters start from zero at each startup. */
+    static Index<ScanGroupStats> scan_group_stats ();
+
     /* Saves the entries in a playlist to a playlist file.
      * The format of the file is determined from the file extension.
      * <mode> specifies whether to wait for metadata scanning to complete.
@@ -48,7 +48,7 @@ struct PluginPreferences;
  * _AUD_PLUGIN_VERSION_MIN to the same value. */
 
 #define _AUD_PLUGIN_VERSION_MIN 48 /* 3.8-devel */
-#define _AUD_PLUGIN_VERSION     48 /* 3.8-devel */
+#define _AUD_PLUGIN_VERSION     49 /* 3.8-devel */
 
 /* A NOTE ON THREADS
  *
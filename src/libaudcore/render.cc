@@ -0,0 +1,283 @@
+/*
+ * render.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>  /* for g_get_monotonic_time */
+
+#define WANT_AUD_BSWAP
+#include "audio.h"
+#include "drct.h"
+#include "i18n.h"
+#include "output.h"
+#include "plugin.h"
+#include "runtime.h"
+#include "vfs.h"
+
+/* The render output is a built-in output plugin that takes the place of the
+ * selected one while rendering (see output_set_override()).  write_audio()
+ * always accepts the whole buffer, so period_wait() is never called and the
+ * rest of the audio path runs as fast as it can.  The audio is written as a
+ * plain WAV file (integer PCM or, for FMT_FLOAT, IEEE float), or discarded if
+ * no file was given.  The sizes in the header are filled in by finish(). */
+
+struct WavHeader {
+    char riff[4];
+    uint32_t riff_size;
+    char wave[4];
+    char fmt[4];
+    uint32_t fmt_size;
+    uint16_t format_tag;
+    uint16_t channels;
+    uint32_t rate;
+    uint32_t bytes_per_sec;
+    uint16_t block_align;
+    uint16_t bits;
+    char data[4];
+    uint32_t data_size;
+};
+
+static_assert (sizeof (WavHeader) == 44, "unexpected padding in WavHeader");
+
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+
+/* returns the WAV format tag to use for <format>, or zero if unsupported */
+static int wav_format_tag (int format)
+{
+    switch (format)
+    {
+    case FMT_S16_LE:
+    case FMT_S24_3LE:
+    case FMT_S32_LE:
+        return WAV_FORMAT_PCM;
+
+    case FMT_FLOAT:
+        /* FMT_FLOAT is in native byte order */
+        return (FMT_S16_NE == FMT_S16_LE) ? WAV_FORMAT_FLOAT : 0;
+
+    default:
+        return 0;
+    }
+}
+
+class RenderOutput : public OutputPlugin
+{
+public:
+    static constexpr PluginInfo info = {N_("Render"), PACKAGE};
+
+    RenderOutput () : OutputPlugin (info, 0) {}
+
+    bool start (const char * uri);
+    void finish (RenderStats & stats);
+
+    StereoVolume get_volume ()
+        { return m_volume; }
+    void set_volume (StereoVolume volume)
+        { m_volume = volume; }
+
+    bool open_audio (int format, int rate, int chans, String & error);
+    void close_audio ();
+
+    void period_wait () {}
+    int write_audio (const void * data, int size);
+    void drain () {}
+
+    int get_delay ()
+        { return 0; }
+
+    void pause (bool pause) {}
+    void flush () {}
+
+private:
+    bool write_header (int64_t data_size);
+
+    VFSFile m_file;
+    StereoVolume m_volume = {100, 100};
+
+    bool m_error = false;
+    bool m_discard = false; /* file format does not match the stream */
+    bool m_header = false; /* header written (with placeholder sizes) */
+
+    int m_format = 0, m_rate = 0, m_channels = 0;
+    int m_bytes_per_sec = 0;
+
+    int64_t m_time = 0; /* milliseconds in streams already closed */
+    int64_t m_stream_bytes = 0, m_bytes = 0, m_data_bytes = 0;
+    int64_t m_first_open = 0, m_last_close = 0;
+};
+
+constexpr PluginInfo RenderOutput::info;
+
+static RenderOutput render_output;
+static bool rendering;
+
+bool RenderOutput::write_header (int64_t data_size)
+{
+    WavHeader header = WavHeader ();
+
+    int frame_size = FMT_SIZEOF (m_format) * m_channels;
+    data_size = aud::min (data_size, (int64_t) UINT32_MAX - 36);
+
+    memcpy (header.riff, "RIFF", 4);
+    header.riff_size = TO_LE32 (36 + data_size);
+    memcpy (header.wave, "WAVE", 4);
+    memcpy (header.fmt, "fmt ", 4);
+    header.fmt_size = TO_LE32 (16);
+    header.format_tag = TO_LE16 (wav_format_tag (m_format));
+    header.channels = TO_LE16 (m_channels);
+    header.rate = TO_LE32 (m_rate);
+    header.bytes_per_sec = TO_LE32 (frame_size * m_rate);
+    header.block_align = TO_LE16 (frame_size);
+    header.bits = TO_LE16 (8 * FMT_SIZEOF (m_format));
+    memcpy (header.data, "data", 4);
+    header.data_size = TO_LE32 (data_size);
+
+    return m_file.fwrite (& header, 1, sizeof header) == sizeof header;
+}
+
+bool RenderOutput::start (const char * uri)
+{
+    m_error = m_discard = m_header = false;
+    m_time = m_stream_bytes = m_bytes = m_data_bytes = 0;
+    m_first_open = m_last_close = 0;
+
+    if (uri)
+    {
+        m_file = VFSFile (uri, "w");
+
+        if (! m_file)
+        {
+            AUDERR ("Cannot create %s: %s.\n", uri, m_file.error ());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void RenderOutput::finish (RenderStats & stats)
+{
+    if (m_file && m_header)
+    {
+        if (m_file.fseek (0, VFS_SEEK_SET) < 0 || ! write_header (m_data_bytes) ||
+         m_file.fflush () < 0)
+        {
+            AUDERR ("Error finishing %s.\n", m_file.filename ());
+            m_error = true;
+        }
+    }
+
+    m_file = VFSFile ();
+
+    stats.time = m_time;
+    stats.elapsed_us = m_last_close - m_first_open;
+    stats.bytes = m_bytes;
+    stats.error = m_error;
+}
+
+bool RenderOutput::open_audio (int format, int rate, int chans, String & error)
+{
+    if (m_file && ! m_header)
+    {
+        if (! wav_format_tag (format))
+        {
+            error = String (_("Unsupported audio format"));
+            return false;
+        }
+
+        m_format = format;
+        m_rate = rate;
+        m_channels = chans;
+
+        if (! write_header (0))
+        {
+            AUDERR ("Error writing to %s.\n", m_file.filename ());
+            m_error = true;
+        }
+
+        m_header = true;
+    }
+    else if (m_file && ! m_discard &&
+     (format != m_format || rate != m_rate || chans != m_channels))
+    {
+        AUDERR ("The audio format changed; a WAV file can hold only one "
+         "format, so the rest of the audio will be discarded.\n");
+        m_error = true;
+        m_discard = true;
+    }
+
+    m_bytes_per_sec = FMT_SIZEOF (format) * chans * rate;
+    m_stream_bytes = 0;
+
+    if (! m_first_open)
+        m_first_open = g_get_monotonic_time ();
+
+    return true;
+}
+
+void RenderOutput::close_audio ()
+{
+    m_time += aud::rescale<int64_t> (m_stream_bytes, m_bytes_per_sec, 1000);
+    m_stream_bytes = 0;
+    m_last_close = g_get_monotonic_time ();
+}
+
+int RenderOutput::write_audio (const void * data, int size)
+{
+    if (m_file && ! m_discard)
+    {
+        if (m_file.fwrite (data, 1, size) == size)
+            m_data_bytes += size;
+        else
+        {
+            AUDERR ("Error writing to %s.\n", m_file.filename ());
+            m_error = true;
+            m_discard = true;
+        }
+    }
+
+    m_stream_bytes += size;
+    m_bytes += size;
+    return size;
+}
+
+EXPORT bool aud_drct_start_render (const char * uri)
+{
+    if (rendering || ! render_output.start (uri))
+        return false;
+
+    rendering = true;
+    aud_drct_reset_output_stats ();
+    output_set_override (& render_output);
+    return true;
+}
+
+EXPORT bool aud_drct_stop_render (RenderStats & stats)
+{
+    if (! rendering)
+        return false;
+
+    /* this closes the render output */
+    output_set_override (nullptr);
+    render_output.finish (stats);
+    rendering = false;
+    return true;
+}
@@ -0,0 +1,76 @@
+/*
+ * rtaudit.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "internal.h"
+
+#ifdef RT_AUDIT
+
+#include "runtime.h"
+
+/* set while the thread is processing audio */
+static __thread bool audited;
+
+static int allocs, locks, contended;
+
+void rt_audit_begin ()
+{
+    audited = true;
+}
+
+void rt_audit_end ()
+{
+    audited = false;
+}
+
+void rt_audit_alloc ()
+{
+    if (audited)
+        __atomic_add_fetch (& allocs, 1, __ATOMIC_RELAXED);
+}
+
+void rt_lock (pthread_mutex_t * mutex)
+{
+    if (! audited)
+    {
+        pthread_mutex_lock (mutex);
+        return;
+    }
+
+    __atomic_add_fetch (& locks, 1, __ATOMIC_RELAXED);
+
+    if (pthread_mutex_trylock (mutex))
+    {
+        __atomic_add_fetch (& contended, 1, __ATOMIC_RELAXED);
+        pthread_mutex_lock (mutex);
+    }
+}
+
+void rt_audit_report ()
+{
+    int a = __atomic_exchange_n (& allocs, 0, __ATOMIC_RELAXED);
+    int l = __atomic_exchange_n (& locks, 0, __ATOMIC_RELAXED);
+    int c = __atomic_exchange_n (& contended, 0, __ATOMIC_RELAXED);
+
+    if (a || c)
+        AUDWARN ("Audio thread: %d allocations, %d locks (%d contended).\n", a, l, c);
+    else
+        AUDINFO ("Audio thread: no allocations, %d locks (none contended).\n", l);
+}
+
+#endif // RT_AUDIT
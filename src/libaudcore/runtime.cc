@@ -294,6 +294,7 @@ EXPORT void aud_init ()
 
     start_plugins_one ();
 
+    conv_init ();
     record_init ();
     scanner_init ();
     load_playlists ();
@@ -338,12 +339,17 @@ EXPORT void aud_cleanup ()
     adder_cleanup ();
     scanner_cleanup ();
     record_cleanup ();
+    effect_cleanup ();
 
     stop_plugins_one ();
 
     art_cleanup ();
     chardet_cleanup ();
     eq_cleanup ();
+    conv_cleanup ();
+    tap_cleanup ();
+    vis_runner_cleanup ();
+    fft_cleanup ();
     output_cleanup ();
     playlist_end ();
 
@@ -52,6 +52,12 @@ enum class OutputStream {
     AfterEqualizer
 };
 
+enum class RecordOverflow {
+    Block,
+    Drop,
+    Grow
+};
+
 enum class ReplayGainMode {
     Track,
     Album,
@@ -19,19 +19,28 @@
 
 #include "scanner.h"
 
+#include <pthread.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <mntent.h>
+#endif
+
 #include <glib.h>  /* for GThreadPool */
 
 #include "audstrings.h"
 #include "cue-cache.h"
 #include "i18n.h"
 #include "internal.h"
+#include "meta-cache.h"
+#include "multihash.h"
+#include "playlist.h"
 #include "plugins.h"
 #include "probe.h"
+#include "runtime.h"
 #include "tuple.h"
 #include "vfs.h"
 
-static GThreadPool * pool;
-
 ScanRequest::ScanRequest (const String & filename, int flags, Callback callback,
  PluginHandle * decoder, Tuple && tuple) :
     filename (filename),
@@ -63,8 +72,27 @@ void ScanRequest::read_cuesheet_entry ()
     }
 }
 
+/* reads the first blocks of a file that is going to be played soon, so that
+ * they are already cached when the decoder asks for them */
+void ScanRequest::warm_input_file (const char * audio_file)
+{
+    if (! file || file.fsize () < 0)
+        return;
+
+    Index<char> buf;
+    buf.resize (SCAN_WARM_BYTES);
+
+    if (file.fread (buf.begin (), 1, buf.len ()) <= 0 || file.fseek (0, VFS_SEEK_SET) != 0)
+    {
+        file = VFSFile ();
+        open_input_file (audio_file, "r", ip, file, & error);
+    }
+}
+
 void ScanRequest::run ()
 {
+    int64_t start = g_get_monotonic_time ();
+
     /* load cuesheet entry (possibly cached) */
     if (cue_cache)
         read_cuesheet_entry ();
@@ -76,14 +104,25 @@ void ScanRequest::run ()
 
     bool need_tuple = (flags & SCAN_TUPLE) && ! tuple.valid ();
     bool need_image = (flags & SCAN_IMAGE);
+    MetaCacheKey cache_key;
+
+    /* album art is not cached, so there is no point if we need to read it */
+    if (need_tuple && ! need_image && ! cue_cache &&
+     meta_cache_lookup (audio_file, cache_key, decoder, tuple))
+        need_tuple = false;
 
     if (! decoder)
+    {
+        touched_file = true;
         decoder = aud_file_find_decoder (audio_file, false, file, & error);
+    }
     if (! decoder)
         goto err;
 
     if (need_tuple || need_image)
     {
+        touched_file = true;
+
         if (! (ip = load_input_plugin (decoder, & error)))
             goto err;
 
@@ -91,13 +130,24 @@ void ScanRequest::run ()
         if (! aud_file_read_tag (audio_file, decoder, file, tuple, pimage, & error))
             goto err;
 
+        if (need_tuple)
+            meta_cache_store (audio_file, cache_key, decoder, tuple);
+
         if ((flags & SCAN_IMAGE) && ! image_data.len ())
             image_file = art_search (audio_file);
     }
 
     /* rewind/reopen the input file */
     if ((flags & SCAN_FILE))
-        open_input_file (audio_file, "r", ip, file, & error);
+    {
+        touched_file = true;
+
+        if (! ip && ! (ip = load_input_plugin (decoder, & error)))
+            goto err;
+
+        if (open_input_file (audio_file, "r", ip, file, & error) && (flags & SCAN_WARM))
+            warm_input_file (audio_file);
+    }
     else
     {
     err:
@@ -105,26 +155,284 @@ void ScanRequest::run ()
         file = VFSFile ();
     }
 
+    scan_time = g_get_monotonic_time () - start;
     callback (this);
 }
 
-static void scan_worker (void * data, void *)
+void ScanRequest::take_results (ScanRequest & other)
+{
+    decoder = other.decoder;
+    tuple = other.tuple.ref ();
+    ip = other.ip;
+    file = std::move (other.file);
+    image_data = std::move (other.image_data);
+    image_file = std::move (other.image_file);
+    error = std::move (other.error);
+}
+
+/*
+ * Each group keeps its own GThreadPool, whose thread limit follows the number
+ * of requests the group is allowed to run at once.  The limit is adjusted
+ * once for every <limit> requests completed, by comparing their average
+ * duration with the shortest average seen for the group (the "baseline"):
+ *  - if requests take more than twice the baseline, the device is probably
+ *    overloaded, so the limit is cut by a quarter;
+ *  - if they take less than 1.25 times the baseline and requests are
+ *    waiting, one more is allowed.
+ * While the limit is 1, the baseline creeps up toward the current average,
+ * so that a group whose requests have become slower for good (a different
+ * kind of file, say) is not held there forever.  It must not do so at higher
+ * limits, or a slow enough climb in the limit would never be noticed.
+ *
+ * Only requests that opened or read the file are counted.  Those answered
+ * from the metadata cache take microseconds and say nothing about the device;
+ * counted, they would pull the baseline so low that the first real reads
+ * looked like an overload, and the limit would be cut to 1 and stay there.
+ */
+
+struct ScanGroup
+{
+    String name;
+    GThreadPool * pool = nullptr;
+
+    int limit = SCAN_THREADS;
+    int waiting = 0, running = 0;
+    int window = 0;  /* completed since the limit was last adjusted */
+
+    int64_t completed = 0;
+    int64_t total_us = 0;
+    int64_t avg_us = 0;       /* moving average */
+    int64_t baseline_us = 0;
+};
+
+#define MOUNTS_REFRESH 10000000  /* microseconds */
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static SimpleHash<String, ScanGroup *> groups;
+
+static void scan_worker (void * data, void * user);
+
+#ifdef __linux__
+static Index<String> mounts;  /* longest first */
+static int64_t mounts_time = -1;
+
+/* reading the mount table does not touch the filesystems themselves, so it
+ * cannot block on a network share that has gone away, unlike stat() */
+static void read_mounts ()
+{
+    FILE * handle = setmntent ("/proc/self/mounts", "r");
+    if (! handle)
+        return;
+
+    mounts.clear ();
+
+    struct mntent * ent;
+    while ((ent = getmntent (handle)))
+        mounts.append (String (ent->mnt_dir));
+
+    endmntent (handle);
+
+    mounts.sort ([] (const String & a, const String & b)
+        { return (int) strlen (b) - (int) strlen (a); });
+}
+
+static String find_mount (const char * path)
+{
+    int64_t now = g_get_monotonic_time ();
+
+    if (mounts_time < 0 || now - mounts_time > MOUNTS_REFRESH)
+    {
+        read_mounts ();
+        mounts_time = now;
+    }
+
+    for (const String & mount : mounts)
+    {
+        int len = strlen (mount);
+
+        if (! strncmp (path, mount, len) && (path[len] == '/' ||
+         ! path[len] || (len && mount[len - 1] == '/')))
+            return mount;
+    }
+
+    return String ("/");
+}
+#endif
+
+/* mutex must be held */
+static ScanGroup * get_group (const char * filename)
+{
+    String name;
+    const char * colon = strstr (filename, "://");
+
+    if (! colon)
+        name = String ("?");
+    else if (strncmp (filename, "file://", 7))
+        name = String (str_copy (filename, colon - filename));
+    else
+    {
+#ifdef __linux__
+        StringBuf path = uri_to_filename (filename);
+        name = path ? find_mount (path) : String ("file");
+#else
+        name = String ("file");
+#endif
+    }
+
+    ScanGroup * * group = groups.lookup (name);
+    if (group)
+        return * group;
+
+    auto new_group = new ScanGroup;
+    new_group->name = name;
+    new_group->pool = g_thread_pool_new (scan_worker, new_group, new_group->limit,
+     false, nullptr);
+
+    AUDINFO ("New scanner group: %s\n", (const char *) name);
+
+    groups.add (name, std::move (new_group));
+    return new_group;
+}
+
+/* mutex must be held */
+static void adjust_limit (ScanGroup * group, int64_t us)
 {
-    ((ScanRequest *) data)->run ();
-    delete (ScanRequest *) data;
+    group->completed ++;
+    group->total_us += us;
+
+    if (group->completed == 1)
+        group->avg_us = us;
+    else
+        group->avg_us += (us - group->avg_us) / 8;
+
+    if (! group->baseline_us || group->avg_us < group->baseline_us)
+        group->baseline_us = group->avg_us;
+    else if (group->limit == 1)
+        group->baseline_us += (group->avg_us - group->baseline_us) / 256;
+
+    if (++ group->window < group->limit)
+        return;
+
+    int limit = group->limit;
+
+    if (group->avg_us > 2 * group->baseline_us)
+        limit = aud::max (1, limit * 3 / 4);
+    else if (group->avg_us < group->baseline_us * 5 / 4 && group->waiting > 0)
+        limit = aud::min (limit + 1, SCAN_MAX_THREADS);
+
+    group->window = 0;
+
+    if (limit != group->limit)
+    {
+        AUDDBG ("Scanner group %s: %d -> %d at a time (%d us, baseline %d us).\n",
+         (const char *) group->name, group->limit, limit, (int) group->avg_us,
+         (int) group->baseline_us);
+
+        group->limit = limit;
+        g_thread_pool_set_max_threads (group->pool, limit, nullptr);
+    }
+}
+
+static void scan_worker (void * data, void * user)
+{
+    auto request = (ScanRequest *) data;
+    auto group = (ScanGroup *) user;
+
+    pthread_mutex_lock (& mutex);
+    group->waiting --;
+    group->running ++;
+    pthread_mutex_unlock (& mutex);
+
+    request->run ();
+    int64_t us = request->scan_time;
+    bool touched_file = request->touched_file;
+    delete request;
+
+    pthread_mutex_lock (& mutex);
+    group->running --;
+    if (touched_file)
+        adjust_limit (group, us);
+    pthread_mutex_unlock (& mutex);
 }
 
 void scanner_init ()
 {
-    pool = g_thread_pool_new (scan_worker, nullptr, SCAN_THREADS, false, nullptr);
+    meta_cache_init ();
 }
 
 void scanner_request (ScanRequest * request)
 {
-    g_thread_pool_push (pool, request, nullptr);
+    pthread_mutex_lock (& mutex);
+
+    ScanGroup * group = get_group (request->filename);
+    group->waiting ++;
+    g_thread_pool_push (group->pool, request, nullptr);
+
+    pthread_mutex_unlock (& mutex);
+}
+
+String scanner_group (const char * filename)
+{
+    pthread_mutex_lock (& mutex);
+    String name = get_group (filename)->name;
+    pthread_mutex_unlock (& mutex);
+
+    return name;
+}
+
+int scanner_capacity (const String & name)
+{
+    pthread_mutex_lock (& mutex);
+
+    /* one more than the group can run, so that it always has one waiting */
+    ScanGroup * * group = groups.lookup (name);
+    int capacity = (group ? (* group)->limit : SCAN_THREADS) + 1;
+
+    pthread_mutex_unlock (& mutex);
+
+    return capacity;
+}
+
+EXPORT Index<Playlist::ScanGroupStats> Playlist::scan_group_stats ()
+{
+    Index<ScanGroupStats> list;
+
+    pthread_mutex_lock (& mutex);
+
+    groups.iterate ([&] (const String & name, ScanGroup * & group) {
+        list.append (ScanGroupStats {name, group->limit, group->running,
+         group->waiting, group->completed, group->total_us,
+         (int) group->avg_us, (int) group->baseline_us});
+    });
+
+    pthread_mutex_unlock (& mutex);
+
+    list.sort ([] (const ScanGroupStats & a, const ScanGroupStats & b)
+        { return strcmp (a.name, b.name); });
+
+    return list;
 }
 
 void scanner_cleanup ()
 {
-    g_thread_pool_free (pool, false, true);
+    /* the workers need the mutex, so it cannot be held while waiting for
+     * them to finish */
+    Index<ScanGroup *> list;
+
+    pthread_mutex_lock (& mutex);
+    groups.iterate ([&] (const String &, ScanGroup * & group)
+        { list.append (group); });
+    pthread_mutex_unlock (& mutex);
+
+    for (ScanGroup * group : list)
+        g_thread_pool_free (group->pool, false, true);
+
+    pthread_mutex_lock (& mutex);
+    groups.clear ();
+    pthread_mutex_unlock (& mutex);
+
+    for (ScanGroup * group : list)
+        delete group;
+
+    meta_cache_cleanup ();
 }
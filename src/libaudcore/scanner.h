@@ -20,6 +20,8 @@
 #ifndef LIBAUDCORE_SCANNER_H
 #define LIBAUDCORE_SCANNER_H
 
+#include <stdint.h>
+
 #include "cue-cache.h"
 #include "index.h"
 #include "objects.h"
@@ -32,8 +34,16 @@ class PluginHandle;
 #define SCAN_TUPLE (1 << 0)
 #define SCAN_IMAGE (1 << 1)
 #define SCAN_FILE  (1 << 2)
+#define SCAN_WARM  (1 << 3)  /* with SCAN_FILE, also read the start of the file */
 
+/* Requests are run by a separate group of threads for each filesystem (local
+ * files) or URI scheme (anything else), so that a slow network share does not
+ * hold up scanning of a local disk, nor a fast disk flood a network share.
+ * Each group starts out running SCAN_THREADS requests at a time, and adjusts
+ * that between 1 and SCAN_MAX_THREADS according to how long they take. */
 #define SCAN_THREADS 2
+#define SCAN_MAX_THREADS 16
+#define SCAN_WARM_BYTES 65536
 
 struct ScanRequest
 {
@@ -53,19 +63,32 @@ struct ScanRequest
     String image_file;
     String error;
 
+    int64_t scan_time = 0;  /* microseconds spent in run(), without the callback */
+    bool touched_file = false;  /* whether run() opened or read the file */
+
     ScanRequest (const String & filename, int flags, Callback callback,
      PluginHandle * decoder = nullptr, Tuple && tuple = Tuple ());
 
     void run ();
 
+    /* takes over the decoder, file handle, etc. found by an earlier request
+     * for the same file, in place of running this one */
+    void take_results (ScanRequest & other);
+
 private:
     SmartPtr<CueCacheRef> cue_cache;
 
     void read_cuesheet_entry ();
+    void warm_input_file (const char * audio_file);
 };
 
 void scanner_init ();
 void scanner_request (ScanRequest * request);
 void scanner_cleanup ();
 
+/* the name of the group that runs requests for <filename> */
+String scanner_group (const char * filename);
+/* the number of requests worth having queued at once to keep a group busy */
+int scanner_capacity (const String & group);
+
 #endif
@@ -0,0 +1,96 @@
+/*
+ * seqlock.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_SEQLOCK_H
+#define LIBAUDCORE_SEQLOCK_H
+
+#include <sched.h>
+#include <string.h>
+
+/*
+ * SeqLock holds a small, plain-data value that is written rarely (compared to
+ * how often it is read) and must be readable without locking:
+ *  - write() may be called by one thread at a time; if there are several
+ *    writers, the caller must serialize them (e.g. with a mutex).
+ *  - read() may be called by any number of threads and never blocks the
+ *    writer.  It retries if a write was in progress, so it always returns a
+ *    value that was written as a whole.
+ * The value is copied in int-sized words, each with an atomic load or store,
+ * so that the copy is not a data race even when it has to be retried.
+ */
+
+template<class T>
+class SeqLock
+{
+public:
+    SeqLock () {}
+
+    SeqLock (const SeqLock &) = delete;
+    SeqLock & operator= (const SeqLock &) = delete;
+
+    void write (const T & value)
+    {
+        int words[n_words] {};
+        memcpy (words, & value, sizeof (T));
+
+        unsigned seq = __atomic_load_n (& m_seq, __ATOMIC_RELAXED);
+        __atomic_store_n (& m_seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence (__ATOMIC_RELEASE);
+
+        for (int i = 0; i < n_words; i ++)
+            __atomic_store_n (& m_words[i], words[i], __ATOMIC_RELAXED);
+
+        __atomic_store_n (& m_seq, seq + 2, __ATOMIC_RELEASE);
+    }
+
+    T read () const
+    {
+        int words[n_words];
+        unsigned seq1, seq2;
+
+        while (1)
+        {
+            seq1 = __atomic_load_n (& m_seq, __ATOMIC_ACQUIRE);
+
+            for (int i = 0; i < n_words; i ++)
+                words[i] = __atomic_load_n (& m_words[i], __ATOMIC_RELAXED);
+
+            __atomic_thread_fence (__ATOMIC_ACQUIRE);
+            seq2 = __atomic_load_n (& m_seq, __ATOMIC_RELAXED);
+
+            if (! (seq1 & 1) && seq1 == seq2)
+                break;
+
+            /* the writer may have been preempted in the middle */
+            sched_yield ();
+        }
+
+        T value;
+        memcpy (& value, words, sizeof (T));
+        return value;
+    }
+
+private:
+    static constexpr int n_words = (sizeof (T) + sizeof (int) - 1) / sizeof (int);
+
+    unsigned m_seq = 0;
+    int m_words[n_words] {};
+};
+
+#endif // LIBAUDCORE_SEQLOCK_H
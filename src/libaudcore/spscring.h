@@ -0,0 +1,137 @@
+/*
+ * spscring.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_SPSCRING_H
+#define LIBAUDCORE_SPSCRING_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "templates.h"
+
+/*
+ * SpscRing is a lock-free ring buffer of bytes, shared between exactly one
+ * producer thread and one consumer thread:
+ *  - write() and space() may be called only by the producer.
+ *  - peek(), consume(), read(), len() and discard() only by the consumer.
+ *  - alloc() may be called only while neither thread is using the buffer.
+ * The read and write positions are 64-bit counters that never wrap, so a full
+ * buffer is distinguishable from an empty one without a spare byte.  Data is
+ * never split into pieces smaller than the caller's own writes, except where
+ * it wraps around the end of the buffer; if the size and all writes are
+ * multiples of n bytes, no n-byte block will ever be split.
+ */
+
+class SpscRing
+{
+public:
+    SpscRing () {}
+    ~SpscRing ()
+        { delete[] m_data; }
+
+    SpscRing (const SpscRing &) = delete;
+    SpscRing & operator= (const SpscRing &) = delete;
+
+    void alloc (int size)
+    {
+        delete[] m_data;
+        m_data = size ? new char[size] : nullptr;
+        m_size = size;
+        m_head = m_tail = 0;
+    }
+
+    int size () const
+        { return m_size; }
+
+    /* producer */
+    int space () const
+        { return m_size - (int) (m_head - load (m_tail)); }
+
+    int write (const void * data, int len)
+    {
+        int64_t tail = load (m_tail);
+        len = aud::min (len, m_size - (int) (m_head - tail));
+
+        int pos = m_head % m_size;
+        int len1 = aud::min (len, m_size - pos);
+
+        memcpy (m_data + pos, data, len1);
+        memcpy (m_data, (const char *) data + len1, len - len1);
+
+        store (m_head, m_head + len);
+        return len;
+    }
+
+    /* consumer */
+    int len () const
+        { return (int) (load (m_head) - load (m_tail)); }
+
+    /* returns the part of the data that can be read without wrapping */
+    const void * peek (int & len) const
+    {
+        int pos = m_tail % m_size;
+        len = aud::min ((int) (load (m_head) - m_tail), m_size - pos);
+        return m_data + pos;
+    }
+
+    void consume (int len)
+        { store (m_tail, m_tail + len); }
+
+    int read (void * data, int len)
+    {
+        len = aud::min (len, this->len ());
+
+        int pos = m_tail % m_size;
+        int len1 = aud::min (len, m_size - pos);
+
+        memcpy (data, m_data + pos, len1);
+        memcpy ((char *) data + len1, m_data, len - len1);
+
+        consume (len);
+        return len;
+    }
+
+    void discard ()
+        { store (m_tail, load (m_head)); }
+
+private:
+    static int64_t load (const int64_t & pos)
+        { return __atomic_load_n (& pos, __ATOMIC_ACQUIRE); }
+    static void store (int64_t & pos, int64_t val)
+        { __atomic_store_n (& pos, val, __ATOMIC_RELEASE); }
+
+    /* one cache line, assumed to be 64 bytes */
+    static constexpr int LINE = 64;
+
+    char * m_data = nullptr;
+    int m_size = 0;
+
+    /* written by the producer and consumer respectively; kept on separate
+     * cache lines so that the two threads do not contend.  The separation is
+     * done with padding rather than alignas(), which operator new does not
+     * honor before C++17: with at least one line's worth of bytes between
+     * them, two fields can never share a line, however the object is placed. */
+    char m_pad0[LINE];
+    int64_t m_head = 0;
+    char m_pad1[LINE - sizeof (int64_t)];
+    int64_t m_tail = 0;
+    char m_pad2[LINE - sizeof (int64_t)];
+};
+
+#endif // LIBAUDCORE_SPSCRING_H
@@ -0,0 +1,433 @@
+/*
+ * tap.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "drct.h"
+#include "internal.h"
+#include "tap.h"
+
+/* The shared memory (laid out as described in tap.h) is created by the first
+ * aud_drct_open_tap() and kept until aud_cleanup(), but is written only while
+ * there are readers.  Each of its rings has a single writer, which never
+ * waits: the PCM ring and the blocks are written by the output, from
+ * write_output() (whose calls never overlap), and the spectra by the main
+ * thread, through a built-in Spectrum visualizer.  After writing, the writer
+ * signals an internal eventfd; the tap thread then signals each reader's own
+ * eventfd, so that the number of readers makes no difference to the audio
+ * thread.  Readers found to be gone are closed by the D-Bus server. */
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <glib.h>  /* for g_get_monotonic_time */
+
+#include "interface.h"
+#include "runtime.h"
+#include "visualizer.h"
+
+#define MAX_READERS 16
+
+struct TapReader {
+    int id;
+    int fd;  /* our end of the reader's eventfd */
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static Index<TapReader> readers;
+static int next_id = 1;
+static bool quit;
+
+static pthread_t tap_thread;
+static int shm_fd = -1, wake_fd = -1;
+static int shm_size;
+
+static AudTapHeader * header;
+static float * pcm;
+static AudTapBlock * blocks;
+static AudTapSpectrum * spectra;
+
+static bool active;  /* read atomically by the output */
+static bool flushed;  /* atomic; set by tap_flush() */
+
+/* used only by the output, in write_output() */
+static uint64_t pcm_head, block_start, block_count;
+
+/* used only by the main thread */
+static uint64_t spectrum_count;
+
+class TapVisualizer : public Visualizer
+{
+public:
+    constexpr TapVisualizer () : Visualizer (Spectrum) {}
+
+    void clear () {}
+
+    /* the same analysis as render_freq() */
+    SpectrumSpec spectrum_spec ()
+        { return {512, 0, false, 0}; }
+
+    void render_spectrum (const SpectrumFrame & frame);
+};
+
+static TapVisualizer tap_vis;
+
+static void wake ()
+{
+    uint64_t one = 1;
+    /* fails only if the count would overflow, in which case it is set anyway */
+    if (write (wake_fd, & one, sizeof one) < 0)
+        return;
+}
+
+/* Writes one slot of a ring under its sequence count (see tap.h).  The fields
+ * are written by memcpy(), as readers copy them. */
+template<class T>
+static void write_slot (T & slot, const T & value, uint64_t index)
+{
+    __atomic_store_n (& slot.seq, 2 * index + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+
+    memcpy ((char *) & slot + sizeof slot.seq, (const char *) & value +
+     sizeof value.seq, sizeof value - sizeof value.seq);
+
+    __atomic_store_n (& slot.seq, 2 * index + 2, __ATOMIC_RELEASE);
+}
+
+void TapVisualizer::render_spectrum (const SpectrumFrame & frame)
+{
+    AudTapSpectrum s = AudTapSpectrum ();
+
+    s.clock_us = g_get_monotonic_time ();
+    s.time = frame.time;
+    s.rate = frame.rate;
+    s.bins = aud::min (frame.bins, AUD_TAP_SPECTRUM_BINS);
+    memcpy (s.values, frame.values, sizeof (float) * s.bins);
+
+    uint64_t i = spectrum_count ++;
+    write_slot (spectra[i % AUD_TAP_SPECTRUM_SLOTS], s, i);
+    __atomic_store_n (& header->spectra, i + 1, __ATOMIC_RELEASE);
+
+    wake ();
+}
+
+bool tap_active ()
+{
+    return __atomic_load_n (& active, __ATOMIC_ACQUIRE);
+}
+
+void tap_write_pcm (const float * data, int samples)
+{
+    while (samples > 0)
+    {
+        int pos = pcm_head & (AUD_TAP_PCM_SAMPLES - 1);
+        int len = aud::min (samples, AUD_TAP_PCM_SAMPLES - pos);
+
+        /* let readers know before anything is overwritten */
+        __atomic_store_n (& header->pcm_reserved, pcm_head + len, __ATOMIC_RELAXED);
+        __atomic_thread_fence (__ATOMIC_RELEASE);
+
+        memcpy (pcm + pos, data, sizeof (float) * len);
+
+        pcm_head += len;
+        data += len;
+        samples -= len;
+    }
+}
+
+void tap_commit (int time, int channels, int rate)
+{
+    if (pcm_head == block_start)
+        return;
+
+    AudTapBlock b = AudTapBlock ();
+
+    b.start = block_start;
+    b.clock_us = g_get_monotonic_time ();
+    b.time = time;
+    b.samples = pcm_head - block_start;
+    b.channels = channels;
+    b.rate = rate;
+
+    if (__atomic_exchange_n (& flushed, false, __ATOMIC_RELAXED))
+        b.flags = AUD_TAP_FLUSHED;
+
+    uint64_t i = block_count ++;
+    write_slot (blocks[i % AUD_TAP_BLOCK_SLOTS], b, i);
+    __atomic_store_n (& header->blocks, i + 1, __ATOMIC_RELEASE);
+
+    block_start = pcm_head;
+    wake ();
+}
+
+void tap_flush ()
+{
+    __atomic_store_n (& flushed, true, __ATOMIC_RELAXED);
+}
+
+static void * tap_worker (void *)
+{
+    pollfd pfd = {wake_fd, POLLIN, 0};
+
+    while (1)
+    {
+        uint64_t count;
+
+        if (poll (& pfd, 1, -1) < 0 && errno != EINTR)
+        {
+            AUDERR ("poll: %s\n", strerror (errno));
+            break;
+        }
+
+        if (read (wake_fd, & count, sizeof count) < 0)
+            continue;
+
+        pthread_mutex_lock (& mutex);
+
+        if (quit)
+        {
+            pthread_mutex_unlock (& mutex);
+            break;
+        }
+
+        /* a reader that does not read its eventfd gets no more than 2^64 - 2
+         * signals, after which write() fails harmlessly */
+        for (const TapReader & reader : readers)
+        {
+            uint64_t one = 1;
+            if (write (reader.fd, & one, sizeof one) < 0)
+                continue;
+        }
+
+        pthread_mutex_unlock (& mutex);
+    }
+
+    return nullptr;
+}
+
+static int align (int offset)
+    { return (offset + 63) & ~63; }
+
+static bool create_tap ()
+{
+    int pcm_offset = align (sizeof (AudTapHeader));
+    int block_offset = align (pcm_offset + sizeof (float) * AUD_TAP_PCM_SAMPLES);
+    int spectrum_offset = align (block_offset + sizeof (AudTapBlock) * AUD_TAP_BLOCK_SLOTS);
+    int size = spectrum_offset + sizeof (AudTapSpectrum) * AUD_TAP_SPECTRUM_SLOTS;
+
+    void * mem = MAP_FAILED;
+    int fd = memfd_create ("audacious-tap", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (fd < 0 || ftruncate (fd, size) < 0 ||
+     (mem = mmap (nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        AUDERR ("Cannot create shared memory for the tap: %s\n", strerror (errno));
+        if (fd >= 0)
+            close (fd);
+        return false;
+    }
+
+    /* readers must not resize the memory (which would crash us) or write to
+     * it; F_SEAL_FUTURE_WRITE is new in Linux 5.1 and does not affect our own
+     * mapping, made before it */
+    int seals = F_SEAL_SHRINK | F_SEAL_GROW;
+#ifdef F_SEAL_FUTURE_WRITE
+    seals |= F_SEAL_FUTURE_WRITE;
+#endif
+
+    if (fcntl (fd, F_ADD_SEALS, seals | F_SEAL_SEAL) < 0)
+        AUDWARN ("Cannot seal shared memory for the tap: %s\n", strerror (errno));
+
+    wake_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (wake_fd < 0)
+    {
+        AUDERR ("Cannot create eventfd: %s\n", strerror (errno));
+        munmap (mem, size);
+        close (fd);
+        return false;
+    }
+
+    header = (AudTapHeader *) mem;
+    header->magic = AUD_TAP_MAGIC;
+    header->version = AUD_TAP_VERSION;
+    header->size = size;
+    header->pcm_offset = pcm_offset;
+    header->pcm_samples = AUD_TAP_PCM_SAMPLES;
+    header->block_offset = block_offset;
+    header->block_slots = AUD_TAP_BLOCK_SLOTS;
+    header->spectrum_offset = spectrum_offset;
+    header->spectrum_slots = AUD_TAP_SPECTRUM_SLOTS;
+    header->spectrum_bins = AUD_TAP_SPECTRUM_BINS;
+
+    pcm = (float *) ((char *) mem + pcm_offset);
+    blocks = (AudTapBlock *) ((char *) mem + block_offset);
+    spectra = (AudTapSpectrum *) ((char *) mem + spectrum_offset);
+
+    shm_fd = fd;
+    shm_size = size;
+    quit = false;
+
+    pthread_create (& tap_thread, nullptr, tap_worker, nullptr);
+
+    AUDINFO ("Created shared memory for the tap (%d bytes).\n", size);
+    return true;
+}
+
+/* called only in the main thread */
+static void set_active (bool enable)
+{
+    if (enable == tap_active ())
+        return;
+
+    if (enable)
+    {
+        aud_visualizer_add (& tap_vis);
+        __atomic_store_n (& active, true, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        __atomic_store_n (& active, false, __ATOMIC_RELEASE);
+        aud_visualizer_remove (& tap_vis);
+    }
+}
+
+EXPORT int aud_drct_open_tap (int & mem_fd, int & event_fd)
+{
+    if (! header && ! create_tap ())
+        return -1;
+
+    int fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int fd2 = (fd >= 0) ? fcntl (fd, F_DUPFD_CLOEXEC, 0) : -1;
+    int shm_fd2 = (fd2 >= 0) ? fcntl (shm_fd, F_DUPFD_CLOEXEC, 0) : -1;
+
+    if (shm_fd2 < 0)
+    {
+        AUDERR ("Cannot create file descriptors for the tap: %s\n", strerror (errno));
+        if (fd >= 0)
+            close (fd);
+        if (fd2 >= 0)
+            close (fd2);
+        return -1;
+    }
+
+    pthread_mutex_lock (& mutex);
+
+    if (readers.len () == MAX_READERS)
+    {
+        AUDWARN ("Too many tap readers; closing the oldest.\n");
+        close (readers[0].fd);
+        readers.remove (0, 1);
+    }
+
+    TapReader reader = {next_id ++, fd};
+    readers.append (reader);
+
+    pthread_mutex_unlock (& mutex);
+
+    set_active (true);
+
+    mem_fd = shm_fd2;
+    event_fd = fd2;
+    return reader.id;
+}
+
+EXPORT void aud_drct_close_tap (int id)
+{
+    bool found = false;
+
+    pthread_mutex_lock (& mutex);
+
+    for (int i = 0; i < readers.len (); i ++)
+    {
+        if (readers[i].id == id)
+        {
+            close (readers[i].fd);
+            readers.remove (i, 1);
+            found = true;
+            break;
+        }
+    }
+
+    bool none = ! readers.len ();
+
+    pthread_mutex_unlock (& mutex);
+
+    if (found && none)
+        set_active (false);
+}
+
+void tap_cleanup ()
+{
+    if (! header)
+        return;
+
+    set_active (false);
+
+    pthread_mutex_lock (& mutex);
+
+    for (const TapReader & reader : readers)
+        close (reader.fd);
+
+    readers.clear ();
+    quit = true;
+
+    pthread_mutex_unlock (& mutex);
+
+    wake ();
+    pthread_join (tap_thread, nullptr);
+
+    munmap (header, shm_size);
+    close (shm_fd);
+    close (wake_fd);
+
+    header = nullptr;
+    pcm = nullptr;
+    blocks = nullptr;
+    spectra = nullptr;
+    shm_fd = wake_fd = -1;
+
+    /* readers of a new tap start from zero */
+    pcm_head = block_start = block_count = 0;
+    spectrum_count = 0;
+}
+
+#else /* ! __linux__ */
+
+/* memfd_create() and eventfd() are specific to Linux */
+
+bool tap_active ()
+    { return false; }
+
+void tap_write_pcm (const float * data, int samples) {}
+void tap_commit (int time, int channels, int rate) {}
+void tap_flush () {}
+void tap_cleanup () {}
+
+EXPORT int aud_drct_open_tap (int & mem_fd, int & event_fd)
+    { return -1; }
+EXPORT void aud_drct_close_tap (int id) {}
+
+#endif /* ! __linux__ */
@@ -0,0 +1,171 @@
+/*
+ * tap.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_TAP_H
+#define LIBAUDCORE_TAP_H
+
+/*
+ * Layout of the shared-memory tap (see aud_drct_open_tap() in drct.h), through
+ * which other processes can follow the audio as it is played.  This header is
+ * plain C and does not need libaudcore, so that any program can be a reader.
+ *
+ * The memory holds three rings, written by Audacious and only read by others:
+ *  - PCM: the audio after the equalizer (and before software volume), as
+ *    interleaved 32-bit floats.  Positions in the stream are 64-bit counters
+ *    that never wrap; sample <n> is at pcm[n % pcm_samples].
+ *  - Blocks: one per buffer written to the output, giving the place of its
+ *    samples in the PCM ring, their format and their timestamps.
+ *  - Spectra: the intensity of frequencies 1/512, 2/512, ..., 256/512 of the
+ *    sample rate of the mono mix, as given to visualizers by render_freq().
+ *
+ * Block and spectrum <i> are kept in slot <i % slots> until overwritten.  A
+ * reader remembers the index of the next one it wants, reads it with
+ * aud_tap_read_block() or aud_tap_read_spectrum() and, for a block, copies its
+ * samples with aud_tap_read_pcm().  Readers never block Audacious; a reader
+ * that falls too far behind finds that the data it wanted has been
+ * overwritten, and may skip ahead to the latest block (aud_tap_blocks() - 1).
+ * The eventfd given with the memory is signaled after new data is written.
+ *
+ * Times are given twice: as the output time (milliseconds of audio written to
+ * the output, which starts again from zero after a seek or a change of audio
+ * format) and as the CLOCK_MONOTONIC time at which the data was written.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define AUD_TAP_MAGIC 0x70617441u  /* "Atap", little-endian */
+#define AUD_TAP_VERSION 1
+
+#define AUD_TAP_PCM_SAMPLES (1 << 18)  /* about 2.7 seconds of 48 kHz stereo */
+#define AUD_TAP_BLOCK_SLOTS 256
+#define AUD_TAP_SPECTRUM_SLOTS 32
+#define AUD_TAP_SPECTRUM_BINS 256
+
+/* AudTapBlock flags */
+#define AUD_TAP_FLUSHED 1  /* the first block after a seek or flush */
+
+/* Sizes and offsets are given here rather than assumed, so that they can be
+ * changed without changing the version. */
+typedef struct {
+    uint32_t magic, version;
+    uint32_t size;  /* of the whole shared memory, in bytes */
+    uint32_t pcm_offset, pcm_samples;  /* pcm_samples is a power of two */
+    uint32_t block_offset, block_slots;
+    uint32_t spectrum_offset, spectrum_slots, spectrum_bins;
+
+    /* written by Audacious while playing; use the functions below */
+    uint64_t pcm_reserved;  /* samples up to here may be being written */
+    uint64_t blocks;  /* number of blocks written */
+    uint64_t spectra;  /* number of spectra written */
+} AudTapHeader;
+
+typedef struct {
+    uint64_t seq;  /* 2i + 2 when block i is complete */
+    uint64_t start;  /* position of the first sample in the PCM stream */
+    int64_t clock_us;  /* CLOCK_MONOTONIC when written, in microseconds */
+    int32_t time;  /* output time of the first sample, in milliseconds */
+    uint32_t samples, channels, rate, flags, reserved;
+} AudTapBlock;
+
+typedef struct {
+    uint64_t seq;  /* 2i + 2 when spectrum i is complete */
+    int64_t clock_us;  /* CLOCK_MONOTONIC when written, in microseconds */
+    int32_t time;  /* output time of the last 512 samples analyzed */
+    uint32_t rate, bins, reserved;  /* bins of values[] used */
+    float values[AUD_TAP_SPECTRUM_BINS];
+} AudTapSpectrum;
+
+/* returns nonzero if <size> bytes mapped from the memfd hold a usable tap */
+static inline int aud_tap_check (const AudTapHeader * h, uint64_t size)
+{
+    return size >= sizeof (AudTapHeader) && h->magic == AUD_TAP_MAGIC &&
+     h->version == AUD_TAP_VERSION && h->size <= size && h->pcm_samples &&
+     ! (h->pcm_samples & (h->pcm_samples - 1)) && h->block_slots &&
+     h->spectrum_slots && h->spectrum_bins <= AUD_TAP_SPECTRUM_BINS &&
+     h->pcm_offset + (uint64_t) h->pcm_samples * sizeof (float) <= h->size &&
+     h->block_offset + (uint64_t) h->block_slots * sizeof (AudTapBlock) <= h->size &&
+     h->spectrum_offset + (uint64_t) h->spectrum_slots * sizeof (AudTapSpectrum) <= h->size;
+}
+
+static inline uint64_t aud_tap_blocks (const AudTapHeader * h)
+    { return __atomic_load_n (& h->blocks, __ATOMIC_ACQUIRE); }
+static inline uint64_t aud_tap_spectra (const AudTapHeader * h)
+    { return __atomic_load_n (& h->spectra, __ATOMIC_ACQUIRE); }
+
+/* Copies a slot written under a sequence count (like a seqlock, but the
+ * reader does not retry).  Returns 1 if the slot held item <i>, 0 if item <i>
+ * has not been written yet, or -1 if it has been overwritten. */
+static inline int aud_tap_read_slot_ (const uint64_t * seq, void * dest,
+ const void * src, size_t len, uint64_t i)
+{
+    uint64_t want = 2 * i + 2;
+    uint64_t seq1 = __atomic_load_n (seq, __ATOMIC_ACQUIRE);
+
+    if (seq1 != want)
+        return (seq1 < want) ? 0 : -1;
+
+    memcpy (dest, src, len);
+
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    return (__atomic_load_n (seq, __ATOMIC_RELAXED) == want) ? 1 : -1;
+}
+
+static inline int aud_tap_read_block (const AudTapHeader * h, uint64_t i,
+ AudTapBlock * block)
+{
+    const AudTapBlock * slot = (const AudTapBlock *) ((const char *) h +
+     h->block_offset) + i % h->block_slots;
+
+    return aud_tap_read_slot_ (& slot->seq, block, slot, sizeof * block, i);
+}
+
+static inline int aud_tap_read_spectrum (const AudTapHeader * h, uint64_t i,
+ AudTapSpectrum * spectrum)
+{
+    const AudTapSpectrum * slot = (const AudTapSpectrum *) ((const char *) h +
+     h->spectrum_offset) + i % h->spectrum_slots;
+
+    return aud_tap_read_slot_ (& slot->seq, spectrum, slot, sizeof * spectrum, i);
+}
+
+/* Copies <count> samples from position <start> in the PCM stream (normally
+ * those of a block).  Returns 0 if they were overwritten while being copied,
+ * in which case <dest> holds garbage. */
+static inline int aud_tap_read_pcm (const AudTapHeader * h, uint64_t start,
+ uint32_t count, float * dest)
+{
+    const float * pcm = (const float *) ((const char *) h + h->pcm_offset);
+    uint32_t pos = start & (h->pcm_samples - 1);
+    uint32_t count1 = h->pcm_samples - pos;
+
+    if (count > h->pcm_samples)
+        return 0;
+    if (count1 > count)
+        count1 = count;
+
+    memcpy (dest, pcm + pos, sizeof (float) * count1);
+    memcpy (dest + count1, pcm, sizeof (float) * (count - count1));
+
+    /* the writer moves pcm_reserved before it overwrites anything */
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    return __atomic_load_n (& h->pcm_reserved, __ATOMIC_RELAXED) - start <= h->pcm_samples;
+}
+
+#endif /* LIBAUDCORE_TAP_H */
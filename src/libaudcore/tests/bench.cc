@@ -0,0 +1,402 @@
+/*
+ * bench.cc - Throughput benchmarks for libaudcore
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "audio.h"
+#include "audstrings.h"
+#include "bitmap.h"
+#include "convolver.h"
+#include "fft.h"
+#include "internal.h"
+#include "playlist-data.h"
+
+#include <complex>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SAMPLES (1 << 16)
+#define BENCH_SECONDS 0.25
+
+static double get_time ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Runs func repeatedly for about BENCH_SECONDS and returns the number of
+ * calls per second. */
+template<class F>
+static double run_timed (F func)
+{
+    int calls = 0;
+    double start = get_time (), elapsed;
+
+    do
+    {
+        for (int i = 0; i < 16; i ++)
+            func ();
+
+        calls += 16;
+        elapsed = get_time () - start;
+    }
+    while (elapsed < BENCH_SECONDS);
+
+    return calls / elapsed;
+}
+
+static const char * const format_names[] = {
+    "float",
+    "s8", "u8",
+    "s16le", "s16be", "u16le", "u16be",
+    "s24le", "s24be", "u24le", "u24be",
+    "s32le", "s32be", "u32le", "u32be",
+    "s24_3le", "s24_3be", "u24_3le", "u24_3be"
+};
+
+static void bench_audio_conversion ()
+{
+    static float f[BENCH_SAMPLES];
+    static char words[4 * BENCH_SAMPLES];
+
+    for (int i = 0; i < BENCH_SAMPLES; i ++)
+        f[i] = 2.2f * rand () / RAND_MAX - 1.1f;
+    for (int i = 0; i < aud::n_elems (words); i ++)
+        words[i] = rand ();
+
+    SimdLevel detected = audio_simd_detect ();
+
+    printf ("audio_from_int / audio_to_int (Msamples/s)\n");
+    printf ("%-8s  %9s %9s  %9s %9s  %9s %9s\n", "format",
+     "from:none", "to:none", "from:sse2", "to:sse2", "from:best", "to:best");
+
+    for (int format = FMT_S8; format <= FMT_U24_3BE; format ++)
+    {
+        printf ("%-8s", format_names[format]);
+
+        for (auto level : {SimdLevel::None, SimdLevel::SSE2, detected})
+        {
+            audio_simd_set_level (level);
+
+            double from = run_timed ([=] () { audio_from_int (words, format, f, BENCH_SAMPLES); });
+            double to = run_timed ([=] () { audio_to_int (f, words, format, BENCH_SAMPLES); });
+
+            printf ("  %9.1f %9.1f", from * BENCH_SAMPLES / 1e6, to * BENCH_SAMPLES / 1e6);
+        }
+
+        printf ("\n");
+    }
+
+    audio_simd_set_level (detected);
+    printf ("(best = %s)\n\n", audio_simd_level_name (detected));
+}
+
+/* compares the separate passes formerly done by write_output() to the fused
+ * single pass; the buffer is refilled before each run in both cases */
+static void bench_post_process ()
+{
+    const int channels = 8, rate = 192000;
+    const int samples = channels * (rate / 4);
+
+    Index<float> source, data;
+    Index<char> out;
+
+    source.resize (samples);
+    data.resize (samples);
+    out.resize (4 * samples);
+
+    for (float & f : source)
+        f = 2.2f * rand () / RAND_MAX - 1.1f;
+
+    eq_init ();
+    eq_set_format (channels, rate);
+
+    AudioPostProcess pp = AudioPostProcess ();
+
+    pp.channels = channels;
+    pp.equalizer = eq_active ();
+    pp.volume = audio_volume_factors (channels, {80, 90}, pp.factors);
+    pp.soft_clip = true;
+    pp.format = FMT_S16_NE;
+
+    double separate = run_timed ([&] () {
+        memcpy (data.begin (), source.begin (), sizeof (float) * samples);
+        eq_filter (data.begin (), samples);
+        audio_amplify (data.begin (), channels, samples / channels, pp.factors);
+        audio_soft_clip (data.begin (), samples);
+        audio_to_int (data.begin (), out.begin (), pp.format, samples);
+    });
+
+    double fused = run_timed ([&] () {
+        memcpy (data.begin (), source.begin (), sizeof (float) * samples);
+        audio_post_process (pp, data.begin (), samples, out.begin ());
+    });
+
+    /* The separate passes stream the float buffer through memory seven times
+     * (read + write for eq, volume and clipping, read for conversion).  The
+     * fused pass reads it once and writes it back once. */
+    double mbytes = sizeof (float) * samples / 1e6;
+
+    printf ("post-processing (%d channels, %d Hz, %.1f MB buffer, eq %s)\n",
+     channels, rate, mbytes, pp.equalizer ? "on" : "off");
+    printf ("  separate: %7.1f Msamples/s  (~%.0f MB/s float traffic)\n",
+     separate * samples / 1e6, separate * mbytes * 7);
+    printf ("  fused:    %7.1f Msamples/s  (~%.0f MB/s float traffic)\n\n",
+     fused * samples / 1e6, fused * mbytes * 2);
+
+    eq_cleanup ();
+}
+
+/* the radix-2 complex FFT that calc_freq() used before RealFFT, kept here
+ * for comparison */
+namespace reference
+{
+    typedef std::complex<float> Complex;
+
+    static float hamming[512];
+    static int reversed[512];
+    static Complex roots[256];
+
+    static void generate_tables ()
+    {
+        for (int n = 0; n < 512; n ++)
+        {
+            hamming[n] = 1 - 0.85f * cosf (n * (2 * (float) M_PI / 512));
+
+            int y = 0;
+            for (int x = n, b = 9; b --; x >>= 1)
+                y = (y << 1) | (x & 1);
+
+            reversed[n] = y;
+        }
+
+        for (int n = 0; n < 256; n ++)
+            roots[n] = exp (Complex (0, n * (2 * (float) M_PI / 512)));
+    }
+
+    static void calc_freq (const float data[512], float freq[256])
+    {
+        Complex a[512];
+        for (int n = 0; n < 512; n ++)
+            a[reversed[n]] = data[n] * hamming[n];
+
+        for (int half = 1, inv = 256; inv; half <<= 1, inv >>= 1)
+        {
+            for (int g = 0; g < 512; g += half << 1)
+            {
+                for (int b = 0, r = 0; b < half; b ++, r += inv)
+                {
+                    Complex even = a[g + b];
+                    Complex odd = roots[r] * a[g + half + b];
+                    a[g + b] = even + odd;
+                    a[g + half + b] = even - odd;
+                }
+            }
+        }
+
+        for (int n = 0; n < 255; n ++)
+            freq[n] = 2 * abs (a[1 + n]) / 512;
+
+        freq[255] = abs (a[256]) / 512;
+    }
+}
+
+static void bench_fft ()
+{
+    static float data[2][FFT_MAX_SIZE];
+    static float re[2][FFT_MAX_SIZE / 2 + 1], im[2][FFT_MAX_SIZE / 2 + 1];
+    float freq[256];
+
+    for (auto & channel : data)
+    {
+        for (float & f : channel)
+            f = 2.0f * rand () / RAND_MAX - 1;
+    }
+
+    reference::generate_tables ();
+
+    SimdLevel detected = audio_simd_detect ();
+
+    RealFFT fft512 (512);
+
+    printf ("512-point intensity (calls/s; the reference is the old calc_freq)\n");
+    printf ("  reference: %10.0f\n", run_timed ([&] () { reference::calc_freq (data[0], freq); }));
+
+    for (auto level : {SimdLevel::None, SimdLevel::SSE2, detected})
+    {
+        audio_simd_set_level (level);
+        printf ("  %-9s  %10.0f\n", audio_simd_level_name (level),
+         run_timed ([&] () { fft512.intensity (data[0], freq); }));
+    }
+
+    printf ("\nRealFFT (microseconds per call; forward2 transforms two channels)\n");
+    printf ("%6s  %-5s  %9s %9s %9s %9s\n", "size", "simd", "forward", "2 x fwd", "forward2", "inverse");
+
+    for (int size = FFT_MIN_SIZE; size <= FFT_MAX_SIZE; size *= 2)
+    {
+        RealFFT fft (size);
+
+        for (auto level : {SimdLevel::None, SimdLevel::SSE2, detected})
+        {
+            audio_simd_set_level (level);
+
+            double forward = run_timed ([&] () { fft.forward (data[0], re[0], im[0]); });
+            double forward2 = run_timed ([&] () {
+                fft.forward2 (data[0], data[1], re[0], im[0], re[1], im[1]);
+            });
+            double inverse = run_timed ([&] () { fft.inverse (re[0], im[0], data[1]); });
+
+            printf ("%6d  %-5s  %9.2f %9.2f %9.2f %9.2f\n", size,
+             audio_simd_level_name (level), 1e6 / forward, 2e6 / forward,
+             1e6 / forward2, 1e6 / inverse);
+        }
+    }
+
+    audio_simd_set_level (detected);
+    printf ("\n");
+
+    fft_cleanup ();
+}
+
+/* how many times faster than real time a stereo 48 kHz stream can be filtered
+ * through impulse responses of various lengths, for each block size (the
+ * latency is one block) */
+static void bench_convolver ()
+{
+    const int channels = 2, rate = 48000, frames = 4096;
+
+    Index<float> ir, data;
+    ir.resize (channels * (1 << 18));
+    data.resize (channels * frames);
+
+    for (int i = 0; i < ir.len (); i ++)
+        ir[i] = (2.0f * rand () / RAND_MAX - 1) * expf (-1e-5f * (i / channels));
+    for (float & f : data)
+        f = 2.0f * rand () / RAND_MAX - 1;
+
+    printf ("convolution (realtime factor, %d channels at %d Hz)\n", channels, rate);
+    printf ("%6s", "taps");
+
+    for (int block = CONV_MIN_BLOCK; block <= CONV_MAX_BLOCK; block *= 2)
+        printf ("  %5d (%4.1f ms)", block, block * 1000.0 / rate);
+
+    printf ("\n");
+
+    for (int taps = 1 << 12; taps <= 1 << 18; taps *= 4)
+    {
+        printf ("%5dk", taps >> 10);
+
+        for (int block = CONV_MIN_BLOCK; block <= CONV_MAX_BLOCK; block *= 2)
+        {
+            ConvFilter filter (ir.begin (), channels, taps, rate, block);
+            Convolver conv (filter, channels);
+
+            double calls = run_timed ([&] () { conv.process (data.begin (), data.len ()); });
+            printf ("  %15.1f", calls * frames / rate);
+        }
+
+        printf ("\n");
+    }
+
+    printf ("\n");
+}
+
+/* finding the unscanned rows of a large playlist, which the scan scheduler
+ * does from row 0 after every structural change; the per-row walk reads the
+ * same bitmap one bit at a time and is a lower bound for the former loop over
+ * the entries themselves */
+static void bench_scan_rows ()
+{
+    const int rows = 1000000;
+
+    PlaylistData::update_formatter ();
+    PlaylistData playlist (nullptr, "bench");
+
+    Index<PlaylistAddItem> items;
+    items.insert (0, rows);
+
+    for (int i = 0; i < rows; i ++)
+    {
+        items[i].filename = String (str_printf ("file:///music/%07d.mp3", i));
+        items[i].tuple.set_filename (items[i].filename);
+        items[i].tuple.set_state (Tuple::Valid);
+    }
+
+    double start = get_time ();
+    playlist.insert_items (0, std::move (items));
+    double insert = get_time () - start;
+
+    printf ("unscanned rows of a %dk-entry playlist (microseconds per sweep)\n", rows / 1000);
+    printf ("  inserting the entries: %.0f ms\n", insert * 1000);
+    printf ("%10s  %9s %9s\n", "unscanned", "find_next", "per-row");
+
+    for (int every : {0, 100000, 1000, 10})
+    {
+        /* as "refresh selected" does */
+        if (every)
+        {
+            playlist.select_all (false);
+            for (int i = every / 2; i < rows; i += every)
+                playlist.select_entry (i, true);
+
+            playlist.reset_tuples (true);
+        }
+
+        int found = 0;
+        double sweep = run_timed ([&] () {
+            found = 0;
+            for (int row = playlist.next_unscanned_entry (0); row >= 0;
+             row = playlist.next_unscanned_entry (row + 1))
+                found ++;
+        });
+
+        Bitmap bits;
+        bits.resize (rows);
+        for (int row = playlist.next_unscanned_entry (0); row >= 0;
+         row = playlist.next_unscanned_entry (row + 1))
+            bits.set (row, true);
+
+        double walk = run_timed ([&] () {
+            int count = 0;
+            for (int row = 0; row < rows; row ++)
+                count += bits.get (row);
+            if (count != found)
+                abort ();
+        });
+
+        printf ("%10d  %9.1f %9.1f\n", found, 1e6 / sweep, 1e6 / walk);
+    }
+
+    printf ("\n");
+
+    PlaylistData::cleanup_formatter ();
+}
+
+int main ()
+{
+    bench_audio_conversion ();
+    bench_post_process ();
+    bench_convolver ();
+    bench_fft ();
+    bench_scan_rows ();
+
+    return 0;
+}
@@ -1,14 +1,193 @@
+#include "audstrings.h"
+#include "interface.h"
 #include "internal.h"
+#include "playlist-data.h"
+#include "playlist-internal.h"
+#include "plugins.h"
+#include "probe.h"
+#include "runtime.h"
+#include "scanner.h"
 #include "vfs.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
 extern "C" const char * libguess_determine_encoding (const char *, int, const char *)
     { return nullptr; }
 
-bool aud_get_bool (const char *, const char *)
-    { return false; }
-String aud_get_str (const char *, const char *)
-    { return String (""); }
+bool aud_get_bool (const char *, const char * name)
+{
+    return ! strcmp (name, "equalizer_active") || ! strcmp (name, "metadata_cache") ||
+     ! strcmp (name, "recurse_folders");
+}
+double aud_get_double (const char *, const char * name)
+    { return ! strcmp (name, "equalizer_preamp") ? -3 : 0; }
+int aud_get_int (const char *, const char *)
+    { return 0; }
+/* a non-flat equalizer curve, so that eq_filter() has something to do */
+String aud_get_str (const char *, const char * name)
+    { return String (! strcmp (name, "equalizer_bands") ? "6,4,0,-3,-6,-2,1,3,5,8" : ""); }
+void aud_set_str (const char *, const char *, const char *) {}
+void aud_set_double (const char *, const char *, double) {}
 String VFSFile::get_metadata (const char *)
     { return String (); }
+Index<char> VFSFile::read_file (const char *, VFSReadOptions)
+    { return Index<char> (); }
+void ConfigHandleBase::add ()
+    { update (); }
+void ConfigHandleBase::remove () {}
+
+/* the metadata cache is kept in $TMPDIR; a single decoder "test" exists */
+const char * aud_get_path (AudPath)
+    { return g_get_tmp_dir (); }
+
+static char test_plugin;
+const char * aud_plugin_get_basename (PluginHandle *)
+    { return "test"; }
+PluginHandle * aud_plugin_lookup_basename (const char * basename)
+    { return ! strcmp (basename, "test") ? (PluginHandle *) & test_plugin : nullptr; }
+PluginType aud_plugin_get_type (PluginHandle *)
+    { return PluginType::Input; }
+bool aud_plugin_get_enabled (PluginHandle *)
+    { return true; }
+
+void aud_visualizer_add (Visualizer *) {}
+void aud_visualizer_remove (Visualizer *) {}
+
+/* PlaylistData is used on its own, without playlist.cc or the scanner */
+void pl_signal_entry_deleted (PlaylistEntry *) {}
+void pl_signal_position_changed (Playlist::ID *) {}
+void pl_signal_update_queued (Playlist::ID *, Playlist::UpdateLevel, int) {}
+void pl_signal_rescan_needed (Playlist::ID *) {}
+void pl_signal_playlist_deleted (Playlist::ID *) {}
+
+ScanRequest::ScanRequest (const String & filename, int flags, Callback callback,
+ PluginHandle * decoder, Tuple && tuple) :
+    filename (filename),
+    flags (flags),
+    callback (callback),
+    decoder (decoder),
+    tuple (std::move (tuple)),
+    ip (nullptr) {}
 
 size_t misc_bytes_allocated;
+
+/* The adder searches real folders, without the transport plugins.  Only
+ * .mp3 and .flac files have a decoder.  A .cue file is read as a cuesheet
+ * holding a FILE line and one TRACK line per track. */
+Index<String> VFSFile::read_folder (const char * uri, String & error)
+{
+    Index<String> entries;
+    StringBuf path = uri_to_filename (uri);
+    GDir * folder = path ? g_dir_open (path, 0, nullptr) : nullptr;
+
+    if (! folder)
+    {
+        error = String ("Cannot open folder");
+        return entries;
+    }
+
+    const char * name;
+    while ((name = g_dir_read_name (folder)))
+        entries.append (String (filename_to_uri (filename_build ({path, name}))));
+
+    g_dir_close (folder);
+    return entries;
+}
+
+VFSFileTest VFSFile::test_file (const char * uri, VFSFileTest test, String & error)
+{
+    StringBuf path = uri_to_filename (uri);
+    GStatBuf st;
+
+    if (! path || g_lstat (path, & st) < 0)
+        return VFSFileTest (test & VFS_NO_ACCESS);
+
+    int passed = 0;
+    if (S_ISLNK (st.st_mode))
+        passed |= VFS_IS_SYMLINK;
+    if (S_ISREG (st.st_mode))
+        passed |= VFS_IS_REGULAR;
+    if (S_ISDIR (st.st_mode))
+        passed |= VFS_IS_DIR;
+
+    return VFSFileTest (test & passed);
+}
+
+int probe_by_filename (const char * filename)
+{
+    return (str_has_suffix_nocase (filename, ".mp3") ||
+     str_has_suffix_nocase (filename, ".flac")) ? PROBE_FLAG_HAS_DECODER : 0;
+}
+
+bool playlist_load (const char * filename, String & title, Index<PlaylistAddItem> & items)
+{
+    StringBuf path = uri_to_filename (filename);
+    char * text;
+
+    if (! path || ! g_file_get_contents (path, & text, nullptr, nullptr))
+        return false;
+
+    String audio_file;
+    char name[256];
+    int track;
+
+    for (char * line = strtok (text, "\n"); line; line = strtok (nullptr, "\n"))
+    {
+        if (sscanf (line, "FILE \"%255[^\"]\"", name) == 1)
+        {
+            const char * slash = strrchr (path, '/');
+            audio_file = String (filename_to_uri (filename_build
+             ({str_copy (path, slash - path), name})));
+        }
+        else if (sscanf (line, "TRACK %d", & track) == 1 && audio_file)
+        {
+            StringBuf sub = str_printf ("%s?%d", filename, track);
+
+            Tuple tuple;
+            tuple.set_filename (sub);
+            tuple.set_str (Tuple::AudioFile, audio_file);
+            tuple.set_int (Tuple::Track, track);
+            tuple.set_state (Tuple::Valid);
+
+            items.append (String (sub), std::move (tuple));
+        }
+    }
+
+    g_free (text);
+    return true;
+}
+
+PluginHandle * aud_file_find_decoder (const char *, bool, VFSFile &, String *)
+    { return nullptr; }
+bool aud_file_read_tag (const char *, PluginHandle *, VFSFile &, Tuple &,
+ Index<char> *, String *)
+    { return false; }
+bool input_plugin_has_subtunes (PluginHandle *)
+    { return false; }
+
+bool aud_get_headless_mode ()
+    { return true; }
+void aud_ui_show_error (const char *) {}
+
+/* the rest of the adder is not used */
+bool Playlist::filename_is_playlist (const char *)
+    { return false; }
+String Playlist::get_title () const
+    { return String (); }
+int Playlist::index () const
+    { return -1; }
+int Playlist::n_entries () const
+    { return 0; }
+void Playlist::queue_remove (int, int) const {}
+void Playlist::remove_entries (int, int) const {}
+void Playlist::set_position (int) const {}
+void Playlist::set_title (const char *) const {}
+void Playlist::start_playback (bool) const {}
+void PlaylistEx::insert_flat_items (int, Index<PlaylistAddItem> &&) const {}
+void playlist_cache_load (Index<PlaylistAddItem> &) {}
+void playlist_enable_scan (bool) {}
@@ -19,16 +19,38 @@
 
 #include "audio.h"
 #include "audstrings.h"
+#include "bitmap.h"
+#include "convolver.h"
+#include "drct.h"
+#include "equalizer.h"
+#include "fft.h"
 #include "internal.h"
+#include "meta-cache.h"
+#include "playlist.h"
+#include "playlist-internal.h"
+#include "plugins.h"
 #include "ringbuf.h"
+#include "runtime.h"
+#include "seqlock.h"
+#include "spscring.h"
+#include "tap.h"
 #include "tuple.h"
 #include "tuple-compiler.h"
 #include "vfs.h"
+#include "visualizer.h"
 
 #include <assert.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
 
 static void test_audio_conversion ()
 {
@@ -60,6 +82,504 @@ static void test_audio_conversion ()
         assert (out[i] == (in[i] & 0xffffff));
 }
 
+/* the vectorized conversions must match the scalar code bit for bit */
+static void test_simd_conversion ()
+{
+    static const float special[] =
+     {0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.5f, -1.5f, 1.0f / 256, -1.0f / 256};
+
+    const int samples = 259;  /* not a multiple of any block size */
+    unsigned char in[4 * samples];
+    float f[samples], f_ref[samples];
+    unsigned char out[4 * samples], out_ref[4 * samples];
+
+    srand (0);
+
+    for (int i = 0; i < aud::n_elems (in); i ++)
+        in[i] = rand ();
+
+    for (int i = 0; i < samples; i ++)
+        f[i] = (i < aud::n_elems (special)) ? special[i] : 2.5f * rand () / RAND_MAX - 1.25f;
+
+    SimdLevel detected = audio_simd_detect ();
+
+    for (int format = FMT_S8; format <= FMT_U24_3BE; format ++)
+    {
+        audio_simd_set_level (SimdLevel::None);
+        audio_from_int (in, format, f_ref, samples);
+        audio_to_int (f, out_ref, format, samples);
+
+        for (auto level : {SimdLevel::SSE2, detected})
+        {
+            audio_simd_set_level (level);
+
+            float f2[samples];
+            audio_from_int (in, format, f2, samples);
+            assert (! memcmp (f2, f_ref, sizeof f_ref));
+
+            memset (out, 0, sizeof out);
+            audio_to_int (f, out, format, samples);
+            assert (! memcmp (out, out_ref, FMT_SIZEOF (format) * samples));
+        }
+    }
+
+    audio_simd_set_level (detected);
+    test_audio_conversion ();
+}
+
+static void test_post_process ()
+{
+    /* break points of the soft clipping curve */
+    static const float clip_in[] = {0, 0.4f, 0.7f, 1, 1.3f, 1.5f, 3, -0.7f, -3};
+    static const float clip_out[] = {0, 0.4f, 0.64f, 0.85f, 0.97f, 1, 1, -0.64f, -1};
+
+    float clip[aud::n_elems (clip_in)];
+    memcpy (clip, clip_in, sizeof clip);
+    audio_soft_clip (clip, aud::n_elems (clip));
+
+    for (int i = 0; i < aud::n_elems (clip); i ++)
+        assert (fabsf (clip[i] - clip_out[i]) < 1e-6f);
+
+    /* the fused pass must give the same result as separate passes: exactly
+     * for volume and conversion, to within one ulp for soft clipping */
+    const int channels = 6, frames = 1001;
+    const int samples = channels * frames;
+    static float f[samples], f_ref[samples];
+    static short out[samples], out_ref[samples];
+
+    AudioPostProcess pp = AudioPostProcess ();
+
+    pp.channels = channels;
+    pp.volume = audio_volume_factors (channels, {70, 90}, pp.factors);
+    pp.format = FMT_S16_NE;
+
+    assert (pp.volume);
+
+    for (int clip = 0; clip < 2; clip ++)
+    {
+        srand (0);
+
+        for (int i = 0; i < samples; i ++)
+            f[i] = f_ref[i] = 3.0f * rand () / RAND_MAX - 1.5f;
+
+        pp.soft_clip = clip;
+
+        audio_amplify (f_ref, channels, frames, pp.factors);
+        if (clip)
+            audio_soft_clip (f_ref, samples);
+        audio_to_int (f_ref, out_ref, FMT_S16_NE, samples);
+
+        audio_post_process (pp, f, samples, out);
+
+        if (clip)
+        {
+            for (int i = 0; i < samples; i ++)
+            {
+                assert (fabsf (f[i] - f_ref[i]) <= 1e-7f);
+                assert (abs (out[i] - out_ref[i]) <= 1);
+            }
+        }
+        else
+        {
+            assert (! memcmp (f, f_ref, sizeof f));
+            assert (! memcmp (out, out_ref, sizeof out));
+        }
+    }
+}
+
+/* the equalizer as it was before the channels were put in vector lanes: each
+ * channel is run through its own cascade of band-pass filters */
+static void eq_filter_reference (float * data, int channels, int frames, int rate)
+{
+    const float Q = 1.2247449f;
+    static const float CF[AUD_EQ_NBANDS] = {31.25f, 62.5f, 125, 250, 500, 1000,
+     2000, 4000, 8000, 16000};
+
+    double bands[AUD_EQ_NBANDS];
+    aud_eq_get_bands (bands);
+    double preamp = aud_get_double (nullptr, "equalizer_preamp");
+
+    int K = AUD_EQ_NBANDS;
+    while (K > 0 && CF[K - 1] > (float) rate / (2.005f * Q))
+        K --;
+
+    float a[AUD_EQ_NBANDS][2], b[AUD_EQ_NBANDS][2], g[AUD_EQ_NBANDS];
+
+    for (int k = 0; k < K; k ++)
+    {
+        float th = 2 * (float) M_PI * CF[k] / (float) rate;
+        float C = (1 - tanf (th * Q / 2)) / (1 + tanf (th * Q / 2));
+
+        a[k][0] = (1 + C) * cosf (th);
+        a[k][1] = -C;
+        b[k][0] = (1 - C) / 2;
+        b[k][1] = -1.005f;
+
+        float adj = preamp + bands[k];
+        g[k] = powf (10, adj / 20) - 1;
+    }
+
+    for (int channel = 0; channel < channels; channel ++)
+    {
+        float wq[AUD_EQ_NBANDS][2] = {};
+
+        for (int i = 0; i < frames; i ++)
+        {
+            float & f = data[i * channels + channel];
+            float yt = f;
+
+            for (int k = 0; k < K; k ++)
+            {
+                float w = yt * b[k][0] + wq[k][0] * a[k][0] + wq[k][1] * a[k][1];
+                yt += (w + wq[k][1] * b[k][1]) * g[k];
+                wq[k][1] = wq[k][0];
+                wq[k][0] = w;
+            }
+
+            f = yt;
+        }
+    }
+}
+
+/* eq_filter() has a one-channel-at-a-time loop for mono and stereo and
+ * kernels for one, two and three vectors per frame; all of them must match
+ * the reference */
+static void test_equalizer ()
+{
+    const int max_frames = 1003;  /* not a multiple of the vector width */
+    static float f[AUD_MAX_CHANNELS * max_frames], f_ref[AUD_MAX_CHANNELS * max_frames];
+
+    srand (0);
+    eq_init ();
+
+    for (int rate : {44100, 22050})
+    {
+        for (int channels = 1; channels <= AUD_MAX_CHANNELS; channels ++)
+        {
+            for (int frames : {1, 7, max_frames})
+            {
+                int samples = channels * frames;
+
+                for (int i = 0; i < samples; i ++)
+                    f[i] = f_ref[i] = 2.0f * rand () / RAND_MAX - 1;
+
+                eq_set_format (channels, rate);
+                assert (eq_active ());
+
+                /* in two pieces, to check that the filter state carries over */
+                int first = channels * (frames / 3);
+                eq_filter (f, first);
+                eq_filter (f + first, samples - first);
+
+                eq_filter_reference (f_ref, channels, frames, rate);
+
+                float diff = 0;
+                for (int i = 0; i < samples; i ++)
+                    diff = aud::max (diff, fabsf (f[i] - f_ref[i]));
+
+                assert (diff < 1e-5f);
+            }
+        }
+    }
+
+    eq_cleanup ();
+}
+
+/* compares against a direct DFT (in double precision) for the smaller sizes,
+ * and checks forward2() and inverse() against forward() for all sizes */
+static void test_fft ()
+{
+    SimdLevel detected = audio_simd_detect ();
+
+    for (auto level : {SimdLevel::None, SimdLevel::SSE2, detected})
+    {
+        audio_simd_set_level (level);
+
+        for (int n = FFT_MIN_SIZE; n <= FFT_MAX_SIZE; n *= 2)
+        {
+            Index<float> x, y, back, spectra;
+            x.resize (n);
+            y.resize (n);
+            back.resize (n);
+            spectra.resize (6 * (n / 2 + 1));
+
+            float * re = & spectra[0], * im = re + n / 2 + 1;
+            float * re1 = im + n / 2 + 1, * im1 = re1 + n / 2 + 1;
+            float * re2 = im1 + n / 2 + 1, * im2 = re2 + n / 2 + 1;
+
+            srand (n);
+
+            for (int i = 0; i < n; i ++)
+            {
+                x[i] = 2.0f * rand () / RAND_MAX - 1;
+                y[i] = 2.0f * rand () / RAND_MAX - 1;
+            }
+
+            /* the error grows roughly with the square root of n */
+            float tolerance = 1e-6f * n;
+
+            RealFFT fft (n);
+            fft.forward (x.begin (), re, im);
+
+            if (n <= 1024)
+            {
+                for (int k = 0; k <= n / 2; k ++)
+                {
+                    double sum_re = 0, sum_im = 0;
+
+                    for (int j = 0; j < n; j ++)
+                    {
+                        double angle = 2 * M_PI * ((int64_t) j * k % n) / n;
+                        sum_re += x[j] * cos (angle);
+                        sum_im -= x[j] * sin (angle);
+                    }
+
+                    assert (fabs (re[k] - sum_re) < tolerance);
+                    assert (fabs (im[k] - sum_im) < tolerance);
+                }
+            }
+
+            fft.forward2 (x.begin (), y.begin (), re1, im1, re2, im2);
+
+            for (int k = 0; k <= n / 2; k ++)
+            {
+                assert (fabsf (re1[k] - re[k]) < tolerance);
+                assert (fabsf (im1[k] - im[k]) < tolerance);
+            }
+
+            fft.forward (y.begin (), re, im);
+
+            for (int k = 0; k <= n / 2; k ++)
+            {
+                assert (fabsf (re2[k] - re[k]) < tolerance);
+                assert (fabsf (im2[k] - im[k]) < tolerance);
+            }
+
+            fft.inverse (re, im, back.begin ());
+
+            for (int i = 0; i < n; i ++)
+                assert (fabsf (back[i] / n - y[i]) < 1e-5f);
+        }
+    }
+
+    audio_simd_set_level (detected);
+
+    /* a sine wave at the center of frequency bin 64 (of size/2) */
+    for (int n = FFT_MIN_SIZE; n <= FFT_MAX_SIZE; n *= 2)
+    {
+        RealFFT fft (n);
+        Index<float> data, other, freq, freq1, freq2;
+        data.resize (n);
+        other.resize (n);
+        freq.resize (n / 2);
+        freq1.resize (n / 2);
+        freq2.resize (n / 2);
+
+        for (int i = 0; i < n; i ++)
+        {
+            data[i] = sinf (i * 65 * (2 * (float) M_PI / n));
+            other[i] = 0.5f * cosf (i * 17 * (2 * (float) M_PI / n));
+        }
+
+        fft.intensity (data.begin (), freq.begin ());
+
+        for (int i = 0; i < n / 2; i ++)
+        {
+            if (i == 64)
+                assert (freq[i] > 0.9f && freq[i] < 1.1f);
+            else if (i < 63 || i > 65)
+                assert (freq[i] < 0.01f);
+        }
+
+        fft.intensity2 (other.begin (), data.begin (), freq1.begin (), freq2.begin ());
+
+        for (int i = 0; i < n / 2; i ++)
+            assert (fabsf (freq2[i] - freq[i]) < 1e-4f);
+
+        assert (freq1[16] > 0.45f && freq1[16] < 0.55f);
+    }
+
+    fft_cleanup ();
+}
+
+class TestSpectrum : public Visualizer
+{
+public:
+    TestSpectrum (int type_mask, SpectrumSpec spec) :
+        Visualizer (type_mask),
+        spec (spec) {}
+
+    void clear () {}
+
+    void render_freq (const float * freq)
+        { this->freq = freq; }
+    SpectrumSpec spectrum_spec ()
+        { return spec; }
+    void render_spectrum (const SpectrumFrame & frame)
+        { this->frame = frame; }
+
+    SpectrumSpec spec;
+    const float * freq = nullptr;
+    SpectrumFrame frame {};
+};
+
+static void test_convolver ()
+{
+    /* more channels of audio than of impulse response, so that the impulse
+     * response channels are reused */
+    const int channels = 3, ir_channels = 2;
+    const int ir_frames = 1500, frames = 4000;
+    const int samples = channels * frames;
+
+    /* the whole convolution, including the decay after the input ends */
+    const int full_frames = frames + ir_frames - 1;
+
+    Index<float> ir, in, direct, out;
+    ir.resize (ir_channels * ir_frames);
+    in.resize (samples);
+    direct.resize (channels * full_frames);
+
+    srand (ir_frames);
+
+    for (int i = 0; i < ir.len (); i ++)
+        ir[i] = (2.0f * rand () / RAND_MAX - 1) * expf (-0.002f * (i / ir_channels));
+    for (float & f : in)
+        f = 2.0f * rand () / RAND_MAX - 1;
+
+    for (int f = 0; f < full_frames; f ++)
+    {
+        for (int c = 0; c < channels; c ++)
+        {
+            double sum = 0;
+            for (int j = aud::max (0, f - frames + 1); j < ir_frames && j <= f; j ++)
+                sum += (double) in[(f - j) * channels + c] * ir[j * ir_channels + c % ir_channels];
+
+            direct[f * channels + c] = sum;
+        }
+    }
+
+    for (int block = CONV_MIN_BLOCK; block <= 1024; block *= 2)
+    {
+        ConvFilter filter (ir.begin (), ir_channels, ir_frames, 48000, block);
+        assert (filter.parts == (ir_frames + block - 1) / block);
+
+        Convolver conv (filter, channels);
+        assert (conv.latency () == block);
+        assert (conv.tail () == block + full_frames - frames);
+
+        /* the input followed by tail() frames of silence */
+        int total = channels * (frames + conv.tail ());
+        out.resize (total);
+
+        for (int pass = 0; pass < 2; pass ++)
+        {
+            memcpy (out.begin (), in.begin (), sizeof (float) * samples);
+            memset (& out[samples], 0, sizeof (float) * (total - samples));
+
+            /* uneven pieces, so that blocks end in different places */
+            for (int at = 0, step = 1; at < total; step ++)
+            {
+                int len = aud::min (channels * (step * 97 % 700 + 1), total - at);
+                conv.process (& out[at], len);
+                at += len;
+            }
+
+            /* the output is delayed by exactly one block, and the silence
+             * pushes out all of it */
+            for (int i = 0; i < total; i ++)
+            {
+                float expected = (i < channels * block) ? 0 : direct[i - channels * block];
+                assert (fabsf (out[i] - expected) < 1e-4f);
+            }
+
+            /* after a reset, the same input gives the same output */
+            conv.reset ();
+        }
+    }
+}
+
+static void test_vis_spectrum ()
+{
+    TestSpectrum legacy (Visualizer::Freq, {});
+    TestSpectrum linear1 (Visualizer::Spectrum, {512, 0, false, 0});
+    TestSpectrum linear2 (Visualizer::Spectrum, {512, 0, false, 0});
+    TestSpectrum bands (Visualizer::Spectrum, {2048, 16, true, 0});
+    TestSpectrum peaks (Visualizer::Spectrum, {2048, 16, true, 60});
+
+    TestSpectrum * all[] = {& legacy, & linear1, & linear2, & bands, & peaks};
+
+    for (TestSpectrum * vis : all)
+        vis_spectrum_add (vis);
+
+    assert (vis_spectrum_frames () == 2048);
+    assert (vis_spectrum_need_mono ());
+
+    /* 1 kHz in the left channel only */
+    const int frames = 2048, rate = 48000;
+    Index<float> data, mono;
+    data.insert (0, 2 * frames);
+    mono.insert (0, frames);
+
+    for (int i = 0; i < frames; i ++)
+    {
+        data[2 * i] = sinf (i * 1000 * (2 * (float) M_PI / rate));
+        mono[i] = data[2 * i] / 2;
+    }
+
+    vis_spectrum_analyze (data.begin (), mono.begin (), 2, frames, rate, 0);
+
+    for (TestSpectrum * vis : all)
+        vis_spectrum_render (vis);
+
+    /* shared products and analyses */
+    assert (legacy.freq && legacy.freq == linear1.frame.values);
+    assert (linear1.frame.values == linear2.frame.values);
+    assert (linear1.frame.bins == 256 && linear1.frame.channels == 1);
+    assert (bands.frame.values != peaks.frame.values);
+    assert (! bands.frame.peaks && peaks.frame.peaks);
+
+    /* 1 kHz is at bin 512 * 1000 / 48000 = 10.7 */
+    assert (legacy.freq[9] > 0.2f && legacy.freq[10] > 0.2f);
+    assert (linear1.frame.edges[10] < 1000 && linear1.frame.edges[11] > 1000);
+
+    assert (bands.frame.bins == 16 && bands.frame.channels == 2);
+    assert (fabsf (bands.frame.edges[0] - 20) < 0.01f);
+    assert (fabsf (bands.frame.edges[16] - rate / 2) < 1);
+
+    for (int i = 0; i < 16; i ++)
+    {
+        assert (peaks.frame.peaks[i] == bands.frame.values[i]);
+        assert (bands.frame.values[16 + i] < 0.001f);
+
+        /* the window spreads the sine over a few bins, which are summed */
+        if (bands.frame.edges[i] < 1000 && bands.frame.edges[i + 1] > 1000)
+            assert (bands.frame.values[i] > 1);
+        else
+            assert (bands.frame.values[i] < 0.1f);
+    }
+
+    /* peaks fall by 60 dB/s, so by a factor of 10 in 1/3 s */
+    float held[16];
+    memcpy (held, peaks.frame.peaks, sizeof held);
+
+    data.erase (0, 2 * frames);
+    vis_spectrum_analyze (data.begin (), mono.begin (), 2, frames, rate, 333);
+    vis_spectrum_render (& peaks);
+
+    for (int i = 0; i < 16; i ++)
+    {
+        assert (peaks.frame.values[i] == 0);
+        assert (fabsf (peaks.frame.peaks[i] - held[i] / 10) < 0.001f);
+    }
+
+    for (TestSpectrum * vis : all)
+        vis_spectrum_remove (vis);
+
+    assert (vis_spectrum_frames () == 0);
+
+    fft_cleanup ();
+}
+
 static void test_case_conversion ()
 {
     const char in[]        = "AÄaäEÊeêIÌiìOÕoõUÚuú";
@@ -481,6 +1001,446 @@ static StringBuf str_repeated_nest (const char * str, int level)
     return buf2;
 }
 
+#define SPSC_COUNT 100000
+
+static void * spscring_producer (void * ring_)
+{
+    auto ring = (SpscRing *) ring_;
+
+    /* writes of varying sizes, so that they wrap at different points */
+    for (int i = 0, n = 1; i < SPSC_COUNT; i += n, n = n % 13 + 1)
+    {
+        n = aud::min (n, SPSC_COUNT - i);
+
+        int buf[13];
+        for (int j = 0; j < n; j ++)
+            buf[j] = i + j;
+
+        for (int written = 0; written < (int) sizeof (int) * n; sched_yield ())
+            written += ring->write ((char *) buf + written, sizeof (int) * n - written);
+    }
+
+    return nullptr;
+}
+
+/* checks find_next() against a plain array of bools */
+static void test_bitmap ()
+{
+    Bitmap bits;
+    Index<bool> ref;
+
+    auto check = [&] ()
+    {
+        assert (bits.len () == ref.len ());
+
+        int next = -1;
+        for (int i = ref.len () - 1; i >= 0; i --)
+        {
+            assert (bits.get (i) == ref[i]);
+            if (ref[i])
+                next = i;
+
+            assert (bits.find_next (i) == next);
+        }
+
+        for (int i = 0; i < ref.len (); i += 97)
+        {
+            int end = aud::min (i + 300, ref.len ());
+            int expect = -1;
+
+            for (int j = i; j < end && expect < 0; j ++)
+                if (ref[j])
+                    expect = j;
+
+            assert (bits.find_next (i, end) == expect);
+        }
+
+        assert (bits.find_next (ref.len ()) == -1);
+        assert (bits.find_next (-1) == -1);
+    };
+
+    srand (0);
+
+    for (int len : {0, 1, 63, 64, 65, 4095, 4096, 4097, 20000, 300, 5000, 0, 9000})
+    {
+        bits.resize (len);
+        if (ref.len () > len)
+            ref.remove (len, -1);
+        else if (ref.len () < len)
+            ref.insert (-1, len - ref.len ());
+
+        check ();
+
+        /* sparse, then dense */
+        for (int i = 0; i < len / 500 + 1 && len; i ++)
+        {
+            int at = rand () % len;
+            bits.set (at, true);
+            ref[at] = true;
+        }
+
+        check ();
+
+        for (int i = 0; i < len; i ++)
+        {
+            bool on = (rand () % 3 == 0);
+            bits.set (i, on);
+            ref[i] = on;
+        }
+
+        check ();
+    }
+
+    bits.clear ();
+    assert (bits.len () == 0 && bits.find_next (0) == -1);
+}
+
+static void test_spscring ()
+{
+    SpscRing ring;
+
+    ring.alloc (20);
+    assert (ring.len () == 0 && ring.space () == 20);
+
+    char buf[20];
+    assert (ring.write ("abcdefghijklmnopqrstuvwxyz", 26) == 20);
+    assert (ring.space () == 0 && ring.len () == 20);
+    assert (ring.read (buf, 15) == 15 && ! memcmp (buf, "abcdefghijklmno", 15));
+    assert (ring.write ("ABCDEFGHIJ", 10) == 10);
+
+    int len;
+    auto data = (const char *) ring.peek (len);
+    assert (len == 5 && ! memcmp (data, "pqrst", 5));
+    ring.consume (5);
+
+    assert (ring.read (buf, 20) == 10 && ! memcmp (buf, "ABCDEFGHIJ", 10));
+    assert (ring.len () == 0);
+
+    assert (ring.write ("0123456789", 10) == 10);
+    ring.discard ();
+    assert (ring.len () == 0 && ring.space () == 20);
+
+    /* one producer and one consumer thread */
+    ring.alloc (4 * 97);
+
+    pthread_t thread;
+    pthread_create (& thread, nullptr, spscring_producer, & ring);
+
+    for (int i = 0; i < SPSC_COUNT; )
+    {
+        int value;
+        if (ring.read (& value, sizeof value) == sizeof value)
+            assert (value == i ++);
+        else
+            sched_yield ();
+    }
+
+    pthread_join (thread, nullptr);
+    assert (ring.len () == 0);
+}
+
+#define SEQLOCK_COUNT 100000
+
+struct SeqTest {
+    int64_t a;
+    int b, c;
+};
+
+static void * seqlock_writer (void * lock_)
+{
+    auto lock = (SeqLock<SeqTest> *) lock_;
+
+    for (int i = 1; i <= SEQLOCK_COUNT; i ++)
+        lock->write ({i, 2 * i, 3 * i});
+
+    return nullptr;
+}
+
+static void test_seqlock ()
+{
+    SeqLock<SeqTest> lock;
+
+    SeqTest t = lock.read ();
+    assert (t.a == 0 && t.b == 0 && t.c == 0);
+
+    lock.write ({1, 2, 3});
+    t = lock.read ();
+    assert (t.a == 1 && t.b == 2 && t.c == 3);
+
+    /* a reader never sees a partly written value, nor goes back in time */
+    pthread_t thread;
+    pthread_create (& thread, nullptr, seqlock_writer, & lock);
+
+    int64_t last = 0;
+    while (last < SEQLOCK_COUNT)
+    {
+        t = lock.read ();
+        assert (t.b == 2 * t.a && t.c == 3 * t.a && t.a >= last);
+        last = t.a;
+    }
+
+    pthread_join (thread, nullptr);
+}
+
+static void test_tap ()
+{
+#ifdef __linux__
+    int mem_fd, event_fd;
+    int id = aud_drct_open_tap (mem_fd, event_fd);
+    assert (id > 0);
+
+    off_t size = lseek (mem_fd, 0, SEEK_END);
+    void * mem = mmap (nullptr, size, PROT_READ, MAP_SHARED, mem_fd, 0);
+    assert (mem != MAP_FAILED);
+
+    /* readers cannot write to the memory */
+    assert (mmap (nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0) == MAP_FAILED);
+
+    auto h = (const AudTapHeader *) mem;
+    assert (aud_tap_check (h, size));
+    assert (aud_tap_blocks (h) == 0);
+
+    static float data[AUD_TAP_PCM_SAMPLES];
+    for (int i = 0; i < AUD_TAP_PCM_SAMPLES; i ++)
+        data[i] = i;
+
+    /* a block may be written in pieces */
+    tap_write_pcm (data, 1000);
+    tap_write_pcm (data + 1000, 1000);
+    tap_flush ();
+    tap_commit (123, 2, 44100);
+
+    /* the reader is signaled from another thread */
+    pollfd pfd = {event_fd, POLLIN, 0};
+    uint64_t count;
+    assert (poll (& pfd, 1, 1000) == 1);
+    assert (read (event_fd, & count, sizeof count) == sizeof count);
+    assert (aud_tap_blocks (h) == 1);
+
+    AudTapBlock block;
+    float pcm[2000];
+    assert (aud_tap_read_block (h, 1, & block) == 0);
+    assert (aud_tap_read_block (h, 0, & block) == 1);
+    assert (block.start == 0 && block.samples == 2000 && block.time == 123);
+    assert (block.channels == 2 && block.rate == 44100 && block.flags == AUD_TAP_FLUSHED);
+    assert (aud_tap_read_pcm (h, block.start, block.samples, pcm));
+    assert (pcm[0] == 0 && pcm[1999] == 1999);
+
+    /* wrap around the end of the ring, overwriting the first block */
+    for (int i = 1; i <= AUD_TAP_BLOCK_SLOTS; i ++)
+    {
+        tap_write_pcm (data, 2000);
+        tap_commit (123 + i, 2, 44100);
+    }
+
+    assert (aud_tap_blocks (h) == AUD_TAP_BLOCK_SLOTS + 1);
+    assert (aud_tap_read_block (h, 0, & block) == -1);
+    assert (! aud_tap_read_pcm (h, 0, 2000, pcm));
+
+    uint64_t last = AUD_TAP_BLOCK_SLOTS;
+    assert (aud_tap_read_block (h, last, & block) == 1);
+    assert (block.start == 2000 * last && block.flags == 0);
+    assert (aud_tap_read_pcm (h, block.start, block.samples, pcm));
+    assert (pcm[0] == 0 && pcm[1999] == 1999);
+
+    aud_drct_close_tap (id);
+
+    munmap (mem, size);
+    close (mem_fd);
+    close (event_fd);
+    tap_cleanup ();
+#endif
+}
+
+static void test_meta_cache ()
+{
+    StringBuf dir = filename_build ({g_get_tmp_dir (), "audacious-test-XXXXXX"});
+    assert (g_mkdtemp (dir));
+
+    StringBuf path = filename_build ({dir, "song.ogg"});
+    StringBuf uri = filename_to_uri (path);
+    assert (g_file_set_contents (path, "data", -1, nullptr));
+
+    StringBuf cache = filename_build ({g_get_tmp_dir (), "metadata-cache"});
+    g_unlink (cache);
+
+    meta_cache_init ();
+
+    MetaCacheKey key;
+    PluginHandle * decoder = nullptr;
+    Tuple tuple;
+
+    /* only local files are cached */
+    assert (! meta_cache_lookup ("http://example.com/song.ogg", key, decoder, tuple));
+    assert (! key.valid ());
+
+    assert (! meta_cache_lookup (uri, key, decoder, tuple));
+    assert (key.valid () && key.size == 4 && ! decoder);
+
+    PluginHandle * plugin = aud_plugin_lookup_basename ("test");
+    short subtunes[] = {1, 3};
+
+    Tuple stored;
+    stored.set_filename (uri);
+    stored.set_str (Tuple::Title, "Title");
+    stored.set_int (Tuple::Length, 123456);
+    stored.set_subtunes (2, subtunes);
+    stored.set_state (Tuple::Valid);
+
+    meta_cache_store (uri, key, plugin, stored);
+
+    /* found before and after saving */
+    for (int pass = 0; pass < 2; pass ++)
+    {
+        MetaCacheKey key2;
+        decoder = nullptr;
+        tuple = Tuple ();
+
+        assert (meta_cache_lookup (uri, key2, decoder, tuple));
+        assert (decoder == plugin && tuple == stored);
+        assert (tuple.get_n_subtunes () == 2 && tuple.get_nth_subtune (1) == 3);
+
+        meta_cache_cleanup ();
+        meta_cache_init ();
+    }
+
+    /* a different decoder does not match */
+    decoder = (PluginHandle *) & key;
+    assert (! meta_cache_lookup (uri, key, decoder, tuple));
+
+    /* nor does a changed file */
+    assert (g_file_set_contents (path, "other data", -1, nullptr));
+    decoder = nullptr;
+    assert (! meta_cache_lookup (uri, key, decoder, tuple));
+    assert (key.size == 10);
+
+    auto stats = Playlist::metadata_cache_stats ();
+    assert (stats.hits == 2 && stats.misses == 3 && stats.stale == 1);
+    assert (stats.stored == 1 && stats.entries == 1);
+
+    /* the changed file is dropped when the cache is saved, even if it is
+     * still in a playlist */
+    meta_cache_touch (uri);
+    meta_cache_cleanup ();
+    meta_cache_init ();
+    assert (Playlist::metadata_cache_stats ().entries == 0);
+    meta_cache_cleanup ();
+
+    g_unlink (cache);
+    g_unlink (path);
+    g_rmdir (dir);
+}
+
+static int filter_calls, filter_inside;
+static bool filter_overlap;
+
+/* counts its calls without atomics, since the adder must not call it from
+ * two threads at once */
+static bool test_adder_filter (const char * filename, void *)
+{
+    if (__atomic_add_fetch (& filter_inside, 1, __ATOMIC_RELAXED) > 1)
+        filter_overlap = true;
+
+    filter_calls ++;
+    sched_yield ();
+
+    __atomic_sub_fetch (& filter_inside, 1, __ATOMIC_RELAXED);
+    return ! strstr (filename, "skip");
+}
+
+static void test_adder ()
+{
+    StringBuf root = filename_build ({g_get_tmp_dir (), "audacious-test-XXXXXX"});
+    assert (g_mkdtemp (root));
+
+    Index<String> folders, files;
+    Index<String> expected, skipped;
+
+    auto make_folder = [&] (const char * name) {
+        StringBuf path = filename_build ({root, name});
+        assert (! g_mkdir_with_parents (path, 0700));
+        folders.append (String (path));
+    };
+
+    auto make_file = [&] (const char * name, const char * contents) {
+        StringBuf path = filename_build ({root, name});
+        assert (g_file_set_contents (path, contents, -1, nullptr));
+        files.append (String (path));
+        return String (filename_to_uri (path));
+    };
+
+    /* more than WALK_RUN files in a folder, so that it is split into runs;
+     * files are created out of order and numbered for natural sorting */
+    auto make_files = [&] (const char * prefix, int count) {
+        for (int i = count; i > 0; i --)
+            make_file (str_printf ("%s%d.mp3", prefix, i), "");
+        for (int i = 1; i <= count; i ++)
+            expected.append (String (filename_to_uri (filename_build
+             ({root, str_printf ("%s%d.mp3", prefix, i)}))));
+    };
+
+    /* the cuesheet comes first, and the file it refers to is left out */
+    String cue = make_file ("album.cue", "FILE \"album.flac\" WAVE\nTRACK 1\nTRACK 2\n");
+    String flac = make_file ("album.flac", "");
+    expected.append (String (str_concat ({cue, "?1"})));
+    expected.append (String (str_concat ({cue, "?2"})));
+
+    make_file ("cover.jpg", "");  /* no decoder */
+    skipped.append (make_file ("skip1.mp3", ""));
+
+    make_folder ("disc1");
+    make_folder ("disc1/inner");
+    make_folder ("disc2");
+    make_folder ("disc10");
+    make_folder ("empty");
+
+    skipped.append (make_file ("disc1/skip2.mp3", ""));
+    make_files ("disc1/a", 35);
+    make_files ("disc1/inner/b", 3);
+    make_files ("disc2/c", 3);
+    make_files ("disc10/d", 2);
+    make_files ("track", 40);
+
+    /* one call for each cuesheet entry, then for each file and folder except
+     * the cuesheet and the file it refers to */
+    int want_calls = 2 + (files.len () - 2) + folders.len ();
+
+    StringBuf uri = filename_to_uri (root);
+
+    /* the same order every time */
+    for (int pass = 0; pass < 3; pass ++)
+    {
+        bool filtered = false;
+        filter_calls = 0;
+
+        auto items = adder_search_folder (uri, test_adder_filter, nullptr, filtered);
+
+        assert (filtered && ! filter_overlap);
+        assert (filter_calls == want_calls);
+        assert (items.len () == expected.len ());
+
+        for (int i = 0; i < items.len (); i ++)
+            assert (! strcmp (items[i].filename, expected[i]));
+
+        assert (items[0].tuple.get_str (Tuple::AudioFile) == flac);
+        assert (items[1].tuple.get_int (Tuple::Track) == 2);
+    }
+
+    /* without a filter, nothing is skipped */
+    bool filtered = true;
+    auto items = adder_search_folder (uri, nullptr, nullptr, filtered);
+
+    assert (! filtered);
+    assert (items.len () == expected.len () + skipped.len ());
+
+    for (int i = files.len () - 1; i >= 0; i --)
+        g_unlink (files[i]);
+    for (int i = folders.len () - 1; i >= 0; i --)
+        g_rmdir (folders[i]);
+
+    g_rmdir (root);
+}
+
 static void test_stringbuf ()
 {
     char expect[262145];
@@ -519,11 +1479,23 @@ static void test_str_printf ()
 int main ()
 {
     test_audio_conversion ();
+    test_simd_conversion ();
+    test_post_process ();
+    test_equalizer ();
+    test_fft ();
+    test_convolver ();
+    test_vis_spectrum ();
     test_case_conversion ();
     test_numeric_conversion ();
     test_filename_split ();
     test_tuple_formats ();
     test_ringbuf ();
+    test_bitmap ();
+    test_spscring ();
+    test_seqlock ();
+    test_tap ();
+    test_meta_cache ();
+    test_adder ();
     test_stringbuf ();
     test_str_printf ();
 
@@ -19,61 +19,185 @@
 
 #include "internal.h"
 
-#include <assert.h>
+#include <errno.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 
-#include "hook.h"
-#include "list.h"
 #include "mainloop.h"
 #include "output.h"
+#include "spscring.h"
 
 #define INTERVAL 33 /* milliseconds */
 #define FRAMES_PER_NODE 512
+#define MAX_NODES 16 /* in each ring */
+
+/* Audio for the visualizers is cut into nodes by the audio thread (in
+ * vis_runner_pass_audio()), and passed to the vis thread through a lock-free
+ * ring of node pointers.  Every INTERVAL, the vis thread picks the node that
+ * matches the output time, runs the analysis on it (vis_analyze()), and then
+ * queues the render callbacks (vis_send_audio()) for the main thread.  Used
+ * nodes are passed back to the audio thread through a second ring, so that
+ * normally no memory is allocated in the audio path.
+ *
+ * A node holds FRAMES_PER_NODE frames of new audio, starting at <time>.  If
+ * a longer analysis window was requested (see vis_runner_set_frames()), the
+ * audio preceding those frames is copied in front of them from the history,
+ * so that <frames> may be more than FRAMES_PER_NODE.
+ *
+ * Rather than being taken out of the rings, the nodes are invalidated on a
+ * flush by a change of <generation>, and recycled by the vis thread. */
 
-struct VisNode : public ListNode
+struct VisNode
 {
-    VisNode (int channels, int time) :
+    VisNode (int channels, int frames) :
         channels (channels),
-        time (time),
-        data (new float[channels * FRAMES_PER_NODE]) {}
+        frames (frames),
+        data (new float[channels * frames]) {}
 
     ~VisNode ()
         { delete[] data; }
 
-    const int channels;
-    int time;
+    const int channels, frames;
+    int time, rate, generation;
     float * data;
 };
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond;
 static bool enabled = false;
 static bool playing = false, paused = false;
+static bool thread_running = false, thread_quit = false;
+static pthread_t vis_thread;
+static QueuedFunc queued_clear, queued_render;
+
+/* read without locking */
+static bool active = false;  /* enabled && playing */
+static int generation = 0;
+static int node_frames = FRAMES_PER_NODE;
+static bool render_pending = false;
+
+static SpscRing ready_ring;  /* audio thread -> vis thread */
+static SpscRing free_ring;   /* vis thread -> audio thread */
+
+/* used only by vis_runner_pass_audio(), which the caller serializes */
 static VisNode * current_node = nullptr;
 static int current_frames;
-static List<VisNode> vis_list;
-static List<VisNode> vis_pool;
-static QueuedFunc queued_clear;
-
-static void send_audio (void *)
+static int current_generation;
+static VisNode * spare_node = nullptr;  /* kept for reuse */
+static int last_time;  /* of the last node written to the ready ring */
+static bool have_last = false;  /* since the last flush */
+static Index<float> history; /* ring of the last node_frames - FRAMES_PER_NODE */
+static int history_pos;      /* oldest sample in the ring */
+
+/* copies the <count> samples preceding data[at] to <dest>, taking them from
+ * the history where data[] does not reach back far enough */
+static void copy_history (float * dest, int count, const float * data, int at)
 {
-    /* call before locking mutex to avoid deadlock */
-    int outputted = output_get_raw_time ();
+    int from_data = aud::min (at, count);
+    int from_history = count - from_data;
 
-    pthread_mutex_lock (& mutex);
+    if (from_history)
+    {
+        int len = history.len ();
+        int start = (history_pos + len - from_history) % len;
+        int part = aud::min (from_history, len - start);
+
+        memcpy (dest, & history[start], sizeof (float) * part);
+        memcpy (dest + part, & history[0], sizeof (float) * (from_history - part));
+    }
+
+    memcpy (dest + from_history, data + at - from_data, sizeof (float) * from_data);
+}
+
+static void add_history (const float * data, int samples)
+{
+    int len = history.len ();
 
-    if (! enabled || ! playing || paused)
+    if (samples >= len)
     {
-        pthread_mutex_unlock (& mutex);
+        memcpy (& history[0], data + samples - len, sizeof (float) * len);
+        history_pos = 0;
         return;
     }
 
+    int part = aud::min (samples, len - history_pos);
+
+    memcpy (& history[history_pos], data, sizeof (float) * part);
+    memcpy (& history[0], data + part, sizeof (float) * (samples - part));
+    history_pos = (history_pos + samples) % len;
+}
+
+/* called in the vis thread; the node goes back to the audio thread */
+static void recycle_node (VisNode * node)
+{
+    if (free_ring.write (& node, sizeof node) < (int) sizeof node)
+        delete node;
+}
+
+/* called in the audio thread */
+static void drop_node (VisNode * node)
+{
+    if (spare_node)
+        delete node;
+    else
+        spare_node = node;
+}
+
+/* called in the audio thread */
+static VisNode * get_node (int channels, int frames)
+{
+    VisNode * node = spare_node;
+    spare_node = nullptr;
+
+    if (! node && free_ring.len ())
+        free_ring.read (& node, sizeof node);
+
+    if (node && (node->channels != channels || node->frames != frames))
+    {
+        delete node;
+        node = nullptr;
+    }
+
+    if (node)
+        return node;
+
+    rt_audit_alloc ();
+    return new VisNode (channels, frames);
+}
+
+static void send_audio (void *)
+{
+    vis_send_audio ();
+    __atomic_store_n (& render_pending, false, __ATOMIC_RELEASE);
+}
+
+static void send_clear (void *)
+{
+    vis_send_clear ();
+}
+
+/* called in the vis thread */
+static void process ()
+{
+    int outputted = output_get_raw_time ();
+    int gen = __atomic_load_n (& generation, __ATOMIC_ACQUIRE);
+
     VisNode * node = nullptr;
-    VisNode * next;
 
-    while ((next = vis_list.head ()))
+    while (ready_ring.len ())
     {
+        int len;
+        VisNode * next = * (VisNode * const *) ready_ring.peek (len);
+
+        if (next->generation != gen)
+        {
+            ready_ring.consume (sizeof next);
+            recycle_node (next);
+            continue;
+        }
+
         /* If we are considering a node, stop searching and use it if it is the
          * most recent (that is, the next one is in the future).  Otherwise,
          * consider the next node if it is not in the future by more than the
@@ -82,36 +206,80 @@ static void send_audio (void *)
             break;
 
         if (node)
-            vis_pool.prepend (node);
+            recycle_node (node);
 
         node = next;
-        vis_list.remove (node);
+        ready_ring.consume (sizeof next);
     }
 
-    pthread_mutex_unlock (& mutex);
-
     if (! node)
         return;
 
-    vis_send_audio (node->data, node->channels);
+    /* if the main thread has not yet rendered the last frame, drop this one
+     * rather than overwrite the results in use */
+    if (! __atomic_load_n (& render_pending, __ATOMIC_ACQUIRE))
+    {
+        vis_analyze (node->data, node->channels, node->frames, node->rate, node->time);
+
+        __atomic_store_n (& render_pending, true, __ATOMIC_RELEASE);
+        queued_render.queue (send_audio, nullptr);
+    }
+
+    recycle_node (node);
+}
+
+static void * vis_worker (void *)
+{
+    timespec next;
+    clock_gettime (CLOCK_MONOTONIC, & next);
 
     pthread_mutex_lock (& mutex);
-    vis_pool.prepend (node);
+
+    while (! thread_quit)
+    {
+        if (! enabled || ! playing || paused)
+        {
+            pthread_cond_wait (& cond, & mutex);
+            clock_gettime (CLOCK_MONOTONIC, & next);
+            continue;
+        }
+
+        /* woken early, the state may have changed */
+        if (pthread_cond_timedwait (& cond, & mutex, & next) != ETIMEDOUT)
+            continue;
+
+        timespec now;
+        clock_gettime (CLOCK_MONOTONIC, & now);
+
+        /* if we have fallen behind, skip the missed intervals */
+        int64_t next_ns = (int64_t) next.tv_sec * 1000000000 + next.tv_nsec;
+        int64_t now_ns = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+        next_ns = aud::max (next_ns + INTERVAL * 1000000, now_ns);
+
+        next.tv_sec = next_ns / 1000000000;
+        next.tv_nsec = next_ns % 1000000000;
+
+        pthread_mutex_unlock (& mutex);
+        process ();
+        pthread_mutex_lock (& mutex);
+    }
+
     pthread_mutex_unlock (& mutex);
+    return nullptr;
 }
 
-static void send_clear (void *)
+static void update_active_locked ()
 {
-    vis_send_clear ();
+    __atomic_store_n (& active, enabled && playing, __ATOMIC_RELEASE);
+
+    /* cond exists only while the thread does */
+    if (thread_running)
+        pthread_cond_signal (& cond);
 }
 
 static void flush_locked ()
 {
-    delete current_node;
-    current_node = nullptr;
-
-    vis_list.clear ();
-    vis_pool.clear ();
+    __atomic_fetch_add (& generation, 1, __ATOMIC_RELEASE);
 
     if (enabled)
         queued_clear.queue (send_clear, nullptr);
@@ -134,10 +302,7 @@ static void start_stop_locked (bool new_playing, bool new_paused)
     if (! enabled || ! playing)
         flush_locked ();
 
-    if (enabled && playing && ! paused)
-        timer_add (TimerRate::Hz30, send_audio);
-    else
-        timer_remove (TimerRate::Hz30, send_audio);
+    update_active_locked ();
 }
 
 void vis_runner_start_stop (bool new_playing, bool new_paused)
@@ -147,14 +312,36 @@ void vis_runner_start_stop (bool new_playing, bool new_paused)
     pthread_mutex_unlock (& mutex);
 }
 
-void vis_runner_pass_audio (int time, const Index<float> & data, int channels, int rate)
+void vis_runner_pass_audio (int time, const float * data, int samples,
+ int channels, int rate)
 {
-    pthread_mutex_lock (& mutex);
+    if (! __atomic_load_n (& active, __ATOMIC_ACQUIRE))
+        return;
 
-    if (! enabled || ! playing)
+    /* node_frames is changed before generation */
+    int gen = __atomic_load_n (& generation, __ATOMIC_ACQUIRE);
+    int frames = __atomic_load_n (& node_frames, __ATOMIC_RELAXED);
+    int history_len = channels * (frames - FRAMES_PER_NODE);
+
+    if (gen != current_generation)
     {
-        pthread_mutex_unlock (& mutex);
-        return;
+        /* flushed; start over with a silent history */
+        if (current_node)
+            drop_node (current_node);
+
+        current_node = nullptr;
+        current_generation = gen;
+        have_last = false;
+
+        memset (history.begin (), 0, sizeof (float) * history.len ());
+        history_pos = 0;
+    }
+
+    if (history.len () != history_len)
+    {
+        history.clear ();
+        history.insert (0, history_len);
+        history_pos = 0;
     }
 
     /* We can build a single node from multiple calls; we can also build
@@ -165,9 +352,7 @@ void vis_runner_pass_audio (int time, const Index<float> & data, int channels, i
 
     while (1)
     {
-        if (current_node)
-            assert (current_node->channels == channels);
-        else
+        if (! current_node || current_node->channels != channels)
         {
             int node_time = time;
 
@@ -178,29 +363,26 @@ void vis_runner_pass_audio (int time, const Index<float> & data, int channels, i
              * queue, we are at the beginning of the song or had an underrun,
              * and we want to copy the earliest audio data we have. */
 
-            VisNode * tail = vis_list.tail ();
-            if (tail)
-                node_time = tail->time + INTERVAL;
+            if (have_last && ready_ring.space () < ready_ring.size ())
+                node_time = last_time + INTERVAL;
 
             at = channels * (int) ((int64_t) (node_time - time) * rate / 1000);
 
             if (at < 0)
                 at = 0;
-            if (at >= data.len ())
+            if (at >= samples)
                 break;
 
-            current_node = vis_pool.head ();
-
             if (current_node)
-            {
-                assert (current_node->channels == channels);
-                vis_pool.remove (current_node);
-                current_node->time = node_time;
-            }
-            else
-                current_node = new VisNode (channels, node_time);
-
-            current_frames = 0;
+                drop_node (current_node);
+
+            current_node = get_node (channels, frames);
+            current_node->time = node_time;
+            current_node->rate = rate;
+            current_node->generation = gen;
+
+            copy_history (current_node->data, history_len, data, at);
+            current_frames = frames - FRAMES_PER_NODE;
         }
 
         /* Copy as much data as we can, limited by how much we have and how much
@@ -208,24 +390,105 @@ void vis_runner_pass_audio (int time, const Index<float> & data, int channels, i
          * wait for more data to be passed in the next call.  If we do fill the
          * node, we loop and start building a new one. */
 
-        int copy = aud::min (data.len () - at, channels * (FRAMES_PER_NODE - current_frames));
-        memcpy (current_node->data + channels * current_frames, & data[at], sizeof (float) * copy);
+        int copy = aud::min (samples - at, channels * (frames - current_frames));
+        memcpy (current_node->data + channels * current_frames, data + at, sizeof (float) * copy);
         current_frames += copy / channels;
 
-        if (current_frames < FRAMES_PER_NODE)
+        if (current_frames < frames)
             break;
 
-        vis_list.append (current_node);
+        /* if the vis thread has fallen behind, the node is dropped */
+        if (ready_ring.write (& current_node, sizeof current_node) == sizeof current_node)
+        {
+            last_time = current_node->time;
+            have_last = true;
+        }
+        else
+            drop_node (current_node);
+
         current_node = nullptr;
     }
 
-    pthread_mutex_unlock (& mutex);
+    if (history_len)
+        add_history (data, samples);
+}
+
+void vis_runner_set_frames (int frames)
+{
+    frames = aud::max (frames, FRAMES_PER_NODE);
+
+    if (frames != __atomic_load_n (& node_frames, __ATOMIC_RELAXED))
+    {
+        /* nodes already built are of the wrong size */
+        __atomic_store_n (& node_frames, frames, __ATOMIC_RELAXED);
+        __atomic_fetch_add (& generation, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void start_thread_locked ()
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init (& attr);
+    pthread_condattr_setclock (& attr, CLOCK_MONOTONIC);
+    pthread_cond_init (& cond, & attr);
+    pthread_condattr_destroy (& attr);
+
+    ready_ring.alloc (MAX_NODES * sizeof (VisNode *));
+    free_ring.alloc (MAX_NODES * sizeof (VisNode *));
+
+    thread_quit = false;
+    pthread_create (& vis_thread, nullptr, vis_worker, nullptr);
+    thread_running = true;
 }
 
 void vis_runner_enable (bool enable)
 {
     pthread_mutex_lock (& mutex);
+
+    if (enable && ! thread_running)
+        start_thread_locked ();
+
     enabled = enable;
     start_stop_locked (playing, paused);
     pthread_mutex_unlock (& mutex);
 }
+
+bool vis_runner_active ()
+{
+    return __atomic_load_n (& active, __ATOMIC_ACQUIRE);
+}
+
+/* called after playback has stopped, so the audio thread is idle */
+void vis_runner_cleanup ()
+{
+    pthread_mutex_lock (& mutex);
+
+    if (! thread_running)
+    {
+        pthread_mutex_unlock (& mutex);
+        return;
+    }
+
+    thread_quit = true;
+    pthread_cond_signal (& cond);
+    pthread_mutex_unlock (& mutex);
+
+    pthread_join (vis_thread, nullptr);
+    pthread_cond_destroy (& cond);
+    thread_running = false;
+
+    queued_render.stop ();
+    __atomic_store_n (& render_pending, false, __ATOMIC_RELAXED);
+
+    VisNode * node;
+    while (ready_ring.read (& node, sizeof node))
+        delete node;
+    while (free_ring.read (& node, sizeof node))
+        delete node;
+
+    delete current_node;
+    delete spare_node;
+    current_node = spare_node = nullptr;
+
+    history.clear ();
+}
@@ -0,0 +1,430 @@
+/*
+ * vis-spectrum.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "internal.h"
+
+#include <math.h>
+
+#include "fft.h"
+#include "objects.h"
+#include "runtime.h"
+#include "visualizer.h"
+
+/* The spectra wanted by Freq and Spectrum visualizers are computed in two
+ * steps.  An Analysis is the intensity of each FFT bin, for one FFT size and
+ * either the mono mix or each channel.  A Product is what a SpectrumSpec asks
+ * for: the bins of an Analysis as they are, or summed into log-spaced bands,
+ * and optionally with held peaks.  Both are reference-counted, so that each
+ * is computed once per frame however many visualizers use it.  Legacy Freq
+ * visualizers use the 512-point mono Analysis directly.
+ *
+ * vis_spectrum_analyze() is called in the vis thread, the rest in the main
+ * thread; the caller (visualization.cc) keeps the two apart. */
+
+#define LOW_FREQ 20 /* Hz, lower edge of the lowest log-spaced band */
+
+struct Analysis
+{
+    Analysis (int size, bool per_channel) :
+        size (size),
+        per_channel (per_channel),
+        fft (size) {}
+
+    const int size;
+    const bool per_channel;
+    RealFFT fft;
+
+    int users = 0;
+    int channels = 0;   /* in <freq>, or 0 if not computed for this frame */
+    Index<float> freq;  /* channels * size / 2 */
+};
+
+struct Product
+{
+    Product (const SpectrumSpec & spec, Analysis * analysis) :
+        spec (spec),
+        analysis (analysis) {}
+
+    const SpectrumSpec spec;
+    Analysis * const analysis;
+
+    int users = 0;
+    bool valid = false;  /* computed for this frame */
+    int rate = 0, channels = 0, time = 0;
+
+    Index<float> edges;
+    Index<float> xscale;  /* band edges as positions in Analysis::freq */
+    Index<float> values, peaks;
+
+    SpectrumFrame frame {};
+};
+
+struct Subscriber
+{
+    Visualizer * vis;
+    Analysis * freq;    /* for render_freq() */
+    Product * product;  /* for render_spectrum() */
+};
+
+static Index<SmartPtr<Analysis>> analyses;
+static Index<SmartPtr<Product>> products;
+static Index<Subscriber> subscribers;
+
+static Index<float> planar;  /* input split into channels, for per_channel */
+
+static SpectrumSpec check_spec (SpectrumSpec spec)
+{
+    int size = FFT_MIN_SIZE;
+    while (size < spec.size && size < FFT_MAX_SIZE)
+        size *= 2;
+
+    if (size != spec.size)
+        AUDWARN ("Unsupported spectrum size %d, using %d.\n", spec.size, size);
+
+    spec.size = size;
+    spec.bands = aud::max (spec.bands, 0);
+    spec.peak_fall = aud::max (spec.peak_fall, 0);
+
+    return spec;
+}
+
+static Analysis * get_analysis (int size, bool per_channel)
+{
+    Analysis * analysis = nullptr;
+
+    for (auto & a : analyses)
+    {
+        if (a->size == size && a->per_channel == per_channel)
+            analysis = a.get ();
+    }
+
+    if (! analysis)
+        analysis = analyses.append (new Analysis (size, per_channel)).get ();
+
+    analysis->users ++;
+    return analysis;
+}
+
+static Product * get_product (const SpectrumSpec & spec)
+{
+    Product * product = nullptr;
+
+    for (auto & p : products)
+    {
+        if (p->spec == spec)
+            product = p.get ();
+    }
+
+    if (! product)
+    {
+        Analysis * analysis = get_analysis (spec.size, spec.per_channel);
+        product = products.append (new Product (spec, analysis)).get ();
+    }
+
+    product->users ++;
+    return product;
+}
+
+static void release_analysis (Analysis * analysis)
+{
+    if (-- analysis->users)
+        return;
+
+    auto is_match = [=] (const SmartPtr<Analysis> & a)
+        { return a.get () == analysis; };
+
+    analyses.remove_if (is_match, true);
+}
+
+static void release_product (Product * product)
+{
+    if (-- product->users)
+        return;
+
+    release_analysis (product->analysis);
+
+    auto is_match = [=] (const SmartPtr<Product> & p)
+        { return p.get () == product; };
+
+    products.remove_if (is_match, true);
+}
+
+void vis_spectrum_add (Visualizer * vis)
+{
+    Subscriber sub = {vis, nullptr, nullptr};
+
+    if ((vis->type_mask & Visualizer::Freq))
+        sub.freq = get_analysis (512, false);
+    if ((vis->type_mask & Visualizer::Spectrum))
+        sub.product = get_product (check_spec (vis->spectrum_spec ()));
+
+    subscribers.append (sub);
+}
+
+void vis_spectrum_remove (Visualizer * vis)
+{
+    auto is_match = [=] (const Subscriber & sub)
+    {
+        if (sub.vis != vis)
+            return false;
+
+        if (sub.freq)
+            release_analysis (sub.freq);
+        if (sub.product)
+            release_product (sub.product);
+
+        return true;
+    };
+
+    subscribers.remove_if (is_match, true);
+}
+
+int vis_spectrum_frames ()
+{
+    int frames = 0;
+    for (auto & a : analyses)
+        frames = aud::max (frames, a->size);
+
+    return frames;
+}
+
+bool vis_spectrum_need_mono ()
+{
+    for (auto & a : analyses)
+    {
+        if (! a->per_channel)
+            return true;
+    }
+
+    return false;
+}
+
+static void analyze (Analysis * a, const float * mono, int channels, int frames)
+{
+    int bins = a->size / 2;
+    int offset = frames - a->size;
+
+    if (! a->per_channel)
+        channels = 1;
+
+    if (a->freq.len () != channels * bins)
+    {
+        a->freq.clear ();
+        a->freq.insert (0, channels * bins);
+    }
+
+    if (! a->per_channel)
+        a->fft.intensity (mono + offset, a->freq.begin ());
+    else
+    {
+        int c = 0;
+
+        /* two channels per FFT */
+        for (; c + 1 < channels; c += 2)
+            a->fft.intensity2 (& planar[c * frames + offset],
+             & planar[(c + 1) * frames + offset], & a->freq[c * bins],
+             & a->freq[(c + 1) * bins]);
+
+        if (c < channels)
+            a->fft.intensity (& planar[c * frames + offset], & a->freq[c * bins]);
+    }
+
+    a->channels = channels;
+}
+
+static void setup_product (Product * p, int rate, int channels)
+{
+    int size = p->spec.size;
+    int bins = p->spec.bands ? p->spec.bands : size / 2;
+
+    p->edges.clear ();
+    p->edges.insert (0, bins + 1);
+    p->xscale.clear ();
+
+    if (p->spec.bands)
+    {
+        /* log-spaced from LOW_FREQ to half the sample rate */
+        float low = LOW_FREQ, high = rate / 2.0f;
+
+        p->xscale.insert (0, bins + 1);
+
+        for (int i = 0; i <= bins; i ++)
+        {
+            float freq = low * powf (high / low, (float) i / bins);
+            p->edges[i] = freq;
+            p->xscale[i] = aud::clamp (freq * size / rate - 0.5f, 0.0f, (float) (size / 2));
+        }
+    }
+    else
+    {
+        /* bin k (k = 1 .. size/2) is centered at k * rate / size */
+        for (int i = 0; i <= bins; i ++)
+            p->edges[i] = (i + 0.5f) * rate / size;
+    }
+
+    p->values.clear ();
+    p->peaks.clear ();
+
+    if (p->spec.bands)
+        p->values.insert (0, channels * bins);
+    if (p->spec.peak_fall)
+        p->peaks.insert (0, channels * bins);
+
+    p->rate = rate;
+    p->channels = channels;
+
+    p->frame.rate = rate;
+    p->frame.channels = channels;
+    p->frame.bins = bins;
+    p->frame.edges = p->edges.begin ();
+    p->frame.peaks = p->spec.peak_fall ? p->peaks.begin () : nullptr;
+}
+
+/* sum of freq[] over positions x0 to x1, where freq[j] covers j to j + 1 */
+static float sum_band (const float * freq, int bins, float x0, float x1)
+{
+    int a = (int) x0, b = (int) x1;
+
+    if (a >= bins)
+        return 0;
+    if (a == b)
+        return freq[a] * (x1 - x0);
+
+    float sum = freq[a] * (a + 1 - x0);
+
+    for (int j = a + 1; j < b; j ++)
+        sum += freq[j];
+
+    if (b < bins)
+        sum += freq[b] * (x1 - b);
+
+    return sum;
+}
+
+static void compute (Product * p, int rate, int time)
+{
+    Analysis * a = p->analysis;
+
+    if (! a->channels)
+    {
+        p->valid = false;
+        return;
+    }
+
+    if (rate != p->rate || a->channels != p->channels)
+    {
+        setup_product (p, rate, a->channels);
+        p->time = time;
+    }
+
+    int bins = p->frame.bins;
+    int fft_bins = a->size / 2;
+
+    if (p->spec.bands)
+    {
+        for (int c = 0; c < p->channels; c ++)
+        {
+            const float * freq = & a->freq[c * fft_bins];
+            float * values = & p->values[c * bins];
+
+            for (int i = 0; i < bins; i ++)
+                values[i] = sum_band (freq, fft_bins, p->xscale[i], p->xscale[i + 1]);
+        }
+
+        p->frame.values = p->values.begin ();
+    }
+    else
+        p->frame.values = a->freq.begin ();
+
+    if (p->spec.peak_fall)
+    {
+        /* the nodes are normally 33 ms apart, but some may have been skipped
+         * (or the time may jump back, after a seek) */
+        int elapsed = aud::clamp (time - p->time, 0, 1000);
+        float fall = powf (10, -0.001f * elapsed * p->spec.peak_fall / 20);
+
+        for (int i = 0; i < p->channels * bins; i ++)
+            p->peaks[i] = aud::max (p->frame.values[i], p->peaks[i] * fall);
+    }
+
+    p->time = time;
+    p->frame.time = time;
+    p->valid = true;
+}
+
+void vis_spectrum_analyze (const float * data, const float * mono,
+ int channels, int frames, int rate, int time)
+{
+    bool need_planar = false;
+
+    for (auto & a : analyses)
+    {
+        a->channels = 0;
+        if (a->per_channel && a->size <= frames)
+            need_planar = true;
+    }
+
+    if (need_planar)
+    {
+        if (planar.len () < channels * frames)
+            planar.insert (-1, channels * frames - planar.len ());
+
+        for (int c = 0; c < channels; c ++)
+        {
+            float * set = & planar[c * frames];
+            for (int f = 0; f < frames; f ++)
+                set[f] = data[f * channels + c];
+        }
+    }
+
+    /* a node built before the frames were last changed may be too short */
+    for (auto & a : analyses)
+    {
+        if (a->size <= frames)
+            analyze (a.get (), mono, channels, frames);
+    }
+
+    for (auto & p : products)
+        compute (p.get (), rate, time);
+}
+
+void vis_spectrum_render (Visualizer * vis)
+{
+    for (const Subscriber & sub : subscribers)
+    {
+        if (sub.vis != vis)
+            continue;
+
+        if (sub.freq && sub.freq->channels)
+            vis->render_freq (sub.freq->freq.begin ());
+        if (sub.product && sub.product->valid)
+            vis->render_spectrum (sub.product->frame);
+
+        break;
+    }
+}
+
+void vis_spectrum_clear ()
+{
+    for (auto & p : products)
+    {
+        for (float & peak : p->peaks)
+            peak = 0;
+    }
+}
@@ -20,20 +20,51 @@
 #include "interface.h"
 #include "internal.h"
 
+#include <pthread.h>
 #include <string.h>
 
 #include "plugin.h"
 #include "plugins.h"
 #include "runtime.h"
 
+/* The analysis is done in the vis thread and the rendering in the main thread.
+ * The vis thread does not start another analysis until the main thread has
+ * rendered the last one (see vis-runner.cc), so the results need no locking.
+ * The mutex guards the analysis setup, which is changed in the main thread. */
+
+static pthread_mutex_t analysis_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int active_mask;  /* union of the type masks of all visualizers */
+
 static Index<Visualizer *> visualizers;
 
+/* results of vis_analyze() */
+static Index<float> mono, multi;
+static int mono_frames, multi_channels;
+
 static int running = false;
 static int num_enabled = 0;
 
+static void update_mask_locked ()
+{
+    active_mask = 0;
+    for (Visualizer * vis : visualizers)
+        active_mask |= vis->type_mask;
+}
+
 EXPORT void aud_visualizer_add (Visualizer * vis)
 {
+    pthread_mutex_lock (& analysis_mutex);
+
     visualizers.append (vis);
+    update_mask_locked ();
+
+    if ((vis->type_mask & (Visualizer::Freq | Visualizer::Spectrum)))
+    {
+        vis_spectrum_add (vis);
+        vis_runner_set_frames (vis_spectrum_frames ());
+    }
+
+    pthread_mutex_unlock (& analysis_mutex);
 
     num_enabled ++;
     if (num_enabled == 1)
@@ -53,7 +84,18 @@ EXPORT void aud_visualizer_remove (Visualizer * vis)
         return true;
     };
 
+    pthread_mutex_lock (& analysis_mutex);
+
     visualizers.remove_if (is_match, true);
+    update_mask_locked ();
+
+    if ((vis->type_mask & (Visualizer::Freq | Visualizer::Spectrum)))
+    {
+        vis_spectrum_remove (vis);
+        vis_runner_set_frames (vis_spectrum_frames ());
+    }
+
+    pthread_mutex_unlock (& analysis_mutex);
 
     num_enabled -= num_disabled;
     if (! num_enabled)
@@ -62,18 +104,22 @@ EXPORT void aud_visualizer_remove (Visualizer * vis)
 
 void vis_send_clear ()
 {
+    pthread_mutex_lock (& analysis_mutex);
+    vis_spectrum_clear ();
+    pthread_mutex_unlock (& analysis_mutex);
+
     for (Visualizer * vis : visualizers)
         vis->clear ();
 }
 
-static void pcm_to_mono (const float * data, float * mono, int channels)
+static void pcm_to_mono (const float * data, float * mono, int channels, int frames)
 {
     if (channels == 1)
-        memcpy (mono, data, sizeof (float) * 512);
+        memcpy (mono, data, sizeof (float) * frames);
     else
     {
         float * set = mono;
-        while (set < & mono[512])
+        while (set < & mono[frames])
         {
             * set ++ = (data[0] + data[1]) / 2;
             data += channels;
@@ -81,35 +127,51 @@ static void pcm_to_mono (const float * data, float * mono, int channels)
     }
 }
 
-void vis_send_audio (const float * data, int channels)
+void vis_analyze (const float * data, int channels, int frames, int rate, int time)
 {
-    auto is_active = [] (int type_mask)
+    pthread_mutex_lock (& analysis_mutex);
+
+    /* the mono mix covers only the new audio, unless it is analyzed */
+    bool need_mono = vis_spectrum_need_mono ();
+    const float * last = data + channels * (frames - 512);
+
+    mono_frames = need_mono ? frames : 512;
+    multi_channels = channels;
+
+    if (need_mono || (active_mask & Visualizer::MonoPCM))
     {
-        for (Visualizer * vis : visualizers)
-        {
-            if ((vis->type_mask & type_mask))
-                return true;
-        }
+        if (mono.len () < mono_frames)
+            mono.insert (-1, mono_frames - mono.len ());
 
-        return false;
-    };
+        pcm_to_mono (need_mono ? data : last, mono.begin (), channels, mono_frames);
+    }
+
+    /* the node is reused once we return */
+    if ((active_mask & Visualizer::MultiPCM))
+    {
+        if (multi.len () < channels * 512)
+            multi.insert (-1, channels * 512 - multi.len ());
 
-    float mono[512];
-    float freq[256];
+        memcpy (multi.begin (), last, sizeof (float) * channels * 512);
+    }
+
+    if ((active_mask & (Visualizer::Freq | Visualizer::Spectrum)))
+        vis_spectrum_analyze (data, mono.begin (), channels, frames, rate, time);
 
-    if (is_active (Visualizer::MonoPCM | Visualizer::Freq))
-        pcm_to_mono (data, mono, channels);
-    if (is_active (Visualizer::Freq))
-        calc_freq (mono, freq);
+    pthread_mutex_unlock (& analysis_mutex);
+}
 
+void vis_send_audio ()
+{
     for (Visualizer * vis : visualizers)
     {
-        if ((vis->type_mask & Visualizer::MonoPCM))
-            vis->render_mono_pcm (mono);
-        if ((vis->type_mask & Visualizer::MultiPCM))
-            vis->render_multi_pcm (data, channels);
-        if ((vis->type_mask & Visualizer::Freq))
-            vis->render_freq (freq);
+        /* added since the analysis */
+        if ((vis->type_mask & Visualizer::MonoPCM) && mono.len () >= mono_frames)
+            vis->render_mono_pcm (mono.begin () + mono_frames - 512);
+        if ((vis->type_mask & Visualizer::MultiPCM) && multi.len () >= multi_channels * 512)
+            vis->render_multi_pcm (multi.begin (), multi_channels);
+        if ((vis->type_mask & (Visualizer::Freq | Visualizer::Spectrum)))
+            vis_spectrum_render (vis);
     }
 }
 
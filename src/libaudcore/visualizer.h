@@ -22,13 +22,46 @@
 
 #include <libaudcore/export.h>
 
+/* Spectral analysis done by the core for Spectrum visualizers.  Each distinct
+ * SpectrumSpec is computed once per frame, however many visualizers ask for
+ * it, and visualizers that differ only in how the spectrum is presented (e.g.
+ * linear bins vs. log-spaced bands of the same FFT) share the FFT as well. */
+
+struct SpectrumSpec
+{
+    int size;          /* FFT size, a power of two from 512 to 8192 */
+    int bands;         /* 0 for linear bins, or the number of log-spaced bands */
+    bool per_channel;  /* one spectrum per channel instead of the mono mix */
+    int peak_fall;     /* if > 0, also hold peaks, falling by this many dB/s */
+
+    bool operator== (const SpectrumSpec & b) const
+        { return size == b.size && bands == b.bands &&
+           per_channel == b.per_channel && peak_fall == b.peak_fall; }
+};
+
+struct SpectrumFrame
+{
+    int rate;              /* sample rate of the analyzed audio */
+    int channels;          /* 1 for the mono mix, else number of channels */
+    int bins;              /* values per channel: <size>/2, or <bands> */
+    const float * edges;   /* lower edge of each bin/band, then the upper edge
+                            * of the last one, in Hz (bins + 1 values) */
+    const float * values;  /* intensity, one channel after another; a bin has
+                            * the same scale as in render_freq(), a band is
+                            * the sum of the bins (or parts of bins) in it */
+    const float * peaks;   /* held peaks, same layout; null if not requested */
+    int time;              /* output time (ms of audio written to the output)
+                            * at which the last 512 frames analyzed begin */
+};
+
 class LIBAUDCORE_PUBLIC Visualizer
 {
 public:
     enum {
         MonoPCM = (1 << 0),
         MultiPCM = (1 << 1),
-        Freq = (1 << 2)
+        Freq = (1 << 2),
+        Spectrum = (1 << 3)
     };
 
     const int type_mask;
@@ -46,6 +79,13 @@ public:
 
     /* intensity of frequencies 1/512, 2/512, ..., 256/512 of sample rate */
     virtual void render_freq (const float * freq) {}
+
+    /* for Spectrum visualizers, the analysis wanted; this is read when the
+     * visualizer is added, so to change it, remove and add the visualizer */
+    virtual SpectrumSpec spectrum_spec () { return {512, 0, false, 0}; }
+
+    /* the analysis requested by spectrum_spec() */
+    virtual void render_spectrum (const SpectrumFrame & frame) {}
 };
 
 #endif /* LIBAUDCORE_VISUALIZER_H */
@@ -50,6 +50,7 @@ struct ListModel {
     bool dragging;
     int clicked_row, receive_row;
     int scroll_speed;
+    int visible_first, visible_last;
 };
 
 /* ==== MODEL ==== */
@@ -225,6 +226,32 @@ static void focus_cb (GtkTreeView * tree, ListModel * model)
          audgui_list_get_focus ((GtkWidget *) tree));
 }
 
+static gboolean expose_cb (GtkWidget * widget, GdkEventExpose * event,
+ ListModel * model)
+{
+    GtkTreePath * start, * end;
+    int first = -1, last = -1;
+
+    if (gtk_tree_view_get_visible_range ((GtkTreeView *) widget, & start, & end))
+    {
+        first = gtk_tree_path_get_indices (start)[0];
+        last = gtk_tree_path_get_indices (end)[0];
+        gtk_tree_path_free (start);
+        gtk_tree_path_free (end);
+    }
+
+    if (first != model->visible_first || last != model->visible_last)
+    {
+        model->visible_first = first;
+        model->visible_last = last;
+
+        if (first >= 0)
+            model->cbs->visible_range (model->user, first, last);
+    }
+
+    return false;
+}
+
 static void activate_cb (GtkTreeView * tree, GtkTreePath * path,
  GtkTreeViewColumn * col, ListModel * model)
 {
@@ -577,6 +604,8 @@ EXPORT GtkWidget * audgui_list_new_real (const AudguiListCallbacks * cbs, int cb
     model->clicked_row = -1;
     model->receive_row = -1;
     model->scroll_speed = 0;
+    model->visible_first = -1;
+    model->visible_last = -1;
 
     GtkWidget * list = gtk_tree_view_new_with_model ((GtkTreeModel *) model);
     gtk_tree_view_set_fixed_height_mode ((GtkTreeView *) list, true);
@@ -602,6 +631,11 @@ EXPORT GtkWidget * audgui_list_new_real (const AudguiListCallbacks * cbs, int cb
     if (MODEL_HAS_CB (model, activate_row))
         g_signal_connect (list, "row-activated", (GCallback) activate_cb, model);
 
+    /* whatever scrolls or resizes the list, or changes the rows shown, ends up
+     * redrawing it */
+    if (MODEL_HAS_CB (model, visible_range))
+        g_signal_connect (list, "expose-event", (GCallback) expose_cb, model);
+
     g_signal_connect (list, "button-press-event", (GCallback) button_press_cb, model);
     g_signal_connect (list, "button-release-event", (GCallback) button_release_cb, model);
     g_signal_connect (list, "key-press-event", (GCallback) key_press_cb, model);
@@ -714,6 +748,7 @@ EXPORT void audgui_list_insert_rows (GtkWidget * list, int at, int rows)
     g_return_if_fail (at >= 0 && at <= model->rows && rows >= 0);
 
     model->rows += rows;
+    model->visible_first = -1;  /* report the new rows */
     if (model->highlight >= at)
         model->highlight += rows;
 
@@ -755,6 +790,7 @@ EXPORT void audgui_list_delete_rows (GtkWidget * list, int at, int rows)
     g_return_if_fail (at >= 0 && rows >= 0 && at + rows <= model->rows);
 
     model->rows -= rows;
+    model->visible_first = -1;
     if (model->highlight >= at + rows)
         model->highlight -= rows;
     else if (model->highlight >= at)
@@ -52,6 +52,10 @@ struct AudguiListCallbacks {
     void (* mouse_leave) (void * user, GdkEventMotion * event, int row); /* optional */
 
     void (* focus_change) (void * user, int row); /* optional */
+
+    /* called with the rows shown (inclusive) whenever they change, for example
+     * to pass them on to Playlist::scan_hint() (optional) */
+    void (* visible_range) (void * user, int first, int last);
 };
 
 GtkWidget * audgui_list_new_real (const AudguiListCallbacks * cbs, int cbs_size,
@@ -143,6 +143,20 @@ static const ComboItem record_elements[] = {
     ComboItem (N_("After applying equalization"), (int) OutputStream::AfterEqualizer)
 };
 
+static const ComboItem record_overflow_elements[] = {
+    ComboItem (N_("Wait for recording"), (int) RecordOverflow::Block),
+    ComboItem (N_("Discard audio"), (int) RecordOverflow::Drop),
+    ComboItem (N_("Enlarge the buffer"), (int) RecordOverflow::Grow)
+};
+
+static const ComboItem convolver_block_elements[] = {
+    ComboItem (N_("256 samples (most CPU)"), 256),
+    ComboItem (N_("512 samples"), 512),
+    ComboItem (N_("1024 samples"), 1024),
+    ComboItem (N_("2048 samples"), 2048),
+    ComboItem (N_("4096 samples (least CPU)"), 4096)
+};
+
 static const ComboItem replaygainmode_elements[] = {
     ComboItem (N_("Track"), (int) ReplayGainMode::Track),
     ComboItem (N_("Album"), (int) ReplayGainMode::Album),
@@ -215,10 +229,20 @@ static const PreferencesWidget audio_page_widgets[] = {
     WidgetSpin (N_("Buffer size:"),
         WidgetInt (0, "output_buffer_size"),
         {100, 10000, 1000, N_("ms")}),
+    WidgetCheck (N_("Write to output device from a separate thread"),
+        WidgetBool (0, "output_writer_thread")),
+    WidgetSpin (N_("Queue size:"),
+        WidgetInt (0, "output_writer_buffer"),
+        {10, 10000, 100, N_("ms")},
+        WIDGET_CHILD),
     WidgetCheck (N_("Soft clipping"),
         WidgetBool (0, "soft_clipping")),
     WidgetCheck (N_("Use software volume control (not recommended)"),
         WidgetBool (0, "software_volume_control")),
+    WidgetCheck (N_("Run each effect plugin in a separate thread"),
+        WidgetBool (0, "effect_pipeline")),
+    WidgetCheck (N_("Allocate audio buffers in advance (realtime mode)"),
+        WidgetBool (0, "output_realtime")),
     WidgetLabel (N_("<b>Recording Settings</b>")),
     WidgetCustomGTK (record_create_checkbox),
     WidgetBox ({{record_buttons}, true},
@@ -226,6 +250,12 @@ static const PreferencesWidget audio_page_widgets[] = {
     WidgetCombo (N_("Record stream:"),
         WidgetInt (0, "record_stream"),
         {{record_elements}}),
+    WidgetSpin (N_("Recording buffer:"),
+        WidgetInt (0, "record_buffer"),
+        {10, 60000, 100, N_("ms")}),
+    WidgetCombo (N_("When the buffer is full:"),
+        WidgetInt (0, "record_overflow"),
+        {{record_overflow_elements}}),
     WidgetLabel (N_("<b>ReplayGain</b>")),
     WidgetCheck (N_("Enable ReplayGain"),
         WidgetBool (0, "enable_replay_gain")),
@@ -237,6 +267,17 @@ static const PreferencesWidget audio_page_widgets[] = {
         WidgetBool (0, "enable_clipping_prevention"),
         WIDGET_CHILD),
     WidgetTable ({{gain_table}},
+        WIDGET_CHILD),
+    WidgetLabel (N_("<b>Convolution</b>")),
+    WidgetCheck (N_("Apply an impulse response (room correction or reverb)"),
+        WidgetBool (0, "convolver_active")),
+    WidgetFileEntry (N_("Impulse response (WAV):"),
+        WidgetString (0, "convolver_file"),
+        {FileSelectMode::File},
+        WIDGET_CHILD),
+    WidgetCombo (N_("Latency:"),
+        WidgetInt (0, "convolver_block"),
+        {{convolver_block_elements}},
         WIDGET_CHILD)
 };
 
@@ -344,13 +385,17 @@ static const PreferencesWidget advanced_page_widgets[] = {
         WidgetBool (0, "recurse_folders")),
     WidgetCheck (N_("Add folders nested within playlist files"),
         WidgetBool (0, "folders_in_playlist")),
+    WidgetCheck (N_("Open the next song in advance"),
+        WidgetBool (0, "prepare_next_song")),
     WidgetLabel (N_("<b>Metadata</b>")),
     WidgetCheck (N_("Guess missing metadata from file path"),
         WidgetBool (0, "metadata_fallbacks")),
     WidgetCheck (N_("Do not load metadata for songs until played"),
         WidgetBool (0, "metadata_on_play")),
     WidgetCheck (N_("Probe content of files with no recognized file name extension"),
-        WidgetBool (0, "slow_probe"))
+        WidgetBool (0, "slow_probe")),
+    WidgetCheck (N_("Remember metadata of local files between sessions"),
+        WidgetBool (0, "metadata_cache"))
 };
 
 #define TITLESTRING_NPRESETS 8
@@ -25,6 +25,7 @@
 #include <QString>
 #include <libaudcore/objects.h>
 
+class QAbstractItemView;
 class QIcon;
 class QLayout;
 class QBoxLayout;
@@ -75,6 +76,11 @@ void aboutwindow_hide ();
 void playlist_show_rename (Playlist playlist);
 void playlist_confirm_delete (Playlist playlist);
 
+/* Has the entries shown in <view> scanned first (see Playlist::scan_hint).
+ * The rows of the view must be the entries of the playlist.  Call it when the
+ * view is scrolled or resized, or its rows change. */
+void playlist_scan_visible (Playlist playlist, QAbstractItemView * view);
+
 /* equalizer.cc */
 void equalizer_show ();
 void equalizer_hide ();
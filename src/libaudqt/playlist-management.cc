@@ -19,6 +19,7 @@
 
 #include "libaudqt.h"
 
+#include <QAbstractItemView>
 #include <QCheckBox>
 #include <QDialog>
 #include <QDialogButtonBox>
@@ -117,4 +118,18 @@ EXPORT void playlist_confirm_delete (Playlist playlist)
     dialog->show ();
 }
 
+EXPORT void playlist_scan_visible (Playlist playlist, QAbstractItemView * view)
+{
+    QRect rect = view->viewport ()->rect ();
+    QModelIndex top = view->indexAt (rect.topLeft ());
+    QModelIndex bottom = view->indexAt (rect.bottomLeft ());
+
+    if (! top.isValid ())
+        return;
+
+    /* the last row may not reach the bottom of the view */
+    int last = bottom.isValid () ? bottom.row () : playlist.n_entries () - 1;
+    playlist.scan_hint (top.row (), last);
+}
+
 } // namespace audqt